@@ -39,6 +39,7 @@ int App::start(int argc, char** argv) {
     k2::RPCProtocolFactory::Dist_t tcpproto;
     k2::RPCProtocolFactory::Dist_t rrdmaproto;
     k2::RPCProtocolFactory::Dist_t autoproto;
+    k2::RPCProtocolFactory::Dist_t shmproto;
     k2::Prometheus prometheus;
     MultiAddressProvider addrProvider;
     RPCProtocolFactory::BuilderFunc_t tcpProtobuilder;
@@ -49,7 +50,27 @@ int App::start(int argc, char** argv) {
     ("prometheus_push_interval", bpo::value<k2::ParseableDuration>(), "How often to push metrics to prometheus push proxy, e.g. 10s ")
     ("tcp_port", bpo::value<uint16_t>(), "If specified, this TCP port will be opened on all shards (kernel-based incoming connection load-balancing via shared bind on same port from multiple listeners. Conflicts with --tcp_endpoints")
     ("tcp_endpoints", bpo::value<std::vector<k2::String>>()->multitoken(), "A list(space-delimited) of TCP listening endpoints to assign to each core. You can specify either full endpoints, e.g. 'tcp+k2rpc://192.168.1.2:12345' or just ports , e.g. '12345'. If simple ports are specified, the stack will bind to 0.0.0.0. Conflicts with --tcp_port")
-    ("enable_tx_checksum", bpo::value<bool>()->default_value(false), "enables transport-level checksums (and validation) on all messages. it incurs double read penalty(data is read separately to compute checksum)")
+    ("enable_tx_checksum", bpo::value<bool>()->default_value(true), "enables transport-level checksums (and validation) on all messages. checksums are computed as messages are written and received")
+    ("tcp_batch_max_bytes", bpo::value<uint64_t>(), "Outgoing TCP messages are written out in batches. A batch is flushed once it reaches this many bytes. 0 disables batching. Default 64KB")
+    ("tcp_batch_max_delay", bpo::value<k2::ParseableDuration>(), "The longest an outgoing TCP message may wait in a batch, e.g. 50us. The default of 0 flushes batches once the current task quota is over")
+    ("enable_shm_rpc", bpo::value<bool>()->default_value(false), "enables the shared memory RPC protocol, which is preferred over TCP/RDMA for peers on the same host")
+    ("shm_ring_size", bpo::value<uint64_t>(), "The size of each shared memory ring, in bytes. Rounded up to a power of 2. Default 4MB")
+    ("shm_host_id", bpo::value<k2::String>(), "Overrides the host id used by the shared memory protocol, in ipv6 form. Processes on the same host which can't share /dev/shm must use different ids. Defaults to the boot id of the host")
+    ("shm_poll_spin", bpo::value<k2::ParseableDuration>(), "How long to keep polling shared memory channels on every reactor cycle after any activity, e.g. 1ms")
+    ("shm_idle_poll_interval", bpo::value<k2::ParseableDuration>(), "How often to poll shared memory channels when they are idle, e.g. 50us")
+    ("shm_max_pending_bytes", bpo::value<uint64_t>(), "A shared memory channel fails if more than this many bytes are waiting for room in its outgoing ring. Default 64MB")
+    ("shm_close_timeout", bpo::value<k2::ParseableDuration>(), "How long shared memory channels keep flushing pending writes when the process stops, e.g. 1s")
+    ("tcp_connections_per_endpoint", bpo::value<uint32_t>(), "The number of TCP connections each core opens to a remote endpoint. With more than one, half of them are used for large messages. Default 1")
+    ("tcp_large_message_bytes", bpo::value<uint64_t>(), "Messages of at least this many bytes are sent over the connections for large messages. Default 16KB")
+    ("tcp_bulk_verbs", bpo::value<std::vector<uint32_t>>()->multitoken(), "A list(space-delimited) of verbs whose requests are sent over the connections for large messages, since they get large responses")
+    ("rpc_window", bpo::value<uint64_t>(), "The number of requests which may be in flight to a single endpoint. Further requests are queued until responses come back. 0 (the default) disables request windows")
+    ("rpc_window_max", bpo::value<uint64_t>(), "The largest an adaptive request window can grow to. Default 1024")
+    ("rpc_window_target_latency", bpo::value<k2::ParseableDuration>(), "If set, request windows adapt to the observed response latency: they grow while responses come faster than this, and are halved when responses are slower or time out, e.g. 5ms")
+    ("rpc_window_max_queue", bpo::value<uint64_t>(), "The number of requests which may be queued for a single endpoint when its request window is full. Further requests fail right away. Default 10000")
+    ("rpc_shed_max_outstanding", bpo::value<uint64_t>(), "Shed incoming requests while this many requests are being handled. 0 (the default) disables the limit")
+    ("rpc_shed_max_latency", bpo::value<k2::ParseableDuration>(), "Shed incoming requests while the average time to handle requests is above this, e.g. 10ms. 0 (the default) disables the limit")
+    ("rpc_shed_priority", bpo::value<uint32_t>(), "Only requests with this priority or lower (0 is the highest priority) are shed when overloaded. Default 128")
+    ("io_uring", bpo::value<bool>()->default_value(false), "Run the reactor on its io_uring backend, which then does all socket and file I/O of the process (e.g. RPC, CPO files and the persistence WAL). Falls back to the default backend with a warning if seastar or the kernel doesn't support io_uring. An explicit --reactor-backend takes precedence")
     ("log_level", bpo::value<std::vector<k2::String>>()->multitoken(), "A list(space-delimited) of log levels. The very first entry must be one of VERBOSE|DEBUG|INFO|WARN|ERROR|FATAL and it sets the global log level. Subsequent entries are of the form <log_module_name>=<log_level> and allow the user to override the log level for particular log modules")
     ;
 
@@ -72,8 +93,37 @@ int App::start(int argc, char** argv) {
             tval->default_value("50M");
         }
     }
+    // seastar picks its reactor backend from the command line before any of our code runs, so --io_uring is
+    // turned into a --reactor-backend argument here
+    std::vector<char*> args(argv, argv + argc);
+    String uringBackendArg("--reactor-backend=io_uring");
+    {
+        bpo::options_description desc;
+        desc.add_options()
+            ("io_uring", bpo::value<bool>()->default_value(false), "")
+            ("reactor-backend", bpo::value<std::string>(), "");
+        bpo::variables_map vm;
+        try {
+            bpo::store(bpo::command_line_parser(argc, argv).options(desc).allow_unregistered().run(), vm);
+        } catch (bpo::error&) {
+            // leave it to seastar to report bad arguments
+            vm.clear();
+        }
+        if (vm.count("io_uring") && vm["io_uring"].as<bool>() && !vm.count("reactor-backend")) {
+            // seastar lists the backends which are usable (built in and supported by the kernel) in the description
+            // of its --reactor-backend option
+            auto backendopt = _app.get_options_description().find_nothrow("reactor-backend", false);
+            if (backendopt && backendopt->description().find("io_uring") != std::string::npos) {
+                args.push_back(uringBackendArg.data());
+            }
+            else {
+                K2LOG_W(log::appbase, "io_uring is not available, running on the default reactor backend");
+            }
+        }
+    }
+
     // we are now ready to assemble the running application
-    auto result = _app.run_deprecated(argc, argv, [&] {
+    auto result = _app.run_deprecated(static_cast<int>(args.size()), args.data(), [&] {
         auto& config = _app.configuration();
         return seastar::smp::invoke_on_all([&] {
             // setup log configuration in each core
@@ -167,6 +217,10 @@ int App::start(int argc, char** argv) {
                 K2LOG_I(log::appbase, "stop autoproto");
                 return autoproto.stop();
             });
+            seastar::engine().at_exit([&] {
+                K2LOG_I(log::appbase, "stop shmproto");
+                return shmproto.stop();
+            });
             seastar::engine().at_exit([&] {
                 K2LOG_I(log::appbase, "hard stop user applets");
                 return seastar::do_for_each(_stoppers.rbegin(), _stoppers.rend(), [](auto& func) {
@@ -222,6 +276,10 @@ int App::start(int argc, char** argv) {
             K2LOG_I(log::appbase, "create auto-rrdma proto");
             return autoproto.start(k2::AutoRRDMARPCProtocol::builder(std::ref(vnet), std::ref(rrdmaproto)));
         })
+        .then([&]() {
+            K2LOG_I(log::appbase, "create shared memory proto");
+            return shmproto.start(k2::ShmRPCProtocol::builder(std::ref(vnet)));
+        })
         .then([&]() {
             K2LOG_I(log::appbase, "create dispatcher");
             return RPCDist().start();
@@ -266,6 +324,14 @@ int App::start(int argc, char** argv) {
             // Could register more protocols here via separate invoke_on_all calls
             return RPCDist().invoke_on_all(&k2::RPCDispatcher::registerProtocol, seastar::ref(autoproto));
         })
+        .then([&]() {
+            K2LOG_I(log::appbase, "start shared memory protocol");
+            return shmproto.invoke_on_all(&k2::RPCProtocolFactory::start);
+        })
+        .then([&]() {
+            K2LOG_I(log::appbase, "register shared memory protocol");
+            return RPCDist().invoke_on_all(&k2::RPCDispatcher::registerProtocol, seastar::ref(shmproto));
+        })
         .then([&]() {
             K2LOG_I(log::appbase, "start dispatcher");
             return RPCDist().invoke_on_all(&k2::RPCDispatcher::start);
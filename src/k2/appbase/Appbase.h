@@ -39,6 +39,7 @@ Copyright(c) 2020 Futurewei Cloud
 #include <k2/transport/Discovery.h>
 #include <k2/transport/RPCProtocolFactory.h>
 #include <k2/transport/RRDMARPCProtocol.h>
+#include <k2/transport/ShmRPCProtocol.h>
 #include <k2/transport/TCPRPCProtocol.h>
 #include <k2/transport/VirtualNetworkStack.h>
 
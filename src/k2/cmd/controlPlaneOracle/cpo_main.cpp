@@ -42,7 +42,8 @@ int main(int argc, char** argv) {
         ("assignment_timeout", bpo::value<k2::ParseableDuration>(), "Timeout for K2 partition assignment")
         ("cpo.tso_assignment_timeout", bpo::value<k2::ParseableDuration>(), "Timeout for per call TSO assignment")
         ("cpo.assignment_base_backoff", bpo::value<k2::ParseableDuration>(), "Base backoff time for assignments that use a retry strategy")
-        ("data_dir", bpo::value<k2::String>(), "The directory where we can keep data");
+        ("data_dir", bpo::value<k2::String>(), "The directory where we can keep data")
+        ("cpo_blocking_file_io", bpo::value<bool>(), "Use blocking POSIX calls for the files in data_dir, instead of the I/O backend of the reactor. Default false");
     app.addApplet<k2::cpo::HealthMonitor>();
     app.addApplet<k2::cpo::CPOService>();
     app.addApplet<k2::APIServer>();
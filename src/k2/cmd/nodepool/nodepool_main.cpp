@@ -39,8 +39,24 @@ int main(int argc, char** argv) {
         ("k23si_query_scan_limit", bpo::value<uint32_t>(), "Max records to scan in a single query execution")
         ("k23si_query_push_limit", bpo::value<uint32_t>(), "Min records in response needed to avoid a push during query processing")
         ("k23si_max_push_count", bpo::value<uint32_t>(), "Max push count in handleRead and handleWrite")
+        ("k23si_conflict_wait_timeout", bpo::value<k2::ParseableDuration>(), "How long to wait for a conflicting in-progress WI to be finalized instead of aborting. 0 disables waiting")
+        ("k23si_closed_timestamp_lag", bpo::value<k2::ParseableDuration>(), "How far behind the TSO time to close timestamps for writes, enabling snapshot reads. 0 closes only up to the retention timestamp")
+        ("k23si_closed_timestamp_update_interval", bpo::value<k2::ParseableDuration>(), "How often to advance the closed timestamp")
+        ("k23si_one_phase_commit", bpo::value<bool>(), "Finalize txns which only wrote to their TRH partition in place, without finalize requests")
+        ("k23si_local_push", bpo::value<bool>(), "Send pushes for TRHs hosted on this node straight to their core, bypassing the network stack")
+        ("k23si_local_push_refuse", bpo::value<bool>(), "For testing only: refuse pushes handed to a TRH core directly, so that they fall back to RPCs")
         ("k23si_read_cache_size", bpo::value<uint64_t>(), "Max size of read cache")
-        ("k23si_persistence_endpoints", bpo::value<std::vector<k2::String>>()->multitoken()->default_value(std::vector<k2::String>()), "A space-delimited list of k2 persistence endpoints, each core will pick one endpoint");
+        ("k23si_gc_interval", bpo::value<k2::ParseableDuration>(), "How often to run a GC pass over the indexer")
+        ("k23si_gc_slice_budget", bpo::value<k2::ParseableDuration>(), "Max reactor time a single GC slice can take")
+        ("k23si_gc_slice_pause", bpo::value<k2::ParseableDuration>(), "Pause between GC slices in a GC pass")
+        ("k23si_persistence_endpoints", bpo::value<std::vector<k2::String>>()->multitoken()->default_value(std::vector<k2::String>()), "A space-delimited list of k2 persistence endpoints, each core will pick one endpoint")
+        ("k23si_recovery_read_size", bpo::value<uint64_t>(), "Max number of log bytes the persistence scans for each page read on recovery")
+        ("k23si_snapshot_interval", bpo::value<k2::ParseableDuration>(), "How often to write a snapshot of each partition to persistence. Zero disables snapshots")
+        ("k23si_snapshot_slice_budget", bpo::value<k2::ParseableDuration>(), "Max reactor time a single snapshot slice can take")
+        ("k23si_snapshot_slice_pause", bpo::value<k2::ParseableDuration>(), "Pause between snapshot slices")
+        ("k23si_snapshot_chunk_size", bpo::value<uint64_t>(), "Size of the chunks in which snapshots are sent to persistence")
+        ("k23si_query_stream_chunk_size", bpo::value<uint32_t>(), "Max records to send in a single chunk of a streaming query")
+        ("k23si_query_stream_idle_timeout", bpo::value<k2::ParseableDuration>(), "Idle time after which a streaming query is closed");
 
     app.addApplet<k2::cpo::HeartbeatResponder>();
     app.addApplet<k2::APIServer>();
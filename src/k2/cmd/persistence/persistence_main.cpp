@@ -27,6 +27,12 @@ Copyright(c) 2020 Futurewei Cloud
 
 int main(int argc, char** argv) {
     k2::App app("PersistenceService");
+    app.addOptions()
+        ("persistence_wal_dir", bpo::value<k2::String>(), "The directory where we keep the write-ahead log. Each core uses a shard_<id> subdirectory")
+        ("persistence_segment_size", bpo::value<uint64_t>(), "The size in bytes at which WAL segments are rotated")
+        ("persistence_sync_policy", bpo::value<k2::String>(), "'fdatasync' to acknowledge records once they are synced to disk, or 'none' to acknowledge them once written")
+        ("persistence_max_group_bytes", bpo::value<uint64_t>(), "The max number of bytes written to the WAL in a single group commit")
+        ("persistence_recovery_read_size", bpo::value<uint64_t>(), "The default number of WAL bytes scanned for each recovery page");
     app.addApplet<k2::cpo::HeartbeatResponder>();
     // pass the ss::distributed container to the PersistenceService constructor
     app.addApplet<k2::PersistenceService>();
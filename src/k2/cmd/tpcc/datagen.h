@@ -32,7 +32,8 @@ Copyright(c) 2020 Futurewei Cloud
 #include "schema.h"
 #include "tpcc_rand.h"
 
-typedef std::vector<std::function<seastar::future<k2::WriteResult>(k2::K2TxnHandle&)>> TPCCData;
+// the rows to load, as functions which produce the SKVRecord for each row
+typedef std::vector<std::function<k2::dto::SKVRecord()>> TPCCData;
 
 struct TPCCDataGen {
     seastar::future<TPCCData> generateItemData()
@@ -46,14 +47,14 @@ struct TPCCDataGen {
             [this] (auto& data, auto& random, auto& range) {
                 return seastar::do_for_each(range, [&random, &data] (auto idx) mutable {
                     auto item = Item(random, idx);
-                    data.push_back([_item=std::move(item)] (k2::K2TxnHandle& txn) mutable {
-                        return writeRow<Item>(_item, txn);
+                    data.push_back([_item=std::move(item)] () mutable {
+                        return toSKVRecord<Item>(_item);
                     });
                 })
                 .then([&data] () mutable {
-                    data.push_back([meta=TPCCMetadata(true)] (k2::K2TxnHandle& txn) mutable {
+                    data.push_back([meta=TPCCMetadata(true)] () mutable {
                         // the last write signals that load is complete
-                        return writeRow<TPCCMetadata>(meta, txn);
+                        return toSKVRecord<TPCCMetadata>(meta);
                     });
                     return seastar::make_ready_future<TPCCData>(std::move(data));
                 });
@@ -68,17 +69,17 @@ struct TPCCDataGen {
             // populate secondary index idx_customer_name
             auto idx_customer_name = IdxCustomerName(customer.WarehouseID.value(), customer.DistrictID.value(),
                 customer.LastName.value(), customer.CustomerID.value());
-            data.push_back([_idx_customer_name=std::move(idx_customer_name)] (k2::K2TxnHandle& txn) mutable {
-                return writeRow<IdxCustomerName>(_idx_customer_name, txn);
+            data.push_back([_idx_customer_name=std::move(idx_customer_name)] () mutable {
+                return toSKVRecord<IdxCustomerName>(_idx_customer_name);
             });
 
-            data.push_back([_customer=std::move(customer)] (k2::K2TxnHandle& txn) mutable {
-                return writeRow<Customer>(_customer, txn);
+            data.push_back([_customer=std::move(customer)] () mutable {
+                return toSKVRecord<Customer>(_customer);
             });
 
             auto history = History(random, w_id, d_id, i);
-            data.push_back([_history=std::move(history)] (k2::K2TxnHandle& txn) mutable {
-                return writeRow<History>(_history, txn);
+            data.push_back([_history=std::move(history)] () mutable {
+                return toSKVRecord<History>(_history);
             });
         }
     }
@@ -99,28 +100,28 @@ struct TPCCDataGen {
 
             for (int j=1; j<=order.OrderLineCount; ++j) {
                 auto order_line = OrderLine(random, order, j);
-                data.push_back([_order_line=std::move(order_line)] (k2::K2TxnHandle& txn) mutable {
-                    return writeRow<OrderLine>(_order_line, txn);
+                data.push_back([_order_line=std::move(order_line)] () mutable {
+                    return toSKVRecord<OrderLine>(_order_line);
                 });
             }
 
             if (i >= 2101) {
                 auto new_order = NewOrder(order);
-                data.push_back([_new_order=std::move(new_order)] (k2::K2TxnHandle& txn) mutable {
-                    return writeRow<NewOrder>(_new_order, txn);
+                data.push_back([_new_order=std::move(new_order)] () mutable {
+                    return toSKVRecord<NewOrder>(_new_order);
                 });
             }
 
             auto idx_order_customer = IdxOrderCustomer(order.WarehouseID.value(), order.DistrictID.value(),
                                      order.CustomerID.value(), order.OrderID.value());
 
-            data.push_back([_order=std::move(order)] (k2::K2TxnHandle& txn) mutable {
-                return writeRow<Order>(_order, txn);
+            data.push_back([_order=std::move(order)] () mutable {
+                return toSKVRecord<Order>(_order);
             });
 
             // populate secondary index idx_order_customer
-            data.push_back([_idx_order_customer=std::move(idx_order_customer)] (k2::K2TxnHandle& txn) mutable {
-                return writeRow<IdxOrderCustomer>(_idx_order_customer, txn);
+            data.push_back([_idx_order_customer=std::move(idx_order_customer)] () mutable {
+                return toSKVRecord<IdxOrderCustomer>(_idx_order_customer);
             });
         }
     }
@@ -150,8 +151,8 @@ struct TPCCDataGen {
             [this, &data, &random] (auto idx) mutable {
                 auto warehouse = Warehouse(random, idx);
 
-                data.push_back([_warehouse=std::move(warehouse)] (k2::K2TxnHandle& txn) mutable {
-                    return writeRow<Warehouse>(_warehouse, txn);
+                data.push_back([_warehouse=std::move(warehouse)] () mutable {
+                    return toSKVRecord<Warehouse>(_warehouse);
                 });
 
                 K2LOG_I(log::tpcc, "Generating Stock for wh={}", idx);
@@ -160,8 +161,8 @@ struct TPCCDataGen {
                     [&random, &data, idx] (auto& range) {
                         return seastar::do_for_each(range, [&random, &data, idx] (auto jdx) {
                             auto stock = Stock(random, idx, jdx);
-                            data.push_back([_stock=std::move(stock)] (k2::K2TxnHandle& txn) mutable {
-                                return writeRow<Stock>(_stock, txn);
+                            data.push_back([_stock=std::move(stock)] () mutable {
+                                return toSKVRecord<Stock>(_stock);
                             });
                         });
                     })
@@ -172,8 +173,8 @@ struct TPCCDataGen {
                         [this, &random, &data, idx] (auto& range) {
                             return seastar::do_for_each(range, [this, &random, &data, idx] (auto jdx) {
                                 auto district = District(random, idx, jdx);
-                                data.push_back([_district=std::move(district)] (k2::K2TxnHandle& txn) mutable {
-                                    return writeRow<District>(_district, txn);
+                                data.push_back([_district=std::move(district)] () mutable {
+                                    return toSKVRecord<District>(_district);
                                 });
 
                                 generateCustomerData(data, random, idx, jdx);
@@ -23,6 +23,7 @@ Copyright(c) 2020 Futurewei Cloud
 
 #pragma once
 
+#include <map>
 #include <vector>
 
 #include <k2/appbase/Appbase.h>
@@ -70,28 +71,38 @@ public:
 private:
     future<> insertDataLoop(K2TxnHandle& txn)
     {
-        return do_with((size_t)0, [this, &txn] (size_t& current_size) {
-            return do_until(
-                [this, &current_size] { return _data.size() == 0 || current_size >= _writes_per_load_txn(); },
-                [this, &current_size, &txn] () {
-                auto write_func = std::move(_data.back());
-                _data.pop_back();
-                if (_data.size() %5000 == 0) {
-                    K2LOG_D(log::tpcc, "remaining data size={}", _data.size());
-                }
-                ++current_size;
-
-                return write_func(txn).discard_result();
-            }).then([&txn] () {
-                return txn.end(true);
-            }).then([] (EndResult&& result) {
-                if (!result.status.is2xxOK()) {
-                    K2LOG_E(log::tpcc, "Failed to commit: {}", result.status);
-                    return make_exception_future<>(std::runtime_error("Commit failed during bulk data load"));
-                }
-
-                return make_ready_future<>();
+        // a write batch is for a single collection, so group the rows for this txn by collection
+        std::map<String, std::vector<dto::SKVRecord>> batches;
+        for (size_t i = 0; i < _writes_per_load_txn() && _data.size() > 0; ++i) {
+            auto record = _data.back()();
+            _data.pop_back();
+            if (_data.size() %5000 == 0) {
+                K2LOG_D(log::tpcc, "remaining data size={}", _data.size());
+            }
+            batches[record.collectionName].push_back(std::move(record));
+        }
+
+        return do_with(std::move(batches), [&txn] (auto& batches) {
+            return do_for_each(batches, [&txn] (auto& batch) {
+                return txn.writeBatch(batch.second).then([] (std::vector<WriteResult>&& results) {
+                    for (auto& result : results) {
+                        if (!result.status.is2xxOK()) {
+                            K2LOG_D(log::tpcc, "writeBatch failed: {}", result.status);
+                            return make_exception_future<>(std::runtime_error("writeBatch failed!"));
+                        }
+                    }
+                    return make_ready_future<>();
+                });
             });
+        }).then([&txn] () {
+            return txn.end(true);
+        }).then([] (EndResult&& result) {
+            if (!result.status.is2xxOK()) {
+                K2LOG_E(log::tpcc, "Failed to commit: {}", result.status);
+                return make_exception_future<>(std::runtime_error("Commit failed during bulk data load"));
+            }
+
+            return make_ready_future<>();
         });
     }
 
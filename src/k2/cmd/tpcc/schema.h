@@ -67,6 +67,15 @@ seastar::future<WriteResult> writeRow(ValueType& row, K2TxnHandle& txn, bool era
     });
 }
 
+// serialize the given row into an SKVRecord, e.g. for K2TxnHandle::writeBatch()
+template<typename ValueType>
+dto::SKVRecord toSKVRecord(ValueType& row)
+{
+    dto::SKVRecord skv_record(row.collectionName, row.schema);
+    row.__writeFields(skv_record);
+    return skv_record;
+}
+
 template<typename ValueType, typename FieldType>
 seastar::future<PartialUpdateResult>
 partialUpdateRow(ValueType& row, FieldType fieldsToUpdate, K2TxnHandle& txn) {
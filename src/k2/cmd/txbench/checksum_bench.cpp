@@ -0,0 +1,160 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+// Microbenchmark for transport checksums.
+// Compares the messages/s for building+sending and for receiving 1KB, 8KB and 64KB messages with checksums
+// disabled, with the running checksum maintained by Payload/RPCParser, and with a separate full pass over the
+// payload as done before the running checksum. For reference, a 10Gb/s link carries about 1.25GB/s.
+// usage: checksum_bench [numMessages=100000]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <k2/transport/RPCParser.h>
+
+using namespace k2;
+
+namespace {
+const size_t segmentSize = 1448;
+// the size of each write into the payload, similar to serializing a record field by field
+const size_t fieldSize = 48;
+
+enum class Mode { NONE, RUNNING, FULL_PASS };
+
+const char* modeName(Mode mode) {
+    switch (mode) {
+        case Mode::NONE: return "none";
+        case Mode::RUNNING: return "running";
+        case Mode::FULL_PASS: return "full-pass";
+    }
+    return "";
+}
+
+// builds the wire bytes for one message with the given payload size and returns their total size
+size_t buildMessage(RPCParser& sender, size_t payloadSize, Mode mode, std::vector<Binary>& out) {
+    static char field[fieldSize] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJK";
+    auto payload = std::make_unique<Payload>(Payload::DefaultAllocator());
+    payload->reserve(txconstants::MAX_HEADER_SIZE);
+    for (size_t written = 0; written < payloadSize; written += fieldSize) {
+        payload->write(field, std::min(fieldSize, payloadSize - written));
+    }
+    if (mode == Mode::FULL_PASS) {
+        // a shared view doesn't have the running checksum, so this is a separate pass over the data
+        auto shared = payload->shareAll();
+        shared.seek(txconstants::MAX_HEADER_SIZE);
+        volatile uint32_t crc = shared.computeCrc32c();
+        (void)crc;
+    }
+    MessageMetadata meta;
+    meta.setRequestID(1);
+    out = sender.prepareForSend(10, std::move(payload), std::move(meta));
+    size_t total = 0;
+    for (auto& buf : out) {
+        total += buf.size();
+    }
+    return total;
+}
+
+void printRate(const char* what, size_t payloadSize, Mode mode, size_t count, size_t bytes, double secs) {
+    printf("%-7s payload=%-6zu checksum=%-9s messages=%zu rate=%.0f msgs/s (%.2f GB/s)\n", what, payloadSize,
+           modeName(mode), count, count / secs, bytes / secs / 1e9);
+}
+
+void runSend(size_t payloadSize, size_t numMessages, Mode mode) {
+    RPCParser sender([] { return false; }, mode != Mode::NONE);
+    std::vector<Binary> out;
+    size_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < numMessages; ++i) {
+        bytes += buildMessage(sender, payloadSize, mode, out);
+    }
+    auto secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printRate("send", payloadSize, mode, numMessages, bytes, secs);
+}
+
+void runReceive(size_t payloadSize, size_t numMessages, Mode mode) {
+    // the message always carries a checksum. The mode determines if and how the receiver validates it
+    RPCParser sender([] { return false; }, true);
+    std::vector<Binary> buffers;
+    auto msgSize = buildMessage(sender, payloadSize, Mode::RUNNING, buffers);
+
+    // lay out the stream in TCP-sized segments
+    Binary stream(msgSize * numMessages);
+    for (size_t i = 0; i < numMessages; ++i) {
+        size_t offset = i * msgSize;
+        for (auto& buf : buffers) {
+            std::memcpy(stream.get_write() + offset, buf.get(), buf.size());
+            offset += buf.size();
+        }
+    }
+    std::vector<Binary> inputs;
+    for (size_t offset = 0; offset < stream.size(); offset += segmentSize) {
+        inputs.push_back(stream.share(offset, std::min(segmentSize, stream.size() - offset)));
+    }
+
+    size_t received = 0;
+    size_t bytes = 0;
+    RPCParser parser([] { return false; }, mode == Mode::RUNNING);
+    parser.registerMessageObserver([&](Verb, MessageMetadata, std::unique_ptr<Payload> payload) {
+        ++received;
+        bytes += payload->getSize();
+        if (mode == Mode::FULL_PASS) {
+            volatile uint32_t crc = payload->computeCrc32c();
+            (void)crc;
+        }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    for (auto& input : inputs) {
+        parser.feed(std::move(input));
+        while (parser.canDispatch()) {
+            parser.dispatchSome();
+        }
+    }
+    auto secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printRate("receive", payloadSize, mode, received, bytes, secs);
+}
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t numMessages = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100'000;
+    if (numMessages == 0) {
+        fprintf(stderr, "usage: %s [numMessages]\n", argv[0]);
+        return 1;
+    }
+    for (size_t payloadSize : {1024, 8192, 65536}) {
+        // keep the 64KB runs to a reasonable amount of memory
+        size_t count = payloadSize > 8192 ? std::min<size_t>(numMessages, 10'000) : numMessages;
+        for (auto mode : {Mode::NONE, Mode::RUNNING, Mode::FULL_PASS}) {
+            runSend(payloadSize, count, mode);
+        }
+        for (auto mode : {Mode::NONE, Mode::RUNNING, Mode::FULL_PASS}) {
+            runReceive(payloadSize, count, mode);
+        }
+    }
+    return 0;
+}
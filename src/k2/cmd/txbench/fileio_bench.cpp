@@ -0,0 +1,198 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+// Benchmark for file I/O done with blocking POSIX calls vs through the I/O backend of the reactor (--reactor-backend
+// or --io_uring).
+// Runs on core 0 and measures:
+// - whole-file writes and reads, as done by the CPO for collections and schemas (fileutil)
+// - durable appends of fixed-size records, as done by the persistence WAL
+// For each phase we also report the largest delay seen by a timer which should fire every 100us. This shows how long
+// the reactor was blocked and unable to serve anything else.
+// usage: fileio_bench --fileio_dir /tmp/fileio [--files 1000] [--file_size 4096] [--appends 10000] [--append_size 4096]
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <k2/appbase/Appbase.h>
+#include <k2/appbase/AppEssentials.h>
+#include <k2/transport/PayloadFileUtil.h>
+#include <seastar/core/file.hh>
+#include <seastar/core/reactor.hh>
+#include <seastar/core/timer.hh>
+
+#include "Log.h"
+using namespace k2;
+
+class FileIOBench {
+public:  // application lifespan
+    seastar::future<> gracefulStop() {
+        return std::move(_benchFut);
+    }
+
+    void start() {
+        if (seastar::this_shard_id() != 0) {
+            return;
+        }
+        if (!fileutil::makeDir(_dir())) {
+            K2LOG_E(log::txbench, "unable to create directory {}", _dir());
+            AppBase().stop(1);
+            return;
+        }
+        _ticker.set_callback([this] {
+            auto now = Clock::now();
+            _maxStall = std::max(_maxStall, Duration(now - _lastTick));
+            _lastTick = now;
+        });
+        _benchFut = _phase("blocking whole-file writes", _files(), [this](size_t i) {
+                return seastar::make_ready_future<bool>(fileutil::writeFile(_filePayload(), _path(i)));
+            })
+            .then([this] {
+                return _phase("reactor whole-file writes", _files(), [this](size_t i) {
+                    return fileutil::writeFileAsync(_filePayload(), _path(i));
+                });
+            })
+            .then([this] {
+                return _phase("blocking whole-file reads", _files(), [this](size_t i) {
+                    Payload p;
+                    return seastar::make_ready_future<bool>(fileutil::readFile(p, _path(i)));
+                });
+            })
+            .then([this] {
+                return _phase("reactor whole-file reads", _files(), [this](size_t i) {
+                    return fileutil::readFileAsync(_path(i)).then([](auto&& p) { return bool(p); });
+                });
+            })
+            .then([this] {
+                return _blockingAppends();
+            })
+            .then([this] {
+                return _reactorAppends();
+            })
+            .handle_exception([](auto exc) {
+                K2LOG_W_EXC(log::txbench, exc, "benchmark failed");
+            })
+            .finally([] {
+                AppBase().stop(0);
+            });
+    }
+
+private:
+    String _path(size_t i) {
+        return String(fmt::format("{}/file_{}", _dir(), i));
+    }
+
+    Payload _filePayload() {
+        Payload p(Payload::DefaultAllocator(_fileSize()));
+        String data(_fileSize(), 'x');
+        p.write(data.data(), data.size());
+        return p;
+    }
+
+    // runs the given op for 0..count-1 in sequence and reports the rate and the longest reactor stall
+    template <typename Func>
+    seastar::future<> _phase(const char* name, size_t count, Func&& op) {
+        _maxStall = 0us;
+        _lastTick = Clock::now();
+        _ticker.arm_periodic(100us);
+        auto start = Clock::now();
+        return seastar::do_with(size_t(0), size_t(0), std::forward<Func>(op), [this, count](auto& i, auto& failed, auto& op) {
+                return seastar::do_until([&i, count] { return i >= count; }, [&i, &failed, &op] {
+                    return op(i++).then([&failed](bool success) {
+                        failed += !success;
+                    });
+                })
+                .then([&failed] {
+                    return failed;
+                });
+            })
+            .then([this, name, count, start](size_t failed) {
+                _ticker.cancel();
+                auto elapsed = Clock::now() - start;
+                K2LOG_I(log::txbench, "{}: {} ops in {}, {:.1f} ops/s, max reactor stall {}, failed {}", name, count,
+                        elapsed, count / (k2::nsec(elapsed).count() / 1e9), _maxStall, failed);
+            });
+    }
+
+    // appends records with write() + fdatasync(), blocking the reactor for each
+    seastar::future<> _blockingAppends() {
+        auto path = _dir() + "/blocking.log";
+        int fd = ::open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+        if (fd < 0) {
+            return seastar::make_exception_future<>(std::runtime_error(fmt::format("unable to open {}", path)));
+        }
+        auto record = std::make_shared<String>(_appendSize(), 'x');
+        return _phase("blocking durable appends", _appends(), [fd, record](size_t) {
+                bool ok = ::write(fd, record->data(), record->size()) == ssize_t(record->size()) && ::fdatasync(fd) == 0;
+                return seastar::make_ready_future<bool>(ok);
+            })
+            .finally([fd] {
+                ::close(fd);
+            });
+    }
+
+    // appends aligned records with DMA writes + flush, through the reactor
+    seastar::future<> _reactorAppends() {
+        auto path = _dir() + "/reactor.log";
+        return seastar::open_file_dma(path, seastar::open_flags::wo | seastar::open_flags::create | seastar::open_flags::truncate)
+            .then([this](seastar::file file) {
+                auto alignment = file.disk_write_dma_alignment();
+                auto size = (_appendSize() + alignment - 1) / alignment * alignment;
+                auto record = Binary::aligned(file.memory_dma_alignment(), size);
+                std::memset(record.get_write(), 'x', size);
+                return seastar::do_with(std::move(file), std::move(record), [this](auto& file, auto& record) {
+                    return _phase("reactor durable appends", _appends(), [&file, &record](size_t i) {
+                            return file.dma_write(i * record.size(), record.get(), record.size())
+                                .then([&file, &record](size_t written) {
+                                    return file.flush().then([ok = written == record.size()] { return ok; });
+                                });
+                        })
+                        .finally([&file] {
+                            return file.close();
+                        });
+                });
+            });
+    }
+
+    ConfigVar<String> _dir{"fileio_dir"};
+    ConfigVar<size_t> _files{"files"};
+    ConfigVar<size_t> _fileSize{"file_size"};
+    ConfigVar<size_t> _appends{"appends"};
+    ConfigVar<size_t> _appendSize{"append_size"};
+    seastar::timer<> _ticker;
+    TimePoint _lastTick;
+    Duration _maxStall{0};
+    seastar::future<> _benchFut = seastar::make_ready_future();
+};
+
+int main(int argc, char** argv) {
+    k2::App app("FileIOBench");
+    app.addApplet<FileIOBench>();
+    app.addOptions()
+        ("fileio_dir", bpo::value<k2::String>()->default_value("/tmp/k2_fileio_bench"), "The directory for the benchmark files. Must be on a file system which supports O_DIRECT for the reactor numbers to be meaningful")
+        ("files", bpo::value<size_t>()->default_value(1000), "How many files to write and read whole")
+        ("file_size", bpo::value<size_t>()->default_value(4096), "The size of each file")
+        ("appends", bpo::value<size_t>()->default_value(10000), "How many durable appends to do")
+        ("append_size", bpo::value<size_t>()->default_value(4096), "The size of each appended record");
+    return app.start(argc, argv);
+}
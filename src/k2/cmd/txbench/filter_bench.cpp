@@ -0,0 +1,129 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+// Microbenchmark for query filter evaluation, as done by the K23SI module for each record in a filtered scan.
+// Compares interpreting the filter expression with evaluating the filter compiled for the record schema.
+// usage: filter_bench [numRecords=1000000] [passes=10]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <k2/common/VecUtil.h>
+#include <k2/dto/Expression.h>
+#include <k2/dto/SKVRecord.h>
+
+using namespace k2;
+namespace k2e = k2::dto::expression;
+
+namespace {
+std::shared_ptr<dto::Schema> makeSchema() {
+    auto schema = std::make_shared<dto::Schema>();
+    schema->name = "bench_schema";
+    schema->version = 1;
+    schema->fields = std::vector<dto::SchemaField>{
+        {dto::FieldType::STRING, "id", false, false},
+        {dto::FieldType::STRING, "name", false, false},
+        {dto::FieldType::INT32T, "quantity", false, false},
+        {dto::FieldType::INT64T, "timestamp", false, false},
+        {dto::FieldType::DOUBLE, "price", false, false},
+        {dto::FieldType::BOOL, "active", false, false},
+        {dto::FieldType::STRING, "comment", false, false},
+    };
+    schema->setPartitionKeyFieldsByName(std::vector<String>{"id"});
+    return schema;
+}
+
+std::vector<dto::SKVRecord::Storage> makeRecords(std::shared_ptr<dto::Schema> schema, size_t numRecords) {
+    std::vector<dto::SKVRecord::Storage> records;
+    records.reserve(numRecords);
+    for (size_t i = 0; i < numRecords; ++i) {
+        dto::SKVRecord rec("collection", schema);
+        rec.serializeNext<String>(String("id_") + std::to_string(i));
+        rec.serializeNext<String>(i % 3 == 0 ? String("alpha_") + std::to_string(i) : String("beta_") + std::to_string(i));
+        rec.serializeNext<int32_t>(i % 100);
+        rec.serializeNext<int64_t>(i * 1000);
+        rec.serializeNext<double>(i * 0.25);
+        rec.serializeNext<bool>(i % 2 == 0);
+        rec.serializeNext<String>("a comment which is long enough to not fit in a small string");
+        records.push_back(std::move(rec.getStorage()));
+    }
+    return records;
+}
+
+// quantity > 50 AND name STARTS_WITH "alpha" AND active
+k2e::Expression makeFilter() {
+    std::vector<k2e::Expression> children;
+    children.push_back(k2e::makeExpression(k2e::Operation::GT,
+        k2::make_vec<k2e::Value>(k2e::makeValueReference("quantity"), k2e::makeValueLiteral<int32_t>(50)), {}));
+    children.push_back(k2e::makeExpression(k2e::Operation::STARTS_WITH,
+        k2::make_vec<k2e::Value>(k2e::makeValueReference("name"), k2e::makeValueLiteral<String>("alpha")), {}));
+    return k2e::makeExpression(k2e::Operation::AND,
+        k2::make_vec<k2e::Value>(k2e::makeValueReference("active")), std::move(children));
+}
+
+double recordsPerSec(size_t records, std::chrono::steady_clock::duration dur) {
+    return records / std::chrono::duration<double>(dur).count();
+}
+
+template <typename EvalFunc>
+void runBench(const char* name, std::shared_ptr<dto::Schema> schema, std::vector<dto::SKVRecord::Storage>& records,
+              size_t passes, EvalFunc&& eval) {
+    size_t passed = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t p = 0; p < passes; ++p) {
+        for (auto& storage : records) {
+            // the record is built per evaluation, same as in the query scan
+            dto::SKVRecord rec("collection", schema, storage.share(), true);
+            passed += eval(rec);
+        }
+    }
+    auto dur = std::chrono::steady_clock::now() - start;
+    printf("%-12s records=%zu passed=%zu rate=%.0f records/s\n", name, records.size() * passes, passed,
+           recordsPerSec(records.size() * passes, dur));
+}
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t numRecords = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1'000'000;
+    size_t passes = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 10;
+    if (numRecords == 0 || passes == 0) {
+        fprintf(stderr, "usage: %s [numRecords] [passes]\n", argv[0]);
+        return 1;
+    }
+    auto schema = makeSchema();
+    auto records = makeRecords(schema, numRecords);
+    auto filter = makeFilter();
+
+    runBench("interpreted", schema, records, passes, [&filter] (dto::SKVRecord& rec) {
+        return filter.evaluate(rec);
+    });
+
+    k2e::CompiledExpression compiled(filter, schema);
+    runBench("compiled", schema, records, passes, [&compiled] (dto::SKVRecord& rec) {
+        return compiled.evaluate(rec) == k2e::EvalResult::PASS;
+    });
+    return 0;
+}
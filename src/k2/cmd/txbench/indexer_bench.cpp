@@ -0,0 +1,116 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+// Microbenchmark for the key indexer implementations used by the K23SI module.
+// Compares point lookups, inserts and 1000-key scans between std::map and the B+tree index.
+// usage: indexer_bench [numKeys=10000000] [numScans=100000]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <vector>
+
+#include <k2/module/k23si/Indexer.h>
+
+using namespace k2;
+
+namespace {
+typedef std::map<IndexerKey, VersionSet> MapIndexT;
+typedef indexer::BTreeIndex<IndexerKey, VersionSet, IndexerKeyTraits> BTreeIndexT;
+
+const size_t scanLength = 1000;
+
+// keys similar to what the ycsb/tpcc loaders produce: a shared table-like prefix followed by a record id
+std::vector<IndexerKey> makeKeys(size_t numKeys) {
+    std::vector<IndexerKey> keys;
+    keys.reserve(numKeys);
+    char buf[64];
+    for (size_t i = 0; i < numKeys; ++i) {
+        auto len = snprintf(buf, sizeof(buf), "usertable\x01user%016zu", i * 2654435761ul % (numKeys * 4));
+        keys.push_back(IndexerKey{.partitionKey=String(buf, len), .rangeKey=""});
+    }
+    return keys;
+}
+
+double opsPerSec(size_t ops, std::chrono::steady_clock::duration dur) {
+    return ops / std::chrono::duration<double>(dur).count();
+}
+
+template <typename IndexT>
+void runBench(const char* name, const std::vector<IndexerKey>& keys, size_t numScans) {
+    std::mt19937_64 rng(42);
+    IndexT index;
+
+    auto start = std::chrono::steady_clock::now();
+    for (auto& key : keys) {
+        index.try_emplace(key);
+    }
+    auto insertDur = std::chrono::steady_clock::now() - start;
+
+    std::vector<size_t> lookups(keys.size());
+    for (auto& l : lookups) {
+        l = rng() % keys.size();
+    }
+    size_t found = 0;
+    start = std::chrono::steady_clock::now();
+    for (auto l : lookups) {
+        found += index.find(keys[l]) != index.end();
+    }
+    auto lookupDur = std::chrono::steady_clock::now() - start;
+
+    size_t scanned = 0;
+    uint64_t checksum = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < numScans; ++i) {
+        auto it = index.lower_bound(keys[lookups[i % lookups.size()]]);
+        for (size_t j = 0; j < scanLength && it != index.end(); ++j, ++it) {
+            checksum += it->second.lastReadTime.endCount;
+            ++scanned;
+        }
+    }
+    auto scanDur = std::chrono::steady_clock::now() - start;
+
+    printf("%-6s keys=%zu insert=%.0f ops/s lookup=%.0f ops/s (found %zu) scan%zu=%.0f scans/s (%.0f keys/s, checksum %lu)\n",
+           name, index.size(), opsPerSec(keys.size(), insertDur), opsPerSec(lookups.size(), lookupDur), found,
+           scanLength, opsPerSec(numScans, scanDur), opsPerSec(scanned, scanDur), checksum);
+}
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t numKeys = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10'000'000;
+    size_t numScans = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 100'000;
+    if (numKeys == 0) {
+        fprintf(stderr, "usage: %s [numKeys] [numScans]\n", argv[0]);
+        return 1;
+    }
+    auto keys = makeKeys(numKeys);
+    // insert in random order
+    std::shuffle(keys.begin(), keys.end(), std::mt19937_64(7));
+
+    runBench<MapIndexT>("map", keys, numScans);
+    runBench<BTreeIndexT>("btree", keys, numScans);
+    return 0;
+}
@@ -153,6 +153,10 @@ public:  // application lifespan
         })
         .finally([this] {
             K2LOG_I(log::txbench, "Done with benchmark");
+            K2LOG_I(log::txbench,
+                "committed={}, aborted={}, txn end latency p50={}us, p99={}us, txn latency p50={}us, p99={}us",
+                _committedTxns, _abortedTxns, _endLatency.percentile(50), _endLatency.percentile(99),
+                _txnLatency.percentile(50), _txnLatency.percentile(99));
         });
 
         return seastar::make_ready_future();
@@ -0,0 +1,119 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+// Microbenchmark for the RPC receive path.
+// Measures how many messages/s RPCParser can parse and dispatch for 64B, 1KB and 64KB payloads, when the
+// stream arrives with one message per binary (unfragmented) and when it is cut into 1448-byte TCP segments.
+// usage: rpcparser_bench [numMessages=100000]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <k2/transport/RPCParser.h>
+
+using namespace k2;
+
+namespace {
+const size_t segmentSize = 1448;
+
+// returns the wire bytes for one message with the given payload size
+Binary makeMessage(RPCParser& sender, size_t payloadSize) {
+    auto payload = std::make_unique<Payload>(Payload::DefaultAllocator(payloadSize + txconstants::MAX_HEADER_SIZE));
+    payload->reserve(txconstants::MAX_HEADER_SIZE);
+    String data(payloadSize, '.');
+    payload->write(data.data(), data.size());
+    MessageMetadata meta;
+    meta.setRequestID(1);
+    auto buffers = sender.prepareForSend(10, std::move(payload), std::move(meta));
+    size_t total = 0;
+    for (auto& buf : buffers) {
+        total += buf.size();
+    }
+    Binary msg(total);
+    size_t offset = 0;
+    for (auto& buf : buffers) {
+        std::memcpy(msg.get_write() + offset, buf.get(), buf.size());
+        offset += buf.size();
+    }
+    return msg;
+}
+
+void runBench(size_t payloadSize, size_t numMessages, bool fragmented) {
+    RPCParser sender([] { return false; }, false);
+    auto msg = makeMessage(sender, payloadSize);
+
+    // lay out the stream in the binaries we're going to feed
+    std::vector<Binary> inputs;
+    if (fragmented) {
+        Binary stream(msg.size() * numMessages);
+        for (size_t i = 0; i < numMessages; ++i) {
+            std::memcpy(stream.get_write() + i * msg.size(), msg.get(), msg.size());
+        }
+        for (size_t offset = 0; offset < stream.size(); offset += segmentSize) {
+            inputs.push_back(stream.share(offset, std::min(segmentSize, stream.size() - offset)));
+        }
+    } else {
+        for (size_t i = 0; i < numMessages; ++i) {
+            inputs.push_back(msg.share());
+        }
+    }
+
+    size_t received = 0;
+    size_t bytes = 0;
+    RPCParser parser([] { return false; }, false);
+    parser.registerMessageObserver([&](Verb, MessageMetadata, std::unique_ptr<Payload> payload) {
+        ++received;
+        bytes += payload->getSize();
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    for (auto& input : inputs) {
+        parser.feed(std::move(input));
+        while (parser.canDispatch()) {
+            parser.dispatchSome();
+        }
+    }
+    auto secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("payload=%-6zu %-12s messages=%zu rate=%.0f msgs/s (%.2f GB/s)\n", payloadSize,
+           fragmented ? "fragmented" : "unfragmented", received, received / secs, bytes / secs / 1e9);
+}
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t numMessages = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100'000;
+    if (numMessages == 0) {
+        fprintf(stderr, "usage: %s [numMessages]\n", argv[0]);
+        return 1;
+    }
+    for (size_t payloadSize : {64, 1024, 65536}) {
+        // keep the 64KB runs to a reasonable amount of memory
+        size_t count = payloadSize > 1024 ? std::min<size_t>(numMessages, 10'000) : numMessages;
+        runBench(payloadSize, count, false);
+        runBench(payloadSize, count, true);
+    }
+    return 0;
+}
@@ -239,17 +239,31 @@ private:
     const static inline String _metadata_key{"ycsb_system_metadata"};
 };
 
-// function to write the given YCSB Data row
-seastar::future<WriteResult> writeRow(YCSBData& row, K2TxnHandle& txn, bool erase = false, dto::ExistencePrecondition precondition = dto::ExistencePrecondition::None)
+// function to serialize the given YCSB Data row into an SKV record
+dto::SKVRecord toSKVRecord(YCSBData& row)
 {
     dto::SKVRecord skv_record(YCSBData::collectionName, YCSBData::schema); // create SKV record
 
     for(auto&& field : row.fields){
         skv_record.serializeNext<String>(field); // add fields to SKV record
     }
+    return skv_record;
+}
+
+// returns true if the given status of a row write means that the load or benchmark can continue
+bool isWriteRowOK(const Status& status)
+{
+    // k2::Statuses::S412_Precondition_Failed for write with erase=false and key already exists and k2::Statuses::S404_Not_Found for write with erase=true and key does not exist
+    return status.is2xxOK() || status.code==412 || status.code==404;
+}
+
+// function to write the given YCSB Data row
+seastar::future<WriteResult> writeRow(YCSBData& row, K2TxnHandle& txn, bool erase = false, dto::ExistencePrecondition precondition = dto::ExistencePrecondition::None)
+{
+    dto::SKVRecord skv_record = toSKVRecord(row);
 
     return txn.write<dto::SKVRecord>(skv_record, erase, precondition).then([] (WriteResult&& result) {
-        if (!result.status.is2xxOK() && result.status.code!=412 && result.status.code!=404) { // k2::Statuses::S412_Precondition_Failed for write with erase=false and key already exists and k2::Statuses::S404_Not_Found for write with erase=true and key does not exist
+        if (!isWriteRowOK(result.status)) {
             K2LOG_D(log::ycsb, "writeRow failed and is retryable: {}", result.status);
             return seastar::make_exception_future<WriteResult>(std::runtime_error("writeRow failed!"));
         }
@@ -93,8 +93,10 @@ public:
                         _random(random), _client(client), _failed(false), _requestDist(requestDist), _scanLengthDist(scanLengthDist) {}
 
      seastar::future<bool> attempt() {
+        _attempts++;
         K2TxnOptions options{};
         options.deadline = Deadline(5s);
+        options.snapshotRead = _snapshot_read();
         return _client.beginTxn(options)
         .then([this] (K2TxnHandle&& txn) {
             _txn = std::move(txn);
@@ -115,6 +117,11 @@ public:
         return _insertMissesLatest;
     }
 
+    // function to get the number of times the transaction was attempted, including retries
+    uint64_t getAttempts(){
+        return _attempts;
+    }
+
 private:
 
     seastar::future<bool> runWithTxn(){
@@ -317,9 +324,11 @@ private:
     std::shared_ptr<RandomGenerator> _requestDist; // Request distribution for selecting keys
     std::shared_ptr<RandomGenerator> _scanLengthDist; // Request distribution for selecting length of scan
     uint64_t _insertMissesLatest{0}; // number of inserts missed when request distribution is Latest distribution
+    uint64_t _attempts{0}; // number of times the transaction was attempted
 
 private:
     ConfigVar<uint64_t> _ops_per_txn{"ops_per_txn"};
+    ConfigVar<bool> _snapshot_read{"snapshot_read"};
     ConfigVar<uint32_t> _field_length{"field_length"};
     ConfigVar<uint32_t> _num_fields{"num_fields"};
     ConfigVar<uint32_t> _max_fields_update{"max_fields_update"};
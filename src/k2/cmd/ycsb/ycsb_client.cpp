@@ -112,6 +112,8 @@ public:  // application lifespan
 
         _metric_groups.add_group("YCSB", {
             sm::make_counter("completed_txns", _completedTxns, sm::description("Number of completed YCSB transactions"), labels),
+            sm::make_counter("txn_attempts", _txnAttempts, sm::description("Number of YCSB transaction attempts, including retries"), labels),
+            sm::make_counter("failed_txns", _failedTxns, sm::description("Number of YCSB transactions which failed after all retries"), labels),
             sm::make_counter("read_ops", _readOps, sm::description("Number of completed Read operations"), labels),
             sm::make_counter("scan_ops", _scanOps, sm::description("Number of completed Scan operations"), labels),
             sm::make_counter("insert_ops", _insertOps, sm::description("Number of completed Insert operations"), labels),
@@ -247,7 +249,9 @@ private:
                     auto txn_start = k2::Clock::now();
                     return curTxn->run() // run the transaction
                     .then([this, txn_start, &curTxn] (bool success) {
+                        _txnAttempts += curTxn->getAttempts();
                         if (!success) {
+                            _failedTxns++;
                             return;
                         }
 
@@ -307,6 +311,8 @@ private:
         }
 
         K2LOG_I(log::ycsb, "Starting transactions...");
+        K2ASSERT(log::ycsb, !_snapshotRead() || (_updateProp() == 0 && _insertProp() == 0 && _deleteProp() == 0),
+                 "Snapshot read transactions require a read-only workload");
 
         _timer.arm(_testDuration());
         _start = k2::Clock::now();
@@ -330,7 +336,9 @@ private:
             auto writepsec = (double)_client.write_ops/totalsecs;
             auto querypsec = (double)_client.query_ops/totalsecs;
             K2LOG_I(log::ycsb, "duration={}", duration);
+            auto abortRate = _txnAttempts == 0 ? 0.0 : (double)(_txnAttempts - _completedTxns)/_txnAttempts;
             K2LOG_I(log::ycsb, "completedTxns={} ({} per sec)", _completedTxns, cntpsec);
+            K2LOG_I(log::ycsb, "txnAttempts={}, failedTxns={}, abort rate={}", _txnAttempts, _failedTxns, abortRate);
             K2LOG_I(log::ycsb, "completed YCSB Read operations={}", _readOps);
             K2LOG_I(log::ycsb, "completed YCSB Update operations={}", _updateOps);
             K2LOG_I(log::ycsb, "completed YCSB Scan operations={}", _scanOps);
@@ -431,6 +439,7 @@ private:
     ConfigVar<double> _insertProp{"insert_proportion"};
     ConfigVar<double> _deleteProp{"delete_proportion"};
     ConfigVar<uint32_t> _maxScanLen{"max_scan_length"};
+    ConfigVar<bool> _snapshotRead{"snapshot_read"};
 
     sm::metric_groups _metric_groups;
     k2::ExponentialHistogram _txnLatency;
@@ -440,6 +449,8 @@ private:
     k2::ExponentialHistogram _insertLatency;
     k2::ExponentialHistogram _deleteLatency;
     uint64_t _completedTxns{0};
+    uint64_t _txnAttempts{0};
+    uint64_t _failedTxns{0};
     uint64_t _readOps{0};
     uint64_t _insertOps{0};
     uint64_t _updateOps{0};
@@ -478,7 +489,9 @@ int main(int argc, char** argv) {;
         ("delete_proportion",bpo::value<double>()->default_value(0), "Delete Proportion")
         ("max_scan_length",bpo::value<uint32_t>()->default_value(10), "Maximum scan length")
         ("max_fields_update",bpo::value<uint32_t>()->default_value(1), "Maximum number of fields to update")
-        ("ops_per_txn",bpo::value<uint64_t>()->default_value(1), "The number of operations per transaction");
+        ("ops_per_txn",bpo::value<uint64_t>()->default_value(1), "The number of operations per transaction")
+        ("snapshot_read",bpo::value<bool>()->default_value(false), "Run the transactions as snapshot reads. Requires a read-only workload")
+        ("snapshot_read_lag", bpo::value<ParseableDuration>(), "How far in the past snapshot read transactions read");
 
     app.addApplet<k2::tso::TSOClient>();
     app.addApplet<Client>();
@@ -34,6 +34,7 @@ CPOClient::CPOClient() {
 void CPOClient::init(String cpoURL) {
     cpo = RPC().getTXEndpoint(cpoURL);
     K2ASSERT(log::cpoclient, cpo, "unable to get endpoint for url {}", cpoURL);
+    RPC().connect(*cpo);
 }
 
 CPOClient::~CPOClient() {
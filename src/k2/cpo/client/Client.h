@@ -43,6 +43,12 @@ Copyright(c) 2020 Futurewei Cloud
 #include <k2/dto/LogStream.h>
 
 namespace k2::cpo {
+// detects requests which carry a transaction MTR, so that we can send their priority along with the RPC
+template <typename T, typename = void>
+struct HasMTRTrait : std::false_type {};
+template <typename T>
+struct HasMTRTrait<T, std::void_t<decltype(std::declval<T>().mtr.priority)>> : std::true_type {};
+
 namespace log {
 inline thread_local logging::Logger cpoclient("k2::cpo_client");
 }
@@ -338,9 +344,15 @@ private:
         request.pvid = partition.partition->keyRangeV.pvid;
         K2LOG_D(log::cpoclient, "making partition call to url={}, with timeout={}", partition.preferredEndpoint->url, timeout);
 
+        // Transaction requests carry their priority so that overloaded servers shed low priority work first
+        std::optional<uint8_t> priority;
+        if constexpr (HasMTRTrait<RequestT>::value) {
+            priority = uint8_t(request.mtr.priority);
+        }
+
         // Attempt the request RPC
         return RPC()
-        .callRPC<RequestT, ResponseT>(verb, request, *partition.preferredEndpoint, timeout)
+        .callRPC<RequestT, ResponseT>(verb, request, *partition.preferredEndpoint, timeout, priority)
         .then([this, &request, deadline] (auto&& result) {
             auto& [status, k2response] = result;
             K2LOG_D(log::cpoclient, "partition call completed with status={}", status);
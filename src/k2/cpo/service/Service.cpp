@@ -348,8 +348,18 @@ seastar::future<std::tuple<Status, dto::CollectionCreateResponse>>
 CPOService::handleCreate(dto::CollectionCreateRequest&& request) {
     return _getNodes().then([this, request=std::move(request)] () mutable {
         K2LOG_I(log::cposvr, "Received collection create request for name={}", request.metadata.name);
-        auto cpath = _getCollectionPath(request.metadata.name);
-        if (fileutil::fileExists(cpath)) {
+        return seastar::with_semaphore(_storeLock, 1, [this, request=std::move(request)] () mutable {
+            return _doCreate(std::move(request));
+        });
+    });
+}
+
+seastar::future<std::tuple<Status, dto::CollectionCreateResponse>>
+CPOService::_doCreate(dto::CollectionCreateRequest&& request) {
+    auto cpath = _getCollectionPath(request.metadata.name);
+    auto exists = _blockingFileIO() ? seastar::make_ready_future<bool>(fileutil::fileExists(cpath)) : seastar::file_exists(cpath);
+    return exists.then([this, request=std::move(request), cpath] (bool exists) mutable {
+        if (exists) {
             return RPCResponse(Statuses::S403_Forbidden("collection already exists"), dto::CollectionCreateResponse());
         }
         request.metadata.heartbeatDeadline = _collectionHeartbeatDeadline();
@@ -374,76 +384,93 @@ CPOService::handleCreate(dto::CollectionCreateRequest&& request) {
 
         schemas[collection.metadata.name] = std::vector<dto::Schema>();
 
-        auto status = _saveCollection(collection);
-        if (!status.is2xxOK()) {
-            return RPCResponse(std::move(status), dto::CollectionCreateResponse());
-        }
+        auto saved = _saveCollection(collection);
+        return saved.then([this, collection=std::move(collection), cpath] (Status&& status) mutable {
+            if (!status.is2xxOK()) {
+                return RPCResponse(std::move(status), dto::CollectionCreateResponse());
+            }
 
-        K2LOG_I(log::cposvr, "Created collection {}", cpath);
-        _assignCollection(collection);
-        return RPCResponse(std::move(status), dto::CollectionCreateResponse());
+            K2LOG_I(log::cposvr, "Created collection {}", cpath);
+            _assignCollection(collection);
+            return RPCResponse(std::move(status), dto::CollectionCreateResponse());
+        });
     });
 }
 
 seastar::future<std::tuple<Status, dto::CollectionGetResponse>>
 CPOService::handleGet(dto::CollectionGetRequest&& request) {
     K2LOG_I(log::cposvr, "Received collection get request for {}", request.name);
-    auto [status, collection] = _getCollection(request.name);
-
-    dto::CollectionGetResponse response{};
+    return seastar::with_semaphore(_storeLock, 1, [this, name=std::move(request.name)] {
+        return _getCollection(name);
+    })
+    .then([] (auto&& result) {
+        auto& [status, collection] = result;
+        dto::CollectionGetResponse response{};
 
-    if (collection.metadata.deleted) {
-        return RPCResponse(Statuses::S404_Not_Found("Collection is being deleted"), std::move(response));
-    }
+        if (collection.metadata.deleted) {
+            return RPCResponse(Statuses::S404_Not_Found("Collection is being deleted"), std::move(response));
+        }
 
-    if (status.is2xxOK()) {
-        response.collection = std::move(collection);
-    }
-    return RPCResponse(std::move(status), std::move(response));
+        if (status.is2xxOK()) {
+            response.collection = std::move(collection);
+        }
+        return RPCResponse(std::move(status), std::move(response));
+    });
 }
 
 seastar::future<std::tuple<Status, dto::CollectionDropResponse>>
 CPOService::handleCollectionDrop(dto::CollectionDropRequest&& request) {
     K2LOG_I(log::cposvr, "Received collection drop request for {}", request.name);
-    auto [status, collection] = _getCollection(request.name);
-
-    if (!status.is2xxOK()) {
-        return RPCResponse(std::move(status), dto::CollectionDropResponse());
-    }
-
-    // Setting the deleted flag will make the CPO not return the collection for getCOllection
-    // requests, but it will let the user retry the drop collection if not all of the
-    // offload requests succeeded
-    collection.metadata.deleted = true;
-    status = _saveCollection(collection);
-    if (!status.is2xxOK()) {
-        return RPCResponse(std::move(status), dto::CollectionDropResponse());
-    }
-    K2LOG_D(log::cposvr, "Collection deleted flag persisted for {}, starting partition offload", request.name);
+    return seastar::with_semaphore(_storeLock, 1, [this, name=request.name] {
+        return _getCollection(name)
+        .then([this] (auto&& result) {
+            auto& [status, collection] = result;
+            if (!status.is2xxOK()) {
+                return seastar::make_ready_future<std::tuple<Status, dto::Collection>>(std::move(result));
+            }
 
-    return _offloadCollection(collection).then([this, name=request.name] (bool allOffloaded) {
-        if (!allOffloaded) {
-            return RPCResponse(Statuses::S503_Service_Unavailable("Not all partitions offloaded"), dto::CollectionDropResponse());
+            // Setting the deleted flag will make the CPO not return the collection for getCOllection
+            // requests, but it will let the user retry the drop collection if not all of the
+            // offload requests succeeded
+            collection.metadata.deleted = true;
+            auto saved = _saveCollection(collection);
+            return saved.then([collection=std::move(collection)] (Status&& status) mutable {
+                return std::make_tuple(std::move(status), std::move(collection));
+            });
+        });
+    })
+    .then([this, name=request.name] (auto&& result) {
+        auto& [status, collection] = result;
+        if (!status.is2xxOK()) {
+            return RPCResponse(std::move(status), dto::CollectionDropResponse());
         }
+        K2LOG_D(log::cposvr, "Collection deleted flag persisted for {}, starting partition offload", name);
+        return seastar::do_with(std::move(collection), [this, name] (auto& collection) {
+            return _offloadCollection(collection).then([this, name] (bool allOffloaded) {
+                if (!allOffloaded) {
+                    return RPCResponse(Statuses::S503_Service_Unavailable("Not all partitions offloaded"), dto::CollectionDropResponse());
+                }
 
-        // TODO implement clean up of persistence data
-        schemas.erase(name);
-        String collPath = _getCollectionPath(name);
-        remove(collPath.c_str());
-        String schemaPath = _getSchemasPath(name);
-        remove(schemaPath.c_str());
-
-        auto it = _nodesToCollection.begin();
-        for (; it != _nodesToCollection.end(); ++it) {
-            if (it->second.collection == name) {
-                it->second.assigned = false;
-                it->second.collection = "";
-            }
-        }
-        // TODO: when we have CPO persistence figured out (replacing current fileutil::writeFile method),
-        // this needs to be persisted
+                // TODO implement clean up of persistence data
+                schemas.erase(name);
+                String collPath = _getCollectionPath(name);
+                remove(collPath.c_str());
+                String schemaPath = _getSchemasPath(name);
+                remove(schemaPath.c_str());
+
+                auto it = _nodesToCollection.begin();
+                for (; it != _nodesToCollection.end(); ++it) {
+                    if (it->second.collection == name) {
+                        it->second.assigned = false;
+                        it->second.collection = "";
+                    }
+                }
+                // TODO: when we have CPO persistence figured out (replacing current fileutil::writeFile method),
+                // this needs to be persisted
 
-        return RPCResponse(Statuses::S200_OK("Offload successful"), dto::CollectionDropResponse());
+                return RPCResponse(Statuses::S200_OK("Offload successful"), dto::CollectionDropResponse());
+            });
+        });
     });
 }
 
@@ -483,17 +510,23 @@ seastar::future<Status> CPOService::_pushSchema(const dto::Collection& collectio
 seastar::future<std::tuple<Status, dto::GetSchemasResponse>>
 CPOService::handleSchemasGet(dto::GetSchemasRequest&& request) {
     auto it = schemas.find(request.collectionName);
-    if (it == schemas.end()) {
-        auto [status, collection] = _getCollection(request.collectionName);
+    if (it != schemas.end()) {
+        return RPCResponse(Statuses::S200_OK("SchemasGet success"), dto::GetSchemasResponse { it->second });
+    }
+
+    return seastar::with_semaphore(_storeLock, 1, [this, cname=request.collectionName] {
+        return _getCollection(cname);
+    })
+    .then([this, cname=request.collectionName] (auto&& result) {
+        auto& status = std::get<0>(result);
         if (!status.is2xxOK()) {
             return RPCResponse(std::move(status), dto::GetSchemasResponse{});
         }
 
-        it = schemas.find(request.collectionName);
+        auto it = schemas.find(cname);
         K2ASSERT(log::cposvr, it != schemas.end(), "Schemas iterator is end after collection refresh");
-    }
-
-    return RPCResponse(Statuses::S200_OK("SchemasGet success"), dto::GetSchemasResponse { it->second });
+        return RPCResponse(Statuses::S200_OK("SchemasGet success"), dto::GetSchemasResponse { it->second });
+    });
 }
 
 seastar::future<std::tuple<Status, dto::CreateSchemaResponse>>
@@ -510,47 +543,68 @@ CPOService::handleCreateSchema(dto::CreateSchemaRequest&& request) {
         return RPCResponse(std::move(validation), dto::CreateSchemaResponse{});
     }
 
-    // 2. Stateful validation
-
-    // getCollection to make sure in memory cache of schemas is up to date, and we need the
-    // collection with partition map anyway to do the schema push
-    auto [status, collection] = _getCollection(cname);
-    if (!status.is2xxOK()) {
-        return RPCResponse(std::move(status), dto::CreateSchemaResponse{});
-    }
+    // the validation, the update and the save of the schemas are done under the store lock, so that concurrent
+    // schema creations don't overwrite each other
+    using SchemaUpdate = std::tuple<Status, dto::Collection, dto::Schema>;
+    return seastar::with_semaphore(_storeLock, 1, [this, request=std::move(request)] () mutable {
+        // 2. Stateful validation
 
-    bool validatedKeys = false;
-    for (const dto::Schema& otherSchema : schemas[cname]) {
-        if (otherSchema.name == request.schema.name && otherSchema.version == request.schema.version) {
-            return RPCResponse(Statuses::S403_Forbidden("Schema name and version already exist"), dto::CreateSchemaResponse{});
-        }
-
-        // As long as we validate that the key fields match with at least one
-        // other schema with the same name then they will always match
-        if (!validatedKeys && otherSchema.name == request.schema.name) {
-            validation = otherSchema.canUpgradeTo(request.schema);
-            if (!validation.is2xxOK()) {
-                return RPCResponse(std::move(validation), dto::CreateSchemaResponse{});
+        // getCollection to make sure in memory cache of schemas is up to date, and we need the
+        // collection with partition map anyway to do the schema push
+        auto cname = request.collectionName;
+        return _getCollection(cname)
+        .then([this, request=std::move(request)] (auto&& result) mutable {
+            auto& [status, collection] = result;
+            auto& cname = request.collectionName;
+            if (!status.is2xxOK()) {
+                return seastar::make_ready_future<SchemaUpdate>(SchemaUpdate(std::move(status), dto::Collection{}, dto::Schema{}));
             }
 
-            validatedKeys = true;
-        }
-    }
+            bool validatedKeys = false;
+            for (const dto::Schema& otherSchema : schemas[cname]) {
+                if (otherSchema.name == request.schema.name && otherSchema.version == request.schema.version) {
+                    return seastar::make_ready_future<SchemaUpdate>(SchemaUpdate(Statuses::S403_Forbidden("Schema name and version already exist"), dto::Collection{}, dto::Schema{}));
+                }
 
-    // 3. Save to disk
-    Status saved = _saveSchemas(request.collectionName);
-    if (!saved.is2xxOK()) {
-        return RPCResponse(std::move(saved), dto::CreateSchemaResponse{});
-    }
+                // As long as we validate that the key fields match with at least one
+                // other schema with the same name then they will always match
+                if (!validatedKeys && otherSchema.name == request.schema.name) {
+                    auto validation = otherSchema.canUpgradeTo(request.schema);
+                    if (!validation.is2xxOK()) {
+                        return seastar::make_ready_future<SchemaUpdate>(SchemaUpdate(std::move(validation), dto::Collection{}, dto::Schema{}));
+                    }
+
+                    validatedKeys = true;
+                }
+            }
 
-    // 4. Update in memory
-    schemas[request.collectionName].push_back(std::move(request.schema));
+            // 3. Update in memory. This has to be done before the save, since the save writes the in-memory list
+            schemas[cname].push_back(request.schema);
 
-    // 5. Push to K2 nodes and respond to client
-    return _pushSchema(collection, schemas[request.collectionName].back())
-    .then([cname, name, ver] (Status&& status) {
-        K2LOG_I(log::cposvr, "CreateSchema  {} : {}@{} completed with status {}", cname, name, ver, status);
-        return RPCResponse(std::move(status), dto::CreateSchemaResponse{});
+            // 4. Save to disk
+            auto saved = _saveSchemas(cname);
+            return saved.then([this, cname, collection=std::move(collection), schema=std::move(request.schema)] (Status&& saved) mutable {
+                if (!saved.is2xxOK()) {
+                    schemas[cname].pop_back();
+                }
+                return std::make_tuple(std::move(saved), std::move(collection), std::move(schema));
+            });
+        });
+    })
+    .then([this, cname, name, ver] (auto&& result) {
+        auto& [saved, collection, schema] = result;
+        if (!saved.is2xxOK()) {
+            return RPCResponse(std::move(saved), dto::CreateSchemaResponse{});
+        }
+
+        // 5. Push to K2 nodes and respond to client
+        return seastar::do_with(std::move(collection), std::move(schema), [this, cname, name, ver] (auto& collection, auto& schema) {
+            return _pushSchema(collection, schema)
+            .then([cname, name, ver] (Status&& status) {
+                K2LOG_I(log::cposvr, "CreateSchema  {} : {}@{} completed with status {}", cname, name, ver, status);
+                return RPCResponse(std::move(status), dto::CreateSchemaResponse{});
+            });
+        });
     });
 }
 
@@ -577,14 +631,15 @@ seastar::future<> CPOService::_doAssignCollection(dto::AssignmentCreateRequest &
         auto& [status, resp] = result;
         if (status.is2xxOK()) {
             K2LOG_I(log::cposvr, "assignment successful for collection {}, for partition {}", name, resp.assignedPartition);
-            _handleCompletedAssignment(name, std::move(resp));
-            return seastar::make_ready_future();     
+            return _handleCompletedAssignment(name, std::move(resp));
         }
         else if (status.is4xxNonRetryable()) {
             // The node refused to accept the assignment. For now, just ignore this
             K2LOG_W(log::cposvr, "assignment for collection {} was refused by {}, due to: {}", name, ep, status);
-            _handleCompletedAssignment(name, std::move(resp));
-            return seastar::make_exception_future<>(std::runtime_error("unable to assign collection"));
+            return _handleCompletedAssignment(name, std::move(resp))
+            .then([] {
+                return seastar::make_exception_future<>(std::runtime_error("unable to assign collection"));
+            });
         }
         else {
             K2LOG_W(log::cposvr, "assignment for collection {} failed because of server error by {}, due to: {}", name, ep, status);
@@ -684,126 +739,170 @@ seastar::future<bool> CPOService::_offloadCollection(dto::Collection& collection
     });
 }
 
-void CPOService::_handleCompletedAssignment(const String& cname, dto::AssignmentCreateResponse&& request) {
-    auto [status, haveCollection] = _getCollection(cname);
-    if (!status.is2xxOK()) {
-        K2LOG_E(log::cposvr, "unable to find collection which reported assignment {}", cname);
-        return;
-    }
-    for (auto& part: haveCollection.partitionMap.partitions) {
-        if (part.keyRangeV == request.assignedPartition.keyRangeV) {
-                K2LOG_I(log::cposvr, "Assignment received for active partition {}", request.assignedPartition);
-                part.astate = request.assignedPartition.astate;
-                part.endpoints = std::move(request.assignedPartition.endpoints);
-                _saveCollection(haveCollection);
-                return;
-        }
-    }
-    K2LOG_E(log::cposvr, "assignment completion does not match any stored partitions: {}", request.assignedPartition);
+seastar::future<> CPOService::_handleCompletedAssignment(const String& cname, dto::AssignmentCreateResponse&& request) {
+    return seastar::with_semaphore(_storeLock, 1, [this, cname, request=std::move(request)] () mutable {
+        return _getCollection(cname)
+        .then([this, cname, request=std::move(request)] (auto&& result) mutable {
+            auto& [status, haveCollection] = result;
+            if (!status.is2xxOK()) {
+                K2LOG_E(log::cposvr, "unable to find collection which reported assignment {}", cname);
+                return seastar::make_ready_future();
+            }
+            for (auto& part: haveCollection.partitionMap.partitions) {
+                if (part.keyRangeV == request.assignedPartition.keyRangeV) {
+                        K2LOG_I(log::cposvr, "Assignment received for active partition {}", request.assignedPartition);
+                        part.astate = request.assignedPartition.astate;
+                        part.endpoints = std::move(request.assignedPartition.endpoints);
+                        return _saveCollection(haveCollection).discard_result();
+                }
+            }
+            K2LOG_E(log::cposvr, "assignment completion does not match any stored partitions: {}", request.assignedPartition);
+            return seastar::make_ready_future();
+        });
+    });
 }
 
-std::tuple<Status, dto::Collection> CPOService::_getCollection(String name) {
+seastar::future<std::tuple<Status, dto::Collection>> CPOService::_getCollection(String name) {
     auto cpath = _getCollectionPath(name);
-    std::tuple<Status, dto::Collection> result;
-    Payload p;
-    if (!fileutil::readFile(p, cpath)) {
-        std::get<0>(result) = Statuses::S404_Not_Found("collection not found");
-        return result;
-    }
-    if (!p.read(std::get<1>(result))) {
-        std::get<0>(result) = Statuses::S500_Internal_Server_Error("unable to read collection data");
-        return result;
-    };
-    K2LOG_I(log::cposvr, "Found collection in: {}", cpath);
-    std::get<0>(result) = Statuses::S200_OK("collection found");
-
-    // Check to see if we need to load schemas from file too
-    auto it = schemas.find(name);
-    if (it == schemas.end()) {
-        Status schemaStatus = _loadSchemas(name);
-        if (!schemaStatus.is2xxOK()) {
-            std::get<0>(result) = Statuses::S500_Internal_Server_Error("unable to read schema data");
-            return result;
-        }
-    }
-
-    return result;
+    return _readFile(cpath)
+    .then([this, name, cpath] (std::optional<Payload>&& p) {
+        std::tuple<Status, dto::Collection> result;
+        if (!p) {
+            std::get<0>(result) = Statuses::S404_Not_Found("collection not found");
+            return seastar::make_ready_future<std::tuple<Status, dto::Collection>>(std::move(result));
+        }
+        if (!p->read(std::get<1>(result))) {
+            std::get<0>(result) = Statuses::S500_Internal_Server_Error("unable to read collection data");
+            return seastar::make_ready_future<std::tuple<Status, dto::Collection>>(std::move(result));
+        };
+        K2LOG_I(log::cposvr, "Found collection in: {}", cpath);
+        std::get<0>(result) = Statuses::S200_OK("collection found");
+
+        // Check to see if we need to load schemas from file too
+        auto it = schemas.find(name);
+        if (it != schemas.end()) {
+            return seastar::make_ready_future<std::tuple<Status, dto::Collection>>(std::move(result));
+        }
+        return _loadSchemas(name)
+        .then([result=std::move(result)] (Status&& schemaStatus) mutable {
+            if (!schemaStatus.is2xxOK()) {
+                std::get<0>(result) = Statuses::S500_Internal_Server_Error("unable to read schema data");
+            }
+            return std::move(result);
+        });
+    });
 }
 
-Status CPOService::_loadSchemas(const String& collectionName) {
+seastar::future<Status> CPOService::_loadSchemas(const String& collectionName) {
     auto cpath = _getSchemasPath(collectionName);
-    Payload p;
-    std::vector<dto::Schema> loadedSchemas;
-    if (!fileutil::readFile(p, cpath)) {
-        return Statuses::S404_Not_Found("schemas not found");
-    }
-    if (!p.read(loadedSchemas)) {
-        return Statuses::S500_Internal_Server_Error("unable to read schema data");
-    }
+    return _readFile(cpath)
+    .then([this, collectionName] (std::optional<Payload>&& p) {
+        std::vector<dto::Schema> loadedSchemas;
+        if (!p) {
+            return Statuses::S404_Not_Found("schemas not found");
+        }
+        if (!p->read(loadedSchemas)) {
+            return Statuses::S500_Internal_Server_Error("unable to read schema data");
+        }
 
-    schemas[collectionName] = std::move(loadedSchemas);
+        schemas[collectionName] = std::move(loadedSchemas);
 
-    return Statuses::S200_OK("Schemas loaded");
+        return Statuses::S200_OK("Schemas loaded");
+    });
 }
 
-Status CPOService::_saveCollection(dto::Collection& collection) {
+seastar::future<Status> CPOService::_saveCollection(const dto::Collection& collection) {
     auto cpath = _getCollectionPath(collection.metadata.name);
     Payload p(Payload::DefaultAllocator(4096));
     p.write(collection);
-    if (!fileutil::writeFile(std::move(p), cpath)) {
-        return Statuses::S500_Internal_Server_Error("unable to write collection data");
-    }
+    return _writeFile(std::move(p), cpath)
+    .then([this, cpath, name=collection.metadata.name] (bool success) {
+        if (!success) {
+            return seastar::make_ready_future<Status>(Statuses::S500_Internal_Server_Error("unable to write collection data"));
+        }
 
-    K2LOG_D(log::cposvr, "saved collection: {}", cpath);
-    return _saveSchemas(collection.metadata.name);
+        K2LOG_D(log::cposvr, "saved collection: {}", cpath);
+        return _saveSchemas(name);
+    });
 }
 
-Status CPOService::_saveSchemas(const String& collectionName) {
+seastar::future<Status> CPOService::_saveSchemas(const String& collectionName) {
     auto cpath = _getSchemasPath(collectionName);
     Payload p(Payload::DefaultAllocator(4096));
     p.write(schemas[collectionName]);
-    if (!fileutil::writeFile(std::move(p), cpath)) {
-        return Statuses::S500_Internal_Server_Error("unable to write schema data");
+    return _writeFile(std::move(p), cpath)
+    .then([cpath] (bool success) {
+        if (!success) {
+            return Statuses::S500_Internal_Server_Error("unable to write schema data");
+        }
+
+        K2LOG_D(log::cposvr, "saved schemas: {}", cpath);
+        return Statuses::S201_Created("schema written");
+    });
+}
+
+seastar::future<std::optional<Payload>> CPOService::_readFile(const String& path) {
+    if (_blockingFileIO()) {
+        Payload p;
+        if (!fileutil::readFile(p, path)) {
+            return seastar::make_ready_future<std::optional<Payload>>(std::nullopt);
+        }
+        return seastar::make_ready_future<std::optional<Payload>>(std::move(p));
     }
+    return fileutil::readFileAsync(path);
+}
 
-    K2LOG_D(log::cposvr, "saved schemas: {}", cpath);
-    return Statuses::S201_Created("schema written");
+seastar::future<bool> CPOService::_writeFile(Payload&& payload, const String& path) {
+    if (_blockingFileIO()) {
+        return seastar::make_ready_future<bool>(fileutil::writeFile(std::move(payload), path));
+    }
+    return fileutil::writeFileAsync(std::move(payload), path);
 }
 
 seastar::future<std::tuple<Status, dto::PersistenceClusterCreateResponse>>
 CPOService::handlePersistenceClusterCreate(dto::PersistenceClusterCreateRequest&& request){
     K2LOG_D(log::cposvr, "Received persistence cluster create request for {}", request.cluster.name);
-    auto cpath = _getPersistenceClusterPath(request.cluster.name);
-    dto::PersistenceCluster persistenceCluster;
-    Payload p;
-    if (fileutil::readFile(p, cpath)) {
-        return RPCResponse(Statuses::S409_Conflict("persistence cluster already exists"), dto::PersistenceClusterCreateResponse());
-    }
+    return seastar::with_semaphore(_storeLock, 1, [this, request=std::move(request)] () mutable {
+        auto cpath = _getPersistenceClusterPath(request.cluster.name);
+        return _readFile(cpath)
+        .then([this, cpath, request=std::move(request)] (std::optional<Payload>&& p) {
+            if (p) {
+                return RPCResponse(Statuses::S409_Conflict("persistence cluster already exists"), dto::PersistenceClusterCreateResponse());
+            }
 
-    Payload q(Payload::DefaultAllocator(4096));
-    q.write(request.cluster);
-    if (!fileutil::writeFile(std::move(q), cpath)) {
-        return RPCResponse(Statuses::S500_Internal_Server_Error("unable to write persistence cluster data"), dto::PersistenceClusterCreateResponse());
-    }
-    return RPCResponse(Statuses::S201_Created("persistence cluster creates successfully"), dto::PersistenceClusterCreateResponse());
+            Payload q(Payload::DefaultAllocator(4096));
+            q.write(request.cluster);
+            return _writeFile(std::move(q), cpath)
+            .then([] (bool success) {
+                if (!success) {
+                    return RPCResponse(Statuses::S500_Internal_Server_Error("unable to write persistence cluster data"), dto::PersistenceClusterCreateResponse());
+                }
+                return RPCResponse(Statuses::S201_Created("persistence cluster creates successfully"), dto::PersistenceClusterCreateResponse());
+            });
+        });
+    });
 }
 
 seastar::future<std::tuple<Status, dto::PersistenceClusterGetResponse>>
 CPOService::handlePersistenceClusterGet(dto::PersistenceClusterGetRequest&& request) {
     K2LOG_D(log::cposvr, "Received persistence cluster get request with name {}", request.name);
     auto cpath = _getPersistenceClusterPath(request.name);
-    dto::PersistenceCluster persistenceCluster;
-    Payload p;
-    if (!fileutil::readFile(p, cpath)) {
-        return RPCResponse(Statuses::S404_Not_Found("persistence cluster not found"), dto::PersistenceClusterGetResponse());
-    }
-    if (!p.read(persistenceCluster)) {
-        return RPCResponse(Statuses::S500_Internal_Server_Error("unable to read persistence cluster data"), dto::PersistenceClusterGetResponse());
-    };
+    return seastar::with_semaphore(_storeLock, 1, [this, cpath] {
+        return _readFile(cpath);
+    })
+    .then([cpath] (std::optional<Payload>&& p) {
+        dto::PersistenceCluster persistenceCluster;
+        if (!p) {
+            return RPCResponse(Statuses::S404_Not_Found("persistence cluster not found"), dto::PersistenceClusterGetResponse());
+        }
+        if (!p->read(persistenceCluster)) {
+            return RPCResponse(Statuses::S500_Internal_Server_Error("unable to read persistence cluster data"), dto::PersistenceClusterGetResponse());
+        };
 
-    K2LOG_D(log::cposvr, "Found persistence cluster in: {}", cpath);
-    dto::PersistenceClusterGetResponse response{.cluster=std::move(persistenceCluster)};
-    return RPCResponse(Statuses::S200_OK("persistence cluster found"), std::move(response));
+        K2LOG_D(log::cposvr, "Found persistence cluster in: {}", cpath);
+        dto::PersistenceClusterGetResponse response{.cluster=std::move(persistenceCluster)};
+        return RPCResponse(Statuses::S200_OK("persistence cluster found"), std::move(response));
+    });
 }
 
 // When the metadata manager seals the old plog and use a new plod to persist metadata, this will be called
@@ -26,13 +26,16 @@ Copyright(c) 2020 Futurewei Cloud
 // third-party
 #include <seastar/core/distributed.hh>
 #include <seastar/core/future.hh>  // for future stuff
+#include <seastar/core/semaphore.hh>
 
 #include <k2/appbase/AppEssentials.h>
 #include <k2/dto/ControlPlaneOracle.h>
 #include <k2/dto/AssignmentManager.h>
 #include <k2/dto/PersistenceCluster.h>
 #include <k2/dto/LogStream.h>
+#include <k2/transport/Payload.h>
 #include <k2/transport/Status.h>
+#include <optional>
 #include <utility>
 #include <unordered_map>
 
@@ -71,12 +74,21 @@ private:
     std::unordered_map<String, seastar::future<>> _assignments;
     std::unordered_map<String, std::vector<dto::PartitionMetdataRecord>> _metadataRecords;
     std::map<String, NodeAssignmentEntry> _nodesToCollection;
-    std::tuple<Status, dto::Collection> _getCollection(String name);
-    Status _saveCollection(dto::Collection& collection);
-    Status _saveSchemas(const String& collectionName);
-    Status _loadSchemas(const String& collectionName);
+    // Collections, schemas and persistence clusters are stored in files in the data directory. The file I/O goes
+    // through the I/O backend of the reactor, unless cpo_blocking_file_io is set. Since that lets other requests run
+    // while we wait for the I/O, all file operations are done under _storeLock, so that read-modify-write
+    // sequences don't interleave. The methods below expect the caller to hold the lock
+    ConfigVar<bool> _blockingFileIO{"cpo_blocking_file_io", false};
+    seastar::semaphore _storeLock{1};
+    seastar::future<std::optional<Payload>> _readFile(const String& path);
+    seastar::future<bool> _writeFile(Payload&& payload, const String& path);
+    seastar::future<std::tuple<Status, dto::Collection>> _getCollection(String name);
+    seastar::future<Status> _saveCollection(const dto::Collection& collection);
+    seastar::future<Status> _saveSchemas(const String& collectionName);
+    seastar::future<Status> _loadSchemas(const String& collectionName);
+    seastar::future<std::tuple<Status, dto::CollectionCreateResponse>> _doCreate(dto::CollectionCreateRequest&& request);
     seastar::future<Status> _pushSchema(const dto::Collection& collection, const dto::Schema& schema);
-    void _handleCompletedAssignment(const String& cname, dto::AssignmentCreateResponse&& request);
+    seastar::future<> _handleCompletedAssignment(const String& cname, dto::AssignmentCreateResponse&& request);
     seastar::future<> _getNodes(); // Get list of nodes from health monitor
     String _assignToFreeNode(String collection);
     int _makeHashPartitionMap(dto::Collection& collection, uint32_t numNodes);
@@ -110,6 +110,10 @@ PartitionGetter::PartitionWithEndpoint PartitionGetter::_getPartitionWithEndpoin
     PartitionWithEndpoint partition{};
     partition.partition = p;
     partition.preferredEndpoint = Discovery::selectBestEndpoint(p->endpoints);
+    if (partition.preferredEndpoint) {
+        // open the connections now, so that the first request to the partition doesn't pay for them
+        RPC().connect(*partition.preferredEndpoint);
+    }
 
     return partition;
 }
@@ -97,13 +97,9 @@ compareOptionals(std::tuple<bool, std::optional<T1>>&, std::tuple<bool, std::opt
     throw TypeMismatchException(fmt::format("non-comparable types: {}, {}", TToFieldType<T1>(), TToFieldType<T1>()));
 }
 
-// template specialization comparing two optionals of comparable types
+// compares two optionals of comparable types, with the given nullLast flags
 template <typename T1, typename T2>
-std::enable_if_t<is_comparable<T1, T2>::value, int>
-compareOptionals(std::tuple<bool, std::optional<T1>>& a, std::tuple<bool, std::optional<T2>>& b) {
-    auto& [a_nullLast, a_opt] = a;
-    auto& [b_nullLast, b_opt] = b;
-
+int compareValues(bool a_nullLast, const std::optional<T1>& a_opt, bool b_nullLast, const std::optional<T2>& b_opt) {
     if (!a_opt && !b_opt) {
         // NULLs of compatible types compare as equal
         return 0;
@@ -127,6 +123,15 @@ compareOptionals(std::tuple<bool, std::optional<T1>>& a, std::tuple<bool, std::o
     return -1;
 }
 
+// template specialization comparing two optionals of comparable types
+template <typename T1, typename T2>
+std::enable_if_t<is_comparable<T1, T2>::value, int>
+compareOptionals(std::tuple<bool, std::optional<T1>>& a, std::tuple<bool, std::optional<T2>>& b) {
+    auto& [a_nullLast, a_opt] = a;
+    auto& [b_nullLast, b_opt] = b;
+    return compareValues(a_nullLast, a_opt, b_nullLast, b_opt);
+}
+
 
 
 template <typename B_TYPE, typename A>
@@ -460,6 +465,402 @@ bool Expression::NOT_handler(SKVRecord& rec) {
     return !expressionChildren[0].evaluate(rec);
 }
 
+
+// The compiled form of an expression is a tree of nodes, where each node is specialized for the types of its operands.
+// Problems which we find while compiling (unknown fields, bad types, invalid structure) become nodes which report the
+// problem when they are evaluated. That way we report them only when Expression::evaluate() would throw them.
+struct CompiledNode {
+    virtual ~CompiledNode() = default;
+    virtual EvalResult eval(SKVRecord& rec, String& error) = 0;
+};
+
+namespace {
+
+// returns true if the result should be passed up as is, i.e. it is not a PASS/FAIL
+inline bool isAbort(EvalResult r) {
+    return r != EvalResult::PASS && r != EvalResult::FAIL;
+}
+
+inline EvalResult toResult(bool pass) {
+    return pass ? EvalResult::PASS : EvalResult::FAIL;
+}
+
+// A node with a fixed result. Used for problems found at compile time and for operations whose result
+// only depends on the schema
+struct ConstNode : public CompiledNode {
+    ConstNode(EvalResult result, String error = "") : result(result), error(std::move(error)) {}
+    EvalResult eval(SKVRecord&, String& err) override {
+        if (result == EvalResult::INVALID) {
+            err = error;
+        }
+        return result;
+    }
+    EvalResult result;
+    String error;
+};
+
+// A value operand of a known type: either a field of the record, or a decoded literal
+template <typename T>
+struct Operand {
+    int fieldIndex = -1;
+    bool nullLast = false;
+    std::optional<T> literal;
+    std::optional<T> field;
+
+    const std::optional<T>& get(SKVRecord& rec) {
+        if (fieldIndex < 0) {
+            return literal;
+        }
+        field = rec.deserializeField<T>(fieldIndex);
+        return field;
+    }
+};
+
+// Resolves a Value against the schema. Mirrors SchematizedValue, and throws the same exceptions
+struct ResolvedValue {
+    ResolvedValue(Value& v, const Schema& schema) : val(v), type(v.type) {
+        if (val.isReference()) {
+            for (size_t i = 0; i < schema.fields.size(); ++i) {
+                if (schema.fields[i].name == val.fieldName) {
+                    fieldIndex = i;
+                    nullLast = schema.fields[i].nullLast;
+                    type = schema.fields[i].type;
+                    break;
+                }
+            }
+            if (type == FieldType::NOT_KNOWN) {
+                throw NoFieldFoundException("unable to create reference with FieldType::NOT_KNOWN");
+            }
+            if (fieldIndex < 0) {
+                throw TypeMismatchException(fmt::format("field {} not found in schema", val.fieldName));
+            }
+        }
+    }
+
+    // makes an operand of the given type, decoding the literal if this is a literal
+    template <typename T>
+    Operand<T> operand() {
+        if (TToFieldType<T>() != type) {
+            throw TypeMismatchException(fmt::format("bad type in compiled value: have {}, got {}", type, TToFieldType<T>()));
+        }
+        Operand<T> result{.fieldIndex = fieldIndex, .nullLast = nullLast};
+        if (!val.isReference()) {
+            val.literal.seek(0);
+            T value{};
+            if (!val.literal.read(value)) {
+                throw DeserializationError(fmt::format("Unable to deserialize value literal of type {}", TToFieldType<T>()));
+            }
+            result.literal = std::move(value);
+        }
+        return result;
+    }
+
+    Value& val;
+    FieldType type = FieldType::NOT_KNOWN;
+    bool nullLast = false;
+    int fieldIndex = -1;
+};
+
+// EQ, GT, GTE, LT, LTE over values of the given types
+template <typename TA, typename TB>
+struct CompareNode : public CompiledNode {
+    CompareNode(Operation op, Operand<TA>&& a, Operand<TB>&& b) : op(op), a(std::move(a)), b(std::move(b)) {}
+    EvalResult eval(SKVRecord& rec, String&) override {
+        auto& aOpt = a.get(rec);
+        auto& bOpt = b.get(rec);
+        int cmp = compareValues(a.nullLast, aOpt, b.nullLast, bOpt);
+        switch (op) {
+            case Operation::EQ: return toResult(cmp == 0);
+            case Operation::GT: return toResult(cmp > 0);
+            case Operation::GTE: return toResult(cmp >= 0);
+            case Operation::LT: return toResult(cmp < 0);
+            default: return toResult(cmp <= 0);
+        }
+    }
+    Operation op;
+    Operand<TA> a;
+    Operand<TB> b;
+};
+
+// IS_NULL over a field of the given type
+template <typename T>
+struct IsNullNode : public CompiledNode {
+    IsNullNode(Operand<T>&& a) : a(std::move(a)) {}
+    EvalResult eval(SKVRecord& rec, String&) override {
+        return toResult(!a.get(rec).has_value());
+    }
+    Operand<T> a;
+};
+
+// STARTS_WITH, CONTAINS, ENDS_WITH
+struct StringMatchNode : public CompiledNode {
+    StringMatchNode(Operation op, Operand<String>&& a, Operand<String>&& b) : op(op), a(std::move(a)), b(std::move(b)) {}
+    EvalResult eval(SKVRecord& rec, String&) override {
+        auto& aOpt = a.get(rec);
+        auto& bOpt = b.get(rec);
+        if (!bOpt) return EvalResult::PASS;  // all strings start with, contain and end with nothing
+        if (!aOpt) return EvalResult::FAIL;  // a null string doesn't match anything
+        switch (op) {
+            case Operation::STARTS_WITH:
+                return toResult(aOpt->size() >= bOpt->size() && ::memcmp(aOpt->c_str(), bOpt->c_str(), bOpt->size()) == 0);
+            case Operation::CONTAINS:
+                return toResult(aOpt->find(*bOpt) != String::npos);
+            default:
+                return toResult(aOpt->size() >= bOpt->size() &&
+                                ::memcmp(aOpt->c_str() + (aOpt->size() - bOpt->size()), bOpt->c_str(), bOpt->size()) == 0);
+        }
+    }
+    Operation op;
+    Operand<String> a;
+    Operand<String> b;
+};
+
+// AND, OR, XOR and NOT. The value children are always evaluated first. Expression children are short-circuited
+// the same way as in Expression::evaluate()
+struct LogicalNode : public CompiledNode {
+    EvalResult eval(SKVRecord& rec, String& error) override {
+        switch (op) {
+            case Operation::AND: {
+                bool result = true;
+                for (auto& value : values) {
+                    auto& opt = value.get(rec);
+                    result = result && opt.has_value() && *opt;
+                }
+                for (auto& child : children) {
+                    if (!result) break;
+                    auto r = child->eval(rec, error);
+                    if (isAbort(r)) return r;
+                    result = r == EvalResult::PASS;
+                }
+                return toResult(result);
+            }
+            case Operation::OR: {
+                bool result = false;
+                for (auto& value : values) {
+                    auto& opt = value.get(rec);
+                    result = result || (opt.has_value() && *opt);
+                }
+                for (auto& child : children) {
+                    if (result) break;
+                    auto r = child->eval(rec, error);
+                    if (isAbort(r)) return r;
+                    result = r == EvalResult::PASS;
+                }
+                return toResult(result);
+            }
+            case Operation::XOR: {
+                if (values.size() == 2) {
+                    auto& aOpt = values[0].get(rec);
+                    auto& bOpt = values[1].get(rec);
+                    return toResult(aOpt.has_value() && bOpt.has_value() && (*aOpt != *bOpt));
+                }
+                if (values.size() == 1) {
+                    auto& aOpt = values[0].get(rec);
+                    auto r = children[0]->eval(rec, error);
+                    if (isAbort(r)) return r;
+                    return toResult(aOpt.has_value() && (*aOpt != (r == EvalResult::PASS)));
+                }
+                auto ra = children[0]->eval(rec, error);
+                if (isAbort(ra)) return ra;
+                auto rb = children[1]->eval(rec, error);
+                if (isAbort(rb)) return rb;
+                return toResult(ra != rb);
+            }
+            default: {
+                // NOT
+                if (values.size() == 1) {
+                    auto& aOpt = values[0].get(rec);
+                    return toResult(!aOpt.has_value() || !(*aOpt));
+                }
+                auto r = children[0]->eval(rec, error);
+                if (isAbort(r)) return r;
+                return toResult(r != EvalResult::PASS);
+            }
+        }
+    }
+    Operation op;
+    std::vector<Operand<bool>> values;
+    std::vector<std::unique_ptr<CompiledNode>> children;
+};
+
+std::unique_ptr<CompiledNode> _compileNode(Expression& expr, const Schema& schema);
+
+template <typename TB, typename TA>
+void _compileCompareInner(ResolvedValue& b, Operand<TA>& a, Operation op, std::unique_ptr<CompiledNode>& result) {
+    Operand<TB> bOp = b.operand<TB>();
+    if constexpr (is_comparable<TA, TB>::value) {
+        result = std::make_unique<CompareNode<TA, TB>>(op, std::move(a), std::move(bOp));
+    } else {
+        throw TypeMismatchException(fmt::format("non-comparable types: {}, {}", TToFieldType<TA>(), TToFieldType<TB>()));
+    }
+}
+
+template <typename TA>
+void _compileCompareOuter(ResolvedValue& a, ResolvedValue& b, Operation op, std::unique_ptr<CompiledNode>& result) {
+    Operand<TA> aOp = a.operand<TA>();
+    K2_DTO_CAST_APPLY_FIELD_VALUE(_compileCompareInner, b, aOp, op, result);
+}
+
+template <typename T>
+void _compileIsNull(ResolvedValue& a, std::unique_ptr<CompiledNode>& result) {
+    result = std::make_unique<IsNullNode<T>>(a.operand<T>());
+}
+
+// resolves a value which must be a bool for a logical operation
+Operand<bool> _boolOperand(Value& value, const Schema& schema, Operation op) {
+    ResolvedValue rv(value, schema);
+    if (rv.type != FieldType::BOOL) {
+        throw TypeMismatchException(fmt::format("{} handler value with non-bool field: {}", op, rv.type));
+    }
+    return rv.operand<bool>();
+}
+
+std::unique_ptr<CompiledNode> _compileOp(Expression& expr, const Schema& schema) {
+    auto& values = expr.valueChildren;
+    auto& exprs = expr.expressionChildren;
+    switch (expr.op) {
+        case Operation::EQ:
+        case Operation::GT:
+        case Operation::GTE:
+        case Operation::LT:
+        case Operation::LTE: {
+            if (values.size() != 2 || exprs.size() > 0) {
+                throw InvalidExpressionException(fmt::format("expression {} must have exactly 2 value children(have {}) and no expression children(have {})", expr.op, values.size(), exprs.size()));
+            }
+            ResolvedValue a(values[0], schema);
+            ResolvedValue b(values[1], schema);
+            std::unique_ptr<CompiledNode> result;
+            K2_DTO_CAST_APPLY_FIELD_VALUE(_compileCompareOuter, a, b, expr.op, result);
+            return result;
+        }
+        case Operation::IS_NULL: {
+            if (values.size() != 1 || exprs.size() > 0 || !values[0].isReference()) {
+                throw InvalidExpressionException(fmt::format("expression IS_NULL must have exactly 1 value literal children(have {}) and no expression children(have {})", values.size(), exprs.size()));
+            }
+            ResolvedValue a(values[0], schema);
+            std::unique_ptr<CompiledNode> result;
+            K2_DTO_CAST_APPLY_FIELD_VALUE(_compileIsNull, a, result);
+            return result;
+        }
+        case Operation::IS_EXACT_TYPE: {
+            if (values.size() != 2 || exprs.size() > 0 || !values[0].isReference() || values[1].isReference()) {
+                throw InvalidExpressionException(fmt::format("expression IS_EXACT_TYPE must have exactly 2 value children, where child0 is a literal and child1 is a reference(have {}) and no expression children(have {})", values.size(), exprs.size()));
+            }
+            // the result only depends on the schema
+            ResolvedValue ref(values[0], schema);
+            ResolvedValue expTypeVal(values[1], schema);
+            FieldType expected = expTypeVal.operand<FieldType>().literal.value();
+            return std::make_unique<ConstNode>(toResult(expected == ref.type));
+        }
+        case Operation::STARTS_WITH:
+        case Operation::CONTAINS:
+        case Operation::ENDS_WITH: {
+            if (values.size() != 2 || exprs.size() > 0) {
+                throw InvalidExpressionException(fmt::format("expression {} must have exactly 2 value children and no expression children(have {})", expr.op, values.size(), exprs.size()));
+            }
+            ResolvedValue a(values[0], schema);
+            ResolvedValue b(values[1], schema);
+            if (a.type != FieldType::STRING || b.type != FieldType::STRING) {
+                throw TypeMismatchException(fmt::format("{} handler non-string fields: {}, {}", expr.op, a.type, b.type));
+            }
+            auto aOp = a.operand<String>();
+            auto bOp = b.operand<String>();
+            return std::make_unique<StringMatchNode>(expr.op, std::move(aOp), std::move(bOp));
+        }
+        case Operation::AND:
+        case Operation::OR:
+        case Operation::XOR:
+        case Operation::NOT: {
+            size_t total = values.size() + exprs.size();
+            if ((expr.op == Operation::AND || expr.op == Operation::OR) && total == 0) {
+                throw InvalidExpressionException(fmt::format("expression {} must have 1 or more children", expr.op));
+            }
+            if (expr.op == Operation::XOR && total != 2) {
+                throw InvalidExpressionException(fmt::format("expression XOR must have exactly 2 total children(have {} value and {} expression)", values.size(), exprs.size()));
+            }
+            if (expr.op == Operation::NOT && total != 1) {
+                throw InvalidExpressionException(fmt::format("expression NOT must have exactly 1 total children(have {} value and {} expression)", values.size(), exprs.size()));
+            }
+            auto result = std::make_unique<LogicalNode>();
+            result->op = expr.op;
+            if (expr.op == Operation::XOR && values.size() == 2) {
+                // both values are resolved before either is read
+                ResolvedValue a(values[0], schema);
+                ResolvedValue b(values[1], schema);
+                if (a.type != FieldType::BOOL || b.type != FieldType::BOOL) {
+                    throw TypeMismatchException(fmt::format("XOR handler two non-bool fields: {}, {}", a.type, b.type));
+                }
+                result->values.push_back(a.operand<bool>());
+                result->values.push_back(b.operand<bool>());
+            } else {
+                for (auto& value : values) {
+                    result->values.push_back(_boolOperand(value, schema, expr.op));
+                }
+            }
+            for (auto& child : exprs) {
+                result->children.push_back(_compileNode(child, schema));
+            }
+            return result;
+        }
+        case Operation::UNKNOWN: {
+            if (values.size() + exprs.size() == 0) {
+                // empty expression - allow it
+                return std::make_unique<ConstNode>(EvalResult::PASS);
+            }
+            throw InvalidExpressionException(fmt::format("UNKNOWN operation {} in expression", expr.op));
+        }
+        default:
+            throw InvalidExpressionException(fmt::format("non-supported operation {} in expression", expr.op));
+    }
+}
+
+// compiles the given expression. Problems are turned into nodes which report them when evaluated
+std::unique_ptr<CompiledNode> _compileNode(Expression& expr, const Schema& schema) {
+    try {
+        return _compileOp(expr, schema);
+    }
+    catch (NoFieldFoundException&) {
+        return std::make_unique<ConstNode>(EvalResult::MISMATCH);
+    }
+    catch (TypeMismatchException&) {
+        return std::make_unique<ConstNode>(EvalResult::MISMATCH);
+    }
+    catch (DeserializationError&) {
+        return std::make_unique<ConstNode>(EvalResult::DESERIALIZATION_ERROR);
+    }
+    catch (InvalidExpressionException& exc) {
+        return std::make_unique<ConstNode>(EvalResult::INVALID, exc.what());
+    }
+}
+} // namespace
+
+CompiledExpression::CompiledExpression(Expression& expr, std::shared_ptr<Schema> schema) :
+    _schema(std::move(schema)) {
+    K2ASSERT(log::dto, _schema, "Compiled expression must have a schema");
+    _root = _compileNode(expr, *_schema);
+    if (auto* node = dynamic_cast<ConstNode*>(_root.get()); node && node->result == EvalResult::PASS) {
+        // the expression passes all records. Don't bother evaluating it
+        _root.reset();
+    }
+}
+
+CompiledExpression::CompiledExpression(CompiledExpression&& o) noexcept = default;
+CompiledExpression& CompiledExpression::operator=(CompiledExpression&& o) noexcept = default;
+CompiledExpression::~CompiledExpression() = default;
+
+EvalResult CompiledExpression::evaluate(SKVRecord& rec) {
+    if (!_root) {
+        return EvalResult::PASS;
+    }
+    try {
+        return _root->eval(rec, _error);
+    }
+    catch (DeserializationError&) {
+        // the record data is corrupted
+        return EvalResult::DESERIALIZATION_ERROR;
+    }
+}
+
 } // ns expression
 } // dto
 } // k2
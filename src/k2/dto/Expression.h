@@ -24,6 +24,7 @@ Copyright(c) 2020 Futurewei Cloud
 #pragma once
 
 #include <functional>
+#include <memory>
 #include <vector>
 
 #include <k2/common/Common.h>
@@ -154,6 +155,49 @@ struct Expression {
     bool NOT_handler(SKVRecord& rec);
 };
 
+// The result of evaluating a CompiledExpression against a record
+K2_DEF_ENUM(EvalResult,
+    PASS,                   /* the record passed the filter */
+    FAIL,                   /* the record did not pass the filter */
+    MISMATCH,               /* the expression refers to a field which the schema doesn't have, or to incompatible types.
+                               Same as NoFieldFoundException/TypeMismatchException from Expression::evaluate() */
+    INVALID,                /* the expression is semantically invalid. See CompiledExpression::error() */
+    DESERIALIZATION_ERROR   /* we were not able to deserialize a value */
+);
+
+// A node of a compiled expression. Defined in Expression.cpp
+struct CompiledNode;
+
+// An Expression compiled for the records of a particular schema version. Field references are resolved to field
+// indices and literals are decoded once when the expression is compiled, and each operation is specialized for the
+// types of its operands. Evaluating a record does no name lookups, no literal decoding, and doesn't throw.
+// The semantics are the same as Expression::evaluate(). Problems with the expression are only reported if the
+// evaluation reaches the part of the expression which has them, e.g. the second child of a short-circuited AND.
+class CompiledExpression {
+public:
+    CompiledExpression(Expression& expr, std::shared_ptr<Schema> schema);
+    CompiledExpression(CompiledExpression&& o) noexcept;
+    CompiledExpression& operator=(CompiledExpression&& o) noexcept;
+    ~CompiledExpression();
+
+    // Evaluates the given record, which must be of the schema this expression was compiled for
+    EvalResult evaluate(SKVRecord& rec);
+
+    // true if all records pass this expression, e.g. if it is the empty expression
+    bool passesAll() const { return !_root; }
+
+    // the reason for the last INVALID result
+    const String& error() const { return _error; }
+
+    // the schema this expression was compiled for
+    const std::shared_ptr<Schema>& schema() const { return _schema; }
+
+private:
+    std::unique_ptr<CompiledNode> _root;
+    std::shared_ptr<Schema> _schema;
+    String _error;
+};
+
 // helper builder: creates a value literal
 template <typename T>
 inline Value makeValueLiteral(T&& literal) {
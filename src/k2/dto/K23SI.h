@@ -129,8 +129,8 @@ K2_DEF_ENUM(TxnRecordState,
 );
 
 // The transaction states for K23SI WI metadata records kept at each participant.
-// All of the *PIP states are the states which can end up in persistence(WAL) and therefore
-// the *PIP states are the only states which can be encountered by replay
+// All of the *PIP states are the states which can end up in persistence(WAL). In addition, the Committed/Aborted
+// states are persisted when a PUSH finalizes a single WI locally, so these are also encountered by replay
 K2_DEF_ENUM(TxnWIMetaState,
         Created,         // The state in which all new TxnWIMeta records are put when first created in memory
         InProgressPIP,   // The txn is InProgress and we're persisting the record
@@ -150,9 +150,12 @@ struct K23SIReadRequest {
     K23SI_MTR mtr; // the MTR for the issuing transaction
     // use the name "key" so that we can use common routing from CPO client
     Key key; // the key to read
+    // set for reads from snapshot read txns. If the MTR timestamp is closed on the partition, the read is served
+    // without registering an observation in the read cache
+    bool snapshotRead{false};
 
-    K2_PAYLOAD_FIELDS(pvid, collectionName, mtr, key);
-    K2_DEF_FMT(K23SIReadRequest, pvid, collectionName, mtr, key);
+    K2_PAYLOAD_FIELDS(pvid, collectionName, mtr, key, snapshotRead);
+    K2_DEF_FMT(K23SIReadRequest, pvid, collectionName, mtr, key, snapshotRead);
 };
 
 // The response for READs
@@ -162,6 +165,35 @@ struct K23SIReadResponse {
     K2_DEF_FMT(K23SIReadResponse, value);
 };
 
+// Reads a number of keys from a single partition under one MTR
+struct K23SIReadBatchRequest {
+    PVID pvid; // the partition version ID. Should be coming from an up-to-date partition map
+    String collectionName; // the name of the collection
+    K23SI_MTR mtr; // the MTR for the issuing transaction
+    // use the name "key" so that we can use common routing from CPO client. This is the first key in the batch
+    Key key;
+    std::vector<Key> keys; // the keys to read, including the routing key
+    bool snapshotRead{false}; // same as K23SIReadRequest::snapshotRead, for all keys in the batch
+
+    K2_PAYLOAD_FIELDS(pvid, collectionName, mtr, key, keys, snapshotRead);
+    K2_DEF_FMT(K23SIReadBatchRequest, pvid, collectionName, mtr, key, keys, snapshotRead);
+};
+
+// The result of reading a single key in a batch. The status codes are the same as for single-key reads
+struct K23SIReadBatchResult {
+    Status status;
+    SKVRecord::Storage value; // the value we found
+    K2_PAYLOAD_FIELDS(status, value);
+    K2_DEF_FMT(K23SIReadBatchResult, status, value);
+};
+
+// The response for batched READs. Contains one result for each requested key, in request order
+struct K23SIReadBatchResponse {
+    std::vector<K23SIReadBatchResult> results;
+    K2_PAYLOAD_FIELDS(results);
+    K2_DEF_FMT(K23SIReadBatchResponse, results);
+};
+
 // status codes for reads
 struct K23SIStatus {
     static const inline Status KeyNotFound=k2::Statuses::S404_Not_Found;
@@ -212,9 +244,71 @@ struct K23SIWriteRequest {
     K2_DEF_FMT(K23SIWriteRequest, pvid, collectionName, mtr, trh, trhCollection, isDelete, designateTRH, precondition, request_id, key, value, fieldsForPartialUpdate);
 };
 
+// The last write of a transaction. If the write lands on the TRH partition, the transaction is committed right
+// after the write succeeds, as if a K23SITxnEndRequest was received. Otherwise it is handled as a regular write.
+// The client must only send this once all other writes of the transaction have been acknowledged
+struct K23SIWriteAndCommitRequest {
+    // The routing fields and the MTR of the write, so that the request is routed and prioritized like a write. They
+    // are moved out of the write by the client, and the server puts them back
+    PVID pvid;
+    String collectionName;
+    K23SI_MTR mtr;
+    Key key;
+    K23SIWriteRequest write;
+    // these have the same meaning as in the end request. The range of the partition which handles the write is
+    // added to the writeRanges by the server
+    std::unordered_map<String, std::unordered_set<KeyRangeVersion>> writeRanges;
+    bool syncFinalize = false;
+
+    K2_PAYLOAD_FIELDS(pvid, collectionName, mtr, key, write, writeRanges, syncFinalize);
+    K2_DEF_FMT(K23SIWriteAndCommitRequest, pvid, collectionName, mtr, key, write, writeRanges, syncFinalize);
+};
+
 struct K23SIWriteResponse {
-    K2_PAYLOAD_EMPTY;
-    K2_DEF_FMT(K23SIWriteResponse);
+    // set if the transaction was ended with this write (see K23SIWriteAndCommitRequest). The status of the response
+    // is then the status of ending the transaction
+    bool txnEnded = false;
+    K2_PAYLOAD_FIELDS(txnEnded);
+    K2_DEF_FMT(K23SIWriteResponse, txnEnded);
+};
+
+// A single write in a batch. The fields have the same meaning as in K23SIWriteRequest
+struct K23SIWriteBatchEntry {
+    bool isDelete = false;
+    ExistencePrecondition precondition = ExistencePrecondition::None;
+    uint64_t request_id;
+    Key key;
+    SKVRecord::Storage value;
+    std::vector<uint32_t> fieldsForPartialUpdate;
+
+    K2_PAYLOAD_FIELDS(isDelete, precondition, request_id, key, value, fieldsForPartialUpdate);
+    K2_DEF_FMT(K23SIWriteBatchEntry, isDelete, precondition, request_id, key, value, fieldsForPartialUpdate);
+};
+
+// Applies a number of writes from one transaction to a single partition. The writes must be for distinct keys;
+// a batch which contains the same key more than once is rejected with BadParameter
+struct K23SIWriteBatchRequest {
+    PVID pvid; // the partition version ID. Should be coming from an up-to-date partition map
+    String collectionName; // the name of the collection
+    K23SI_MTR mtr; // the MTR for the issuing transaction
+    Key trh; // the TRH key for the transaction, as in K23SIWriteRequest
+    String trhCollection; // the collection for the TRH
+    // if this is set, the server which receives the request will be designated the TRH. The routing key must
+    // be the TRH key in that case
+    bool designateTRH = false;
+    // use the name "key" so that we can use common routing from CPO client. This is the key of the first write
+    Key key;
+    std::vector<K23SIWriteBatchEntry> writes;
+
+    K2_PAYLOAD_FIELDS(pvid, collectionName, mtr, trh, trhCollection, designateTRH, key, writes);
+    K2_DEF_FMT(K23SIWriteBatchRequest, pvid, collectionName, mtr, trh, trhCollection, designateTRH, key, writes);
+};
+
+// The response for batched writes. Contains the status for each write, in request order
+struct K23SIWriteBatchResponse {
+    std::vector<Status> statuses;
+    K2_PAYLOAD_FIELDS(statuses);
+    K2_DEF_FMT(K23SIWriteBatchResponse, statuses);
 };
 
 struct K23SIQueryRequest {
@@ -247,6 +341,41 @@ struct K23SIQueryResponse {
     K2_DEF_FMT(K23SIQueryResponse, nextToScan, exclusiveToken, results);
 };
 
+// Opens a streaming query on the partition which owns query.key. Instead of returning one page per request, the
+// partition keeps a cursor for the scan and pushes the results back to the sender in K23SIQueryStreamChunk
+// messages, for as long as the sender has granted it credits
+struct K23SIQueryStreamOpenRequest {
+    uint64_t streamId; // chosen by the client. Identifies the stream among the streams of the client
+    uint32_t credits; // the number of records the partition may send before it has to wait for more credits
+    K23SIQueryRequest query;
+    K2_PAYLOAD_FIELDS(streamId, credits, query);
+    K2_DEF_FMT(K23SIQueryStreamOpenRequest, streamId, credits, query);
+};
+
+// Sent by the client of an open stream to grant the partition more credits, or to close the stream
+struct K23SIQueryStreamCreditRequest {
+    uint64_t streamId;
+    uint32_t credits;
+    bool close = false;
+    K2_PAYLOAD_FIELDS(streamId, credits, close);
+    K2_DEF_FMT(K23SIQueryStreamCreditRequest, streamId, credits, close);
+};
+
+// A chunk of results for a streaming query, pushed from the partition to the client
+struct K23SIQueryStreamChunk {
+    uint64_t streamId;
+    Status status; // the status of the scan. The stream is closed after a chunk with a non-OK status
+    std::vector<SKVRecord::Storage> results;
+    // set on the last chunk from this partition
+    bool done = false;
+    // where the scan continues after this chunk, with the same meaning as in K23SIQueryResponse. Allows the
+    // client to continue with regular query requests if the stream breaks
+    Key nextToScan;
+    bool exclusiveToken = false;
+    K2_PAYLOAD_FIELDS(streamId, status, results, done, nextToScan, exclusiveToken);
+    K2_DEF_FMT(K23SIQueryStreamChunk, streamId, status, results, done, nextToScan, exclusiveToken);
+};
+
 struct K23SITxnHeartbeatRequest {
     // the partition version ID for the TRH. Should be coming from an up-to-date partition map
     PVID pvid;
@@ -269,9 +398,15 @@ struct K23SITxnHeartbeatResponse {
 
 template <typename ValueType>
 struct K23SI_PersistenceRequest {
+    // the collection and partition which produced this batch. Used to find the batches for a partition on recovery.
+    // The full pvid makes sure that a partition never recovers the batches of an older assignment
+    String collectionName;
+    PVID pvid;
+    // the sequence number of this batch among all batches persisted by the partition
+    uint64_t sequence = 0;
     SerializeAsPayload<ValueType> value;  // the value of the write
-    K2_PAYLOAD_FIELDS(value);
-    K2_DEF_FMT(K23SI_PersistenceRequest);
+    K2_PAYLOAD_FIELDS(collectionName, pvid, sequence, value);
+    K2_DEF_FMT(K23SI_PersistenceRequest, collectionName, pvid, sequence);
 };
 
 struct K23SI_PersistenceResponse {
@@ -279,9 +414,83 @@ struct K23SI_PersistenceResponse {
     K2_DEF_FMT(K23SI_PersistenceResponse);
 };
 
+// Request to read back the batches persisted by a partition. The batches are returned in pages
 struct K23SI_PersistenceRecoveryRequest {
+    String collectionName;
+    // only the batches persisted with this exact pvid are returned
+    PVID pvid;
+    // the position from which to continue reading. Use the continuation from the previous response,
+    // or leave as default to start from the beginning
+    uint64_t continuationSegment = 0;
+    uint64_t continuationOffset = 0;
+    // the max number of log bytes to scan for this page
+    uint64_t maxBytes = 0;
+    // only return batches with sequence at or after this one
+    uint64_t fromSequence = 0;
+    K2_PAYLOAD_FIELDS(collectionName, pvid, continuationSegment, continuationOffset, maxBytes, fromSequence);
+    K2_DEF_FMT(K23SI_PersistenceRecoveryRequest, collectionName, pvid, continuationSegment, continuationOffset, maxBytes, fromSequence);
+};
+
+struct K23SI_PersistenceRecoveryResponse {
+    // the batches for the partition found in this page, in the order in which they were persisted
+    std::vector<K23SI_PersistenceRequest<Payload>> batches;
+    // where to continue reading for the next page
+    uint64_t continuationSegment = 0;
+    uint64_t continuationOffset = 0;
+    // set when we reached the end of the log
+    bool done = false;
+    K2_PAYLOAD_FIELDS(batches, continuationSegment, continuationOffset, done);
+    K2_DEF_FMT(K23SI_PersistenceRecoveryResponse, continuationSegment, continuationOffset, done);
+};
+
+// Request to write a chunk of a snapshot of a partition. The chunks of a snapshot are written in order, and the
+// snapshot replaces the previous snapshot of the partition once its last chunk is written
+struct K23SI_PersistenceSnapshotRequest {
+    String collectionName;
+    uint64_t partitionId = 0;
+    // The sequence of the first batch which may not be reflected in the snapshot. It identifies the snapshot, and
+    // recovery replays the batches from this sequence on top of the snapshot
+    uint64_t startSequence = 0;
+    // the index of this chunk in the snapshot
+    uint64_t chunkId = 0;
+    // set for the last chunk of the snapshot
+    bool last = false;
+    Payload data;
+    K2_PAYLOAD_FIELDS(collectionName, partitionId, startSequence, chunkId, last, data);
+    K2_DEF_FMT(K23SI_PersistenceSnapshotRequest, collectionName, partitionId, startSequence, chunkId, last);
+};
+
+struct K23SI_PersistenceSnapshotResponse {
     K2_PAYLOAD_EMPTY;
-    K2_DEF_FMT(K23SI_PersistenceRecoveryRequest);
+    K2_DEF_FMT(K23SI_PersistenceSnapshotResponse);
+};
+
+// Request to read back the latest snapshot of a partition. The chunks are returned in pages
+struct K23SI_PersistenceSnapshotReadRequest {
+    String collectionName;
+    uint64_t partitionId = 0;
+    // the position from which to continue reading. Use the continuation from the previous response,
+    // or 0 to start from the beginning
+    uint64_t continuationOffset = 0;
+    // the max number of snapshot bytes to return in this page. Use 0 to only find out if there is a snapshot
+    uint64_t maxBytes = 0;
+    K2_PAYLOAD_FIELDS(collectionName, partitionId, continuationOffset, maxBytes);
+    K2_DEF_FMT(K23SI_PersistenceSnapshotReadRequest, collectionName, partitionId, continuationOffset, maxBytes);
+};
+
+struct K23SI_PersistenceSnapshotReadResponse {
+    // set if there is a snapshot for the partition
+    bool found = false;
+    // the start sequence of the snapshot
+    uint64_t startSequence = 0;
+    // the chunks in this page, in order
+    std::vector<Payload> chunks;
+    // where to continue reading for the next page
+    uint64_t continuationOffset = 0;
+    // set when we reached the end of the snapshot
+    bool done = false;
+    K2_PAYLOAD_FIELDS(found, startSequence, chunks, continuationOffset, done);
+    K2_DEF_FMT(K23SI_PersistenceSnapshotReadResponse, found, startSequence, continuationOffset, done);
 };
 
 struct K23SI_PersistencePartialUpdate {
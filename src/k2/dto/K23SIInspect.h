@@ -46,7 +46,9 @@ struct K23SIInspectRecordsRequest {
 
 struct K23SIInspectRecordsResponse {
     std::vector<DataRecord> records;
-    K2_PAYLOAD_FIELDS(records);
+    // the latest timestamp at which the key was observed by reads, as tracked in the read cache
+    Timestamp lastReadTime;
+    K2_PAYLOAD_FIELDS(records, lastReadTime);
 };
 
 // Requests the TRH of a transaction without affecting transaction state
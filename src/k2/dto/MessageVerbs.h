@@ -70,6 +70,17 @@ enum Verbs : k2::Verb {
     K23SI_TXN_FINALIZE,
     K23SI_PUSH_SCHEMA,
     K23SI_QUERY,
+    // K23SI reads of multiple keys from one partition
+    K23SI_READ_BATCH,
+    // K23SI writes of multiple keys to one partition
+    K23SI_WRITE_BATCH,
+    // K23SI streaming queries: open a stream, grant credits to (or close) an open stream, and the chunks of
+    // results which a partition pushes to the client
+    K23SI_QUERY_STREAM_OPEN,
+    K23SI_QUERY_STREAM_CREDIT,
+    K23SI_QUERY_STREAM_CHUNK,
+    // K23SI last write of a txn, which commits the txn if it lands on the TRH partition
+    K23SI_WRITE_AND_COMMIT,
 
     /************ K23SI Persistence *****************/
     K23SI_Persist = 80,
@@ -78,6 +89,11 @@ enum Verbs : k2::Verb {
     PLOG_READ,
     PLOG_SEAL,
     PLOG_GET_STATUS,
+    // read back the data persisted by a K23SI partition
+    K23SI_Persist_Recovery,
+    // write and read back the snapshots of K23SI partitions
+    K23SI_Persist_Snapshot,
+    K23SI_Persist_Snapshot_Read,
     /************ K23SI Inspection ******************/
     K23SI_INSPECT_RECORDS = 100,
     K23SI_INSPECT_TXN,
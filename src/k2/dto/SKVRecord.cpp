@@ -51,44 +51,60 @@ void SKVRecord::serializeNull() {
         storage.excludedFields = std::vector<bool>(schema->fields.size(), false);
     }
 
+    noteFieldOffset(fieldCursor);
     storage.excludedFields[fieldCursor] = true;
     ++fieldCursor;
 }
 
-// NoOp function to be used with the convience macros to get document fields
-template <typename T>
-void NoOp(std::optional<T> value, const String& fieldName, int n) {
-    (void) value;
-    (void) fieldName;
-    (void) n;
-};
-
 uint32_t SKVRecord::getFieldCursor() const {
     return fieldCursor;
 }
 
-void SKVRecord::seekField(uint32_t fieldIndex) {
-    if (fieldIndex > schema->fields.size()) {
-        throw NoFieldFoundException();
+template <typename T>
+void skipFieldHelper(const SchemaField& field, Payload& fieldData, bool& success) {
+    (void) field;
+    size_t size = fieldData.getSerializedSizeOf<T>();
+    success = size > 0 && size <= fieldData.getDataRemaining();
+    if (success) {
+        fieldData.skip(size);
     }
+}
 
-    if (fieldIndex == fieldCursor) {
+void SKVRecord::buildFieldOffsets(uint32_t fieldIndex) {
+    auto& offsets = storage.fieldOffsets;
+    if (offsets.size() > fieldIndex) {
         return;
     }
-
-    if (fieldIndex < fieldCursor) {
-        fieldCursor = 0;
-        storage.fieldData.seek(0);
+    if (offsets.empty()) {
+        offsets.push_back(0);
     }
 
-    while(fieldIndex != fieldCursor) {
-        if (storage.excludedFields.size() > 0 && storage.excludedFields[fieldCursor]) {
-            ++fieldCursor;
-            continue;
+    // continue from the last field we know the offset of, skipping over the field data without decoding it
+    storage.fieldData.seek(offsets.back());
+    for (uint32_t i = offsets.size() - 1; i < fieldIndex; ++i) {
+        if (storage.excludedFields.empty() || !storage.excludedFields[i]) {
+            bool success = false;
+            K2_DTO_CAST_APPLY_FIELD_VALUE(skipFieldHelper, schema->fields[i], storage.fieldData, success);
+            if (!success) {
+                throw DeserializationError(fmt::format("Unable to skip over field {} in SKVRecord", i));
+            }
         }
+        offsets.push_back(storage.fieldData.getCurrentPosition().offset);
+    }
+}
+
+void SKVRecord::seekField(uint32_t fieldIndex) {
+    if (fieldIndex > schema->fields.size()) {
+        throw NoFieldFoundException();
+    }
 
-        DO_ON_NEXT_RECORD_FIELD((*this), NoOp, 0);
+    if (fieldIndex == fieldCursor) {
+        return;
     }
+
+    buildFieldOffsets(fieldIndex);
+    storage.fieldData.seek(storage.fieldOffsets[fieldIndex]);
+    fieldCursor = fieldIndex;
 }
 
 // We expose the storage in case the user wants to write it to file or otherwise
@@ -225,7 +241,8 @@ SKVRecord::Storage SKVRecord::Storage::share() {
     return SKVRecord::Storage {
         excludedFields,
         fieldData.shareAll(),
-        schemaVersion
+        schemaVersion,
+        fieldOffsets
     };
 }
 
@@ -233,7 +250,8 @@ SKVRecord::Storage SKVRecord::Storage::copy() {
     return SKVRecord::Storage {
         excludedFields,
         fieldData.copy(),
-        schemaVersion
+        schemaVersion,
+        fieldOffsets
     };
 }
 
@@ -286,6 +304,8 @@ SKVRecord SKVRecord::getSKVKeyRecord() {
     }
     key_storage.fieldData.truncateToCurrent();
     key_storage.fieldData.seek(0);
+    // the offsets of the key fields are still valid, and all the fields after them start at the end of the data
+    key_storage.fieldOffsets.resize(std::min(key_storage.fieldOffsets.size(), num_keys + 1));
 
     return SKVRecord(collectionName, schema, std::move(key_storage), true);
 }
@@ -91,6 +91,7 @@ public:
             }
         }
 
+        noteFieldOffset(fieldCursor);
         storage.fieldData.write(field);
         ++fieldCursor;
     }
@@ -146,9 +147,11 @@ public:
             seekField(fieldIndex);
         }
 
+        noteFieldOffset(fieldIndex);
         ++fieldCursor;
 
         if (storage.excludedFields.size() > 0 && storage.excludedFields[fieldIndex]) {
+            noteFieldOffset(fieldCursor);
             return null_val;
         }
 
@@ -157,6 +160,7 @@ public:
         if (!success) {
             throw DeserializationError("Deserialization of payload in SKVRecord failed");
         }
+        noteFieldOffset(fieldCursor);
 
         return value;
     }
@@ -200,6 +204,11 @@ public:
         std::vector<bool> excludedFields;
         Payload fieldData;
         uint32_t schemaVersion = 0;
+        // The offset of each field in fieldData, indexed by field, plus the end offset of the last field.
+        // Excluded fields have the same offset as the field which follows them. The index isn't serialized:
+        // it is filled in as the record is written and built on demand for records we receive, so that
+        // seeking to any field is O(1) once the index covers it
+        std::vector<uint32_t> fieldOffsets;
 
         Storage share();
         Storage copy();
@@ -237,6 +246,15 @@ public:
     }
 
 private:
+    // Records the current payload position as the offset of the given field, if that is the next field
+    // missing from the offset index
+    void noteFieldOffset(uint32_t fieldIndex) {
+        if (storage.fieldOffsets.size() == fieldIndex) {
+            storage.fieldOffsets.push_back(storage.fieldData.getCurrentPosition().offset);
+        }
+    }
+    // Extends the offset index so that it covers the given field index
+    void buildFieldOffsets(uint32_t fieldIndex);
     void constructKeyStrings();
     template <typename T>
     void makeKeyString(std::optional<T> value, const String& fieldName, int tmp);
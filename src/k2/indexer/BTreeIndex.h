@@ -0,0 +1,606 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace k2::indexer {
+
+// An ordered in-memory index, implemented as a B+tree with a std::map-like interface.
+//
+// Each node keeps an inline, cache-line aligned array of 8-byte key heads. A head is an order-preserving
+// slice of the key bytes, taken right after the prefix which all keys in the node have in common
+// (i.e. the heads are prefix-compressed). Searching within a node is a search over this array and we only
+// look at the full keys when the heads of the search key and a node key are equal.
+//
+// The entries themselves are allocated out of line and never move once inserted. This keeps
+// pointers and references to keys and values stable across inserts and erases, the same as std::map.
+// Iterators however are invalidated by any insert or erase.
+//
+// Leaves are removed from the tree when they become empty, but partially-filled nodes are not merged.
+//
+// The KeyTraits type describes the keys as a sequence of byte segments, e.g. (partitionKey, rangeKey):
+//   static constexpr size_t segments;                           // the number of segments in each key
+//   static std::string_view segment(const K& key, size_t idx);  // the bytes of the given segment
+//   static int compare(const K& a, const K& b);                 // three-way comparison of two keys
+// The comparison must order keys the same way as comparing their segments in turn, each one
+// lexicographically as unsigned bytes.
+template <typename K, typename V, typename KeyTraits, uint16_t Capacity=16>
+class BTreeIndex {
+    static_assert(Capacity >= 4, "node capacity is too small");
+    static_assert(KeyTraits::segments > 0, "keys must have at least one segment");
+
+public: // types
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<const K, V> value_type;
+    typedef size_t size_type;
+
+private: // nodes
+    struct Node {
+        // the heads of the keys in this node. See _refreshHeads()
+        alignas(64) uint64_t heads[Capacity];
+        // number of keys in this node
+        uint16_t count{0};
+        bool isLeaf{true};
+        // All keys in the node are equal in segments [0, prefixSegment) and they share the first
+        // prefixLen bytes of segment prefixSegment. The heads are taken from that segment after the prefix.
+        uint32_t prefixSegment{0};
+        uint32_t prefixLen{0};
+    };
+
+    struct Leaf : Node {
+        value_type* entries[Capacity];
+        // leaves are linked to allow for iteration
+        Leaf* prev{nullptr};
+        Leaf* next{nullptr};
+    };
+
+    struct Inner : Node {
+        Inner() { this->isLeaf = false; }
+        // keys[i] is the smallest key which can be found under children[i+1]
+        K keys[Capacity - 1];
+        Node* children[Capacity];
+    };
+
+public: // iterators
+    template <bool Const>
+    class Iter {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef typename BTreeIndex::value_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::conditional_t<Const, const value_type*, value_type*> pointer;
+        typedef std::conditional_t<Const, const value_type&, value_type&> reference;
+
+        Iter() = default;
+        Iter(const BTreeIndex* tree, Leaf* leaf, uint16_t idx) : _tree(tree), _leaf(leaf), _idx(idx) {}
+
+        // allow conversion from iterator to const_iterator
+        template <bool C = Const, typename = std::enable_if_t<C>>
+        Iter(const Iter<false>& o) : _tree(o._tree), _leaf(o._leaf), _idx(o._idx) {}
+
+        reference operator*() const { return *_leaf->entries[_idx]; }
+        pointer operator->() const { return _leaf->entries[_idx]; }
+
+        Iter& operator++() {
+            if (++_idx == _leaf->count) {
+                _leaf = _leaf->next;
+                _idx = 0;
+            }
+            return *this;
+        }
+        Iter operator++(int) {
+            Iter result = *this;
+            ++(*this);
+            return result;
+        }
+        Iter& operator--() {
+            if (_leaf == nullptr) {
+                // decrementing end() takes us to the last element
+                _leaf = _tree->_last;
+                _idx = _leaf->count - 1;
+            } else if (_idx == 0) {
+                _leaf = _leaf->prev;
+                _idx = _leaf->count - 1;
+            } else {
+                --_idx;
+            }
+            return *this;
+        }
+        Iter operator--(int) {
+            Iter result = *this;
+            --(*this);
+            return result;
+        }
+
+        friend bool operator==(const Iter& a, const Iter& b) { return a._leaf == b._leaf && a._idx == b._idx; }
+        friend bool operator!=(const Iter& a, const Iter& b) { return !(a == b); }
+
+    private:
+        friend class BTreeIndex;
+        template <bool> friend class Iter;
+        const BTreeIndex* _tree{nullptr};
+        // end() is represented with a null leaf
+        Leaf* _leaf{nullptr};
+        uint16_t _idx{0};
+    };
+    typedef Iter<false> iterator;
+    typedef Iter<true> const_iterator;
+
+public: // lifecycle
+    BTreeIndex() = default;
+    ~BTreeIndex() { clear(); }
+    BTreeIndex(const BTreeIndex&) = delete;
+    BTreeIndex& operator=(const BTreeIndex&) = delete;
+    BTreeIndex(BTreeIndex&& o) noexcept { _steal(o); }
+    BTreeIndex& operator=(BTreeIndex&& o) noexcept {
+        if (this != &o) {
+            clear();
+            _steal(o);
+        }
+        return *this;
+    }
+
+public: // API
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+
+    iterator begin() { return iterator(this, _first, 0); }
+    iterator end() { return iterator(this, nullptr, 0); }
+    const_iterator begin() const { return const_iterator(this, _first, 0); }
+    const_iterator end() const { return const_iterator(this, nullptr, 0); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+    // the first element not less than the given key
+    iterator lower_bound(const K& key) { return _bound<false>(key); }
+    const_iterator lower_bound(const K& key) const { return const_cast<BTreeIndex*>(this)->template _bound<false>(key); }
+
+    // the first element greater than the given key
+    iterator upper_bound(const K& key) { return _bound<true>(key); }
+    const_iterator upper_bound(const K& key) const { return const_cast<BTreeIndex*>(this)->template _bound<true>(key); }
+
+    iterator find(const K& key) {
+        auto it = lower_bound(key);
+        return (it != end() && KeyTraits::compare(it->first, key) == 0) ? it : end();
+    }
+    const_iterator find(const K& key) const { return const_cast<BTreeIndex*>(this)->find(key); }
+
+    std::pair<iterator, iterator> equal_range(const K& key) {
+        auto lower = lower_bound(key);
+        auto upper = lower;
+        if (upper != end() && KeyTraits::compare(upper->first, key) == 0) {
+            ++upper;
+        }
+        return {lower, upper};
+    }
+
+    // Inserts a value for the given key, constructed from the given args, if the key isn't in the index.
+    // Returns an iterator to the element for the key and a flag indicating if an insert took place
+    template <typename KK, typename... Args>
+    std::pair<iterator, bool> try_emplace(KK&& key, Args&&... args) {
+        if (_root == nullptr) {
+            auto* leaf = new Leaf();
+            _root = _first = _last = leaf;
+        }
+        Leaf* leaf = _descend(key, true);
+        uint16_t pos = _search(leaf, key, false);
+        if (pos < leaf->count && KeyTraits::compare(leaf->entries[pos]->first, key) == 0) {
+            return {iterator(this, leaf, pos), false};
+        }
+        auto* entry = new value_type(std::piecewise_construct,
+                                     std::forward_as_tuple(std::forward<KK>(key)),
+                                     std::forward_as_tuple(std::forward<Args>(args)...));
+        return {_insertEntry(leaf, pos, entry), true};
+    }
+
+    template <typename P>
+    std::pair<iterator, bool> insert(P&& p) {
+        return try_emplace(std::forward<P>(p).first, std::forward<P>(p).second);
+    }
+
+    // The hint is accepted for compatibility with std::map, but we always descend from the root
+    template <typename P>
+    iterator insert(const_iterator, P&& p) {
+        return insert(std::forward<P>(p)).first;
+    }
+
+    template <typename KK, typename... Args>
+    iterator emplace_hint(const_iterator, KK&& key, Args&&... args) {
+        return try_emplace(std::forward<KK>(key), std::forward<Args>(args)...).first;
+    }
+
+    // Removes the element at the given position. Returns an iterator to the element which followed it.
+    iterator erase(const_iterator it) {
+        Leaf* leaf = it._leaf;
+        uint16_t pos = it._idx;
+        --_size;
+        if (leaf->count > 1) {
+            delete leaf->entries[pos];
+            std::copy(leaf->entries + pos + 1, leaf->entries + leaf->count, leaf->entries + pos);
+            --leaf->count;
+            _eraseHead(leaf, pos);
+            return _makeIter(leaf, pos);
+        }
+
+        // The leaf becomes empty and has to be removed. Find the path to it before we drop the key
+        _descend(leaf->entries[0]->first, true);
+        delete leaf->entries[0];
+        Leaf* next = leaf->next;
+        _unlinkLeaf(leaf);
+        _removeNode(_path.size(), leaf);
+        return iterator(this, next, 0);
+    }
+
+    size_t erase(const K& key) {
+        auto it = find(key);
+        if (it == end()) {
+            return 0;
+        }
+        erase(it);
+        return 1;
+    }
+
+    void clear() {
+        if (_root != nullptr) {
+            _free(_root);
+        }
+        _root = nullptr;
+        _first = _last = nullptr;
+        _size = 0;
+    }
+
+private: // helpers
+    // an entry in a root-to-leaf path: the inner node and the index of the child we took
+    struct PathEntry {
+        Inner* node;
+        uint16_t idx;
+    };
+
+    void _steal(BTreeIndex& o) {
+        _root = std::exchange(o._root, nullptr);
+        _first = std::exchange(o._first, nullptr);
+        _last = std::exchange(o._last, nullptr);
+        _size = std::exchange(o._size, 0);
+    }
+
+    static const K& _keyAt(const Node* n, uint16_t i) {
+        if (n->isLeaf) {
+            return static_cast<const Leaf*>(n)->entries[i]->first;
+        }
+        return static_cast<const Inner*>(n)->keys[i];
+    }
+
+    // Big-endian 8 bytes of the given segment starting at the given offset, padded with zeros.
+    // Comparing heads as integers orders them the same as comparing the bytes lexicographically, and
+    // a strictly smaller head means a strictly smaller segment.
+    static uint64_t _head(std::string_view seg, size_t offset) {
+        if (offset + sizeof(uint64_t) <= seg.size()) {
+            uint64_t h;
+            std::memcpy(&h, seg.data() + offset, sizeof(h));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            h = __builtin_bswap64(h);
+#endif
+            return h;
+        }
+        uint64_t h = 0;
+        for (size_t i = 0; i < sizeof(uint64_t); ++i) {
+            h <<= 8;
+            if (offset + i < seg.size()) {
+                h |= static_cast<uint8_t>(seg[offset + i]);
+            }
+        }
+        return h;
+    }
+
+    // Recompute the common prefix and all heads in the node. Since the keys in the node are sorted,
+    // the prefix common to all keys is the prefix common to the first and the last key.
+    static void _refreshHeads(Node* n) {
+        n->prefixSegment = 0;
+        n->prefixLen = 0;
+        if (n->count == 0) {
+            return;
+        }
+        const K& first = _keyAt(n, 0);
+        const K& last = _keyAt(n, n->count - 1);
+        size_t seg = 0;
+        while (seg + 1 < KeyTraits::segments && KeyTraits::segment(first, seg) == KeyTraits::segment(last, seg)) {
+            ++seg;
+        }
+        auto a = KeyTraits::segment(first, seg);
+        auto b = KeyTraits::segment(last, seg);
+        auto len = std::min(a.size(), b.size());
+        n->prefixSegment = seg;
+        n->prefixLen = std::mismatch(a.begin(), a.begin() + len, b.begin()).first - a.begin();
+        for (uint16_t i = 0; i < n->count; ++i) {
+            n->heads[i] = _head(KeyTraits::segment(_keyAt(n, i), seg), n->prefixLen);
+        }
+    }
+
+    // Update the heads after a key was inserted at the given position (count already includes the new key).
+    // A key inserted between two existing keys shares their prefix so only its head needs computing.
+    // A new first or last key may shorten the prefix so we recompute everything.
+    static void _insertHead(Node* n, uint16_t pos) {
+        if (pos == 0 || pos + 1 == n->count) {
+            _refreshHeads(n);
+            return;
+        }
+        std::memmove(n->heads + pos + 1, n->heads + pos, (n->count - 1 - pos) * sizeof(uint64_t));
+        n->heads[pos] = _head(KeyTraits::segment(_keyAt(n, pos), n->prefixSegment), n->prefixLen);
+    }
+
+    // Update the heads after the key at the given position was removed (count already excludes it).
+    // Removing keys can only make the common prefix longer, so the current prefix remains valid.
+    static void _eraseHead(Node* n, uint16_t pos) {
+        std::memmove(n->heads + pos, n->heads + pos + 1, (n->count - pos) * sizeof(uint64_t));
+    }
+
+    // Find the first position in the node where the key is greater than (upper=true) or not less
+    // than (upper=false) the given key
+    static uint16_t _search(const Node* n, const K& key, bool upper) {
+        const uint16_t count = n->count;
+        if (count == 0) {
+            return 0;
+        }
+        // check the search key against the prefix of the node first
+        const K& ref = _keyAt(n, 0);
+        for (size_t s = 0; s < n->prefixSegment; ++s) {
+            int c = KeyTraits::segment(key, s).compare(KeyTraits::segment(ref, s));
+            if (c != 0) {
+                return c < 0 ? 0 : count;
+            }
+        }
+        auto kseg = KeyTraits::segment(key, n->prefixSegment);
+        int c = kseg.substr(0, n->prefixLen).compare(KeyTraits::segment(ref, n->prefixSegment).substr(0, n->prefixLen));
+        if (c != 0) {
+            return c < 0 ? 0 : count;
+        }
+
+        // Same prefix. Keys with smaller heads are smaller and keys with bigger heads are bigger than
+        // the search key, so we only need full comparisons for the keys with an equal head
+        const uint64_t h = _head(kseg, n->prefixLen);
+        const uint64_t* heads = n->heads;
+        uint16_t lo = std::lower_bound(heads, heads + count, h) - heads;
+        uint16_t hi = std::upper_bound(heads + lo, heads + count, h) - heads;
+        for (; lo < hi; ++lo) {
+            int cmp = KeyTraits::compare(_keyAt(n, lo), key);
+            if (cmp > 0 || (cmp == 0 && !upper)) {
+                break;
+            }
+        }
+        return lo;
+    }
+
+    // Descend to the leaf which should contain the given key, optionally recording the path in _path
+    Leaf* _descend(const K& key, bool recordPath) {
+        if (recordPath) {
+            _path.clear();
+        }
+        Node* n = _root;
+        while (!n->isLeaf) {
+            auto* in = static_cast<Inner*>(n);
+            // children[i] holds keys in [keys[i-1], keys[i])
+            uint16_t idx = _search(in, key, true);
+            if (recordPath) {
+                _path.push_back(PathEntry{in, idx});
+            }
+            n = in->children[idx];
+        }
+        return static_cast<Leaf*>(n);
+    }
+
+    template <bool Upper>
+    iterator _bound(const K& key) {
+        if (_root == nullptr) {
+            return end();
+        }
+        Leaf* leaf = _descend(key, false);
+        return _makeIter(leaf, _search(leaf, key, Upper));
+    }
+
+    // make an iterator for the given position, moving to the next leaf if we're past the end of this one
+    iterator _makeIter(Leaf* leaf, uint16_t pos) {
+        if (pos == leaf->count) {
+            return iterator(this, leaf->next, 0);
+        }
+        return iterator(this, leaf, pos);
+    }
+
+    static void _leafInsert(Leaf* leaf, uint16_t pos, value_type* entry) {
+        std::copy_backward(leaf->entries + pos, leaf->entries + leaf->count, leaf->entries + leaf->count + 1);
+        leaf->entries[pos] = entry;
+        ++leaf->count;
+        _insertHead(leaf, pos);
+    }
+
+    // Insert the entry at the given position in the leaf found by the last recorded descent,
+    // splitting nodes as needed
+    iterator _insertEntry(Leaf* leaf, uint16_t pos, value_type* entry) {
+        ++_size;
+        if (leaf->count < Capacity) {
+            _leafInsert(leaf, pos, entry);
+            return iterator(this, leaf, pos);
+        }
+
+        // the leaf is full: move its upper half into a new leaf
+        constexpr uint16_t mid = Capacity / 2;
+        auto* right = new Leaf();
+        std::copy(leaf->entries + mid, leaf->entries + Capacity, right->entries);
+        right->count = Capacity - mid;
+        leaf->count = mid;
+        right->prev = leaf;
+        right->next = leaf->next;
+        if (right->next != nullptr) {
+            right->next->prev = right;
+        } else {
+            _last = right;
+        }
+        leaf->next = right;
+        _refreshHeads(leaf);
+        _refreshHeads(right);
+
+        Leaf* target = leaf;
+        if (pos > mid) {
+            target = right;
+            pos -= mid;
+        }
+        _leafInsert(target, pos, entry);
+        _insertIntoParent(_path.size(), leaf, K(right->entries[0]->first), right);
+        return iterator(this, target, pos);
+    }
+
+    // Link a new right sibling created by splitting the node at the given depth (0 is the root)
+    void _insertIntoParent(size_t level, Node* left, K&& sep, Node* right) {
+        if (level == 0) {
+            // we split the root. Grow the tree
+            auto* root = new Inner();
+            root->keys[0] = std::move(sep);
+            root->children[0] = left;
+            root->children[1] = right;
+            root->count = 1;
+            _refreshHeads(root);
+            _root = root;
+            return;
+        }
+
+        auto [parent, idx] = _path[level - 1];
+        if (parent->count < Capacity - 1) {
+            std::move_backward(parent->keys + idx, parent->keys + parent->count, parent->keys + parent->count + 1);
+            parent->keys[idx] = std::move(sep);
+            std::copy_backward(parent->children + idx + 1, parent->children + parent->count + 1, parent->children + parent->count + 2);
+            parent->children[idx + 1] = right;
+            ++parent->count;
+            _insertHead(parent, idx);
+            return;
+        }
+
+        // The parent is full. Lay out all keys and children, including the new ones, and split them
+        // around the middle key which moves up to the grandparent
+        K keys[Capacity];
+        Node* children[Capacity + 1];
+        std::move(parent->keys, parent->keys + idx, keys);
+        keys[idx] = std::move(sep);
+        std::move(parent->keys + idx, parent->keys + Capacity - 1, keys + idx + 1);
+        std::copy(parent->children, parent->children + idx + 1, children);
+        children[idx + 1] = right;
+        std::copy(parent->children + idx + 1, parent->children + Capacity, children + idx + 2);
+
+        constexpr uint16_t mid = Capacity / 2;
+        auto* sibling = new Inner();
+        std::move(keys, keys + mid, parent->keys);
+        std::copy(children, children + mid + 1, parent->children);
+        parent->count = mid;
+        std::move(keys + mid + 1, keys + Capacity, sibling->keys);
+        std::copy(children + mid + 1, children + Capacity + 1, sibling->children);
+        sibling->count = Capacity - mid - 1;
+        _refreshHeads(parent);
+        _refreshHeads(sibling);
+        _insertIntoParent(level - 1, parent, std::move(keys[mid]), sibling);
+    }
+
+    void _unlinkLeaf(Leaf* leaf) {
+        if (leaf->prev != nullptr) {
+            leaf->prev->next = leaf->next;
+        } else {
+            _first = leaf->next;
+        }
+        if (leaf->next != nullptr) {
+            leaf->next->prev = leaf->prev;
+        } else {
+            _last = leaf->prev;
+        }
+    }
+
+    // Remove an empty node found at the given depth of the last recorded path (0 is the root)
+    void _removeNode(size_t level, Node* node) {
+        _deleteNode(node);
+        if (level == 0) {
+            _root = nullptr;
+            return;
+        }
+        auto [parent, idx] = _path[level - 1];
+        if (parent->count == 0) {
+            // this was the only child of the parent so the parent goes away as well
+            _removeNode(level - 1, parent);
+            return;
+        }
+        // drop the child along with one of the separators around it. The neighboring child absorbs its key range
+        uint16_t kpos = idx > 0 ? idx - 1 : 0;
+        std::move(parent->keys + kpos + 1, parent->keys + parent->count, parent->keys + kpos);
+        parent->keys[parent->count - 1] = K{};
+        std::copy(parent->children + idx + 1, parent->children + parent->count + 1, parent->children + idx);
+        --parent->count;
+        _eraseHead(parent, kpos);
+
+        // shrink the tree if the root is left with a single child
+        while (!_root->isLeaf && _root->count == 0) {
+            auto* oldRoot = static_cast<Inner*>(_root);
+            _root = oldRoot->children[0];
+            delete oldRoot;
+        }
+    }
+
+    static void _deleteNode(Node* n) {
+        if (n->isLeaf) {
+            delete static_cast<Leaf*>(n);
+        } else {
+            delete static_cast<Inner*>(n);
+        }
+    }
+
+    static void _free(Node* n) {
+        if (n->isLeaf) {
+            auto* leaf = static_cast<Leaf*>(n);
+            for (uint16_t i = 0; i < leaf->count; ++i) {
+                delete leaf->entries[i];
+            }
+        } else {
+            auto* in = static_cast<Inner*>(n);
+            for (uint16_t i = 0; i <= in->count; ++i) {
+                _free(in->children[i]);
+            }
+        }
+        _deleteNode(n);
+    }
+
+private: // fields
+    Node* _root{nullptr};
+    // the first and last leaves, used for iteration
+    Leaf* _first{nullptr};
+    Leaf* _last{nullptr};
+    size_t _size{0};
+    // scratch space for the root-to-leaf path in inserts and erases. Kept here to avoid allocating per operation
+    std::vector<PathEntry> _path;
+};
+
+} // namespace k2::indexer
@@ -53,6 +53,16 @@ struct K23SIConfig {
     // how many writes to finalize in parallel
     ConfigVar<uint64_t> finalizeBatchSize{"k23si_txn_finalize_batch_size", 20};
 
+    // finalize txns which only wrote to their TRH partition in place, as part of ending the txn
+    ConfigVar<bool> onePhaseCommit{"k23si_one_phase_commit", true};
+
+    // hand pushes for TRHs hosted on this node to their core directly, instead of sending them as RPCs
+    ConfigVar<bool> localPush{"k23si_local_push", true};
+
+    // for testing only: the TRH refuses pushes handed to its core directly, as it does when its heartbeat is dead,
+    // so that they fall back to RPCs
+    ConfigVar<bool> localPushRefuse{"k23si_local_push_refuse", false};
+
     // Max number of records to return in a single query response
     ConfigVar<uint32_t> paginationLimit{"k23si_query_pagination_limit", 10};
 
@@ -69,8 +79,50 @@ struct K23SIConfig {
     ConfigVar<std::vector<String>> persistenceEndpoint{"k23si_persistence_endpoints"};
     ConfigDuration persistenceTimeout{"k23si_persistence_timeout", 10s};
     ConfigDuration persistenceAutoflushDeadline{"k23si_autoflush_deadline", 1s};
+    // the max number of log bytes the persistence scans for each page we read back on recovery
+    ConfigVar<uint64_t> recoveryReadSize{"k23si_recovery_read_size", 4 * 1024 * 1024};
 
     // maximum push count for a key during handleRead() and handWrite()
     ConfigVar<uint32_t> maxPushCount{"k23si_max_push_count", 1};
+
+    // How long a request which lost a push against an in-progress txn waits for the incumbent WI to be finalized
+    // before it is aborted. Zero disables waiting, i.e. such requests are aborted right away
+    ConfigDuration conflictWaitTimeout{"k23si_conflict_wait_timeout", 0s};
+
+    // How far behind the TSO time a partition closes timestamps. Writes at or below the closed timestamp are
+    // rejected, which allows snapshot reads at or below it to skip the read cache. Zero only closes timestamps
+    // up to the retention timestamp
+    ConfigDuration closedTimestampLag{"k23si_closed_timestamp_lag", 0s};
+
+    // how often to advance the closed timestamp, when a lag is configured
+    ConfigDuration closedTimestampUpdateInterval{"k23si_closed_timestamp_update_interval", 1s};
+
+    // how often to run a garbage collection pass over the indexer, reclaiming versions outside the retention window
+    ConfigDuration gcInterval{"k23si_gc_interval", 10s};
+
+    // the max amount of time a single GC slice can run on the reactor before it yields
+    ConfigDuration gcSliceBudget{"k23si_gc_slice_budget", 200us};
+
+    // the pause between consecutive GC slices in a pass
+    ConfigDuration gcSlicePause{"k23si_gc_slice_pause", 1ms};
+
+    // How often to write a snapshot of the partition to persistence. Recovery loads the latest snapshot and only
+    // replays the log after it. Zero disables snapshots
+    ConfigDuration snapshotInterval{"k23si_snapshot_interval", 60s};
+
+    // the max amount of time a single snapshot slice can run on the reactor before it yields
+    ConfigDuration snapshotSliceBudget{"k23si_snapshot_slice_budget", 200us};
+
+    // the pause between consecutive snapshot slices
+    ConfigDuration snapshotSlicePause{"k23si_snapshot_slice_pause", 1ms};
+
+    // snapshots are sent to persistence in chunks of about this size
+    ConfigVar<uint64_t> snapshotChunkSize{"k23si_snapshot_chunk_size", 1024 * 1024};
+
+    // the max number of records we send in a single chunk of a streaming query
+    ConfigVar<uint32_t> queryStreamChunkSize{"k23si_query_stream_chunk_size", 100};
+
+    // streaming queries which see no activity from the client for this long are closed
+    ConfigDuration queryStreamIdleTimeout{"k23si_query_stream_idle_timeout", 10s};
 };
 }
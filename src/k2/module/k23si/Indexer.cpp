@@ -25,6 +25,7 @@ Copyright(c) 2022 Futurewei Cloud
 
 #include <k2/common/MapUtil.h>
 
+#include <algorithm>
 #include <iterator>
 
 namespace k2 {
@@ -56,6 +57,10 @@ seastar::future<> Indexer::start(dto::Timestamp createdTs) {
 }
 
 seastar::future<> Indexer::stop() {
+    // dropping the promises fails anyone still waiting for a WI
+    for (auto& [schemaName, si]: _schemaIndexer) {
+        si.waiters.clear();
+    }
     return seastar::make_ready_future();
 }
 
@@ -63,15 +68,94 @@ const Indexer::SchemaIndexer& Indexer::getSchemaIndexer() const {
     return _schemaIndexer;
 }
 
+std::tuple<uint64_t, seastar::future<>> Indexer::waitForWI(const dto::Key& key) {
+    auto& si = _getOrCreateKeyIndexer(key.schemaName);
+    auto& queue = si.waiters[IndexerKey{key.partitionKey, key.rangeKey}];
+    auto id = _nextWaiterId++;
+    queue.push_back(KeyIndexer::Waiter{.id=id, .promise=seastar::promise<>()});
+    return {id, queue.back().promise.get_future()};
+}
+
+void Indexer::removeWaiter(const dto::Key& key, uint64_t waiterId) {
+    auto sit = _schemaIndexer.find(key.schemaName);
+    if (sit == _schemaIndexer.end()) {
+        return;
+    }
+    auto& waiters = sit->second.waiters;
+    auto it = waiters.find(IndexerKey{key.partitionKey, key.rangeKey});
+    if (it == waiters.end()) {
+        return;
+    }
+    auto& queue = it->second;
+    queue.erase(std::remove_if(queue.begin(), queue.end(), [waiterId] (auto& waiter) { return waiter.id == waiterId; }),
+                queue.end());
+    if (queue.empty()) {
+        waiters.erase(it);
+    }
+}
+
+size_t Indexer::waitersCount() const {
+    size_t count = 0;
+    for (auto& [schemaName, si]: _schemaIndexer) {
+        for (auto& [key, queue]: si.waiters) {
+            count += queue.size();
+        }
+    }
+    return count;
+}
+
 void Indexer::createSchema(const dto::Schema& schema) {
+    _getOrCreateKeyIndexer(schema.name);
+}
+
+KeyIndexer& Indexer::_getOrCreateKeyIndexer(const String& schemaName) {
     // create a default indexer for the schema if one doesn't exist
-    auto [iter, success] = _schemaIndexer.try_emplace(schema.name);
+    auto [iter, success] = _schemaIndexer.try_emplace(schemaName);
     if (success) {
-        K2LOG_D(log::skvsvr, "Created new schema indexer for {}", schema.name);
+        K2LOG_D(log::skvsvr, "Created new schema indexer for {}", schemaName);
         // if we did create a new indexer, set the low/high watermarks to the time we created the main indexer
         iter->second.lastReadTimeLow = _createdTs;
         iter->second.lastReadTimeHigh = _createdTs;
     }
+    return iter->second;
+}
+
+VersionSet& Indexer::_replayVersionSet(const dto::Key& key) {
+    auto& ki = _getOrCreateKeyIndexer(key.schemaName);
+    auto [it, created] = ki.impl.try_emplace(IndexerKey{.partitionKey=key.partitionKey, .rangeKey=key.rangeKey});
+    if (created) {
+        // we don't know when this key was last read so assume it was read when the indexer was created
+        it->second.lastReadTime = _createdTs;
+    }
+    return it->second;
+}
+
+void Indexer::replayWI(const dto::Key& key, dto::WriteIntent&& wi) {
+    _replayVersionSet(key).WI = std::move(wi);
+}
+
+void Indexer::replayCommitted(const dto::Key& key, dto::DataRecord&& rec) {
+    auto& versions = _replayVersionSet(key).committed;
+    // versions are sorted newest first. Replay mostly brings newer versions so search from the front
+    auto pos = versions.begin();
+    while (pos != versions.end() && pos->timestamp.compareCertain(rec.timestamp) > 0) {
+        ++pos;
+    }
+    if (pos != versions.end() && pos->timestamp == rec.timestamp) {
+        return;
+    }
+    versions.insert(pos, std::move(rec));
+}
+
+void Indexer::loadCommitted(const dto::Key& key, VersionsT&& versions) {
+    auto& vset = _replayVersionSet(key);
+    if (vset.committed.empty()) {
+        vset.committed = std::move(versions);
+        return;
+    }
+    for (auto& rec: versions) {
+        replayCommitted(key, std::move(rec));
+    }
 }
 
 size_t Indexer::size() {
@@ -85,6 +169,168 @@ size_t Indexer::size() {
     return sz;
 }
 
+// Trim the versions of a single key. Returns the timestamp of the newest version we dropped
+// or ZERO if nothing was dropped.
+static dto::Timestamp _trimVersions(VersionSet& vset, const dto::Timestamp& retentionTs, IndexerGCStats& stats) {
+    auto& committed = vset.committed;
+    // versions are sorted newest-first. Find the newest version which is still visible at the retention time
+    auto it = committed.begin();
+    for (; it != committed.end(); ++it) {
+        if (it->timestamp.compareCertain(retentionTs) <= 0) {
+            break;
+        }
+    }
+    if (it == committed.end()) {
+        // all versions are newer than the retention timestamp
+        return dto::Timestamp::ZERO;
+    }
+
+    // Any transaction can only read at or after the retention timestamp, so the version we found is the oldest
+    // version anyone can observe. If it is a tombstone, reads will not find anything whether it is present or not
+    // so it can be reclaimed too
+    auto firstDrop = it->isTombstone ? it : it + 1;
+    if (firstDrop == committed.end()) {
+        return dto::Timestamp::ZERO;
+    }
+    auto newestDropped = firstDrop->timestamp;
+    for (auto dit = firstDrop; dit != committed.end(); ++dit) {
+        stats.reclaimedBytes += dit->value.fieldData.getSize();
+        ++stats.reclaimedVersions;
+    }
+    committed.erase(firstDrop, committed.end());
+    return newestDropped;
+}
+
+IndexerGCStats Indexer::collectGarbage(dto::Timestamp retentionTs, Duration budget) {
+    IndexerGCStats stats{};
+    auto deadline = Clock::now() + budget;
+    // checking the clock is not free. Only check it every so often
+    static constexpr uint64_t clockCheckInterval = 32;
+
+    if (_gcSchemaIdx >= _gcSchemas.size()) {
+        // starting a new pass
+        _gcSchemas.clear();
+        _gcSchemas.reserve(_schemaIndexer.size());
+        for (auto& [name, _] : _schemaIndexer) {
+            _gcSchemas.push_back(name);
+        }
+        _gcSchemaIdx = 0;
+        _gcNextKey.reset();
+    }
+
+    while (_gcSchemaIdx < _gcSchemas.size()) {
+        auto sit = _schemaIndexer.find(_gcSchemas[_gcSchemaIdx]);
+        if (sit == _schemaIndexer.end()) {
+            // schema went away since we started the pass
+            ++_gcSchemaIdx;
+            _gcNextKey.reset();
+            continue;
+        }
+        auto& si = sit->second;
+        auto it = _gcNextKey ? si.impl.lower_bound(*_gcNextKey) : si.impl.begin();
+
+        while (it != si.impl.end()) {
+            if (stats.visitedKeys % clockCheckInterval == 0 && stats.visitedKeys > 0 && Clock::now() >= deadline) {
+                // out of budget. Remember where to resume
+                _gcNextKey = it->first;
+                K2LOG_D(log::skvsvr, "GC slice out of budget with stats {}", stats);
+                return stats;
+            }
+            ++stats.visitedKeys;
+            auto& vset = it->second;
+            auto newestDropped = _trimVersions(vset, retentionTs, stats);
+            if (!vset.empty()) {
+                ++it;
+                continue;
+            }
+
+            // Nothing left for this key. Remove it and transfer its observations to its neighbors,
+            // the same way we do when a WI is aborted
+            auto lastObservedAt = vset.lastReadTime;
+            lastObservedAt.maxEq(newestDropped);
+            K2LOG_D(log::skvsvr, "GC removing empty entry for key={}, lastObserved={}", it->first, lastObservedAt);
+            auto next = si.impl.erase(it);
+            if (next == si.impl.begin()) {
+                si.lastReadTimeLow.maxEq(lastObservedAt);
+            } else {
+                std::prev(next)->second.lastReadTime.maxEq(lastObservedAt);
+            }
+            if (next == si.impl.end()) {
+                si.lastReadTimeHigh.maxEq(lastObservedAt);
+            } else {
+                next->second.lastReadTime.maxEq(lastObservedAt);
+            }
+            ++stats.erasedKeys;
+            it = next;
+        }
+        // done with this schema
+        ++_gcSchemaIdx;
+        _gcNextKey.reset();
+    }
+
+    stats.passDone = true;
+    K2LOG_D(log::skvsvr, "GC pass completed with last slice stats {}", stats);
+    return stats;
+}
+
+void Indexer::restartSnapshot() {
+    _snapshotSchemas.clear();
+    _snapshotSchemaIdx = 0;
+    _snapshotNextKey.reset();
+}
+
+bool Indexer::visitForSnapshot(Duration budget, const SnapshotVisitor& visitor) {
+    auto deadline = Clock::now() + budget;
+    // checking the clock is not free. Only check it every so often
+    static constexpr uint64_t clockCheckInterval = 32;
+    uint64_t visitedKeys = 0;
+
+    if (_snapshotSchemaIdx >= _snapshotSchemas.size()) {
+        // starting a new pass
+        _snapshotSchemas.clear();
+        _snapshotSchemas.reserve(_schemaIndexer.size());
+        for (auto& [name, _] : _schemaIndexer) {
+            _snapshotSchemas.push_back(name);
+        }
+        _snapshotSchemaIdx = 0;
+        _snapshotNextKey.reset();
+    }
+
+    while (_snapshotSchemaIdx < _snapshotSchemas.size()) {
+        auto sit = _schemaIndexer.find(_snapshotSchemas[_snapshotSchemaIdx]);
+        if (sit == _schemaIndexer.end()) {
+            ++_snapshotSchemaIdx;
+            _snapshotNextKey.reset();
+            continue;
+        }
+        auto& si = sit->second;
+        auto it = _snapshotNextKey ? si.impl.lower_bound(*_snapshotNextKey) : si.impl.begin();
+        while (it != si.impl.end()) {
+            if (visitedKeys % clockCheckInterval == 0 && visitedKeys > 0 && Clock::now() >= deadline) {
+                _snapshotNextKey = it->first;
+                return false;
+            }
+            ++visitedKeys;
+            bool proceed = visitor(sit->first, it->first, it->second);
+            ++it;
+            if (!proceed) {
+                if (it != si.impl.end()) {
+                    _snapshotNextKey = it->first;
+                    return false;
+                }
+                // we paused at the last key of the schema
+                ++_snapshotSchemaIdx;
+                _snapshotNextKey.reset();
+                return _snapshotSchemaIdx >= _snapshotSchemas.size();
+            }
+        }
+        // done with this schema
+        ++_snapshotSchemaIdx;
+        _snapshotNextKey.reset();
+    }
+    return true;
+}
+
 Indexer::Iterator Indexer::find(const dto::Key& key, bool reverse) {
     // if schema doesn't exist, it is an internal error - upon deployment of a new schema, we create an indexer for it
     auto it = _schemaIndexer.find(key.schemaName);
@@ -202,8 +448,11 @@ void Indexer::Iterator::addWI(const dto::Key& key, dto::DataRecord&& rec, uint64
     // We need to create the key in the indexer if it didn't exist before
     if (_foundIt == _si.impl.end()) {
         auto lastRead = getLastReadTime();
-        _foundIt = _si.impl.insert(_afterIt, std::make_pair(
-            IndexerKey{.partitionKey=key.partitionKey, .rangeKey=key.rangeKey}, VersionSet{}));
+        _foundIt = _si.impl.emplace_hint(_afterIt,
+            IndexerKey{.partitionKey=key.partitionKey, .rangeKey=key.rangeKey}, VersionSet{});
+        // the insert may have invalidated the neighbor iterators so reposition them around the new key
+        _beforeIt = _foundIt == _si.impl.begin() ? _si.impl.end() : std::prev(_foundIt);
+        _afterIt = std::next(_foundIt);
         // mark the new entry as being observed at the same time as the neighbors.
         _foundIt->second.lastReadTime = lastRead;
         K2LOG_D(log::skvsvr, "Created new key {}", key);
@@ -218,12 +467,15 @@ void Indexer::Iterator::addWI(const dto::Key& key, dto::DataRecord&& rec, uint64
 void Indexer::Iterator::abortWI() {
     if (_foundIt != _si.impl.end()) {
         _foundIt->second.WI.reset();
+        _wakeWaiters();
         if (_foundIt->second.committed.empty()) {
             auto lastObservedAt = _foundIt->second.lastReadTime;
             // this entire entry can now be removed as it has no WI and no committed data
             K2LOG_D(log::skvsvr, "Removing empty entry for key={}, lastObserved=", _foundIt->first, lastObservedAt);
-            _si.impl.erase(_foundIt);
+            // the erase may have invalidated the neighbor iterators so reposition them around the removed key
+            _afterIt = _si.impl.erase(_foundIt);
             _foundIt = _si.impl.end();
+            _beforeIt = _afterIt == _si.impl.begin() ? _si.impl.end() : std::prev(_afterIt);
             // update the neighbors with our timestamp
             observeAt(lastObservedAt);
         }
@@ -234,6 +486,24 @@ void Indexer::Iterator::commitWI() {
     K2ASSERT(log::skvsvr, _foundIt != _si.impl.end() && _foundIt->second.WI.has_value(), "WI must have value to commit");
     _foundIt->second.committed.push_front(std::move(_foundIt->second.WI->data));
     _foundIt->second.WI.reset();
+    _wakeWaiters();
+}
+
+void Indexer::Iterator::_wakeWaiters() {
+    if (_si.waiters.empty()) {
+        return;
+    }
+    auto it = _si.waiters.find(_foundIt->first);
+    if (it == _si.waiters.end()) {
+        return;
+    }
+    K2LOG_D(log::skvsvr, "Waking {} waiters for key={}", it->second.size(), _foundIt->first);
+    // the waiters run after we're done here, so it is safe to drop the queue now
+    auto queue = std::move(it->second);
+    _si.waiters.erase(it);
+    for (auto& waiter: queue) {
+        waiter.promise.set_value();
+    }
 }
 
 void Indexer::Iterator::observeAt(dto::Timestamp ts) {
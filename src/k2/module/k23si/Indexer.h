@@ -26,7 +26,11 @@ Copyright(c) 2022 Futurewei Cloud
 #include <map>
 #include <unordered_map>
 #include <deque>
+#include <functional>
 #include <optional>
+#include <string_view>
+#include <tuple>
+#include <vector>
 
 #if K2_MODULE_POOL_ALLOCATOR == 1
 // this can only work on GCC > 4
@@ -36,6 +40,9 @@ Copyright(c) 2022 Futurewei Cloud
 #include <k2/common/Common.h>
 #include <k2/dto/K23SI.h>
 #include <k2/dto/Timestamp.h>
+#include <k2/indexer/BTreeIndex.h>
+
+#include <seastar/core/future.hh>
 
 #include "Log.h"
 
@@ -53,6 +60,18 @@ struct IndexerKey {
     K2_DEF_FMT(IndexerKey, partitionKey, rangeKey);
 };
 
+// Describes IndexerKeys to the B+tree indexer: the keys are ordered by partitionKey, then by rangeKey
+struct IndexerKeyTraits {
+    static constexpr size_t segments = 2;
+    static std::string_view segment(const IndexerKey& key, size_t idx) {
+        const String& seg = idx == 0 ? key.partitionKey : key.rangeKey;
+        return std::string_view(seg.data(), seg.size());
+    }
+    static int compare(const IndexerKey& a, const IndexerKey& b) noexcept {
+        return a.compare(b);
+    }
+};
+
 // This struct is the "value" we store for each key in the indexer and represents
 // all versions (in MVCC terms) which we have for that key
 struct VersionSet {
@@ -81,15 +100,42 @@ struct KeyIndexer {
     // the last time we observed the highes bound (a virtual key bigger than all other keys)
     dto::Timestamp lastReadTimeHigh{dto::Timestamp::ZERO};
     // the type holding versions for all keys, i.e. the implementation for this key indexer
-    #if K2_MODULE_POOL_ALLOCATOR == 1
+    #if K2_MODULE_BTREE_INDEXER == 1
+    typedef indexer::BTreeIndex<IndexerKey, VersionSet, IndexerKeyTraits> KeyIndexerT;
+    #elif K2_MODULE_POOL_ALLOCATOR == 1
     typedef std::map<IndexerKey, VersionSet, std::less<IndexerKey>, __gnu_cxx::__pool_alloc<std::pair<IndexerKey, VersionSet>>> KeyIndexerT;
     #else
     typedef std::map<IndexerKey, VersionSet> KeyIndexerT;
     #endif
     // the implementation container for storing key->vset
     KeyIndexerT impl;
-    // an iterator for our implementation container
+    // an iterator for our implementation container. Note that depending on the implementation, iterators may be
+    // invalidated by inserts and erases so they should not be held across mutations
     typedef KeyIndexerT::iterator iterator;
+    // a request waiting for a WI to be finalized
+    struct Waiter {
+        // identifies the waiter, so that it can be removed if it stops waiting
+        uint64_t id;
+        seastar::promise<> promise;
+    };
+    // requests waiting for the WI at a key to be finalized, in arrival order. Kept outside of the vsets so that
+    // the indexer implementation doesn't have to carry (or copy) them around
+    std::map<IndexerKey, std::vector<Waiter>> waiters;
+};
+
+// Results from running a single garbage collection slice over the indexer
+struct IndexerGCStats {
+    // number of keys examined in this slice
+    uint64_t visitedKeys{0};
+    // number of committed versions removed
+    uint64_t reclaimedVersions{0};
+    // number of user payload bytes released with the removed versions
+    uint64_t reclaimedBytes{0};
+    // number of keys removed from the indexer since they held only tombstones
+    uint64_t erasedKeys{0};
+    // set when the slice reached the end of the indexer, i.e. a full GC pass has completed
+    bool passDone{false};
+    K2_DEF_FMT(IndexerGCStats, visitedKeys, reclaimedVersions, reclaimedBytes, erasedKeys, passDone);
 };
 
 // The indexer for K2 records. It stores records, mapped as: IndexerKey --> dto::DataRecord
@@ -122,12 +168,80 @@ public: // API
     // raw access to the underlying schema indexer, used by our debugging APIs
     const SchemaIndexer& getSchemaIndexer() const;
 
+    // Returns the id of a new waiter, and a future which becomes ready once the WI currently at the given key is
+    // committed or aborted. Waiters are woken in the order in which they arrived. If the indexer is stopped first,
+    // the future fails with a broken promise
+    std::tuple<uint64_t, seastar::future<>> waitForWI(const dto::Key& key);
+
+    // Removes the waiter with the given id for the given key, e.g. when it gave up waiting. Its future fails with a
+    // broken promise. Does nothing if the waiter was already woken
+    void removeWaiter(const dto::Key& key, uint64_t waiterId);
+
+    // returns the number of requests currently waiting for WIs to be finalized
+    size_t waitersCount() const;
+
+    // Run one incremental garbage collection slice, starting from where the previous slice stopped.
+    // For each visited key we drop all committed versions older than the newest version at or below
+    // the given retention timestamp, and we erase keys which are left holding nothing but a tombstone.
+    // The slice stops once the given time budget is exhausted. The returned stats indicate via passDone
+    // if the slice completed a full pass over all schemas, in which case the next slice starts a new pass.
+    IndexerGCStats collectGarbage(dto::Timestamp retentionTs, Duration budget);
+
+    // The function type used to visit keys for a snapshot. It is called for each visited key, and returns false
+    // if the visit should pause after that key
+    typedef std::function<bool(const String& schemaName, const IndexerKey& key, const VersionSet& vset)> SnapshotVisitor;
+
+    // Visit the keys in the indexer for a snapshot, in time-sliced increments. Each call resumes from where the previous
+    // call stopped and visits the keys of each schema in order, until the visitor asks to pause or the given time
+    // budget is exhausted. Returns true once all keys have been visited, in which case the next call starts a new pass.
+    // The indexer may change between calls, so a pass sees each key as it was when the pass reached it.
+    bool visitForSnapshot(Duration budget, const SnapshotVisitor& visitor);
+
+    // Reset the snapshot cursor so that the next visit starts a new pass
+    void restartSnapshot();
+
+public: // recovery API
+    // These place data read back from persistence directly in the indexer, without any of the transactional checks.
+    // The schema indexer for the key is created if needed.
+    // Keys created this way are treated as observed at the time the indexer was created.
+
+    // Place the given WI for the given key, replacing any existing WI
+    void replayWI(const dto::Key& key, dto::WriteIntent&& wi);
+
+    // Add the given committed version for the given key. Versions which are already present are ignored
+    void replayCommitted(const dto::Key& key, dto::DataRecord&& rec);
+
+    // Add the given committed versions, sorted newest first, for the given key. This is used to bulk-load snapshots,
+    // which contain each key only once, so normally the key is new
+    void loadCommitted(const dto::Key& key, VersionsT&& versions);
+
 private:
+    // returns the key indexer for the given schema, creating it if needed
+    KeyIndexer& _getOrCreateKeyIndexer(const String& schemaName);
+
+    // returns the version set for the given key for replay, creating it if needed
+    VersionSet& _replayVersionSet(const dto::Key& key);
+
     // the time at which the indexer got created. This will be the assumed observed time for any keys we do not have
     dto::Timestamp _createdTs{dto::Timestamp::ZERO};
 
     // the indexer, mapping schema_name -> indexer_for_schema
     SchemaIndexer _schemaIndexer;
+
+    // the id for the next WI waiter
+    uint64_t _nextWaiterId{0};
+
+    // GC cursor. The schemas for the current pass are captured at the start of the pass so that
+    // the pass is not impacted by rehashing of the schema indexer.
+    std::vector<String> _gcSchemas;
+    size_t _gcSchemaIdx{0};
+    // the next key to examine in the current schema. Unset means we start at the beginning of the schema
+    std::optional<IndexerKey> _gcNextKey;
+
+    // Snapshot cursor. Same as the GC cursor, but for visiting the keys for a snapshot
+    std::vector<String> _snapshotSchemas;
+    size_t _snapshotSchemaIdx{0};
+    std::optional<IndexerKey> _snapshotNextKey;
 }; // class KeyIndexer
 
 
@@ -192,6 +306,9 @@ public: // APIs
     dto::Key getKey() const;
 
 private:
+    // wake up everyone waiting for the WI at the current Iterator position to be finalized
+    void _wakeWaiters();
+
     // iterators pointing into the KeyIndexer for the keys:
     // These iterators are always in the forward direction. We may rewind them if we're asked
     // to iterate in reverse but they are always positioned forward.
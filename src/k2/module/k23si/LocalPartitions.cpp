@@ -0,0 +1,67 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "LocalPartitions.h"
+
+#include <seastar/core/smp.hh>
+
+#include "Log.h"
+
+namespace k2 {
+
+thread_local std::unordered_map<dto::PVID, unsigned> LocalPartitions::_cores;
+thread_local std::unordered_map<dto::PVID, K23SIPartitionModule*> LocalPartitions::_modules;
+
+seastar::future<> LocalPartitions::add(const dto::PVID& pvid, K23SIPartitionModule* module) {
+    K2LOG_D(log::skvsvr, "adding local partition {}", pvid);
+    _modules[pvid] = module;
+    return seastar::smp::invoke_on_all([pvid, core=seastar::this_shard_id()] {
+        _cores[pvid] = core;
+    });
+}
+
+seastar::future<> LocalPartitions::remove(const dto::PVID& pvid) {
+    K2LOG_D(log::skvsvr, "removing local partition {}", pvid);
+    _modules.erase(pvid);
+    return seastar::smp::invoke_on_all([pvid, core=seastar::this_shard_id()] {
+        // the partition may have been announced by another core since
+        if (auto it = _cores.find(pvid); it != _cores.end() && it->second == core) {
+            _cores.erase(it);
+        }
+    });
+}
+
+std::optional<unsigned> LocalPartitions::findCore(const dto::PVID& pvid) {
+    auto it = _cores.find(pvid);
+    if (it == _cores.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+K23SIPartitionModule* LocalPartitions::findModule(const dto::PVID& pvid) {
+    auto it = _modules.find(pvid);
+    return it == _modules.end() ? nullptr : it->second;
+}
+
+}  // namespace k2
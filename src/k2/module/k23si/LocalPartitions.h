@@ -0,0 +1,59 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+#include <optional>
+#include <unordered_map>
+
+#include <k2/dto/Collection.h>
+
+#include <seastar/core/future.hh>
+
+namespace k2 {
+
+class K23SIPartitionModule;
+
+// Tracks the K23SI partitions hosted on the cores of this node, so that requests meant for them can be handed to the
+// hosting core directly, instead of going through the network stack.
+// Each core keeps its own copy of the pvid->core map. A module can only be looked up on the core which hosts it
+class LocalPartitions {
+public:
+    // Announce to all cores that the given module, which runs on the current core, hosts the partition with the
+    // given pvid
+    static seastar::future<> add(const dto::PVID& pvid, K23SIPartitionModule* module);
+
+    // Announce to all cores that the partition with the given pvid is no longer hosted on the current core
+    static seastar::future<> remove(const dto::PVID& pvid);
+
+    // Returns the core which hosts the partition with the given pvid, if it is hosted on this node
+    static std::optional<unsigned> findCore(const dto::PVID& pvid);
+
+    // Returns the module which hosts the partition with the given pvid on the current core, or nullptr
+    static K23SIPartitionModule* findModule(const dto::PVID& pvid);
+
+private:
+    static thread_local std::unordered_map<dto::PVID, unsigned> _cores;
+    static thread_local std::unordered_map<dto::PVID, K23SIPartitionModule*> _modules;
+};
+
+}  // namespace k2
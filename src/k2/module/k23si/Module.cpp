@@ -22,6 +22,7 @@ Copyright(c) 2020 Futurewei Cloud
 */
 
 #include "Module.h"
+#include "LocalPartitions.h"
 
 #include <k2/appbase/AppEssentials.h>
 #include <k2/common/Defer.h>
@@ -29,6 +30,11 @@ Copyright(c) 2020 Futurewei Cloud
 #include <k2/dto/MessageVerbs.h>
 #include <k2/infrastructure/APIServer.h>
 
+#include <seastar/core/sleep.hh>
+#include <seastar/core/with_timeout.hh>
+
+#include <algorithm>
+
 namespace k2 {
 
 // ********************** Validators
@@ -39,6 +45,13 @@ bool K23SIPartitionModule::_validateRetentionWindow(const dto::Timestamp& ts) co
     return result;
 }
 
+bool K23SIPartitionModule::_isClosed(const dto::Timestamp& ts) const {
+    bool result = ts.compareCertain(_closedTimestamp) <= 0;
+    K2LOG_D(log::skvsvr, "closed timestamp validation {}, {} vs {}",
+            (result ? "passed" : "failed"), _closedTimestamp, ts);
+    return result;
+}
+
 
 template <typename T, typename = void>
 struct has_key_field : std::false_type {};
@@ -68,6 +81,10 @@ Status K23SIPartitionModule::_validateStaleWrite(const dto::K23SIWriteRequest& r
         // the request is outside the retention window
         return dto::K23SIStatus::AbortRequestTooOld("write request is outside retention window");
     }
+    if (_isClosed(request.mtr.timestamp)) {
+        // snapshot reads may have already been served at this time
+        return dto::K23SIStatus::AbortRequestTooOld("write request is at or below the closed timestamp");
+    }
 
     auto ts = iter.getLastReadTime();
     if (request.mtr.timestamp.compareCertain(ts) < 0) {
@@ -196,6 +213,20 @@ seastar::future<> K23SIPartitionModule::_registerVerbs() {
                });
     });
 
+    RPC().registerRPCObserver<dto::K23SIReadBatchRequest, dto::K23SIReadBatchResponse>
+    (dto::Verbs::K23SI_READ_BATCH, [this, &hb_resp](dto::K23SIReadBatchRequest&& request) {
+        if (!hb_resp.isUp()) {
+            return RPCResponse(dto::K23SIStatus::RefreshCollection("Heartbeat is dead"), dto::K23SIReadBatchResponse{});
+        }
+
+        k2::OperationLatencyReporter reporter(_readBatchLatency); // for reporting metrics
+        return handleReadBatch(std::move(request), FastDeadline(_config.readTimeout()))
+               .then([this, reporter=std::move(reporter)](auto&& response) mutable {
+                    reporter.report();
+                    return std::move(response);
+               });
+    });
+
     RPC().registerRPCObserver<dto::K23SIQueryRequest, dto::K23SIQueryResponse>
     (dto::Verbs::K23SI_QUERY, [this, &hb_resp](dto::K23SIQueryRequest&& request) {
         if (!hb_resp.isUp()) {
@@ -210,6 +241,26 @@ seastar::future<> K23SIPartitionModule::_registerVerbs() {
                });
     });
 
+    RPC().registerMessageObserver(dto::Verbs::K23SI_QUERY_STREAM_OPEN, [this, &hb_resp](Request&& request) {
+        if (!hb_resp.isUp()) {
+            dto::K23SIQueryStreamOpenRequest openRequest;
+            if (request.payload->read(openRequest)) {
+                auto endpoint = seastar::make_lw_shared<TXEndpoint>(std::move(request.endpoint));
+                auto payload = endpoint->newPayload();
+                payload->write(dto::K23SIQueryStreamChunk{.streamId = openRequest.streamId,
+                                                          .status = dto::K23SIStatus::RefreshCollection("Heartbeat is dead")});
+                (void)RPC().send(dto::Verbs::K23SI_QUERY_STREAM_CHUNK, std::move(payload), *endpoint)
+                    .finally([endpoint] {});
+            }
+            return;
+        }
+        _handleQueryStreamOpen(std::move(request));
+    });
+
+    RPC().registerMessageObserver(dto::Verbs::K23SI_QUERY_STREAM_CREDIT, [this](Request&& request) {
+        _handleQueryStreamCredit(std::move(request));
+    });
+
     RPC().registerRPCObserver<dto::K23SIWriteRequest, dto::K23SIWriteResponse>
     (dto::Verbs::K23SI_WRITE, [this, &hb_resp](dto::K23SIWriteRequest&& request) {
         if (!hb_resp.isUp()) {
@@ -227,6 +278,40 @@ seastar::future<> K23SIPartitionModule::_registerVerbs() {
             });
     });
 
+    RPC().registerRPCObserver<dto::K23SIWriteAndCommitRequest, dto::K23SIWriteResponse>
+    (dto::Verbs::K23SI_WRITE_AND_COMMIT, [this, &hb_resp](dto::K23SIWriteAndCommitRequest&& request) {
+        if (!hb_resp.isUp()) {
+            return RPCResponse(dto::K23SIStatus::RefreshCollection("Heartbeat is dead"), dto::K23SIWriteResponse{});
+        }
+
+        k2::OperationLatencyReporter reporter(_writeAndCommitLatency); // for reporting metrics
+        return handleWriteAndCommit(std::move(request), FastDeadline(_config.writeTimeout()))
+            .then([this, reporter=std::move(reporter)] (auto&& resp) mutable {
+                return _respondAfterFlush(std::move(resp))
+                        .then([this, reporter=std::move(reporter)] (auto&& response) mutable {
+                            reporter.report();
+                            return std::move(response);
+                        });
+            });
+    });
+
+    RPC().registerRPCObserver<dto::K23SIWriteBatchRequest, dto::K23SIWriteBatchResponse>
+    (dto::Verbs::K23SI_WRITE_BATCH, [this, &hb_resp](dto::K23SIWriteBatchRequest&& request) {
+        if (!hb_resp.isUp()) {
+            return RPCResponse(dto::K23SIStatus::RefreshCollection("Heartbeat is dead"), dto::K23SIWriteBatchResponse{});
+        }
+
+        k2::OperationLatencyReporter reporter(_writeBatchLatency); // for reporting metrics
+        return handleWriteBatch(std::move(request), FastDeadline(_config.writeTimeout()))
+            .then([this, reporter=std::move(reporter)] (auto&& resp) mutable {
+                return _respondAfterFlush(std::move(resp))
+                        .then([this, reporter=std::move(reporter)] (auto&& response) mutable {
+                            reporter.report();
+                            return std::move(response);
+                        });
+            });
+    });
+
     RPC().registerRPCObserver<dto::K23SITxnPushRequest, dto::K23SITxnPushResponse>
     (dto::Verbs::K23SI_TXN_PUSH, [this, &hb_resp](dto::K23SITxnPushRequest&& request) {
         if (!hb_resp.isUp()) {
@@ -312,8 +397,13 @@ void K23SIPartitionModule::_unregisterVerbs() {
     APIServer& api_server = AppBase().getDist<APIServer>().local();
 
     RPC().registerMessageObserver(dto::Verbs::K23SI_READ, nullptr);
+    RPC().registerMessageObserver(dto::Verbs::K23SI_READ_BATCH, nullptr);
     RPC().registerMessageObserver(dto::Verbs::K23SI_QUERY, nullptr);
+    RPC().registerMessageObserver(dto::Verbs::K23SI_QUERY_STREAM_OPEN, nullptr);
+    RPC().registerMessageObserver(dto::Verbs::K23SI_QUERY_STREAM_CREDIT, nullptr);
     RPC().registerMessageObserver(dto::Verbs::K23SI_WRITE, nullptr);
+    RPC().registerMessageObserver(dto::Verbs::K23SI_WRITE_BATCH, nullptr);
+    RPC().registerMessageObserver(dto::Verbs::K23SI_WRITE_AND_COMMIT, nullptr);
     RPC().registerMessageObserver(dto::Verbs::K23SI_TXN_PUSH, nullptr);
     RPC().registerMessageObserver(dto::Verbs::K23SI_TXN_END, nullptr);
     RPC().registerMessageObserver(dto::Verbs::K23SI_TXN_HEARTBEAT, nullptr);
@@ -342,16 +432,64 @@ void K23SIPartitionModule::_registerMetrics() {
         sm::make_counter("total_committed_payload", _totalCommittedPayload, sm::description("Total size of committed payloads"), labels),
         sm::make_histogram("read_latency", [this]{ return _readLatency.getHistogram();},
                 sm::description("Latency of Read Operations"), labels),
+        sm::make_histogram("read_batch_latency", [this]{ return _readBatchLatency.getHistogram();},
+                sm::description("Latency of Read Batch Operations"), labels),
+        sm::make_histogram("read_batch_keys", [this]{ return _readBatchKeys.getHistogram();},
+                sm::description("Number of keys in Read Batch Operations"), labels),
         sm::make_histogram("write_latency", [this]{ return _writeLatency.getHistogram();},
                 sm::description("Latency of Write Operations"), labels),
+        sm::make_histogram("write_batch_latency", [this]{ return _writeBatchLatency.getHistogram();},
+                sm::description("Latency of Write Batch Operations"), labels),
+        sm::make_histogram("write_and_commit_latency", [this]{ return _writeAndCommitLatency.getHistogram();},
+                sm::description("Latency of Write And Commit Operations"), labels),
+        sm::make_histogram("write_batch_keys", [this]{ return _writeBatchKeys.getHistogram();},
+                sm::description("Number of keys in Write Batch Operations"), labels),
         sm::make_histogram("query_page_latency", [this]{ return _queryPageLatency.getHistogram();},
                 sm::description("Latency of Query Page Operations"), labels),
         sm::make_histogram("push_latency", [this]{ return _pushLatency.getHistogram();},
                 sm::description("Latency of Pushes"), labels),
+        sm::make_counter("query_streams_opened", _queryStreamsOpened, sm::description("Number of streaming queries opened"), labels),
+        sm::make_counter("query_streams_expired", _queryStreamsExpired, sm::description("Number of streaming queries closed due to inactivity"), labels),
+        sm::make_counter("query_stream_chunks", _queryStreamChunks, sm::description("Number of chunks sent for streaming queries"), labels),
+        sm::make_counter("write_commits", _writeCommits, sm::description("Number of transactions committed with their last write"), labels),
+        sm::make_counter("local_pushes", _localPushes, sm::description("Number of pushes handled by a TRH on this node without an RPC"), labels),
+        sm::make_counter("remote_pushes", _remotePushes, sm::description("Number of pushes sent to the TRH as an RPC"), labels),
+        sm::make_gauge("local_push_ratio", [this]{
+                    auto total = _localPushes + _remotePushes;
+                    return total == 0 ? 0.0 : double(_localPushes) / total;
+                }, sm::description("Ratio of the pushes handled by a TRH on this node"), labels),
+        sm::make_counter("conflict_waits", _conflictWaits, sm::description("Number of times a request waited for a conflicting WI instead of aborting"), labels),
+        sm::make_counter("conflict_wait_timeouts", _conflictWaitTimeouts, sm::description("Number of conflict waits which timed out"), labels),
+        sm::make_gauge("conflict_waiters", [this]{ return _indexer.waitersCount();},
+                sm::description("Number of requests currently waiting for conflicting WIs"), labels),
+        sm::make_histogram("conflict_wait_latency", [this]{ return _conflictWaitLatency.getHistogram();},
+                sm::description("Time spent waiting for conflicting WIs"), labels),
+        sm::make_counter("snapshot_reads", _snapshotReads, sm::description("Number of snapshot reads served without touching the read cache"), labels),
+        sm::make_counter("snapshot_read_fallbacks", _snapshotReadFallbacks, sm::description("Number of snapshot reads served as regular reads since their timestamp was not closed"), labels),
+        sm::make_gauge("query_streams_open", [this]{ return _queryStreams.size();},
+                sm::description("Number of open streaming queries"), labels),
         sm::make_histogram("query_page_scans", [this]{ return _queryPageScans.getHistogram();},
                 sm::description("Number of records scanned by query page operations"), labels),
         sm::make_histogram("query_page_returns", [this]{ return _queryPageReturns.getHistogram();},
-                sm::description("Number of records returned by query page operations"), labels)
+                sm::description("Number of records returned by query page operations"), labels),
+        sm::make_counter("gc_reclaimed_versions", _gcReclaimedVersions, sm::description("Number of record versions reclaimed by GC"), labels),
+        sm::make_counter("gc_reclaimed_bytes", _gcReclaimedBytes, sm::description("Total size of user payloads reclaimed by GC"), labels),
+        sm::make_counter("gc_erased_keys", _gcErasedKeys, sm::description("Number of tombstoned keys erased by GC"), labels),
+        sm::make_counter("gc_passes", _gcPasses, sm::description("Number of completed GC passes over the indexer"), labels),
+        sm::make_histogram("gc_slice_latency", [this]{ return _gcSliceLatency.getHistogram();},
+                sm::description("Reactor time spent in a single GC slice"), labels),
+        sm::make_gauge("recovered_records", _recoveredRecords, sm::description("Number of records replayed during recovery"), labels),
+        sm::make_gauge("recovered_bytes", _recoveredBytes, sm::description("Number of bytes replayed during recovery"), labels),
+        sm::make_gauge("recovery_time_ms", [this]{ return msec(_recoveryTime).count();},
+                sm::description("Time taken to recover the partition"), labels),
+        sm::make_gauge("recovery_records_per_sec", [this]{ return _recoveryRate(_recoveredRecords);},
+                sm::description("Rate of replayed records during recovery"), labels),
+        sm::make_gauge("recovery_mb_per_sec", [this]{ return _recoveryRate(_recoveredBytes) / (1024 * 1024);},
+                sm::description("Rate of replayed MB during recovery"), labels),
+        sm::make_counter("snapshots", _snapshots, sm::description("Number of snapshots written"), labels),
+        sm::make_counter("snapshot_bytes", _snapshotBytes, sm::description("Total size of the snapshots written"), labels),
+        sm::make_histogram("snapshot_slice_latency", [this]{ return _snapshotSliceLatency.getHistogram();},
+                sm::description("Reactor time spent in a single snapshot slice"), labels)
     });
 }
 
@@ -375,6 +513,7 @@ seastar::future<> K23SIPartitionModule::start() {
     .then([this](dto::Timestamp&& startTs) {
         K2LOG_D(log::skvsvr, "Starting timestamp: {}, retention period={}", startTs, _cmeta.retentionPeriod);
         _retentionTimestamp = startTs;
+        _closedTimestamp = startTs;
 
         _retentionUpdateTimer.setCallback([this] {
             K2LOG_D(log::skvsvr, "Partition {}, refreshing retention timestamp", _partition);
@@ -382,12 +521,37 @@ seastar::future<> K23SIPartitionModule::start() {
                 .then([this](dto::Timestamp&& ts) {
                     // set the retention timestamp (the time of the oldest entry we should keep)
                     _retentionTimestamp.maxEq(ts - _cmeta.retentionPeriod);
+                    _closedTimestamp.maxEq(_retentionTimestamp);
                     _txnMgr.updateRetentionTimestamp(_retentionTimestamp);
                     _twimMgr.updateRetentionTimestamp(_retentionTimestamp);
                 });
         });
         _retentionUpdateTimer.armPeriodic(_config.retentionTimestampUpdateInterval());
-        _persistence = std::make_shared<Persistence>();
+        _closedTimestampTimer.setCallback([this] {
+            return _tsoClient.getTimestamp()
+                .then([this](dto::Timestamp&& ts) {
+                    _closedTimestamp.maxEq(ts - _config.closedTimestampLag());
+                    K2LOG_D(log::skvsvr, "Partition {}, advanced closed timestamp to {}", _partition, _closedTimestamp);
+                })
+                .handle_exception([this](auto exc) {
+                    // we'll try again on the next tick. Until then snapshot reads just take the regular path
+                    K2LOG_W_EXC(log::skvsvr, exc, "Partition {}, unable to advance closed timestamp", _partition);
+                });
+        });
+        if (_config.closedTimestampLag() > 0s) {
+            _closedTimestampTimer.armPeriodic(_config.closedTimestampUpdateInterval());
+        }
+        _gcTimer.setCallback([this] {
+            return _runGC();
+        });
+        _snapshotTimer.setCallback([this] {
+            return _writeSnapshot();
+        });
+        _queryStreamTimer.setCallback([this] {
+            _expireQueryStreams();
+            return seastar::make_ready_future();
+        });
+        _persistence = std::make_shared<Persistence>(_cmeta.name, _partition().keyRangeV.pvid);
         return _persistence->start()
             .then([this] {
                 return _indexer.start(_retentionTimestamp);
@@ -396,13 +560,27 @@ seastar::future<> K23SIPartitionModule::start() {
                 return _twimMgr.start(_retentionTimestamp, _persistence, _cpoEndpoint);
             })
             .then([this] {
+                // Txns which only wrote to this partition are finalized here when they end. Their end record is
+                // all we persist, and recovery applies its outcome to the WIs
+                _txnMgr.setLocalFinalizer(_partition().keyRangeV, [this] (dto::Timestamp txnts, dto::EndAction action) {
+                    return _finalizeTxn(txnts, action, false);
+                });
                 return _txnMgr.start(_cmeta.name, _retentionTimestamp, _cmeta.heartbeatDeadline, _persistence, _cpoEndpoint);
             })
             .then([this] {
                 return _recovery();
             })
             .then([this] {
+                _gcTimer.armPeriodic(_config.gcInterval());
+                if (_config.snapshotInterval() > 0s) {
+                    _snapshotTimer.armPeriodic(_config.snapshotInterval());
+                }
+                _queryStreamTimer.armPeriodic(_config.queryStreamIdleTimeout() / 2);
                 return _registerVerbs();
+            })
+            .then([this] {
+                // let the other cores hand pushes to us directly
+                return LocalPartitions::add(_partition().keyRangeV.pvid, this);
             });
     });
 }
@@ -413,7 +591,32 @@ K23SIPartitionModule::~K23SIPartitionModule() {
 
 seastar::future<> K23SIPartitionModule::gracefulStop() {
     K2LOG_I(log::skvsvr, "stop for cname={}, part={}", _cmeta.name, _partition);
-    return _retentionUpdateTimer.stop()
+    return LocalPartitions::remove(_partition().keyRangeV.pvid)
+        .then([this] {
+            return _retentionUpdateTimer.stop();
+        })
+        .then([this] {
+            return _closedTimestampTimer.stop();
+        })
+        .then([this] {
+            return _gcTimer.stop();
+        })
+        .then([this] {
+            return _snapshotTimer.stop();
+        })
+        .then([this] {
+            return _queryStreamTimer.stop();
+        })
+        .then([this] {
+            // close all streams and wait for any chunks in progress
+            std::vector<seastar::future<>> futs;
+            for (auto it = _queryStreams.begin(); it != _queryStreams.end();) {
+                auto stream = (it++)->second;
+                _closeQueryStream(*stream);
+                futs.push_back(std::move(stream->runFut));
+            }
+            return seastar::when_all_succeed(futs.begin(), futs.end()).discard_result();
+        })
         .then([this] {
             return _txnMgr.gracefulStop();
         })
@@ -435,6 +638,35 @@ seastar::future<> K23SIPartitionModule::gracefulStop() {
         });
 }
 
+seastar::future<> K23SIPartitionModule::_runGC() {
+    K2LOG_D(log::skvsvr, "Partition {}, starting GC pass at retention ts {}", _partition, _retentionTimestamp);
+    return seastar::do_with(false, [this] (bool& passDone) {
+        return seastar::do_until(
+            [this, &passDone] {
+                // stop early if we're shutting down
+                return passDone || !_gcTimer.isArmed();
+            },
+            [this, &passDone] {
+                k2::OperationLatencyReporter reporter(_gcSliceLatency); // for reporting metrics
+                // use the latest retention timestamp for each slice. It only ever moves forward
+                auto stats = _indexer.collectGarbage(_retentionTimestamp, _config.gcSliceBudget());
+                reporter.report();
+
+                _gcReclaimedVersions += stats.reclaimedVersions;
+                _gcReclaimedBytes += stats.reclaimedBytes;
+                _gcErasedKeys += stats.erasedKeys;
+                _recordVersions -= std::min(_recordVersions, stats.reclaimedVersions);
+                passDone = stats.passDone;
+                if (passDone) {
+                    _gcPasses++;
+                    return seastar::make_ready_future();
+                }
+                // give the reactor back to other tasks before the next slice
+                return seastar::sleep(_config.gcSlicePause());
+            });
+    });
+}
+
 // Helper for iterating over the indexer, modifies it to end() if iterator would go past the target schema
 // or if it would go past begin() for reverse scan. Starting iterator must not be end() and must
 // point to a record with the target schema
@@ -459,7 +691,7 @@ Indexer::Iterator K23SIPartitionModule::_initializeScan(const dto::K23SIQueryReq
 
 // Helper for handleQuery. Checks to see if the indexer scan should stop.
 bool K23SIPartitionModule::_isScanDone(const Indexer::Iterator& iter, const dto::K23SIQueryRequest& request,
-                                       size_t response_size, uint64_t num_scans) {
+                                       size_t response_size, uint64_t num_scans, size_t pageLimit) {
     // we're at end of iteration
     if (iter.atEnd()) {
         return true;
@@ -478,7 +710,7 @@ bool K23SIPartitionModule::_isScanDone(const Indexer::Iterator& iter, const dto:
         return true;
     } else if (request.recordLimit >= 0 && response_size == (uint32_t)request.recordLimit) {
         return true;
-    } else if (response_size == _config.paginationLimit()) {
+    } else if (response_size == pageLimit) {
         return true;
     } else if (_config.scanLimit() > 0 && num_scans == _config.scanLimit()) {
         return true;
@@ -534,51 +766,73 @@ dto::Key K23SIPartitionModule::_getContinuationToken(const Indexer::Iterator& it
 
 // Makes the SKVRecord and applies the request's filter to it. If the returned Status is not OK,
 // the caller should return the status in the query response. Otherwise bool in tuple is whether
-// the filter passed
+// the filter passed. The filter is compiled once for each schema version, and kept in filters
 std::tuple<Status, bool> K23SIPartitionModule::_doQueryFilter(dto::K23SIQueryRequest& request,
-                                                              dto::SKVRecord::Storage& storage) {
-    // We know the schema name exists because it is validated at the beginning of handleQuery
-    auto schemaIt = _schemas.find(request.key.schemaName);
-    auto versionIt = schemaIt->second.find(storage.schemaVersion);
-    if (versionIt == schemaIt->second.end()) {
-        return std::make_tuple(dto::K23SIStatus::OperationNotAllowed(
-            "Schema version of found record does not exist"), false);
+                                                              dto::SKVRecord::Storage& storage,
+                                                              QueryFilters& filters) {
+    auto filterIt = filters.find(storage.schemaVersion);
+    if (filterIt == filters.end()) {
+        // We know the schema name exists because it is validated at the beginning of handleQuery
+        auto schemaIt = _schemas.find(request.key.schemaName);
+        auto versionIt = schemaIt->second.find(storage.schemaVersion);
+        if (versionIt == schemaIt->second.end()) {
+            return std::make_tuple(dto::K23SIStatus::OperationNotAllowed(
+                "Schema version of found record does not exist"), false);
+        }
+        filterIt = filters.try_emplace(storage.schemaVersion, request.filterExpression, versionIt->second).first;
     }
 
-    dto::SKVRecord record(request.collectionName, versionIt->second, storage.share(), true);
-    bool keep = false;
-    Status status = dto::K23SIStatus::OK;
-
-    try {
-        keep = request.filterExpression.evaluate(record);
-    }
-    catch(dto::NoFieldFoundException&) {}
-    catch(dto::TypeMismatchException&) {}
-    catch (dto::DeserializationError&) {
-        status = dto::K23SIStatus::OperationNotAllowed("DeserializationError in query filter");
-    }
-    catch (dto::InvalidExpressionException& exp) {
-        status = dto::K23SIStatus::OperationNotAllowed(fmt::format("InvalidExpression in query filter: {}", exp.what()));
+    auto& filter = filterIt->second;
+    if (filter.passesAll()) {
+        return std::make_tuple(dto::K23SIStatus::OK, true);
     }
 
-    return std::make_tuple(std::move(status), keep);
+    dto::SKVRecord record(request.collectionName, filter.schema(), storage.share(), true);
+    switch (filter.evaluate(record)) {
+        case dto::expression::EvalResult::PASS:
+            return std::make_tuple(dto::K23SIStatus::OK, true);
+        case dto::expression::EvalResult::DESERIALIZATION_ERROR:
+            return std::make_tuple(dto::K23SIStatus::OperationNotAllowed("DeserializationError in query filter"), false);
+        case dto::expression::EvalResult::INVALID:
+            return std::make_tuple(dto::K23SIStatus::OperationNotAllowed(
+                fmt::format("InvalidExpression in query filter: {}", filter.error())), false);
+        default:
+            // the record doesn't pass, or the filter doesn't apply to it
+            return std::make_tuple(dto::K23SIStatus::OK, false);
+    }
 }
 
 seastar::future<std::tuple<Status, dto::K23SIQueryResponse>>
 K23SIPartitionModule::handleQuery(dto::K23SIQueryRequest&& request, dto::K23SIQueryResponse&& response, FastDeadline deadline, uint32_t count) {
+    return seastar::do_with(std::move(request), std::move(response), QueryFilters{}, false,
+        [this, deadline, count] (auto& request, auto& response, auto& filters, bool& paginated) {
+            return _processQuery(request, response, filters, _config.paginationLimit(), paginated, deadline, count)
+                .then([&response] (auto&& status) {
+                    if (!status.is2xxOK()) {
+                        return RPCResponse(std::move(status), dto::K23SIQueryResponse{});
+                    }
+                    return RPCResponse(std::move(status), std::move(response));
+                });
+        });
+}
+
+seastar::future<Status>
+K23SIPartitionModule::_processQuery(dto::K23SIQueryRequest& request, dto::K23SIQueryResponse& response,
+                                    QueryFilters& filters, size_t pageLimit, bool& paginated,
+                                    FastDeadline deadline, uint32_t count) {
     K2LOG_D(log::skvsvr, "Partition: {}, received query {}", _partition, request);
 
     uint64_t numScans = 0;
     Status validateStatus = _validateReadRequest(request);
     if (!validateStatus.is2xxOK()) {
-        return RPCResponse(std::move(validateStatus), dto::K23SIQueryResponse{});
+        return seastar::make_ready_future<Status>(std::move(validateStatus));
     }
     if (_partition.getHashScheme() != dto::HashScheme::Range) {
-            return RPCResponse(dto::K23SIStatus::OperationNotAllowed("Query not implemented for hash partitioned collection"), dto::K23SIQueryResponse{});
+            return seastar::make_ready_future<Status>(dto::K23SIStatus::OperationNotAllowed("Query not implemented for hash partitioned collection"));
     }
 
     auto iter = _initializeScan(request);
-    for (; !_isScanDone(iter, request, response.results.size(), numScans);
+    for (; !_isScanDone(iter, request, response.results.size(), numScans, pageLimit);
                         _scanAdvance(iter, request)) {
         ++numScans;
         auto [record, conflict] = iter.getDataRecordAt(request.mtr.timestamp);
@@ -591,9 +845,9 @@ K23SIPartitionModule::handleQuery(dto::K23SIQueryRequest&& request, dto::K23SIQu
         // happy case: either committed, or txn is reading its own write
         if (!conflict) {
             if (!record->isTombstone) {
-                auto [status, keep] = _doQueryFilter(request, record->value);
+                auto [status, keep] = _doQueryFilter(request, record->value, filters);
                 if (!status.is2xxOK()) {
-                    return RPCResponse(std::move(status), dto::K23SIQueryResponse{});
+                    return seastar::make_ready_future<Status>(std::move(status));
                 }
                 if (!keep) {
                     continue;
@@ -609,8 +863,7 @@ K23SIPartitionModule::handleQuery(dto::K23SIQueryRequest&& request, dto::K23SIQu
                     bool success = _makeProjection(record->value, request, storage);
                     if (!success) {
                         K2LOG_W(log::skvsvr, "Error making projection!");
-                        return RPCResponse(dto::K23SIStatus::InternalError("Error making projection"),
-                                                dto::K23SIQueryResponse{});
+                        return seastar::make_ready_future<Status>(dto::K23SIStatus::InternalError("Error making projection"));
                     }
 
                     response.results.push_back(std::move(storage));
@@ -646,22 +899,165 @@ K23SIPartitionModule::handleQuery(dto::K23SIQueryRequest&& request, dto::K23SIQu
         _queryPageReturns.add(response.results.size());
 
         return _doPush(request.key, record->timestamp, request.mtr, deadline, ++count)
-        .then([this, request=std::move(request),
-                        resp=std::move(response), deadline, count](auto&& retryChallenger) mutable {
+        .then([this, &request, &response, &filters, pageLimit, &paginated, deadline, count](auto&& retryChallenger) mutable {
             if (!retryChallenger.is2xxOK()) {
                 // sitting transaction won. Abort the incoming request
-                return RPCResponse(dto::K23SIStatus::AbortConflict("incumbent txn won in query push"), dto::K23SIQueryResponse{});
+                return seastar::make_ready_future<Status>(dto::K23SIStatus::AbortConflict("incumbent txn won in query push"));
             }
-            return handleQuery(std::move(request), std::move(resp), deadline, count);
+            return _processQuery(request, response, filters, pageLimit, paginated, deadline, count);
         });
     }
 
     response.nextToScan = _getContinuationToken(iter, request, response, response.results.size());
+    // the scan stopped inside the partition if the continuation is the key we stopped at
+    paginated = !iter.atEnd() && response.nextToScan.partitionKey != "";
     K2LOG_D(log::skvsvr, "nextToScan: {}, exclusiveToken: {}", response.nextToScan, response.exclusiveToken);
 
     _queryPageScans.add(numScans);
     _queryPageReturns.add(response.results.size());
-    return RPCResponse(dto::K23SIStatus::OK("Query success"), std::move(response));
+    return seastar::make_ready_future<Status>(dto::K23SIStatus::OK("Query success"));
+}
+
+void K23SIPartitionModule::_handleQueryStreamOpen(Request&& request) {
+    dto::K23SIQueryStreamOpenRequest openRequest;
+    if (!request.payload->read(openRequest)) {
+        K2LOG_W(log::skvsvr, "unable to parse stream open request from {}", request.endpoint.url);
+        return;
+    }
+    K2LOG_D(log::skvsvr, "Partition: {}, opening query stream {} from {}", _partition, openRequest, request.endpoint.url);
+
+    QueryStreamId id(request.endpoint.url, openRequest.streamId);
+    auto it = _queryStreams.find(id);
+    if (it != _queryStreams.end()) {
+        // the client reused the id, which means it is done with the old stream
+        _closeQueryStream(*it->second);
+    }
+
+    auto stream = seastar::make_lw_shared<QueryStream>(QueryStream{
+        .request = std::move(openRequest.query),
+        .endpoint = std::move(request.endpoint),
+        .streamId = openRequest.streamId,
+        .credits = openRequest.credits,
+        .lastActivity = CachedSteadyClock::now(),
+    });
+    _queryStreams[std::move(id)] = stream;
+    _queryStreamsOpened++;
+    _runQueryStream(std::move(stream));
+}
+
+void K23SIPartitionModule::_handleQueryStreamCredit(Request&& request) {
+    dto::K23SIQueryStreamCreditRequest creditRequest;
+    if (!request.payload->read(creditRequest)) {
+        K2LOG_W(log::skvsvr, "unable to parse stream credit request from {}", request.endpoint.url);
+        return;
+    }
+    K2LOG_D(log::skvsvr, "Partition: {}, credits for query stream {} from {}", _partition, creditRequest, request.endpoint.url);
+
+    auto it = _queryStreams.find(QueryStreamId(request.endpoint.url, creditRequest.streamId));
+    if (it == _queryStreams.end()) {
+        // the stream is already done or expired. The client will find out from the last chunk it received
+        return;
+    }
+    auto stream = it->second;
+    if (creditRequest.close) {
+        _closeQueryStream(*stream);
+        return;
+    }
+    stream->credits += creditRequest.credits;
+    stream->lastActivity = CachedSteadyClock::now();
+    _runQueryStream(std::move(stream));
+}
+
+void K23SIPartitionModule::_runQueryStream(seastar::lw_shared_ptr<QueryStream> stream) {
+    if (stream->running || stream->closed || stream->credits == 0) {
+        // either we're already producing chunks, or we have to wait for more credits
+        return;
+    }
+    stream->running = true;
+    stream->runFut = seastar::do_until(
+        [stream] { return stream->closed || stream->credits == 0; },
+        [this, stream] {
+            size_t pageLimit = std::min<uint64_t>(stream->credits, _config.queryStreamChunkSize());
+            return seastar::do_with(dto::K23SIQueryResponse{}, false,
+                [this, stream, pageLimit] (auto& response, bool& paginated) {
+                return _processQuery(stream->request, response, stream->filters, pageLimit, paginated,
+                                     FastDeadline(_config.readTimeout()), 0)
+                .then([this, stream, &response, &paginated] (auto&& status) {
+                    if (stream->closed) {
+                        // closed while we were pushing
+                        return seastar::make_ready_future();
+                    }
+                    dto::K23SIQueryStreamChunk chunk{.streamId = stream->streamId, .status = std::move(status)};
+                    if (!chunk.status.is2xxOK()) {
+                        _closeQueryStream(*stream);
+                        return _sendQueryStreamChunk(*stream, std::move(chunk));
+                    }
+
+                    size_t count = response.results.size();
+                    stream->credits -= std::min<uint64_t>(count, stream->credits);
+                    if (paginated) {
+                        // continue the scan from where this chunk stopped
+                        stream->request.key = response.nextToScan;
+                        stream->request.exclusiveKey = response.exclusiveToken;
+                        if (stream->request.recordLimit >= 0) {
+                            stream->request.recordLimit -= count;
+                        }
+                        if (count == 0) {
+                            // we hit the scan limit without finding anything. Keep scanning
+                            return seastar::make_ready_future();
+                        }
+                    } else {
+                        // the scan in this partition is complete
+                        chunk.done = true;
+                        _closeQueryStream(*stream);
+                    }
+                    chunk.nextToScan = std::move(response.nextToScan);
+                    chunk.exclusiveToken = response.exclusiveToken;
+                    chunk.results = std::move(response.results);
+                    return _sendQueryStreamChunk(*stream, std::move(chunk));
+                });
+            });
+        })
+        .handle_exception([this, stream] (auto exc) {
+            K2LOG_W_EXC(log::skvsvr, exc, "query stream {} from {} failed", stream->streamId, stream->endpoint.url);
+            _closeQueryStream(*stream);
+        })
+        .finally([stream] {
+            stream->running = false;
+        });
+}
+
+seastar::future<> K23SIPartitionModule::_sendQueryStreamChunk(QueryStream& stream, dto::K23SIQueryStreamChunk&& chunk) {
+    K2LOG_D(log::skvsvr, "sending query stream chunk with {} results, done={}, status={} to {}",
+            chunk.results.size(), chunk.done, chunk.status, stream.endpoint.url);
+    auto payload = stream.endpoint.newPayload();
+    payload->write(chunk);
+    _queryStreamChunks++;
+    return RPC().send(dto::Verbs::K23SI_QUERY_STREAM_CHUNK, std::move(payload), stream.endpoint);
+}
+
+void K23SIPartitionModule::_closeQueryStream(QueryStream& stream) {
+    if (stream.closed) {
+        return;
+    }
+    stream.closed = true;
+    auto it = _queryStreams.find(QueryStreamId(stream.endpoint.url, stream.streamId));
+    if (it != _queryStreams.end() && it->second.get() == &stream) {
+        _queryStreams.erase(it);
+    }
+}
+
+void K23SIPartitionModule::_expireQueryStreams() {
+    auto expiry = CachedSteadyClock::now() - _config.queryStreamIdleTimeout();
+    for (auto it = _queryStreams.begin(); it != _queryStreams.end();) {
+        auto stream = (it++)->second;
+        // streams which are producing chunks are not idle
+        if (!stream->running && stream->lastActivity < expiry) {
+            K2LOG_D(log::skvsvr, "expiring idle query stream {} from {}", stream->streamId, stream->endpoint.url);
+            _queryStreamsExpired++;
+            _closeQueryStream(*stream);
+        }
+    }
 }
 
 seastar::future<std::tuple<Status, dto::K23SIReadResponse>>
@@ -673,16 +1069,27 @@ K23SIPartitionModule::handleRead(dto::K23SIReadRequest&& request, FastDeadline d
         return RPCResponse(std::move(validateStatus), dto::K23SIReadResponse{});
     }
 
-    K2LOG_D(log::skvsvr, "read from txn {}, updates read cache for key {}",
-                request.mtr, request.key);
-
     // find the record we should return
     auto iter = _indexer.find(request.key);
-    iter.observeAt(request.mtr.timestamp);
+    if (request.snapshotRead && _isClosed(request.mtr.timestamp)) {
+        // Nothing can be written at or below a closed timestamp anymore, so this read can't be invalidated
+        // and there is no need to register it in the read cache
+        K2LOG_D(log::skvsvr, "snapshot read from txn {} for key {}", request.mtr, request.key);
+        _snapshotReads++;
+    }
+    else {
+        if (request.snapshotRead) {
+            _snapshotReadFallbacks++;
+        }
+        K2LOG_D(log::skvsvr, "read from txn {}, updates read cache for key {}",
+                    request.mtr, request.key);
+        iter.observeAt(request.mtr.timestamp);
+    }
     auto [rec, conflict] = iter.getDataRecordAt(request.mtr.timestamp);
 
     if (conflict) {
-        // record is still pending and isn't from same transaction.
+        // record is still pending and isn't from same transaction. For snapshot reads, this can only be a WI
+        // which was placed before the timestamp was closed, so the push is rare
         return _doPush(request.key, rec->timestamp, request.mtr, deadline, ++count)
             .then([this, request=std::move(request), deadline, count](auto&& retryChallenger) mutable {
                 if (!retryChallenger.is2xxOK()) {
@@ -702,6 +1109,48 @@ K23SIPartitionModule::handleRead(dto::K23SIReadRequest&& request, FastDeadline d
     return RPCResponse(dto::K23SIStatus::OK("read succeeded"), std::move(response));
 }
 
+seastar::future<std::tuple<Status, dto::K23SIReadBatchResponse>>
+K23SIPartitionModule::handleReadBatch(dto::K23SIReadBatchRequest&& request, FastDeadline deadline) {
+    K2LOG_D(log::skvsvr, "Partition: {}, received read batch {}", _partition, request);
+
+    if (!_validateRequestPartition(request)) {
+        // tell client their collection partition is gone
+        return RPCResponse(dto::K23SIStatus::RefreshCollection("collection refresh needed in read batch request"), dto::K23SIReadBatchResponse{});
+    }
+    if (request.keys.empty()) {
+        return RPCResponse(dto::K23SIStatus::BadParameter("no keys in read batch request"), dto::K23SIReadBatchResponse{});
+    }
+    _readBatchKeys.add(request.keys.size());
+
+    // Each key goes through the single-read path, which validates the key and observes it at the MTR timestamp
+    // (unless this is a snapshot read at a closed timestamp).
+    // Keys without a conflict complete immediately; the rest push and retry concurrently
+    std::vector<seastar::future<std::tuple<Status, dto::K23SIReadResponse>>> futs;
+    futs.reserve(request.keys.size());
+    for (auto& key : request.keys) {
+        futs.push_back(handleRead(dto::K23SIReadRequest{
+                .pvid = request.pvid,
+                .collectionName = request.collectionName,
+                .mtr = request.mtr,
+                .key = std::move(key),
+                .snapshotRead = request.snapshotRead
+            }, deadline, 0));
+    }
+
+    return seastar::when_all_succeed(futs.begin(), futs.end())
+        .then([] (auto&& readResults) {
+            dto::K23SIReadBatchResponse response;
+            response.results.reserve(readResults.size());
+            for (auto& [status, readResp] : readResults) {
+                response.results.push_back(dto::K23SIReadBatchResult{
+                    .status = std::move(status),
+                    .value = std::move(readResp.value)
+                });
+            }
+            return RPCResponse(dto::K23SIStatus::OK("read batch completed"), std::move(response));
+        });
+}
+
 std::size_t K23SIPartitionModule::_findField(const dto::Schema schema, k2::String fieldName ,dto::FieldType fieldtype) {
     std::size_t fieldNumber = -1;
     for (std::size_t i = 0; i < schema.fields.size(); ++i) {
@@ -837,6 +1286,8 @@ bool K23SIPartitionModule::_makeFieldsForSameVersion(dto::Schema& schema, dto::K
 
     request.value.fieldData = std::move(payload);
     request.value.fieldData.truncateToCurrent();
+    // the field data was rebuilt so any offsets we had are stale
+    request.value.fieldOffsets.clear();
     return true;
 }
 
@@ -933,6 +1384,8 @@ bool K23SIPartitionModule::_makeFieldsForDiffVersion(dto::Schema& schema, dto::S
 
     request.value.fieldData = std::move(payload);
     request.value.fieldData.truncateToCurrent();
+    // the field data was rebuilt so any offsets we had are stale
+    request.value.fieldOffsets.clear();
     return true;
 }
 
@@ -1015,6 +1468,7 @@ bool K23SIPartitionModule::_makeProjection(dto::SKVRecord::Storage& fullRec, dto
     projectionRec.fieldData = std::move(projectedPayload);
     projectionRec.fieldData.truncateToCurrent();
     projectionRec.schemaVersion = fullRec.schemaVersion;
+    projectionRec.fieldOffsets.clear();
     return true;
 }
 
@@ -1070,6 +1524,116 @@ K23SIPartitionModule::handleWrite(dto::K23SIWriteRequest&& request, FastDeadline
     return _processWrite(std::move(request), deadline, 0);
 }
 
+seastar::future<std::tuple<Status, dto::K23SIWriteResponse>>
+K23SIPartitionModule::handleWriteAndCommit(dto::K23SIWriteAndCommitRequest&& request, FastDeadline deadline) {
+    K2LOG_D(log::skvsvr, "Partition: {}, handle write and commit: {}", _partition, request);
+    auto& write = request.write;
+    write.pvid = request.pvid;
+    write.collectionName = std::move(request.collectionName);
+    write.mtr = std::move(request.mtr);
+    write.key = std::move(request.key);
+    if (write.trhCollection != _cmeta.name || !_partition.owns(write.trh)) {
+        // the client has to end the txn as usual
+        return handleWrite(std::move(write), deadline);
+    }
+
+    // We hold the TRH so we can end the txn here once the write is in. The client only asks for this
+    // when all other writes of the txn have been acknowledged
+    dto::K23SITxnEndRequest endRequest{
+        .pvid = write.pvid,
+        .collectionName = write.collectionName,
+        .key = write.trh,
+        .mtr = write.mtr,
+        .action = dto::EndAction::Commit,
+        .writeRanges = std::move(request.writeRanges),
+        .syncFinalize = request.syncFinalize
+    };
+    return handleWrite(std::move(write), deadline)
+        .then([this, endRequest=std::move(endRequest)] (auto&& writeResp) mutable {
+            auto& [status, response] = writeResp;
+            if (!status.is2xxOK()) {
+                // the client has to end the txn as usual
+                K2LOG_D(log::skvsvr, "not committing txn {} after failed write with status {}", endRequest.mtr, status);
+                return seastar::make_ready_future<std::tuple<Status, dto::K23SIWriteResponse>>(std::move(writeResp));
+            }
+            endRequest.writeRanges[_cmeta.name].insert(_partition().keyRangeV);
+            return handleTxnEnd(std::move(endRequest))
+                .then([this] (auto&& endResp) {
+                    auto& [endStatus, k2response] = endResp;
+                    if (endStatus.is2xxOK()) {
+                        _writeCommits++;
+                    }
+                    return RPCResponse(std::move(endStatus), dto::K23SIWriteResponse{.txnEnded = true});
+                });
+        });
+}
+
+seastar::future<std::tuple<Status, dto::K23SIWriteBatchResponse>>
+K23SIPartitionModule::handleWriteBatch(dto::K23SIWriteBatchRequest&& request, FastDeadline deadline) {
+    K2LOG_D(log::skvsvr, "Partition: {}, handle write batch: {}", _partition, request);
+    if (!_validateRequestPartition(request)) {
+        // tell client their collection partition is gone
+        return RPCResponse(dto::K23SIStatus::RefreshCollection("collection refresh needed in write batch"), dto::K23SIWriteBatchResponse{});
+    }
+    if (request.writes.empty()) {
+        return RPCResponse(dto::K23SIStatus::BadParameter("no writes in write batch request"), dto::K23SIWriteBatchResponse{});
+    }
+    // The writes are processed in parallel, so two writes to the same key would race each other
+    std::vector<const dto::Key*> keys;
+    keys.reserve(request.writes.size());
+    for (auto& write : request.writes) {
+        keys.push_back(&write.key);
+    }
+    std::sort(keys.begin(), keys.end(), [] (const dto::Key* a, const dto::Key* b) { return *a < *b; });
+    if (std::adjacent_find(keys.begin(), keys.end(), [] (const dto::Key* a, const dto::Key* b) { return *a == *b; }) != keys.end()) {
+        return RPCResponse(dto::K23SIStatus::BadParameter("duplicate keys in write batch request"), dto::K23SIWriteBatchResponse{});
+    }
+    _writeBatchKeys.add(request.writes.size());
+
+    auto fut = seastar::make_ready_future<Status>(dto::K23SIStatus::OK);
+    if (request.designateTRH) {
+        fut = _designateTRH(request.mtr, request.key);
+    }
+
+    return fut.then([this, request=std::move(request), deadline] (auto&& status) mutable {
+        if (!status.is2xxOK()) {
+            K2LOG_D(log::skvsvr, "failed creating TR for {}", request.mtr);
+            return RPCResponse(std::move(status), dto::K23SIWriteBatchResponse{});
+        }
+
+        // All writes which don't need a push complete synchronously here, so their WIs are appended to
+        // the same persistence buffer and go out with the flush done before we respond
+        std::vector<seastar::future<std::tuple<Status, dto::K23SIWriteResponse>>> futs;
+        futs.reserve(request.writes.size());
+        for (auto& write : request.writes) {
+            futs.push_back(_processWrite(dto::K23SIWriteRequest{
+                    .pvid = request.pvid,
+                    .collectionName = request.collectionName,
+                    .mtr = request.mtr,
+                    .trh = request.trh,
+                    .trhCollection = request.trhCollection,
+                    .isDelete = write.isDelete,
+                    .designateTRH = false,
+                    .precondition = write.precondition,
+                    .request_id = write.request_id,
+                    .key = std::move(write.key),
+                    .value = std::move(write.value),
+                    .fieldsForPartialUpdate = std::move(write.fieldsForPartialUpdate)
+                }, deadline, 0));
+        }
+
+        return seastar::when_all_succeed(futs.begin(), futs.end())
+            .then([] (auto&& writeResults) {
+                dto::K23SIWriteBatchResponse response;
+                response.statuses.reserve(writeResults.size());
+                for (auto& [status, writeResp] : writeResults) {
+                    response.statuses.push_back(std::move(status));
+                }
+                return RPCResponse(dto::K23SIStatus::OK("write batch completed"), std::move(response));
+            });
+    });
+}
+
 seastar::future<std::tuple<Status, dto::K23SIWriteResponse>>
 K23SIPartitionModule::_processWrite(dto::K23SIWriteRequest&& request, FastDeadline deadline, uint32_t count) {
     K2LOG_D(log::skvsvr, "processing write: {} with count {}", request, count);
@@ -1172,7 +1736,7 @@ K23SIPartitionModule::_createWI(dto::K23SIWriteRequest&& request, Indexer::Itera
     // the TWIM accepted the write. Add it as a WI now
     iter.addWI(request.key, std::move(rec), request.request_id);
     _totalWI++;
-    _persistence->append(iter.getWI()->data);
+    _persistence->append(PersistenceRecordType::WriteIntent, request.key, *iter.getWI());
     return Statuses::S201_Created("WI created");
 }
 
@@ -1259,12 +1823,12 @@ K23SIPartitionModule::_doPush(dto::Key key, dto::Timestamp incumbentId, dto::K23
             });
         }
         else {
-            // we don't know locally what's going on with this txn. Make a remote call to find out
+            // we don't know locally what's going on with this txn. Ask the TRH to find out
             fut = fut.then([this, &request, deadline] (auto&&) {
-                return _cpo.partitionRequest<dto::K23SITxnPushRequest, dto::K23SITxnPushResponse, dto::Verbs::K23SI_TXN_PUSH>(deadline, request);
+                return _pushToTRH(request, deadline);
             });
         }
-        return fut.then([this, &key, &request](auto&& responsePair) {
+        return fut.then([this, &key, &request, deadline](auto&& responsePair) {
             auto& [status, response] = responsePair;
             K2LOG_D(log::skvsvr, "Push request completed with status={} and response={}", status, response);
             if (!status.is2xxOK()) {
@@ -1282,6 +1846,10 @@ K23SIPartitionModule::_doPush(dto::Key key, dto::Timestamp incumbentId, dto::K23
             if (wi && wi->data.timestamp == request.incumbentMTR.timestamp) {
                 switch (response.incumbentFinalization) {
                     case dto::EndAction::None: {
+                        if (!response.allowChallengerRetry && _config.conflictWaitTimeout() > 0s) {
+                            // the incumbent is still going and it beat us. Rather than aborting, wait for it to finish
+                            return _waitForIncumbent(key, deadline);
+                        }
                         break;
                     }
                     case dto::EndAction::Abort: {
@@ -1315,6 +1883,86 @@ K23SIPartitionModule::_doPush(dto::Key key, dto::Timestamp incumbentId, dto::K23
     });
 }
 
+seastar::future<Status>
+K23SIPartitionModule::_waitForIncumbent(const dto::Key& key, FastDeadline deadline) {
+    auto timeout = std::min(_config.conflictWaitTimeout(), deadline.getRemaining());
+    K2LOG_D(log::skvsvr, "waiting up to {} for WI at key {} to be finalized", timeout, key);
+    _conflictWaits++;
+    k2::OperationLatencyReporter reporter(_conflictWaitLatency);
+    auto [waiterId, waitFut] = _indexer.waitForWI(key);
+    return seastar::with_timeout(Clock::now() + timeout, std::move(waitFut))
+        .then_wrapped([this, &key, waiterId=waiterId, reporter=std::move(reporter)] (auto&& fut) mutable {
+            reporter.report();
+            if (fut.failed()) {
+                // timed out, or we're shutting down. We're no longer waiting, so drop our waiter
+                fut.ignore_ready_future();
+                _indexer.removeWaiter(key, waiterId);
+                K2LOG_D(log::skvsvr, "conflict wait did not complete");
+                _conflictWaitTimeouts++;
+                return seastar::make_ready_future<Status>(dto::K23SIStatus::AbortConflict("incumbent txn did not finish while waiting"));
+            }
+            return seastar::make_ready_future<Status>(dto::K23SIStatus::OK("incumbent WI finalized while waiting"));
+        });
+}
+
+seastar::future<std::tuple<Status, dto::K23SITxnPushResponse>>
+K23SIPartitionModule::_pushToTRH(dto::K23SITxnPushRequest& request, FastDeadline deadline) {
+    std::optional<unsigned> core;
+    if (_config.localPush()) {
+        if (auto it = _cpo.collections.find(request.collectionName); it != _cpo.collections.end()) {
+            auto& part = it->second->getPartitionForKey(request.key);
+            if (part.partition) {
+                request.pvid = part.partition->keyRangeV.pvid;
+                core = LocalPartitions::findCore(request.pvid);
+            }
+        }
+    }
+    if (!core) {
+        _remotePushes++;
+        return _cpo.partitionRequest<dto::K23SITxnPushRequest, dto::K23SITxnPushResponse, dto::Verbs::K23SI_TXN_PUSH>(deadline, request);
+    }
+
+    if (deadline.isOver()) {
+        return RPCResponse(Statuses::S408_Request_Timeout("push deadline exceeded"), dto::K23SITxnPushResponse{});
+    }
+
+    K2LOG_D(log::skvsvr, "Pushing to TRH on local core {} for request {}", *core, request);
+    auto fut = seastar::smp::submit_to(*core, [request=request] () mutable {
+            auto* module = LocalPartitions::findModule(request.pvid);
+            if (module == nullptr) {
+                return RPCResponse(Statuses::S410_Gone("partition is no longer hosted on this core"), dto::K23SITxnPushResponse{});
+            }
+            // same checks and metrics as for a push which arrives as an RPC
+            if (!AppBase().getDist<cpo::HeartbeatResponder>().local().isUp() || module->_config.localPushRefuse()) {
+                return RPCResponse(dto::K23SIStatus::RefreshCollection("Heartbeat is dead"), dto::K23SITxnPushResponse{});
+            }
+            k2::OperationLatencyReporter reporter(module->_pushLatency); // for reporting metrics
+            return module->handleTxnPush(std::move(request))
+                .then([reporter=std::move(reporter)] (auto&& response) mutable {
+                    reporter.report();
+                    return std::move(response);
+                });
+        });
+    return seastar::with_timeout(Clock::now() + deadline.getRemaining(), std::move(fut))
+        .then_wrapped([this, &request, deadline] (auto&& fut) {
+            if (fut.failed()) {
+                // the TRH core may still complete the push, but we're not waiting for it any more
+                K2LOG_W_EXC(log::skvsvr, fut.get_exception(), "Local push did not complete for request {}", request);
+                return RPCResponse(Statuses::S408_Request_Timeout("push deadline exceeded"), dto::K23SITxnPushResponse{});
+            }
+            auto result = fut.get0();
+            auto& status = std::get<0>(result);
+            if (status == Statuses::S410_Gone || status == dto::K23SIStatus::RefreshCollection) {
+                // our partition map is out of date, or the TRH is not serving. Let the RPC path deal with it
+                K2LOG_D(log::skvsvr, "Local push failed with {}. Retrying as an RPC", status);
+                _remotePushes++;
+                return _cpo.partitionRequest<dto::K23SITxnPushRequest, dto::K23SITxnPushResponse, dto::Verbs::K23SI_TXN_PUSH>(deadline, request);
+            }
+            _localPushes++;
+            return seastar::make_ready_future<std::tuple<Status, dto::K23SITxnPushResponse>>(std::move(result));
+        });
+}
+
 seastar::future<std::tuple<Status, dto::K23SITxnFinalizeResponse>>
 K23SIPartitionModule::handleTxnFinalize(dto::K23SITxnFinalizeRequest&& request) {
     // find the version deque for the key
@@ -1324,29 +1972,37 @@ K23SIPartitionModule::handleTxnFinalize(dto::K23SITxnFinalizeRequest&& request)
         return RPCResponse(dto::K23SIStatus::RefreshCollection("collection refresh needed in finalize"), dto::K23SITxnFinalizeResponse{});
     }
 
-    if (auto status = _twimMgr.endTxn(request.txnTimestamp, request.action); !status.is2xxOK()) {
-        K2LOG_W(log::skvsvr, "Unable to end transaction {} with local txn metadata due to {}", request.txnTimestamp, status);
+    if (auto status = _finalizeTxn(request.txnTimestamp, request.action, true); !status.is2xxOK()) {
         return RPCResponse(std::move(status), dto::K23SITxnFinalizeResponse{});
     }
 
+    return RPCResponse(dto::K23SIStatus::OK("Finalization success"), dto::K23SITxnFinalizeResponse{});
+}
+
+Status K23SIPartitionModule::_finalizeTxn(dto::Timestamp txnts, dto::EndAction action, bool persistTwim) {
+    if (auto status = _twimMgr.endTxn(txnts, action); !status.is2xxOK()) {
+        K2LOG_W(log::skvsvr, "Unable to end transaction {} with local txn metadata due to {}", txnts, status);
+        return status;
+    }
+
     // Put the twim in Finalizing state
-    if (auto status=_twimMgr.finalizingWIs(request.txnTimestamp); !status.is2xxOK()) {
-        K2LOG_W(log::skvsvr, "Unable to start finalizing in transaction {} with local txn metadata due to {}", request.txnTimestamp, status);
-        return RPCResponse(std::move(status), dto::K23SITxnFinalizeResponse{});
+    if (auto status=_twimMgr.finalizingWIs(txnts); !status.is2xxOK()) {
+        K2LOG_W(log::skvsvr, "Unable to start finalizing in transaction {} with local txn metadata due to {}", txnts, status);
+        return status;
     };
 
-    if (auto status = _finalizeTxnWIs(request.txnTimestamp, request.action); !status.is2xxOK()) {
-        K2LOG_W(log::skvsvr, "Unable to finalize WIs in transaction {} due to {}", request.txnTimestamp, status);
-        return RPCResponse(std::move(status), dto::K23SITxnFinalizeResponse{});
+    if (auto status = _finalizeTxnWIs(txnts, action); !status.is2xxOK()) {
+        K2LOG_W(log::skvsvr, "Unable to finalize WIs in transaction {} due to {}", txnts, status);
+        return status;
     }
 
     // Finalize and discard the twim
-    if (auto status=_twimMgr.finalizedTxn(request.txnTimestamp); !status.is2xxOK()) {
-        K2LOG_W(log::skvsvr, "Unable to complete finalization in transaction {} with local txn metadata due to {}", request.txnTimestamp, status);
-        return RPCResponse(std::move(status), dto::K23SITxnFinalizeResponse{});
+    if (auto status=_twimMgr.finalizedTxn(txnts, persistTwim); !status.is2xxOK()) {
+        K2LOG_W(log::skvsvr, "Unable to complete finalization in transaction {} with local txn metadata due to {}", txnts, status);
+        return status;
     };
 
-    return RPCResponse(dto::K23SIStatus::OK("Finalization success"), dto::K23SITxnFinalizeResponse{});
+    return dto::K23SIStatus::OK;
 }
 
 Status K23SIPartitionModule::_finalizeTxnWIs(dto::Timestamp txnts, dto::EndAction action) {
@@ -1414,7 +2070,7 @@ K23SIPartitionModule::handleInspectRecords(dto::K23SIInspectRecordsRequest&& req
         return RPCResponse(dto::K23SIStatus::KeyNotFound("Key not found in indexer"), dto::K23SIInspectRecordsResponse{});
     }
 
-    dto::K23SIInspectRecordsResponse response{.records=iter.getAllDataRecords()};
+    dto::K23SIInspectRecordsResponse response{.records=iter.getAllDataRecords(), .lastReadTime=iter.getLastReadTime()};
     return RPCResponse(dto::K23SIStatus::OK("Inspect records success"), std::move(response));
 }
 
@@ -1480,9 +2136,269 @@ K23SIPartitionModule::handleInspectAllKeys(dto::K23SIInspectAllKeysRequest&& req
 }
 
 seastar::future<> K23SIPartitionModule::_recovery() {
-    //TODO perform recovery
-    K2LOG_D(log::skvsvr, "Partition: {}, recovery", _partition);
-    return seastar::make_ready_future();
+    K2LOG_I(log::skvsvr, "Partition: {}, starting recovery", _partition);
+    auto start = Clock::now();
+    return seastar::do_with(RecoveryState{}, [this, start] (auto& state) {
+        // snapshot chunks use the same format as the persisted batches
+        return _persistence->loadSnapshot([this, &state] (Payload&& chunk) {
+                _replayBatch(chunk, state);
+            })
+            .then([this, &state] (uint64_t startSequence) {
+                // the snapshot reflects everything before its start sequence, so we only replay the log after that
+                return _persistence->recover(startSequence, [this, &state] (dto::K23SI_PersistenceRequest<Payload>&& batch) {
+                    _replayBatch(batch.value.val, state);
+                });
+            })
+            .then([this, &state, start] {
+                _completeReplay(state);
+                _recoveredRecords = state.records;
+                _recoveredBytes = state.bytes;
+                _recoveryTime = Clock::now() - start;
+                K2LOG_I(log::skvsvr,
+                    "Partition: {}, recovered {} records ({} bytes) from {} batches in {}: {} records/s, {} MB/s",
+                    _partition, _recoveredRecords, _recoveredBytes, state.batches, _recoveryTime,
+                    _recoveryRate(_recoveredRecords), _recoveryRate(_recoveredBytes) / (1024 * 1024));
+            });
+    });
+}
+
+double K23SIPartitionModule::_recoveryRate(uint64_t count) const {
+    auto secs = std::chrono::duration<double>(_recoveryTime).count();
+    return secs > 0 ? count / secs : 0;
+}
+
+void K23SIPartitionModule::_replayBatch(Payload& batch, RecoveryState& state) {
+    batch.seek(0);
+    while (batch.getDataRemaining() > 0) {
+        PersistenceRecordType type;
+        if (!batch.read(type)) {
+            throw std::runtime_error("unable to read persisted record type");
+        }
+        switch (type) {
+            case PersistenceRecordType::WriteIntent: {
+                dto::Key key;
+                dto::WriteIntent wi;
+                if (!batch.read(key) || !batch.read(wi)) {
+                    throw std::runtime_error("unable to read persisted write intent");
+                }
+                _replayWI(std::move(key), std::move(wi), state);
+                break;
+            }
+            case PersistenceRecordType::TxnRecord: {
+                TxnRecord rec;
+                if (!batch.read(rec)) {
+                    throw std::runtime_error("unable to read persisted txn record");
+                }
+                if (rec.onePhase && rec.finalizeAction != dto::EndAction::None) {
+                    // the end record of a one-phase txn is also the outcome of its WIs, which are all in this
+                    // partition. The twim may come later in a snapshot, so we record the outcome with it now
+                    _replayOutcome(rec.mtr.timestamp, rec.finalizeAction, state);
+                    _twimMgr.replay(TxnWIMeta{.trh=rec.trh, .trhCollection=_cmeta.name, .mtr=rec.mtr,
+                                              .finalizeAction=rec.finalizeAction});
+                }
+                _txnMgr.replay(std::move(rec));
+                break;
+            }
+            case PersistenceRecordType::TxnWIMeta: {
+                TxnWIMeta twim;
+                if (!batch.read(twim)) {
+                    throw std::runtime_error("unable to read persisted twim");
+                }
+                // Once the outcome is known, the WIs of the txn can be applied. We persist the outcome either
+                // when a PUSH finalizes the WIs or when the txn finalizes them
+                if (twim.finalizeAction != dto::EndAction::None) {
+                    _replayOutcome(twim.mtr.timestamp, twim.finalizeAction, state);
+                }
+                _twimMgr.replay(std::move(twim));
+                break;
+            }
+            case PersistenceRecordType::SnapshotSchema: {
+                if (!batch.read(state.snapshotSchema)) {
+                    throw std::runtime_error("unable to read snapshot schema");
+                }
+                break;
+            }
+            case PersistenceRecordType::SnapshotVersions: {
+                dto::Key key{.schemaName=state.snapshotSchema, .partitionKey="", .rangeKey=""};
+                uint64_t count = 0;
+                if (!batch.read(key.partitionKey) || !batch.read(key.rangeKey) || !batch.read(count)) {
+                    throw std::runtime_error("unable to read snapshot versions");
+                }
+                VersionsT versions;
+                for (uint64_t i = 0; i < count; ++i) {
+                    dto::DataRecord rec;
+                    if (!batch.read(rec)) {
+                        throw std::runtime_error("unable to read snapshot version");
+                    }
+                    _totalCommittedPayload += rec.value.fieldData.getSize();
+                    versions.push_back(std::move(rec));
+                }
+                _recordVersions += count;
+                _indexer.loadCommitted(key, std::move(versions));
+                break;
+            }
+            default:
+                throw std::runtime_error(fmt::format("unknown persisted record type {}", type));
+        }
+        ++state.records;
+    }
+    state.bytes += batch.getSize();
+    ++state.batches;
+}
+
+void K23SIPartitionModule::_replayWI(dto::Key&& key, dto::WriteIntent&& wi, RecoveryState& state) {
+    auto txnts = wi.data.timestamp;
+    // The twim is persisted before the first WI of the txn. A snapshot may however contain WIs for twims which were
+    // created after it started, in which case the twim follows in the log
+    TxnWIMeta* twim = _twimMgr.getTxnWIMeta(txnts);
+    if (twim != nullptr && twim->finalizeAction != dto::EndAction::None) {
+        _replayFinalizedWI(key, std::move(wi), twim->finalizeAction);
+        return;
+    }
+    state.pendingWIs[txnts].insert_or_assign(std::move(key), std::move(wi));
+}
+
+void K23SIPartitionModule::_replayOutcome(dto::Timestamp txnts, dto::EndAction action, RecoveryState& state) {
+    auto it = state.pendingWIs.find(txnts);
+    if (it == state.pendingWIs.end()) {
+        return;
+    }
+    for (auto& [key, wi]: it->second) {
+        _replayFinalizedWI(key, std::move(wi), action);
+    }
+    state.pendingWIs.erase(it);
+}
+
+void K23SIPartitionModule::_replayFinalizedWI(const dto::Key& key, dto::WriteIntent&& wi, dto::EndAction action) {
+    if (action != dto::EndAction::Commit) {
+        // aborted WIs leave no trace
+        return;
+    }
+    _totalCommittedPayload += wi.data.value.fieldData.getSize();
+    _recordVersions++;
+    _indexer.replayCommitted(key, std::move(wi.data));
+}
+
+void K23SIPartitionModule::_completeReplay(RecoveryState& state) {
+    // We keep one WI per key, so if more than one unfinished txn wrote the same key, only the newest WI
+    // can be placed. This doesn't happen normally since a PUSH persists the outcome of the txn it finalizes
+    std::unordered_map<dto::Key, dto::Timestamp> newest;
+    for (auto& [txnts, wis]: state.pendingWIs) {
+        for (auto& [key, _]: wis) {
+            auto [it, inserted] = newest.try_emplace(key, txnts);
+            if (!inserted && it->second.compareCertain(txnts) < 0) {
+                it->second = txnts;
+            }
+        }
+    }
+    for (auto& [txnts, wis]: state.pendingWIs) {
+        TxnWIMeta* twim = _twimMgr.getTxnWIMeta(txnts);
+        for (auto& [key, wi]: wis) {
+            if (twim == nullptr || newest[key] != txnts) {
+                K2LOG_W(log::skvsvr, "Partition: {}, dropping replayed WI for key {} of txn {}", _partition, key, txnts);
+                continue;
+            }
+            twim->writeKeys.insert(key);
+            _indexer.replayWI(key, std::move(wi));
+        }
+    }
+    state.pendingWIs.clear();
+
+    _twimMgr.completeReplay();
+    _txnMgr.completeReplay();
+}
+
+seastar::future<> K23SIPartitionModule::_writeSnapshot() {
+    struct SnapshotWriter {
+        uint64_t startSequence{0};
+        uint64_t chunkId{0};
+        uint64_t bytes{0};
+        Payload chunk{Payload::DefaultAllocator()};
+        // the schema of the last key we added to the chunk
+        String chunkSchema;
+        bool done{false};
+    };
+    SnapshotWriter writer;
+    // Anything we change from now on is persisted with this sequence or later. Recovery replays these batches on
+    // top of the snapshot, which makes up for the changes we miss while the snapshot is being written
+    writer.startSequence = _persistence->nextSequence();
+    K2LOG_D(log::skvsvr, "Partition {}, starting snapshot at sequence {}", _partition, writer.startSequence);
+    // the txn state goes first so that the WIs in the snapshot can be resolved when it is loaded
+    _txnMgr.writeSnapshot(writer.chunk);
+    _twimMgr.writeSnapshot(writer.chunk);
+    _indexer.restartSnapshot();
+
+    return seastar::do_with(std::move(writer), [this] (auto& writer) {
+        return seastar::do_until(
+            [this, &writer] {
+                // stop early if we're shutting down
+                return writer.done || !_snapshotTimer.isArmed();
+            },
+            [this, &writer] {
+                k2::OperationLatencyReporter reporter(_snapshotSliceLatency); // for reporting metrics
+                auto chunkSize = _config.snapshotChunkSize();
+                bool passDone = _indexer.visitForSnapshot(_config.snapshotSliceBudget(),
+                    [this, &writer, chunkSize] (const String& schemaName, const IndexerKey& key, const VersionSet& vset) {
+                        _writeSnapshotKey(writer.chunk, writer.chunkSchema, schemaName, key, vset);
+                        return writer.chunk.getSize() < chunkSize;
+                    });
+                reporter.report();
+                if (!passDone && writer.chunk.getSize() < chunkSize) {
+                    // give the reactor back to other tasks before the next slice
+                    return seastar::sleep(_config.snapshotSlicePause());
+                }
+
+                writer.done = passDone;
+                writer.bytes += writer.chunk.getSize();
+                auto chunk = std::exchange(writer.chunk, Payload(Payload::DefaultAllocator()));
+                // each chunk starts with its schema
+                writer.chunkSchema = "";
+                return _persistence->writeSnapshotChunk(writer.startSequence, writer.chunkId++, passDone, std::move(chunk))
+                    .then([] (Status&& status) {
+                        if (!status.is2xxOK()) {
+                            throw std::runtime_error(fmt::format("unable to write snapshot chunk: {}", status));
+                        }
+                    });
+            })
+            .then([this, &writer] {
+                if (writer.done) {
+                    _snapshots++;
+                    _snapshotBytes += writer.bytes;
+                    K2LOG_I(log::skvsvr, "Partition {}, wrote snapshot at sequence {} with {} bytes in {} chunks",
+                            _partition, writer.startSequence, writer.bytes, writer.chunkId);
+                }
+            })
+            .handle_exception([this] (auto exc) {
+                // we'll try again with the next snapshot. Until then, recovery uses the previous snapshot
+                K2LOG_W_EXC(log::skvsvr, exc, "Partition {}, unable to write snapshot", _partition);
+            });
+    });
+}
+
+void K23SIPartitionModule::_writeSnapshotKey(Payload& chunk, String& chunkSchema, const String& schemaName,
+                                             const IndexerKey& key, const VersionSet& vset) {
+    if (vset.empty()) {
+        return;
+    }
+    if (chunkSchema != schemaName) {
+        chunk.write(PersistenceRecordType::SnapshotSchema);
+        chunk.write(schemaName);
+        chunkSchema = schemaName;
+    }
+    if (!vset.committed.empty()) {
+        chunk.write(PersistenceRecordType::SnapshotVersions);
+        chunk.write(key.partitionKey);
+        chunk.write(key.rangeKey);
+        chunk.write(uint64_t(vset.committed.size()));
+        for (auto& rec: vset.committed) {
+            chunk.write(rec);
+        }
+    }
+    if (vset.WI) {
+        chunk.write(PersistenceRecordType::WriteIntent);
+        chunk.write(dto::Key{.schemaName=schemaName, .partitionKey=key.partitionKey, .rangeKey=key.rangeKey});
+        chunk.write(*vset.WI);
+    }
 }
 
 dto::OwnerPartition& K23SIPartitionModule::getOwnerPartition() {
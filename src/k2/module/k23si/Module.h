@@ -59,9 +59,23 @@ public:
     seastar::future<std::tuple<Status, dto::K23SIReadResponse>>
     handleRead(dto::K23SIReadRequest&& request, FastDeadline deadline, uint32_t count);
 
+    // Reads each key in the batch as an individual read would, with pushes for any conflicting keys
+    // running in parallel. Returns a result for each key, in request order
+    seastar::future<std::tuple<Status, dto::K23SIReadBatchResponse>>
+    handleReadBatch(dto::K23SIReadBatchRequest&& request, FastDeadline deadline);
+
     seastar::future<std::tuple<Status, dto::K23SIWriteResponse>>
     handleWrite(dto::K23SIWriteRequest&& request, FastDeadline deadline);
 
+    // If we hold the TRH for the txn, the txn is committed once the write succeeds. Otherwise this is a regular write
+    seastar::future<std::tuple<Status, dto::K23SIWriteResponse>>
+    handleWriteAndCommit(dto::K23SIWriteAndCommitRequest&& request, FastDeadline deadline);
+
+    // Applies each write in the batch as an individual write would. The writes which don't need a push are
+    // all applied in the same task, so that their WIs go out with a single persistence flush
+    seastar::future<std::tuple<Status, dto::K23SIWriteBatchResponse>>
+    handleWriteBatch(dto::K23SIWriteBatchRequest&& request, FastDeadline deadline);
+
     seastar::future<std::tuple<Status, dto::K23SIQueryResponse>>
     handleQuery(dto::K23SIQueryRequest&& request, dto::K23SIQueryResponse&& response, FastDeadline deadline, uint32_t count);
 
@@ -115,6 +129,15 @@ private: // methods
     seastar::future<Status>
     _doPush(dto::Key key, dto::Timestamp incumbentId, dto::K23SI_MTR challengerMTR, FastDeadline deadline, uint32_t count);
 
+    // Sends the given push to the TRH of the incumbent. If the TRH partition is hosted on this node, the push is
+    // handed to its core directly. Otherwise, or if the local core can't handle it, it is sent as an RPC
+    seastar::future<std::tuple<Status, dto::K23SITxnPushResponse>>
+    _pushToTRH(dto::K23SITxnPushRequest& request, FastDeadline deadline);
+
+    // Waits for the WI at the given key to be finalized, for up to the configured conflict wait timeout.
+    // Resolves to OK if the challenger should retry, or AbortConflict if the wait timed out
+    seastar::future<Status> _waitForIncumbent(const dto::Key& key, FastDeadline deadline);
+
     // validate requests are coming to the correct partition. return true if request is valid
     template<typename RequestT>
     bool _validateRequestPartition(const RequestT& req) const;
@@ -122,6 +145,9 @@ private: // methods
     // return true iff the given timestamp is within the retention window for the collection.
     bool _validateRetentionWindow(const dto::Timestamp& ts) const;
 
+    // return true iff the given timestamp is closed, i.e. no more writes can be accepted at or below it
+    bool _isClosed(const dto::Timestamp& ts) const;
+
     // validate keys in the requests must include non-empty partitionKey. return true if request parameter is valid
     template <typename RequestT>
     bool _validateRequestPartitionKey(const RequestT& req) const;
@@ -165,13 +191,56 @@ private: // methods
     Indexer::Iterator _initializeScan(const dto::K23SIQueryRequest& request);
 
     // Helper for handleQuery. Checks to see if the indexer scan should stop.
-    bool _isScanDone(const Indexer::Iterator& iter, const dto::K23SIQueryRequest& request, size_t response_size, uint64_t num_scans);
+    bool _isScanDone(const Indexer::Iterator& iter, const dto::K23SIQueryRequest& request, size_t response_size, uint64_t num_scans, size_t pageLimit);
 
     // Helper for handleQuery. Returns continuation token (aka response.nextToScan)
     dto::Key _getContinuationToken(const Indexer::Iterator& iter, const dto::K23SIQueryRequest& request,
                                             dto::K23SIQueryResponse& response, size_t response_size);
 
-    std::tuple<Status, bool> _doQueryFilter(dto::K23SIQueryRequest& request, dto::SKVRecord::Storage& storage);
+    // the filter of a query, compiled for each schema version we've found in the scan
+    typedef std::unordered_map<uint32_t, dto::expression::CompiledExpression> QueryFilters;
+
+    std::tuple<Status, bool> _doQueryFilter(dto::K23SIQueryRequest& request, dto::SKVRecord::Storage& storage,
+                                            QueryFilters& filters);
+
+    // Scans one page of query results into the response, with at most pageLimit records. The request is updated as
+    // needed for push retries. Sets paginated if the page ended before the end of the scan in this partition
+    seastar::future<Status>
+    _processQuery(dto::K23SIQueryRequest& request, dto::K23SIQueryResponse& response, QueryFilters& filters,
+                  size_t pageLimit, bool& paginated, FastDeadline deadline, uint32_t count);
+
+    // The state of a streaming query. The request is kept from the open message, so the filter is only
+    // deserialized once per scan, and its key is advanced to the continuation after each chunk
+    struct QueryStream {
+        dto::K23SIQueryRequest request;
+        QueryFilters filters;
+        TXEndpoint endpoint; // the client, which we push the chunks to
+        uint64_t streamId{0};
+        uint64_t credits{0}; // the number of records we can send before we have to wait for more credits
+        TimePoint lastActivity;
+        bool closed{false};
+        // set while we are producing chunks
+        bool running{false};
+        seastar::future<> runFut = seastar::make_ready_future();
+    };
+    // streams are identified by the url of the client and the id the client picked
+    typedef std::pair<String, uint64_t> QueryStreamId;
+
+    // handlers for the streaming query messages
+    void _handleQueryStreamOpen(Request&& request);
+    void _handleQueryStreamCredit(Request&& request);
+
+    // produce and send chunks for the given stream until it runs out of credits or the scan is done
+    void _runQueryStream(seastar::lw_shared_ptr<QueryStream> stream);
+
+    // send the given chunk to the client of the stream
+    seastar::future<> _sendQueryStreamChunk(QueryStream& stream, dto::K23SIQueryStreamChunk&& chunk);
+
+    // close the given stream and drop it from our set of open streams
+    void _closeQueryStream(QueryStream& stream);
+
+    // close the streams which have been idle for longer than the configured timeout
+    void _expireQueryStreams();
 
     seastar::future<> _registerVerbs();
 
@@ -191,8 +260,50 @@ private: // methods
     // helper used to finalize all local WIs for a give transaction
     Status _finalizeTxnWIs(dto::Timestamp txnts, dto::EndAction action);
 
+    // helper used to end the given transaction locally and finalize its WIs. The twim for the txn is only persisted
+    // if persistTwim is set
+    Status _finalizeTxn(dto::Timestamp txnts, dto::EndAction action, bool persistTwim);
+
     void _registerMetrics();
 
+    // run a full garbage collection pass over the indexer in time-sliced increments
+    seastar::future<> _runGC();
+
+    // state we keep while replaying the persisted data of the partition
+    struct RecoveryState {
+        // the replayed WIs of txns whose outcome is not known yet: txn id -> (key -> WI)
+        std::unordered_map<dto::Timestamp, std::unordered_map<dto::Key, dto::WriteIntent>> pendingWIs;
+        // the schema of the keys which follow, when loading a snapshot
+        String snapshotSchema;
+        uint64_t batches{0};
+        uint64_t records{0};
+        uint64_t bytes{0};
+    };
+
+    // replay all records in a batch which was read back from persistence
+    void _replayBatch(Payload& batch, RecoveryState& state);
+
+    // replay a WI record. The WI is applied once we know the outcome of its txn
+    void _replayWI(dto::Key&& key, dto::WriteIntent&& wi, RecoveryState& state);
+
+    // apply the pending WIs of the given txn, once its outcome is known
+    void _replayOutcome(dto::Timestamp txnts, dto::EndAction action, RecoveryState& state);
+
+    // apply a single WI of a txn with a known outcome
+    void _replayFinalizedWI(const dto::Key& key, dto::WriteIntent&& wi, dto::EndAction action);
+
+    // place the WIs of txns which are still in progress and hand off the replayed state to the txn managers
+    void _completeReplay(RecoveryState& state);
+
+    // the per-second rate of the given count over the duration of the recovery
+    double _recoveryRate(uint64_t count) const;
+
+    // write a snapshot of the partition to persistence in time-sliced increments
+    seastar::future<> _writeSnapshot();
+
+    // add the given key to the snapshot chunk. The current schema of the chunk is updated as needed
+    void _writeSnapshotKey(Payload& chunk, String& chunkSchema, const String& schemaName, const IndexerKey& key, const VersionSet& vset);
+
 private:  // members
     // to get K2 timestamps
     tso::TSOClient& _tsoClient;
@@ -224,6 +335,25 @@ private:  // members
     // timer used to refresh the retention timestamp from the TSO
     PeriodicTimer _retentionUpdateTimer;
 
+    // the closed timestamp. We do not accept writes at or below it, so reads at or below it can't be invalidated
+    // by future writes. It is never behind the retention timestamp
+    dto::Timestamp _closedTimestamp;
+
+    // timer used to advance the closed timestamp from the TSO
+    PeriodicTimer _closedTimestampTimer;
+
+    // timer used to drive the indexer garbage collection
+    PeriodicTimer _gcTimer;
+
+    // timer used to drive the snapshots of the partition
+    PeriodicTimer _snapshotTimer;
+
+    // the open streaming queries
+    std::map<QueryStreamId, seastar::lw_shared_ptr<QueryStream>> _queryStreams;
+
+    // timer used to expire idle streaming queries
+    PeriodicTimer _queryStreamTimer;
+
     std::shared_ptr<Persistence> _persistence;
 
     cpo::CPOClient _cpo;
@@ -236,13 +366,40 @@ private:  // members
     uint64_t _recordVersions{0};
     uint64_t _totalCommittedPayload{0}; //total committed user payload size
     uint64_t _finalizedWI{0}; // total number of finalized WI
+    uint64_t _gcReclaimedVersions{0}; // total number of record versions reclaimed by GC
+    uint64_t _gcReclaimedBytes{0}; // total user payload bytes reclaimed by GC
+    uint64_t _gcErasedKeys{0}; // total number of keys removed by GC
+    uint64_t _gcPasses{0}; // total number of completed GC passes
+    uint64_t _recoveredRecords{0}; // number of records replayed during recovery
+    uint64_t _recoveredBytes{0}; // number of bytes replayed during recovery
+    Duration _recoveryTime{0}; // total time taken by recovery
+    uint64_t _snapshots{0}; // number of snapshots written
+    uint64_t _snapshotBytes{0}; // total size of the snapshots written
+    uint64_t _queryStreamsOpened{0}; // number of streaming queries opened
+    uint64_t _queryStreamsExpired{0}; // number of streaming queries closed due to inactivity
+    uint64_t _queryStreamChunks{0}; // number of chunks sent for streaming queries
+    uint64_t _writeCommits{0}; // number of txns committed with their last write
+    uint64_t _localPushes{0}; // number of pushes handled by a TRH on this node without an RPC
+    uint64_t _remotePushes{0}; // number of pushes sent to the TRH as an RPC
+    uint64_t _conflictWaits{0}; // number of times a request waited for a conflicting WI instead of aborting
+    uint64_t _conflictWaitTimeouts{0}; // number of conflict waits which timed out
+    uint64_t _snapshotReads{0}; // number of snapshot reads served without touching the read cache
+    uint64_t _snapshotReadFallbacks{0}; // number of snapshot reads served as regular reads since their ts wasn't closed
 
     k2::ExponentialHistogram _readLatency;
+    k2::ExponentialHistogram _readBatchLatency;
+    k2::ExponentialHistogram _readBatchKeys;
     k2::ExponentialHistogram _writeLatency;
+    k2::ExponentialHistogram _writeBatchLatency;
+    k2::ExponentialHistogram _writeAndCommitLatency;
+    k2::ExponentialHistogram _writeBatchKeys;
     k2::ExponentialHistogram _queryPageLatency;
     k2::ExponentialHistogram _pushLatency;
     k2::ExponentialHistogram _queryPageScans;
     k2::ExponentialHistogram _queryPageReturns;
+    k2::ExponentialHistogram _gcSliceLatency;
+    k2::ExponentialHistogram _snapshotSliceLatency;
+    k2::ExponentialHistogram _conflictWaitLatency;
 };
 
     }  // ns k2
@@ -25,7 +25,8 @@ Copyright(c) 2020 Futurewei Cloud
 #include <k2/appbase/Appbase.h>
 namespace k2 {
 
-Persistence::Persistence() {
+Persistence::Persistence(String collectionName, dto::PVID pvid):
+    _collectionName(std::move(collectionName)), _pvid(pvid), _partitionId(pvid.id) {
     int id = seastar::this_shard_id();
     String endpoint = _config.persistenceEndpoint()[id % _config.persistenceEndpoint().size()];
     _remoteEndpoint = RPC().getTXEndpoint(endpoint);
@@ -88,6 +89,9 @@ seastar::future<Status> Persistence::flush() {
     // move the buffered data into a single request and delete the buffer.
     // Any writes after this point will be appended to a new buffer/batch
     dto::K23SI_PersistenceRequest<Payload> request{};
+    request.collectionName = _collectionName;
+    request.pvid = _pvid;
+    request.sequence = _sequence++;
     request.value.val = std::move(*_buffer);
     _buffer.reset(nullptr);
     std::vector<seastar::promise<Status>> proms; // ditto for the pending promises
@@ -127,6 +131,235 @@ seastar::future<Status> Persistence::flush() {
             });
 }
 
+std::vector<std::unique_ptr<TXEndpoint>> Persistence::_allEndpoints() {
+    std::vector<std::unique_ptr<TXEndpoint>> endpoints;
+    for (auto& url: _config.persistenceEndpoint()) {
+        auto ep = RPC().getTXEndpoint(url);
+        if (!ep) {
+            throw std::runtime_error(fmt::format("invalid persistence endpoint {}", url));
+        }
+        endpoints.push_back(std::move(ep));
+    }
+    return endpoints;
+}
+
+seastar::future<> Persistence::recover(uint64_t fromSequence, std::function<void(dto::K23SI_PersistenceRequest<Payload>&&)> replayFunc) {
+    std::vector<std::unique_ptr<TXEndpoint>> endpoints;
+    try {
+        endpoints = _allEndpoints();
+    } catch (...) {
+        return seastar::make_exception_future(std::current_exception());
+    }
+    std::vector<RecoveryStream> streams;
+    for (auto& ep: endpoints) {
+        streams.push_back(RecoveryStream{
+            .endpoint=std::move(ep),
+            .request=dto::K23SI_PersistenceRecoveryRequest{
+                .collectionName=_collectionName,
+                .pvid=_pvid,
+                .continuationSegment=0,
+                .continuationOffset=0,
+                .maxBytes=_config.recoveryReadSize(),
+                .fromSequence=fromSequence
+            }
+        });
+    }
+    // the batches before the start of the snapshot are never replayed. Never reuse their sequence numbers
+    _sequence = std::max(_sequence, fromSequence);
+    K2LOG_I(log::skvsvr, "Recovering partition {} of {} from {} endpoints, starting with sequence {}",
+            _partitionId, _collectionName, streams.size(), fromSequence);
+
+    return seastar::do_with(std::move(streams), std::move(replayFunc), [this] (auto& streams, auto& replayFunc) {
+        return seastar::do_until(
+            [&streams] {
+                return std::all_of(streams.begin(), streams.end(), [](auto& stream) {
+                    return stream.done && !stream.inFlight && stream.batches.empty();
+                });
+            },
+            [this, &streams, &replayFunc] {
+                for (auto& stream: streams) {
+                    if (!stream.status.is2xxOK()) {
+                        return seastar::make_exception_future(std::runtime_error(
+                            fmt::format("unable to read from persistence endpoint {}: {}", stream.endpoint->url, stream.status)));
+                    }
+                    // keep up to one page queued and one page in flight for each endpoint
+                    if (!stream.done && !stream.inFlight && stream.queuedBytes < stream.request.maxBytes) {
+                        _fetchRecoveryPage(stream);
+                    }
+                }
+                // we can only pick the next batch once we have the next batch from each endpoint
+                for (auto& stream: streams) {
+                    if (stream.batches.empty() && stream.inFlight) {
+                        return std::exchange(stream.fetchFut, seastar::make_ready_future());
+                    }
+                }
+                RecoveryStream* next = nullptr;
+                for (auto& stream: streams) {
+                    if (!stream.batches.empty() && (next == nullptr || stream.batches.front().sequence < next->batches.front().sequence)) {
+                        next = &stream;
+                    }
+                }
+                if (next != nullptr) {
+                    auto batch = std::move(next->batches.front());
+                    next->batches.pop_front();
+                    next->queuedBytes -= batch.value.val.getSize();
+                    _sequence = std::max(_sequence, batch.sequence + 1);
+                    replayFunc(std::move(batch));
+                }
+                return seastar::make_ready_future();
+            })
+            .finally([&streams] {
+                // wait for any fetches which may still be running in case we failed
+                std::vector<seastar::future<>> futs;
+                for (auto& stream: streams) {
+                    futs.push_back(std::move(stream.fetchFut));
+                }
+                return seastar::when_all_succeed(futs.begin(), futs.end()).discard_result();
+            });
+    });
+}
+
+void Persistence::_fetchRecoveryPage(RecoveryStream& stream) {
+    K2LOG_D(log::skvsvr, "fetching recovery page from {} with request {}", stream.endpoint->url, stream.request);
+    stream.inFlight = true;
+    stream.fetchFut = RPC().callRPC<dto::K23SI_PersistenceRecoveryRequest, dto::K23SI_PersistenceRecoveryResponse>
+        (dto::Verbs::K23SI_Persist_Recovery, stream.request, *stream.endpoint, _config.persistenceTimeout())
+        .then([&stream] (auto&& result) {
+            auto& [status, response] = result;
+            stream.inFlight = false;
+            if (!status.is2xxOK()) {
+                K2LOG_E(log::skvsvr, "recovery read from {} failed with {}", stream.endpoint->url, status);
+                stream.status = std::move(status);
+                return;
+            }
+            stream.request.continuationSegment = response.continuationSegment;
+            stream.request.continuationOffset = response.continuationOffset;
+            stream.done = response.done;
+            for (auto& batch: response.batches) {
+                stream.queuedBytes += batch.value.val.getSize();
+                stream.batches.push_back(std::move(batch));
+            }
+        })
+        .handle_exception([&stream] (auto exc) {
+            K2LOG_W_EXC(log::skvsvr, exc, "recovery read from {} failed", stream.endpoint->url);
+            stream.inFlight = false;
+            stream.status = Statuses::S503_Service_Unavailable("unable to reach persistence");
+        });
+}
+
+seastar::future<Status> Persistence::writeSnapshotChunk(uint64_t startSequence, uint64_t chunkId, bool last, Payload&& data) {
+    if (_stopped || !_remoteEndpoint) {
+        return seastar::make_ready_future<Status>(dto::K23SIStatus::OperationNotAllowed("persistence is not available"));
+    }
+    dto::K23SI_PersistenceSnapshotRequest request{
+        .collectionName=_collectionName,
+        .partitionId=_partitionId,
+        .startSequence=startSequence,
+        .chunkId=chunkId,
+        .last=last,
+        .data=std::move(data)
+    };
+    return RPC().callRPC<dto::K23SI_PersistenceSnapshotRequest, dto::K23SI_PersistenceSnapshotResponse>
+        (dto::Verbs::K23SI_Persist_Snapshot, request, *_remoteEndpoint, _config.persistenceTimeout())
+        .then([](auto&& result) {
+            auto& [status, _] = result;
+            return std::move(status);
+        });
+}
+
+seastar::future<uint64_t> Persistence::loadSnapshot(std::function<void(Payload&&)> loadFunc) {
+    std::vector<std::unique_ptr<TXEndpoint>> endpoints;
+    try {
+        endpoints = _allEndpoints();
+    } catch (...) {
+        return seastar::make_exception_future<uint64_t>(std::current_exception());
+    }
+    // a partition may send its snapshots to a different endpoint after a restart. Ask all of them
+    return seastar::do_with(std::move(endpoints), std::move(loadFunc), [this] (auto& endpoints, auto& loadFunc) {
+        std::vector<seastar::future<std::tuple<Status, dto::K23SI_PersistenceSnapshotReadResponse>>> futs;
+        for (auto& ep: endpoints) {
+            dto::K23SI_PersistenceSnapshotReadRequest request{
+                .collectionName=_collectionName,
+                .partitionId=_partitionId,
+                .continuationOffset=0,
+                .maxBytes=0
+            };
+            futs.push_back(RPC().callRPC<dto::K23SI_PersistenceSnapshotReadRequest, dto::K23SI_PersistenceSnapshotReadResponse>
+                (dto::Verbs::K23SI_Persist_Snapshot_Read, request, *ep, _config.persistenceTimeout()));
+        }
+        return seastar::when_all_succeed(futs.begin(), futs.end())
+            .then([this, &endpoints, &loadFunc] (auto&& results) {
+                TXEndpoint* latest = nullptr;
+                uint64_t startSequence = 0;
+                for (size_t i = 0; i < results.size(); ++i) {
+                    auto& [status, response] = results[i];
+                    if (!status.is2xxOK()) {
+                        throw std::runtime_error(fmt::format("unable to find snapshot at {}: {}", endpoints[i]->url, status));
+                    }
+                    if (response.found && (latest == nullptr || response.startSequence > startSequence)) {
+                        latest = endpoints[i].get();
+                        startSequence = response.startSequence;
+                    }
+                }
+                if (latest == nullptr) {
+                    K2LOG_I(log::skvsvr, "No snapshot found for partition {} of {}", _partitionId, _collectionName);
+                    return seastar::make_ready_future<uint64_t>(0);
+                }
+                K2LOG_I(log::skvsvr, "Loading snapshot {} for partition {} of {} from {}", startSequence, _partitionId, _collectionName, latest->url);
+                return _streamSnapshot(*latest, startSequence, loadFunc)
+                    .then([startSequence] {
+                        return startSequence;
+                    });
+            });
+    });
+}
+
+seastar::future<> Persistence::_streamSnapshot(TXEndpoint& endpoint, uint64_t startSequence, std::function<void(Payload&&)>& loadFunc) {
+    dto::K23SI_PersistenceSnapshotReadRequest request{
+        .collectionName=_collectionName,
+        .partitionId=_partitionId,
+        .continuationOffset=0,
+        .maxBytes=_config.recoveryReadSize()
+    };
+    auto fetch = [this, &endpoint](dto::K23SI_PersistenceSnapshotReadRequest& request) {
+        return RPC().callRPC<dto::K23SI_PersistenceSnapshotReadRequest, dto::K23SI_PersistenceSnapshotReadResponse>
+            (dto::Verbs::K23SI_Persist_Snapshot_Read, request, endpoint, _config.persistenceTimeout());
+    };
+    auto firstPage = fetch(request);
+    return seastar::do_with(std::move(request), std::move(firstPage), false,
+        [fetch, startSequence, &loadFunc] (auto& request, auto& nextPage, bool& done) {
+        return seastar::do_until(
+            [&done] { return done; },
+            [fetch, startSequence, &loadFunc, &request, &nextPage, &done] {
+                return std::exchange(nextPage, seastar::make_ready_future<std::tuple<Status, dto::K23SI_PersistenceSnapshotReadResponse>>())
+                    .then([fetch, startSequence, &loadFunc, &request, &nextPage, &done] (auto&& result) {
+                        auto& [status, response] = result;
+                        if (!status.is2xxOK()) {
+                            throw std::runtime_error(fmt::format("unable to read snapshot: {}", status));
+                        }
+                        if (!response.found || response.startSequence != startSequence) {
+                            throw std::runtime_error(fmt::format("snapshot {} is no longer available", startSequence));
+                        }
+                        done = response.done;
+                        if (!done) {
+                            // prefetch the next page while we load this one
+                            request.continuationOffset = response.continuationOffset;
+                            nextPage = fetch(request);
+                        }
+                        for (auto& chunk: response.chunks) {
+                            loadFunc(std::move(chunk));
+                        }
+                    });
+            })
+            .finally([&nextPage] {
+                // wait for the prefetch in case we failed
+                return std::exchange(nextPage, seastar::make_ready_future<std::tuple<Status, dto::K23SI_PersistenceSnapshotReadResponse>>())
+                    .discard_result()
+                    .handle_exception([](auto) {});
+            });
+    });
+}
+
 seastar::future<Status> Persistence::_chainFlushResponse() {
     seastar::promise<Status> prom;
     auto fut = prom.get_future();
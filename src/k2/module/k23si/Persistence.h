@@ -22,6 +22,10 @@ Copyright(c) 2020 Futurewei Cloud
 */
 
 #pragma once
+#include <algorithm>
+#include <deque>
+#include <functional>
+
 #include <k2/appbase/AppEssentials.h>
 #include <k2/common/Timer.h>
 #include <k2/dto/K23SI.h>
@@ -30,9 +34,19 @@ Copyright(c) 2020 Futurewei Cloud
 #include "Log.h"
 
 namespace k2 {
+// The type tag we write in front of each record we append to persistence so that the records can be decoded on recovery
+K2_DEF_ENUM(PersistenceRecordType,
+    WriteIntent, // a dto::Key followed by the dto::WriteIntent for that key
+    TxnRecord,   // a TxnRecord at the TRH
+    TxnWIMeta,   // a TxnWIMeta at a participant
+    SnapshotSchema,  // in snapshots: the schema name for the keys which follow
+    SnapshotVersions // in snapshots: a partition key and a range key, followed by the committed versions of that key
+);
+
 class Persistence {
 public:
-    Persistence();
+    // The persistence for the given partition. All data we persist is tagged with the partition identity
+    Persistence(String collectionName, dto::PVID pvid);
 
     // start the persistence subsystem
     seastar::future<> start();
@@ -48,7 +62,7 @@ public:
     // Appends are always asynchronous (buffered locally) until an explicit call to flush()
     // append_cont returns the status of the flush call
     template<typename ValueType>
-    seastar::future<Status> append_cont(const ValueType& val) {
+    seastar::future<Status> append_cont(PersistenceRecordType type, const ValueType& val) {
         if (_stopped) {
             K2LOG_W(log::skvsvr, "Attempt to append while stopped");
             return seastar::make_ready_future<Status>(dto::K23SIStatus::OperationNotAllowed("persistence has stopped"));
@@ -59,7 +73,7 @@ public:
         }
         K2LOG_D(log::skvsvr, "appending new write");
 
-        append(val);
+        append(type, val);
         _pendingProms.emplace_back();
         return _pendingProms.back().get_future().then([fid=_flushId] (auto&& status) {
             K2LOG_D(log::skvsvr, "Notifying promise from fid={}", fid);
@@ -67,9 +81,10 @@ public:
         });
     }
 
-    // Append the given value to the persistence buffer. An explicit call to flush() is needed to send the data out
-    template<typename ValueType>
-    void append(const ValueType& val) {
+    // Append a record of the given type, made up of the given values, to the persistence buffer.
+    // An explicit call to flush() is needed to send the data out
+    template<typename... ValueTypes>
+    void append(PersistenceRecordType type, const ValueTypes&... vals) {
         if (_stopped) {
             K2LOG_W(log::skvsvr, "Attempt to append while stopped");
             return;
@@ -77,13 +92,63 @@ public:
         if (!_buffer) {
             _buffer = _remoteEndpoint->newPayload();
         }
-        _buffer->write(val);
+        _buffer->write(type);
+        (_buffer->write(vals), ...);
     }
 
+    // Read back all batches we persisted for our partition starting with the given sequence, from all persistence
+    // endpoints, and call the given function for each batch, in the order in which the batches were persisted.
+    // Pages of batches are fetched from all endpoints in parallel, and are prefetched while we replay the current batch.
+    // Batches persisted after this call continue the sequence of the recovered batches.
+    seastar::future<> recover(uint64_t fromSequence, std::function<void(dto::K23SI_PersistenceRequest<Payload>&&)> replayFunc);
+
+    // the sequence which the next batch we send out will get
+    uint64_t nextSequence() const { return _sequence; }
+
+    // Send a chunk of a snapshot of our partition to persistence. See dto::K23SI_PersistenceSnapshotRequest
+    seastar::future<Status> writeSnapshotChunk(uint64_t startSequence, uint64_t chunkId, bool last, Payload&& data);
+
+    // Find the latest snapshot of our partition among all persistence endpoints and call the given function for each
+    // of its chunks, in order. The next page of chunks is prefetched while we load the current page.
+    // Returns the start sequence of the snapshot, or 0 if there is no snapshot
+    seastar::future<uint64_t> loadSnapshot(std::function<void(Payload&&)> loadFunc);
+
     void _registerMetrics();
 
 private:
+    // The recovery state for a single persistence endpoint
+    struct RecoveryStream {
+        std::unique_ptr<TXEndpoint> endpoint;
+        // the request for the next page
+        dto::K23SI_PersistenceRecoveryRequest request;
+        // the batches we fetched and haven't replayed yet
+        std::deque<dto::K23SI_PersistenceRequest<Payload>> batches;
+        // the number of data bytes in the queued batches
+        size_t queuedBytes{0};
+        // set if a fetch for the next page is in progress
+        bool inFlight{false};
+        // set after we fetched the last page
+        bool done{false};
+        // the status of the last fetch
+        Status status{Statuses::S200_OK};
+        seastar::future<> fetchFut = seastar::make_ready_future();
+    };
+
+    // start fetching the next page for the given stream
+    void _fetchRecoveryPage(RecoveryStream& stream);
+
+    // stream the chunks of the latest snapshot from the given endpoint
+    seastar::future<> _streamSnapshot(TXEndpoint& endpoint, uint64_t startSequence, std::function<void(Payload&&)>& loadFunc);
+
+    // returns the endpoints for all configured persistence urls
+    std::vector<std::unique_ptr<TXEndpoint>> _allEndpoints();
+
     bool _stopped{false};
+    String _collectionName;
+    dto::PVID _pvid;
+    uint64_t _partitionId{0};
+    // the sequence number for the next batch we send out
+    uint64_t _sequence{0};
     std::unique_ptr<Payload> _buffer;
     std::unique_ptr<TXEndpoint> _remoteEndpoint;
     K23SIConfig _config;
@@ -71,11 +71,17 @@ void TxnManager::_registerMetrics() {
         sm::make_counter("committed_txns", _committedTxns, sm::description("Number of commited transactions"), labels),
         sm::make_counter("aborted_txns", _abortedTxns, sm::description("Number of aborted transactions"), labels),
         sm::make_counter("conflict_aborts", _conflictAborts, sm::description("Number of conflict aborts (incumbent abort due to push)"), labels),
+        sm::make_counter("one_phase_txns", _onePhaseTxns, sm::description("Number of transactions finalized in place in the TRH partition"), labels),
         sm::make_histogram("finalization_latency", [this]{ return _finalizationLatency.getHistogram();},
                 sm::description("Latency of Finalizations"), labels)
     });
 }
 
+void TxnManager::setLocalFinalizer(dto::KeyRangeVersion localRange, LocalFinalizer_t finalizer) {
+    _localRange = std::move(localRange);
+    _localFinalizer = std::move(finalizer);
+}
+
 seastar::future<> TxnManager::start(const String& collectionName, dto::Timestamp rts, Duration hbDeadline, std::shared_ptr<Persistence> persistence, const String& cpoEndpoint) {
     K2LOG_D(log::skvsvr, "start");
     _cpo.init(cpoEndpoint);
@@ -378,6 +384,7 @@ TxnManager::endTxn(dto::K23SITxnEndRequest&& request) {
     rec.syncFinalize = request.syncFinalize;
     rec.timeToFinalize = request.timeToFinalize;
     rec.finalizeAction = request.action;
+    rec.onePhase = _isOnePhase(rec);
     if (request.action == dto::EndAction::Commit) {
         rec.hasAttemptedCommit = true;
     }
@@ -617,7 +624,7 @@ seastar::future<Status> TxnManager::_endPIPHelper(TxnRecord& rec) {
     // manage rw expiry
     rec.unlinkRW(_rwlist);
 
-    auto finfut =  _persistence->append_cont(rec)
+    auto finfut =  _persistence->append_cont(PersistenceRecordType::TxnRecord, rec)
             .then([this, &rec] (auto&& status) {
                 K2LOG_D(log::skvsvr, "persist completed for EndPIP of {} with {}", rec, status);
                 if (!status.is2xxOK()) {
@@ -658,6 +665,21 @@ seastar::future<Status> TxnManager::_abort(TxnRecord& rec) {
 seastar::future<Status> TxnManager::_endHelper(TxnRecord& rec) {
     K2LOG_D(log::skvsvr, "Processing END for {}", rec);
 
+    if (rec.onePhase) {
+        // the WIs are all in this partition so there is nothing to wait for
+        if (rec.syncFinalize || nsec(rec.timeToFinalize).count() == 0) {
+            return _finalizeLocally(rec);
+        }
+        _addBgTask(rec,
+            [this, &rec] {
+                return seastar::sleep(rec.timeToFinalize)
+                    .then([this, &rec] {
+                        return _finalizeLocally(rec).discard_result();
+                    });
+            });
+        return seastar::make_ready_future<Status>(dto::K23SIStatus::OK);
+    }
+
     auto timeout = (10s + _config.writeTimeout() * rec.writeRanges.size()) / _config.finalizeBatchSize();
 
     if (rec.syncFinalize) {
@@ -685,9 +707,21 @@ seastar::future<Status> TxnManager::_finalizedPIP(TxnRecord& rec) {
     // set state
     rec.state = dto::TxnRecordState::FinalizedPIP;
 
+    if (rec.onePhase) {
+        // The end record we persisted also stands for the outcome of the WIs, and recovery finalizes them
+        // from it. There is nothing else to persist
+        _addBgTask(rec,
+            [this, &rec] {
+                K2LOG_D(log::skvsvr, "Erasing one-phase txn record: {}", rec);
+                _transactions.erase(rec.mtr.timestamp);
+                return seastar::make_ready_future();
+            });
+        return seastar::make_ready_future<Status>(dto::K23SIStatus::OK);
+    }
+
     _addBgTask(rec,
         [this, &rec] {
-            return _persistence->append_cont(rec)
+            return _persistence->append_cont(PersistenceRecordType::TxnRecord, rec)
                 .then([this, &rec](auto&& status) {
                     K2LOG_D(log::skvsvr, "persist completed for FinalizedPIP of {} with {}", rec, status);
                     if (!status.is2xxOK()) {
@@ -705,6 +739,68 @@ seastar::future<Status> TxnManager::_finalizedPIP(TxnRecord& rec) {
     return seastar::make_ready_future<Status>(dto::K23SIStatus::OK);
 }
 
+void TxnManager::replay(TxnRecord&& rec) {
+    K2LOG_D(log::skvsvr, "replaying txn record {}", rec);
+    if (rec.state == dto::TxnRecordState::FinalizedPIP) {
+        _transactions.erase(rec.mtr.timestamp);
+        return;
+    }
+    // Snapshots capture records whose end has already been persisted. Finalization resumes for these the
+    // same way as for the records which we were persisting
+    if (rec.state == dto::TxnRecordState::Committed) {
+        rec.state = dto::TxnRecordState::CommittedPIP;
+    } else if (rec.state == dto::TxnRecordState::Aborted) {
+        rec.state = dto::TxnRecordState::AbortedPIP;
+    }
+    auto& tr = _transactions[rec.mtr.timestamp];
+    tr.mtr = std::move(rec.mtr);
+    tr.writeRanges = std::move(rec.writeRanges);
+    tr.trh = std::move(rec.trh);
+    tr.state = rec.state;
+    tr.finalizeAction = rec.finalizeAction;
+    tr.hasAttemptedCommit = rec.hasAttemptedCommit;
+    tr.onePhase = rec.onePhase;
+    // there is no client waiting for the finalization any more
+    tr.syncFinalize = false;
+}
+
+void TxnManager::completeReplay() {
+    // Only the records for ended transactions are persisted. These end up in the Commit/Abort PIP states, which
+    // we complete here as if the persistence call just succeeded. This kicks off the finalization for the txn
+    K2LOG_I(log::skvsvr, "resuming finalization for {} recovered transactions", _transactions.size());
+    for (auto& [_, tr]: _transactions) {
+        if (tr.state != dto::TxnRecordState::CommittedPIP && tr.state != dto::TxnRecordState::AbortedPIP) {
+            K2LOG_W(log::skvsvr, "Unexpected state for recovered txn {}", tr);
+            continue;
+        }
+        _addBgTask(tr, [this, &tr] {
+            return _onAction(TxnRecord::Action::onPersistSucceed, tr)
+                .then([&tr](auto&& status) {
+                    if (!status.is2xxOK()) {
+                        K2LOG_E(log::skvsvr, "Unable to resume finalization for {} due to {}", tr, status);
+                    }
+                });
+        });
+    }
+}
+
+void TxnManager::writeSnapshot(Payload& out) const {
+    for (auto& [_, tr]: _transactions) {
+        switch (tr.state) {
+            case dto::TxnRecordState::CommittedPIP:
+            case dto::TxnRecordState::Committed:
+            case dto::TxnRecordState::AbortedPIP:
+            case dto::TxnRecordState::Aborted:
+                out.write(PersistenceRecordType::TxnRecord);
+                out.write(tr);
+                break;
+            default:
+                // the other states are either not persisted, or the txn is already finalized
+                break;
+        }
+    }
+}
+
 // This helper generates the finalization requests for the given txn record
 auto _genFinalizeRequests(TxnRecord& rec) {
     std::deque<std::tuple<dto::K23SITxnFinalizeRequest, dto::KeyRangeVersion>> requests;
@@ -749,6 +845,35 @@ void TxnManager::_genFinalizeReqsAfterPMAPUpdate(dto::K23SITxnFinalizeRequest&&
     }
 }
 
+bool TxnManager::_isOnePhase(const TxnRecord& rec) const {
+    if (!_localFinalizer || !_config.onePhaseCommit() || rec.writeRanges.size() != 1) {
+        return false;
+    }
+    auto it = rec.writeRanges.find(_collectionName);
+    return it != rec.writeRanges.end() && it->second.size() == 1 && *it->second.begin() == _localRange;
+}
+
+seastar::future<Status> TxnManager::_finalizeLocally(TxnRecord& rec) {
+    K2LOG_D(log::skvsvr, "Finalizing locally {}", rec);
+    const auto endAction = rec.state == dto::TxnRecordState::Committed ? dto::EndAction::Commit : dto::EndAction::Abort;
+    k2::OperationLatencyReporter reporter(_finalizationLatency); // for reporting metrics
+    auto status = _localFinalizer(rec.mtr.timestamp, endAction);
+    if (!status.is2xxOK()) {
+        if (status != dto::K23SIStatus::KeyNotFound) {
+            // The twim may have ended already, so a finalize request to this partition would fail the same way.
+            // Handle it as a failed finalize request for multi-partition txns
+            K2LOG_E(log::skvsvr, "Unable to finalize txn {} locally due to {}. Leaving in memory", rec, status);
+            return seastar::make_ready_future<Status>(dto::K23SIStatus::OK);
+        }
+        // same as with finalize requests, this may simply indicate that the client's write failed
+        K2LOG_W(log::skvsvr, "Local finalize did not find txn {}, status={}", rec, status);
+    }
+    reporter.report();
+    rec.writeRanges.clear();
+    _onePhaseTxns++;
+    return _onAction(TxnRecord::Action::onFinalizeComplete, rec);
+}
+
 seastar::future<Status> TxnManager::_finalizeTransaction(TxnRecord& rec, FastDeadline deadline) {
     K2LOG_D(log::skvsvr, "Finalizing {}", rec);
     //TODO we need to keep trying to finalize in cases of failures.
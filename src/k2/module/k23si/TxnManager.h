@@ -81,8 +81,12 @@ struct TxnRecord {
     // if this transaction ever attempts to commit, we set this flag.
     bool hasAttemptedCommit{false};
 
-    K2_PAYLOAD_FIELDS(mtr, writeRanges, trh, syncFinalize, state, finalizeAction, hasAttemptedCommit);
-    K2_DEF_FMT(TxnRecord, mtr, writeRanges, trh, rwExpiry, hbExpiry, syncFinalize, timeToFinalize, state, finalizeAction, hasAttemptedCommit);
+    // set when all write ranges are in the TRH partition. The WIs of such txns are finalized in place, without
+    // finalize requests, and the persisted end record doubles as the record of their outcome
+    bool onePhase{false};
+
+    K2_PAYLOAD_FIELDS(mtr, writeRanges, trh, syncFinalize, state, finalizeAction, hasAttemptedCommit, onePhase);
+    K2_DEF_FMT(TxnRecord, mtr, writeRanges, trh, rwExpiry, hbExpiry, syncFinalize, timeToFinalize, state, finalizeAction, hasAttemptedCommit, onePhase);
 
     // The last action on this TR (the action that put us into the above state)
     K2_DEF_ENUM_IC(Action,
@@ -113,10 +117,19 @@ struct TxnRecord {
 
 // Manage K23SI transaction records.
 class TxnManager {
+public: // types
+    // Finalizes the WIs of the given txn in the TRH partition
+    typedef std::function<Status(dto::Timestamp txnTimestamp, dto::EndAction action)> LocalFinalizer_t;
+
 public: // lifecycle
     TxnManager();
     ~TxnManager();
 
+    // Set the key range of the TRH partition and the function which finalizes WIs in it. Transactions which
+    // only wrote to this range are finalized by calling the function instead of sending finalize requests.
+    // Must be called before start()
+    void setLocalFinalizer(dto::KeyRangeVersion localRange, LocalFinalizer_t finalizer);
+
     // When started, we need to be told:
     // - the current retentionTimestamp
     // - the heartbeat interval for the collection
@@ -150,6 +163,16 @@ public: // lifecycle
     seastar::future<std::tuple<Status, dto::K23SIInspectAllTxnsResponse>> inspectTxns();
     seastar::future<std::tuple<Status, dto::K23SIInspectTxnResponse>> inspectTxn(dto::Timestamp txnTimestamp);
 
+public: // recovery API
+    // Replay a txn record read back from persistence. Txns which have been finalized are dropped
+    void replay(TxnRecord&& rec);
+
+    // Called once all records have been replayed. Resumes the finalization of the recovered transactions
+    void completeReplay();
+
+    // Write the records of the ended txns, whose finalization recovery would have to resume, to the given snapshot
+    void writeSnapshot(Payload& out) const;
+
 private:  // methods driving the state machine
     // delivers the given action for the given transaction and returns the status of executing the action
     // Returns the response from the execution of the newly entered state
@@ -174,6 +197,13 @@ private:  // methods driving the state machine
     // Helper method which finalizes a transaction
     seastar::future<Status> _finalizeTransaction(TxnRecord& rec, FastDeadline deadline);
 
+    // returns true if the given txn can be ended in one phase, i.e. all of its writes are in the TRH partition
+    bool _isOnePhase(const TxnRecord& rec) const;
+
+    // Helper method which finalizes a one-phase transaction in place. As in _finalizeTransaction(), a txn
+    // which fails to finalize is left in memory
+    seastar::future<Status> _finalizeLocally(TxnRecord& rec);
+
     // helper handler for retries of endTxn requests
     seastar::future<std::tuple<Status, dto::K23SITxnEndResponse>>
     _endTxnRetry(TxnRecord& rec, dto::K23SITxnEndRequest&& request);
@@ -221,12 +251,17 @@ private: // fields
 
     std::shared_ptr<Persistence> _persistence;
 
+    // the range of the TRH partition and the finalizer for its WIs
+    dto::KeyRangeVersion _localRange;
+    LocalFinalizer_t _localFinalizer;
+
     sm::metric_groups _metric_groups;
 
     //metrics
     uint64_t _committedTxns{0}; // for committed txn rate
     uint64_t _abortedTxns{0}; // for aborts rate
     uint64_t _conflictAborts{0}; // for conflict abort rate
+    uint64_t _onePhaseTxns{0}; // for txns finalized without finalize requests
     k2::ExponentialHistogram _finalizationLatency;
 }; // class TxnManager
 
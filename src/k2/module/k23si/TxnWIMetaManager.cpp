@@ -23,6 +23,8 @@ Copyright(c) 2021 Futurewei Cloud
 #include "TxnWIMetaManager.h"
 #include <k2/dto/K23SIInspect.h>
 
+#include <algorithm>
+
 namespace k2 {
 
 bool TxnWIMeta::isCommitted() {
@@ -161,9 +163,13 @@ Status TxnWIMetaManager::abortWrite(dto::Timestamp txnId, dto::Key key) {
         return Statuses::S404_Not_Found(fmt::format("transaction ID {} not found in abort for key {}", txnId, key));
     }
 
+    auto knewOutcome = it->second.finalizeAction != dto::EndAction::None;
     auto status = _onAction(Action::onAbort, it->second);
     if (status.is2xxOK()) {
         it->second.writeKeys.erase(key);
+        if (!knewOutcome) {
+            _persistPushOutcome(it->second);
+        }
     }
     return status;
 }
@@ -174,13 +180,67 @@ Status TxnWIMetaManager::commitWrite(dto::Timestamp txnId, dto::Key key) {
         return Statuses::S404_Not_Found(fmt::format("transaction ID {} not found in commit for key {}", txnId, key));
     }
 
+    auto knewOutcome = it->second.finalizeAction != dto::EndAction::None;
     auto status = _onAction(Action::onCommit, it->second);
     if (status.is2xxOK()) {
         it->second.writeKeys.erase(key);
+        if (!knewOutcome) {
+            _persistPushOutcome(it->second);
+        }
     }
     return status;
 }
 
+void TxnWIMetaManager::_persistPushOutcome(TxnWIMeta& twim) {
+    K2LOG_D(log::skvsvr, "persisting outcome from push for twim {}", twim);
+    _persistence->append(PersistenceRecordType::TxnWIMeta, twim);
+}
+
+void TxnWIMetaManager::replay(TxnWIMeta&& twim) {
+    K2LOG_D(log::skvsvr, "replaying twim {}", twim);
+    if (twim.state == dto::TxnWIMetaState::FinalizedPIP) {
+        // all WIs for this txn have been finalized. There is nothing left to track
+        _twims.erase(twim.mtr.timestamp);
+        return;
+    }
+    auto& rec = _twims[twim.mtr.timestamp];
+    rec.mtr = std::move(twim.mtr);
+    rec.trh = std::move(twim.trh);
+    rec.trhCollection = std::move(twim.trhCollection);
+    if (twim.finalizeAction != dto::EndAction::None) {
+        // we learned the outcome of the txn via a PUSH
+        rec.finalizeAction = twim.finalizeAction;
+        rec.state = rec.isCommitted() ? dto::TxnWIMetaState::Committed : dto::TxnWIMetaState::Aborted;
+    }
+    else if (rec.finalizeAction == dto::EndAction::None) {
+        rec.state = dto::TxnWIMetaState::InProgress;
+    }
+}
+
+void TxnWIMetaManager::completeReplay() {
+    // the retention window list must be ordered by txn timestamp
+    std::vector<TxnWIMeta*> recovered;
+    recovered.reserve(_twims.size());
+    for (auto& [_, twim]: _twims) {
+        recovered.push_back(&twim);
+    }
+    std::sort(recovered.begin(), recovered.end(), [](TxnWIMeta* a, TxnWIMeta* b) {
+        return a->mtr.timestamp.compareCertain(b->mtr.timestamp) < 0;
+    });
+    for (auto* twim: recovered) {
+        twim->unlinkRW(_rwlist);
+        _rwlist.push_back(*twim);
+    }
+    K2LOG_I(log::skvsvr, "recovered {} twims", recovered.size());
+}
+
+void TxnWIMetaManager::writeSnapshot(Payload& out) const {
+    for (auto& [_, twim]: _twims) {
+        out.write(PersistenceRecordType::TxnWIMeta);
+        out.write(twim);
+    }
+}
+
 Status TxnWIMetaManager::endTxn(dto::Timestamp txnId, dto::EndAction action) {
     auto it = _twims.find(txnId);
     if (it == _twims.end()) {
@@ -197,11 +257,17 @@ Status TxnWIMetaManager::finalizingWIs(dto::Timestamp txnId) {
     return _onAction(Action::onFinalize, it->second);
 }
 
-Status TxnWIMetaManager::finalizedTxn(dto::Timestamp txnId) {
+Status TxnWIMetaManager::finalizedTxn(dto::Timestamp txnId, bool persist) {
     auto it = _twims.find(txnId);
     if (it == _twims.end()) {
         return Statuses::S404_Not_Found(fmt::format("transaction ID {} not found in finalized", txnId));
     }
+    if (!persist) {
+        if (it->second.state != dto::TxnWIMetaState::FinalizingWIs) {
+            return Statuses::S500_Internal_Server_Error(fmt::format("Action {} not supported in state {}", Action::onFinalized, it->second.state));
+        }
+        return _finalizedPIP(it->second, false);
+    }
     return _onAction(Action::onFinalized, it->second);
 }
 
@@ -335,7 +401,7 @@ Status TxnWIMetaManager::_onAction(Action action, TxnWIMeta& twim) {
         }
         case dto::TxnWIMetaState::FinalizingWIs: switch (action) {
             case Action::onFinalized: {
-                return _finalizedPIP(twim);
+                return _finalizedPIP(twim, true);
             }
             case Action::onFinalize: {
                 return _finalizing(twim);
@@ -381,7 +447,7 @@ Status TxnWIMetaManager::_inProgressPIP(TxnWIMeta& twim) {
     twim.state = newState;
     if (!isRetry) {
         K2LOG_D(log::skvsvr, "State transition: {} for twim {}", newState, twim);
-        auto fut = _persistence->append_cont(twim)
+        auto fut = _persistence->append_cont(PersistenceRecordType::TxnWIMeta, twim)
             .then([this, &twim] (auto&& status) {
                 K2LOG_D(log::skvsvr, "persist completed for InProgressPIP of {} with {}", twim, status);
                 if (!status.is2xxOK()) {
@@ -470,12 +536,20 @@ Status TxnWIMetaManager::_finalizing(TxnWIMeta& twim) {
     return Statuses::S200_OK("processed state transition");
 }
 
-Status TxnWIMetaManager::_finalizedPIP(TxnWIMeta& twim) {
+Status TxnWIMetaManager::_finalizedPIP(TxnWIMeta& twim, bool persist) {
     auto newState = dto::TxnWIMetaState::FinalizedPIP;
     K2LOG_D(log::skvsvr, "Entering state: {}", newState);
     twim.state = newState;
 
-    auto fut = _persistence->append_cont(twim)
+    if (!persist) {
+        _addBgTask(twim, [this, &twim] {
+            _onAction(Action::onPersistSucceed, twim);
+            return seastar::make_ready_future();
+        });
+        return Statuses::S201_Created("Finalized twim");
+    }
+
+    auto fut = _persistence->append_cont(PersistenceRecordType::TxnWIMeta, twim)
         .then([this, &twim] (auto&& status) {
             K2LOG_D(log::skvsvr, "persist completed for {} with {}", twim, status);
             if (!status.is2xxOK()) {
@@ -109,8 +109,20 @@ public:
     // Set the state to finalizingWIs
     Status finalizingWIs(dto::Timestamp txnId);
 
-    // Set the state to finalized
-    Status finalizedTxn(dto::Timestamp txnId);
+    // Set the state to finalized. The finalized twim is persisted unless the caller asks us not to, which is the
+    // case when the outcome is already persisted with the TRH's record in this partition
+    Status finalizedTxn(dto::Timestamp txnId, bool persist=true);
+
+public: // recovery API
+    // Replay a twim read back from persistence. Txns which have been finalized are dropped.
+    // The write keys of the replayed twims are not restored. The caller must add the keys for the WIs it restores
+    void replay(TxnWIMeta&& twim);
+
+    // Called once all records have been replayed. Starts tracking the retention window for the recovered twims
+    void completeReplay();
+
+    // Write all twims to the given snapshot, in the same form as they are persisted
+    void writeSnapshot(Payload& out) const;
 
 private:
     // timer to check for retention window expiry
@@ -153,6 +165,10 @@ private:
     // process the given action against the given metadata record
     Status _onAction(Action action, TxnWIMeta& twim);
 
+    // persist the given twim after we learned the txn outcome via a PUSH. The record is buffered so that it
+    // goes out with the next flush, ahead of any new WI which replaces the WI finalized by the PUSH
+    void _persistPushOutcome(TxnWIMeta& twim);
+
     // helper handlers for individual states
     Status _inProgress(TxnWIMeta& twim);
     Status _inProgressPIP(TxnWIMeta& twim);
@@ -161,7 +177,7 @@ private:
     Status _aborted(TxnWIMeta& twim);
     Status _forceFinalize(TxnWIMeta& twim);
     Status _finalizing(TxnWIMeta& twim);
-    Status _finalizedPIP(TxnWIMeta& twim);
+    Status _finalizedPIP(TxnWIMeta& twim, bool persist);
     Status _finalized(TxnWIMeta& twim, bool success);
 
     // add a function to the list of background tasks. The function will run when the current chain
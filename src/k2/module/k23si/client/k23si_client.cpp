@@ -50,6 +50,17 @@ void K2TxnHandle::_checkResponseStatus(Status& status) {
     }
 }
 
+void K2TxnHandle::_maybeStartHeartbeat(const Status& status) {
+    if ((status.is2xxOK() || status == dto::K23SIStatus::ConditionFailed) &&
+        !_heartbeat_timer.isArmed()) {
+        K2ASSERT(log::skvclient, _cpo_client->collections.find(_trh_collection) != _cpo_client->collections.end(), "collection not present after successful write");
+        K2LOG_D(log::skvclient, "Starting hb, mtr={}", _mtr);
+        _heartbeat_interval = _cpo_client->collections[_trh_collection]->collection.metadata.heartbeatDeadline / 2;
+        _makeHeartbeatTimer();
+        _heartbeat_timer.armPeriodic(_heartbeat_interval);
+    }
+}
+
 void K2TxnHandle::_makeHeartbeatTimer() {
     K2LOG_D(log::skvclient, "makehb, mtr={}", _mtr);
     _heartbeat_timer.setCallback([this] {
@@ -86,7 +97,8 @@ std::unique_ptr<dto::K23SIReadRequest> K2TxnHandle::_makeReadRequest(
         .pvid = dto::PVID{}, // Will be filled in by PartitionRequest
         .collectionName = collection,
         .mtr = _mtr,
-        .key = key
+        .key = key,
+        .snapshotRead = _options.snapshotRead
     });
 }
 
@@ -160,6 +172,137 @@ seastar::future<ReadResult<dto::SKVRecord>> K2TxnHandle::read(dto::Key key, Stri
 }
 
 
+seastar::future<std::vector<ReadResult<dto::SKVRecord>>> K2TxnHandle::readBatch(std::vector<dto::Key> keys, String collection) {
+    typedef std::vector<ReadResult<dto::SKVRecord>> ResultsT;
+    if (!_valid) {
+        return seastar::make_exception_future<ResultsT>(K23SIClientException("Invalid use of K2TxnHandle"));
+    }
+    if (_failed) {
+        ResultsT results;
+        results.reserve(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            results.emplace_back(_failed_status, dto::SKVRecord());
+        }
+        return seastar::make_ready_future<ResultsT>(std::move(results));
+    }
+    if (keys.empty()) {
+        return seastar::make_ready_future<ResultsT>();
+    }
+
+    K2LOG_D(log::skvclient, "making batch request for {} keys, collection={}", keys.size(), collection);
+    _client->read_ops += keys.size();
+    _ongoing_ops++;
+
+    return _cpo_client->getPartitionGetterWithRetry(_options.deadline, collection)
+    .then([this, keys=std::move(keys), collection=std::move(collection)] (auto&& result) mutable {
+        auto& [status, pgetter] = result;
+        ResultsT results;
+        results.reserve(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            results.emplace_back(status, dto::SKVRecord());
+        }
+        if (!status.is2xxOK()) {
+            K2LOG_D(log::skvclient, "failed to get collection for batch read with status={}", status);
+            return seastar::make_ready_future<ResultsT>(std::move(results));
+        }
+
+        // group the keys by the partition which owns them
+        std::unordered_map<uint64_t, std::vector<size_t>> groups;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto& pwe = pgetter->getPartitionForKey(keys[i]);
+            groups[pwe.partition ? pwe.partition->keyRangeV.pvid.id : 0].push_back(i);
+        }
+
+        return seastar::do_with(std::move(results), std::move(keys), std::move(collection), std::move(groups),
+            [this] (auto& results, auto& keys, auto& collection, auto& groups) {
+                std::vector<seastar::future<>> futs;
+                futs.reserve(groups.size());
+                for (auto& [pid, indices] : groups) {
+                    futs.push_back(_readBatchGroup(keys, indices, collection, results));
+                }
+                return seastar::when_all_succeed(futs.begin(), futs.end()).discard_result()
+                    .then([&results] {
+                        return std::move(results);
+                    });
+            });
+    }).finally([this] {
+        _ongoing_ops--;
+    });
+}
+
+seastar::future<> K2TxnHandle::_readBatchGroup(const std::vector<dto::Key>& keys, const std::vector<size_t>& indices,
+                                               const String& collection, std::vector<ReadResult<dto::SKVRecord>>& results) {
+    auto request = std::make_unique<dto::K23SIReadBatchRequest>(dto::K23SIReadBatchRequest{
+        .pvid = dto::PVID{}, // Will be filled in by PartitionRequest
+        .collectionName = collection,
+        .mtr = _mtr,
+        .key = keys[indices[0]],
+        .keys = {},
+        .snapshotRead = _options.snapshotRead
+    });
+    request->keys.reserve(indices.size());
+    for (auto idx : indices) {
+        request->keys.push_back(keys[idx]);
+    }
+
+    return _cpo_client->partitionRequest
+        <dto::K23SIReadBatchRequest, dto::K23SIReadBatchResponse, dto::Verbs::K23SI_READ_BATCH>
+        (_options.deadline, *request).
+        then([this, &keys, &indices, &collection, &results] (auto&& response) {
+            auto& [status, k2response] = response;
+            _checkResponseStatus(status);
+            K2LOG_D(log::skvclient, "got batch status={}", status);
+            if (status.is2xxOK() && k2response.results.size() != indices.size()) {
+                status = dto::K23SIStatus::InternalError("read batch response does not match the request");
+            }
+            if (!status.is2xxOK()) {
+                for (auto idx : indices) {
+                    results[idx].status = status;
+                }
+                return seastar::make_ready_future();
+            }
+
+            std::vector<seastar::future<>> futs;
+            futs.reserve(indices.size());
+            for (size_t i = 0; i < indices.size(); ++i) {
+                futs.push_back(_completeBatchRead(keys[indices[i]], collection, std::move(k2response.results[i]), results[indices[i]]));
+            }
+            return seastar::when_all_succeed(futs.begin(), futs.end()).discard_result();
+        }).finally([r = std::move(request)] () mutable {
+            (void)r;
+        });
+}
+
+seastar::future<> K2TxnHandle::_completeBatchRead(const dto::Key& key, const String& collection,
+                                                  dto::K23SIReadBatchResult&& result, ReadResult<dto::SKVRecord>& out) {
+    _checkResponseStatus(result.status);
+    if (result.status == dto::K23SIStatus::RefreshCollection) {
+        // The partition map changed since we grouped the keys and this key is now owned by another partition.
+        // A single-key read refreshes the map and routes the key correctly
+        return read(key, collection)
+            .then([&out] (auto&& readResult) {
+                out = std::move(readResult);
+            });
+    }
+    if (!result.status.is2xxOK()) {
+        out.status = std::move(result.status);
+        return seastar::make_ready_future();
+    }
+
+    return _client->getSchema(collection, key.schemaName, result.value.schemaVersion)
+    .then([s=std::move(result.status), storage=std::move(result.value), &collection, &out] (auto&& response) mutable {
+        auto& [status, schema_ptr] = response;
+        K2LOG_D(log::skvclient, "got status for getSchema: {}", status);
+
+        if (!status.is2xxOK()) {
+            out.status = dto::K23SIStatus::OperationNotAllowed("Matching schema could not be found");
+            return;
+        }
+        out = ReadResult<dto::SKVRecord>(std::move(s), dto::SKVRecord(collection, schema_ptr, std::move(storage), true));
+    });
+}
+
+
 std::unique_ptr<dto::K23SIWriteRequest> K2TxnHandle::_makeWriteRequest(dto::SKVRecord& record, bool erase,
                                                                     dto::ExistencePrecondition precondition) {
     for (const String& key : record.partitionKeys) {
@@ -196,6 +339,186 @@ std::unique_ptr<dto::K23SIWriteRequest> K2TxnHandle::_makeWriteRequest(dto::SKVR
     });
 }
 
+seastar::future<std::vector<WriteResult>> K2TxnHandle::writeBatch(std::vector<dto::SKVRecord>& records, bool erase,
+                                                                  dto::ExistencePrecondition precondition) {
+    typedef std::vector<WriteResult> ResultsT;
+    if (!_valid) {
+        return seastar::make_exception_future<ResultsT>(K23SIClientException("Invalid use of K2TxnHandle"));
+    }
+    if (_options.snapshotRead) {
+        return seastar::make_exception_future<ResultsT>(K23SIClientException("Snapshot read transactions cannot write"));
+    }
+    if (_failed) {
+        ResultsT results;
+        results.reserve(records.size());
+        for (size_t i = 0; i < records.size(); ++i) {
+            results.emplace_back(_failed_status, dto::K23SIWriteResponse());
+        }
+        return seastar::make_ready_future<ResultsT>(std::move(results));
+    }
+    if (records.empty()) {
+        return seastar::make_ready_future<ResultsT>();
+    }
+    for (auto& record : records) {
+        if (record.collectionName != records[0].collectionName) {
+            return seastar::make_exception_future<ResultsT>(K23SIClientException("All records in a write batch must belong to the same collection"));
+        }
+    }
+
+    bool designateTRH = !_trh_key.has_value();
+    std::vector<std::unique_ptr<dto::K23SIWriteRequest>> requests;
+    requests.reserve(records.size());
+    try {
+        for (auto& record : records) {
+            requests.push_back(_makeWriteRequest(record, erase, precondition));
+        }
+    }
+    catch (...) {
+        // a bad record later in the batch must not leave us with a TRH key for which we never created a TRH
+        if (designateTRH) {
+            _trh_key.reset();
+            _trh_collection = String();
+        }
+        return seastar::make_exception_future<ResultsT>(std::current_exception());
+    }
+
+    K2LOG_D(log::skvclient, "making write batch for {} records, collection={}", records.size(), records[0].collectionName);
+    _ongoing_ops++;
+
+    return _cpo_client->getPartitionGetterWithRetry(_options.deadline, records[0].collectionName)
+    .then([this, requests=std::move(requests)] (auto&& result) mutable {
+        auto& [status, pgetter] = result;
+        ResultsT results;
+        results.reserve(requests.size());
+        for (size_t i = 0; i < requests.size(); ++i) {
+            results.emplace_back(status, dto::K23SIWriteResponse());
+        }
+        if (!status.is2xxOK()) {
+            K2LOG_D(log::skvclient, "failed to get collection for write batch with status={}", status);
+            return seastar::make_ready_future<ResultsT>(std::move(results));
+        }
+
+        // group the requests by the partition which owns them. The first request is first in the first group,
+        // so if it designates the TRH it is also the routing key of its group
+        std::vector<std::vector<size_t>> groups;
+        std::unordered_map<uint64_t, size_t> groupIndex;
+        for (size_t i = 0; i < requests.size(); ++i) {
+            auto& pwe = pgetter->getPartitionForKey(requests[i]->key);
+            auto [it, inserted] = groupIndex.try_emplace(pwe.partition ? pwe.partition->keyRangeV.pvid.id : 0, groups.size());
+            if (inserted) {
+                groups.emplace_back();
+            }
+            groups[it->second].push_back(i);
+        }
+
+        return seastar::do_with(std::move(results), std::move(requests), std::move(groups),
+            [this] (auto& results, auto& requests, auto& groups) {
+                // the TRH has to exist before the writes to other partitions reference it
+                auto fut = seastar::make_ready_future();
+                size_t parallelStart = 0;
+                if (requests[0]->designateTRH) {
+                    fut = _writeBatchGroup(requests, groups[0], results);
+                    parallelStart = 1;
+                }
+                return fut.then([this, &results, &requests, &groups, parallelStart] {
+                    std::vector<seastar::future<>> futs;
+                    futs.reserve(groups.size());
+                    for (size_t i = parallelStart; i < groups.size(); ++i) {
+                        futs.push_back(_writeBatchGroup(requests, groups[i], results));
+                    }
+                    return seastar::when_all_succeed(futs.begin(), futs.end()).discard_result();
+                })
+                .then([&results] {
+                    return std::move(results);
+                });
+            });
+    }).finally([this] {
+        _ongoing_ops--;
+    });
+}
+
+seastar::future<> K2TxnHandle::_writeBatchGroup(std::vector<std::unique_ptr<dto::K23SIWriteRequest>>& requests,
+                                                const std::vector<size_t>& indices, std::vector<WriteResult>& results) {
+    if (_failed) {
+        for (auto idx : indices) {
+            results[idx].status = _failed_status;
+        }
+        return seastar::make_ready_future();
+    }
+
+    auto& first = *requests[indices[0]];
+    auto request = std::make_unique<dto::K23SIWriteBatchRequest>(dto::K23SIWriteBatchRequest{
+        .pvid = dto::PVID{}, // Will be filled in by PartitionRequest
+        .collectionName = first.collectionName,
+        .mtr = _mtr,
+        .trh = first.trh,
+        .trhCollection = first.trhCollection,
+        .designateTRH = first.designateTRH,
+        .key = first.key,
+        .writes = {}
+    });
+    request->writes.reserve(indices.size());
+    for (auto idx : indices) {
+        auto& write = *requests[idx];
+        request->writes.push_back(dto::K23SIWriteBatchEntry{
+            .isDelete = write.isDelete,
+            .precondition = write.precondition,
+            .request_id = write.request_id,
+            .key = write.key,
+            .value = write.value.share(),
+            .fieldsForPartialUpdate = write.fieldsForPartialUpdate
+        });
+    }
+
+    return _cpo_client->partitionRequest
+        <dto::K23SIWriteBatchRequest, dto::K23SIWriteBatchResponse, dto::Verbs::K23SI_WRITE_BATCH>
+        (_options.deadline, *request).
+        then([this, &requests, &indices, &results] (auto&& response) {
+            auto& [status, k2response] = response;
+            K2LOG_D(log::skvclient, "got write batch status={}", status);
+            if (status.is2xxOK() && k2response.statuses.size() != indices.size()) {
+                status = dto::K23SIStatus::InternalError("write batch response does not match the request");
+            }
+            if (!status.is2xxOK()) {
+                for (auto idx : indices) {
+                    _registerRangeForWrite(status, *requests[idx]);
+                    results[idx].status = status;
+                }
+                _checkResponseStatus(status);
+                return seastar::make_ready_future();
+            }
+
+            std::vector<seastar::future<>> futs;
+            for (size_t i = 0; i < indices.size(); ++i) {
+                auto& writeStatus = k2response.statuses[i];
+                auto& singleRequest = *requests[indices[i]];
+                auto& out = results[indices[i]];
+                if (writeStatus == dto::K23SIStatus::RefreshCollection) {
+                    // The partition map changed since we grouped the records and this key is now owned by another
+                    // partition. A single write refreshes the map and routes the key correctly
+                    futs.push_back(_cpo_client->partitionRequest
+                        <dto::K23SIWriteRequest, dto::K23SIWriteResponse, dto::Verbs::K23SI_WRITE>
+                        (_options.deadline, singleRequest).
+                        then([this, &singleRequest, &out] (auto&& response) {
+                            auto& [status, k2response] = response;
+                            _registerRangeForWrite(status, singleRequest);
+                            _checkResponseStatus(status);
+                            _maybeStartHeartbeat(status);
+                            out.status = std::move(status);
+                        }));
+                    continue;
+                }
+                _registerRangeForWrite(writeStatus, singleRequest);
+                _checkResponseStatus(writeStatus);
+                _maybeStartHeartbeat(writeStatus);
+                out.status = std::move(writeStatus);
+            }
+            return seastar::when_all_succeed(futs.begin(), futs.end()).discard_result();
+        }).finally([r = std::move(request)] () mutable {
+            (void)r;
+        });
+}
+
 std::unique_ptr<dto::K23SIWriteRequest> K2TxnHandle::_makePartialUpdateRequest(dto::SKVRecord& record,
                     std::vector<uint32_t> fieldsForPartialUpdate, dto::Key&& key) {
         bool isTRH = !_trh_key.has_value();
@@ -221,7 +544,6 @@ std::unique_ptr<dto::K23SIWriteRequest> K2TxnHandle::_makePartialUpdateRequest(d
 }
 
 seastar::future<EndResult> K2TxnHandle::end(bool shouldCommit) {
-    k2::OperationLatencyReporter reporter(_client->_txnEndLatency);
     if (!_valid) {
         return seastar::make_exception_future<EndResult>(K23SIClientException("Tried to end() an invalid TxnHandle"));
     }
@@ -232,6 +554,23 @@ seastar::future<EndResult> K2TxnHandle::end(bool shouldCommit) {
         return seastar::make_exception_future<EndResult>(K23SIClientException("Tried to end() with ongoing ops"));
     }
 
+    _closeQueryStreams();
+    return _end(shouldCommit);
+}
+
+void K2TxnHandle::_closeQueryStreams() {
+    // the application is done with any streaming queries it didn't read to the end
+    for (auto& stream : _query_streams) {
+        (void)_closeQueryStream(std::move(stream))
+            .handle_exception([] (auto exc) {
+                K2LOG_W_EXC(log::skvclient, exc, "failed to close query stream");
+            });
+    }
+    _query_streams.clear();
+}
+
+seastar::future<EndResult> K2TxnHandle::_end(bool shouldCommit) {
+    k2::OperationLatencyReporter reporter(_client->_txnEndLatency);
     if (_write_ranges.empty()) {
         _client->successful_txns++;
 
@@ -243,7 +582,8 @@ seastar::future<EndResult> K2TxnHandle::end(bool shouldCommit) {
         }
         auto minTransTime = _client->getTSOErrorbound();
         auto time_spent = Clock::now() - _start_time;
-        if (time_spent < minTransTime) {
+        // snapshot reads are far enough in the past that there is no need to wait out the TSO uncertainty
+        if (!_options.snapshotRead && time_spent < minTransTime) {
             auto sleep = minTransTime - time_spent;
             return seastar::sleep(sleep).then([this, reporter = std::move(reporter), time_spent] () mutable {
                 reporter.report();
@@ -275,36 +615,7 @@ seastar::future<EndResult> K2TxnHandle::end(bool shouldCommit) {
         (Deadline<>(_txn_end_deadline), *request).
         then([this, shouldCommit] (auto&& response) {
             auto& [status, k2response] = response;
-            if (status.is2xxOK() && !_failed) {
-                _client->successful_txns++;
-            } else if (!status.is2xxOK()){
-                K2LOG_W(log::skvclient, "TxnEndRequest failed: status={}, mtr={}", status, _mtr);
-            }
-
-            if (_failed && shouldCommit && status.is2xxOK()) {
-                // This could either be a bug in the application, where the failure was a read/write op
-                // and the app should know to abort, or it is a normal scenario where there was a
-                // failure on the heartbeat and the app was not aware.
-                //
-                // Either way, we aborted the transaction but we need to indicate to the app that
-                // it was not commited
-                K2LOG_D(log::skvclient, "Tried to commit a failed transaction, mtr={}", _mtr);
-                status = _failed_status;
-            }
-
-            K2LOG_D(log::skvclient, "txn {} end request was accepted", _mtr);
-            return _heartbeat_timer.stop().then([this, s=std::move(status)] () {
-                auto time_spent = Clock::now() - _start_time;
-                K2LOG_D(log::skvclient, "time {}, spent: {}", _mtr, time_spent);
-                auto minTransTime = _client->getTSOErrorbound();
-                if (time_spent < minTransTime) {
-                    auto sleep = minTransTime - time_spent;
-                    return seastar::sleep(sleep).then([s=std::move(s)] () {
-                        return seastar::make_ready_future<EndResult>(EndResult(std::move(s)));
-                    });
-                }
-                return seastar::make_ready_future<EndResult>(EndResult(std::move(s)));
-            });
+            return _completeEnd(std::move(status), shouldCommit);
         }).finally([this, request, reporter=std::move(reporter)] () mutable {
             delete request;
             reporter.report();
@@ -322,6 +633,7 @@ K23SIClient::K23SIClient(const K23SIClientConfig &) :
         sm::make_counter("write_ops", write_ops, sm::description("Total K23SI Write/Delete operations"), labels),
         sm::make_counter("total_txns", total_txns, sm::description("Total K23SI transactions began"), labels),
         sm::make_counter("successful_txns", successful_txns, sm::description("Total K23SI transactions ended successfully (committed or user aborted)"), labels),
+        sm::make_counter("write_commits", write_commits, sm::description("Total K23SI transactions committed by the TRH with their last write"), labels),
         sm::make_counter("abort_conflicts", abort_conflicts, sm::description("Total K23SI transactions aborted due to conflict"), labels),
         sm::make_counter("abort_too_old", abort_too_old, sm::description("Total K23SI transactions aborted due to retention window expiration"), labels),
         sm::make_counter("heartbeats", heartbeats, sm::description("Total K23SI transaction heartbeats sent"), labels),
@@ -343,10 +655,31 @@ seastar::future<> K23SIClient::start() {
     K2LOG_I(log::skvclient, "_cpo={}", _cpo());
     cpo_client.init(_cpo());
 
+    RPC().registerMessageObserver(dto::Verbs::K23SI_QUERY_STREAM_CHUNK, [this](Request&& request) {
+        dto::K23SIQueryStreamChunk chunk;
+        if (!request.payload->read(chunk)) {
+            K2LOG_W(log::skvclient, "unable to parse query stream chunk from {}", request.endpoint.url);
+            return;
+        }
+        auto it = queryStreams.find(chunk.streamId);
+        if (it == queryStreams.end()) {
+            K2LOG_D(log::skvclient, "dropping chunk for closed query stream {}", chunk.streamId);
+            return;
+        }
+        auto stream = it->second;
+        if (chunk.done || !chunk.status.is2xxOK()) {
+            // the partition doesn't send anything after the last chunk
+            queryStreams.erase(it);
+        }
+        stream->push(std::move(chunk));
+    });
+
     return seastar::make_ready_future<>();
 }
 
 seastar::future<> K23SIClient::gracefulStop() {
+    RPC().registerMessageObserver(dto::Verbs::K23SI_QUERY_STREAM_CHUNK, nullptr);
+    queryStreams.clear();
     return seastar::make_ready_future<>();
 }
 
@@ -373,6 +706,10 @@ seastar::future<K2TxnHandle> K23SIClient::beginTxn(const K2TxnOptions& options)
             .timestamp=std::move(ts),
             .priority=options.priority
         };
+        if (options.snapshotRead) {
+            // read far enough in the past for the timestamp to be closed on the partitions
+            mtr.timestamp = mtr.timestamp - snapshot_read_lag();
+        }
 
         total_txns++;
         return seastar::make_ready_future<K2TxnHandle>(
@@ -512,6 +849,91 @@ seastar::future<CreateQueryResult> K23SIClient::createQuery(const String& collec
 
 }
 
+// Counts the outcome of the txn, reports a commit of a failed txn as the failure, and stops the heartbeat.
+// The result is delivered once the txn has lasted at least the TSO error bound
+seastar::future<EndResult> K2TxnHandle::_completeEnd(Status&& status, bool shouldCommit) {
+    if (status.is2xxOK() && !_failed) {
+        _client->successful_txns++;
+    } else if (!status.is2xxOK()){
+        K2LOG_W(log::skvclient, "TxnEndRequest failed: status={}, mtr={}", status, _mtr);
+    }
+
+    if (_failed && shouldCommit && status.is2xxOK()) {
+        // This could either be a bug in the application, where the failure was a read/write op
+        // and the app should know to abort, or it is a normal scenario where there was a
+        // failure on the heartbeat and the app was not aware.
+        //
+        // Either way, we aborted the transaction but we need to indicate to the app that
+        // it was not commited
+        K2LOG_D(log::skvclient, "Tried to commit a failed transaction, mtr={}", _mtr);
+        status = _failed_status;
+    }
+
+    K2LOG_D(log::skvclient, "txn {} end request was accepted", _mtr);
+    return _heartbeat_timer.stop().then([this, s=std::move(status)] () mutable {
+        auto time_spent = Clock::now() - _start_time;
+        K2LOG_D(log::skvclient, "time {}, spent: {}", _mtr, time_spent);
+        auto minTransTime = _client->getTSOErrorbound();
+        if (time_spent < minTransTime) {
+            auto sleep = minTransTime - time_spent;
+            return seastar::sleep(sleep).then([s=std::move(s)] () mutable {
+                return seastar::make_ready_future<EndResult>(EndResult(std::move(s)));
+            });
+        }
+        return seastar::make_ready_future<EndResult>(EndResult(std::move(s)));
+    });
+}
+
+seastar::future<EndResult> K2TxnHandle::_writeAndCommit(std::unique_ptr<dto::K23SIWriteRequest> request) {
+    k2::OperationLatencyReporter reporter(_client->_txnEndLatency);
+    // as with end(), the application is not allowed to use the handle once it has asked for the commit
+    _valid = false;
+    _closeQueryStreams();
+    auto commitRequest = std::make_unique<dto::K23SIWriteAndCommitRequest>(dto::K23SIWriteAndCommitRequest{
+        .pvid = dto::PVID{}, // Will be filled in by PartitionRequest
+        .collectionName = std::move(request->collectionName),
+        .mtr = std::move(request->mtr),
+        .key = std::move(request->key),
+        .write = std::move(*request),
+        .writeRanges = _write_ranges,
+        .syncFinalize = _options.syncFinalize
+    });
+    _ongoing_ops++;
+
+    return _cpo_client->partitionRequest
+        <dto::K23SIWriteAndCommitRequest, dto::K23SIWriteResponse, dto::Verbs::K23SI_WRITE_AND_COMMIT>
+        (_options.deadline, *commitRequest).
+        then([this, request=std::move(commitRequest), reporter=std::move(reporter)] (auto&& response) mutable {
+            auto& [status, k2response] = response;
+            _ongoing_ops--;
+            if (k2response.txnEnded) {
+                // the TRH committed the transaction with the write. This is the status of the commit
+                K2LOG_D(log::skvclient, "txn {} was ended with its last write", _mtr);
+                if (status.is2xxOK()) {
+                    _client->write_commits++;
+                }
+                _heartbeat_timer.cancel();
+                _write_ranges.clear();
+                return _completeEnd(std::move(status), true)
+                    .finally([this, reporter=std::move(reporter)] () mutable {
+                        reporter.report();
+                        _client->_txnDuration.add(k2::Clock::now() - _startTime);
+                    });
+            }
+
+            // the write didn't land on the TRH, or it failed. End the transaction as usual
+            _registerRangeForWrite(status, *request);
+            _checkResponseStatus(status);
+            if (!status.is2xxOK()) {
+                K2LOG_D(log::skvclient, "aborting txn {} after its last write failed with {}", _mtr, status);
+                return _end(false).then([status=std::move(status)] (auto&&) mutable {
+                    return EndResult(std::move(status));
+                });
+            }
+            return _end(true);
+        });
+}
+
 // Called the first time a Query object is used to validate and setup the request object
 void K2TxnHandle::_prepareQueryRequest(Query& query) {
     // Start and end records need to be at least a prefix of key fields. If they are a proper prefix,
@@ -606,13 +1028,23 @@ seastar::future<QueryResult> K2TxnHandle::query(Query& query) {
     _client->query_ops++;
     _ongoing_ops++;
 
+    auto fut = query.streaming ? _streamQuery(query) : _queryPage(query);
+    return fut.then([this] (auto&& result) {
+        _ongoing_ops--;
+        return std::move(result);
+    })
+    .finally([reporter=std::move(reporter)] () mutable{
+        reporter.report();
+    });
+}
+
+seastar::future<QueryResult> K2TxnHandle::_queryPage(Query& query) {
     return _cpo_client->partitionRequest
         <dto::K23SIQueryRequest, dto::K23SIQueryResponse, dto::Verbs::K23SI_QUERY>
         (_options.deadline, query.request, query.request.reverseDirection, query.request.exclusiveKey)
     .then([this, &query] (auto&& response) {
         auto& [status, k2response] = response;
         _checkResponseStatus(status);
-        _ongoing_ops--;
 
         if (!status.is2xxOK()) {
             query.done = true;
@@ -634,11 +1066,138 @@ seastar::future<QueryResult> K2TxnHandle::query(Query& query) {
         }
 
         return QueryResult::makeQueryResult(_client, query, std::move(status), std::move(k2response));
+    });
+}
+
+seastar::future<QueryResult> K2TxnHandle::_streamQuery(Query& query) {
+    auto opened = query.stream ?
+        seastar::make_ready_future<Status>(dto::K23SIStatus::OK("query stream is open")) :
+        _openQueryStream(query);
+
+    return opened.then([this, &query] (Status&& status) {
+        if (!status.is2xxOK()) {
+            return seastar::make_ready_future<dto::K23SIQueryStreamChunk>(dto::K23SIQueryStreamChunk{.status = std::move(status)});
+        }
+        return query.stream->next(std::min(_options.deadline.getRemaining(), _cpo_client->partition_request_timeout()));
     })
-    .finally([reporter=std::move(reporter)] () mutable{
-        reporter.report();
+    .then([this, &query] (dto::K23SIQueryStreamChunk&& chunk) {
+        if (chunk.status == dto::K23SIStatus::RefreshCollection || chunk.status.is5xxRetryable()) {
+            // The partition moved, or it isn't responding. Continue with a regular query request, which
+            // refreshes the partition map and retries as needed. The next call opens a new stream
+            K2LOG_D(log::skvclient, "query stream failed with status={}, falling back to query request", chunk.status);
+            auto stream = std::move(query.stream);
+            query.stream = nullptr;
+            return (stream ? _closeQueryStream(std::move(stream)) : seastar::make_ready_future())
+                .then([this, &query] {
+                    return _queryPage(query);
+                });
+        }
+
+        _checkResponseStatus(chunk.status);
+        if (!chunk.status.is2xxOK()) {
+            query.done = true;
+            query.stream = nullptr;
+            return seastar::make_ready_future<QueryResult>(QueryResult(std::move(chunk.status)));
+        }
+
+        auto& stream = *query.stream;
+        stream.outstandingCredits -= std::min<uint64_t>(stream.outstandingCredits, chunk.results.size());
+        if (chunk.nextToScan.partitionKey == "") {
+            query.done = true;
+        } else {
+            query.request.key = std::move(chunk.nextToScan);
+            query.request.exclusiveKey = chunk.exclusiveToken;
+        }
+
+        if (query.request.recordLimit >= 0) {
+            query.request.recordLimit -= chunk.results.size();
+            if (query.request.recordLimit == 0) {
+                query.done = true;
+            }
+        }
+
+        seastar::future<> credits = seastar::make_ready_future();
+        if (chunk.done) {
+            // the partition closed the stream. The scan continues on the next partition with a new stream
+            query.stream = nullptr;
+        } else if (query.done) {
+            credits = _closeQueryStream(std::move(query.stream));
+            query.stream = nullptr;
+        } else {
+            credits = _grantQueryStreamCredits(stream);
+        }
+
+        return credits.then([this, &query, status=std::move(chunk.status), results=std::move(chunk.results)] () mutable {
+            dto::K23SIQueryResponse response;
+            response.results = std::move(results);
+            return QueryResult::makeQueryResult(_client, query, std::move(status), std::move(response));
+        });
     });
+}
 
+seastar::future<Status> K2TxnHandle::_openQueryStream(Query& query) {
+    return _cpo_client->getPartitionGetterWithRetry(_options.deadline, query.request.collectionName, query.request.key,
+                                                    query.request.reverseDirection, query.request.exclusiveKey)
+    .then([this, &query] (auto&& result) {
+        auto& [status, pgetter] = result;
+        if (!status.is2xxOK()) {
+            return seastar::make_ready_future<Status>(std::move(status));
+        }
+        auto& partition = pgetter->getPartitionForKey(query.request.key, query.request.reverseDirection, query.request.exclusiveKey);
+        if (!partition.partition || partition.partition->astate != dto::AssignmentState::Assigned) {
+            return seastar::make_ready_future<Status>(Statuses::S503_Service_Unavailable("partition not assigned"));
+        }
+        query.request.pvid = partition.partition->keyRangeV.pvid;
+
+        auto stream = seastar::make_lw_shared<QueryStream>();
+        stream->id = _client->nextQueryStreamId++;
+        stream->endpoint = std::make_unique<TXEndpoint>(*partition.preferredEndpoint);
+        stream->outstandingCredits = _client->query_stream_window();
+        _client->queryStreams[stream->id] = stream;
+        _query_streams.push_back(stream);
+        query.stream = stream;
+
+        K2LOG_D(log::skvclient, "opening query stream {} to {} for {}", stream->id, stream->endpoint->url, query.request);
+        auto payload = stream->endpoint->newPayload();
+        payload->write(dto::K23SIQueryStreamOpenRequest{
+            .streamId = stream->id,
+            .credits = _client->query_stream_window(),
+            .query = query.request
+        });
+        // all messages of a stream go over the same connection, since the partition identifies the stream by
+        // the endpoint it arrives from, and it expects them in order
+        return RPC().send(dto::Verbs::K23SI_QUERY_STREAM_OPEN, std::move(payload), *stream->endpoint, stream->id)
+            .then([stream] {
+                return seastar::make_ready_future<Status>(dto::K23SIStatus::OK("query stream opened"));
+            });
+    });
+}
+
+seastar::future<> K2TxnHandle::_grantQueryStreamCredits(QueryStream& stream) {
+    uint32_t window = _client->query_stream_window();
+    // grant credits in batches so that we don't send a message for every chunk
+    if (stream.outstandingCredits >= window / 2) {
+        return seastar::make_ready_future();
+    }
+    auto payload = stream.endpoint->newPayload();
+    payload->write(dto::K23SIQueryStreamCreditRequest{
+        .streamId = stream.id,
+        .credits = uint32_t(window - stream.outstandingCredits)
+    });
+    stream.outstandingCredits = window;
+    return RPC().send(dto::Verbs::K23SI_QUERY_STREAM_CREDIT, std::move(payload), *stream.endpoint, stream.id);
+}
+
+seastar::future<> K2TxnHandle::_closeQueryStream(seastar::lw_shared_ptr<QueryStream> stream) {
+    if (_client->queryStreams.erase(stream->id) == 0) {
+        // the partition already closed this stream
+        return seastar::make_ready_future();
+    }
+    K2LOG_D(log::skvclient, "closing query stream {} to {}", stream->id, stream->endpoint->url);
+    auto payload = stream->endpoint->newPayload();
+    payload->write(dto::K23SIQueryStreamCreditRequest{.streamId = stream->id, .credits = 0, .close = true});
+    return RPC().send(dto::Verbs::K23SI_QUERY_STREAM_CREDIT, std::move(payload), *stream->endpoint, stream->id)
+        .finally([stream] {});
 }
 
 const dto::K23SI_MTR& K2TxnHandle::mtr() const {
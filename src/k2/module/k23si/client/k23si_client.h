@@ -59,7 +59,11 @@ public:
     Deadline<> deadline = Deadline<>(Duration(1s));
     dto::TxnPriority priority{dto::TxnPriority::Medium};
     bool syncFinalize = false;
-    K2_DEF_FMT(K2TxnOptions, deadline, priority, syncFinalize);
+    // Run the txn as a read-only snapshot read. The txn reads at a timestamp which trails the TSO time by the
+    // client's snapshot_read_lag, so that partitions can serve its reads without tracking them in their read caches.
+    // Such txns may not write
+    bool snapshotRead = false;
+    K2_DEF_FMT(K2TxnOptions, deadline, priority, syncFinalize, snapshotRead);
 };
 
 template<typename ValueType>
@@ -143,12 +147,18 @@ public:
     ConfigDuration create_collection_deadline{"create_collection_deadline", 1s};
     ConfigDuration retention_window{"retention_window", 600s};
     ConfigDuration txn_end_deadline{"txn_end_deadline", 60s};
+    // how far in the past snapshot read txns read. To benefit from snapshot reads, this has to be larger than the
+    // closed timestamp lag of the servers plus their update interval. Otherwise the reads are served as regular reads
+    ConfigDuration snapshot_read_lag{"snapshot_read_lag", 10s};
+    // the max number of records a partition may push ahead of the application in a streaming query
+    ConfigVar<uint32_t> query_stream_window{"query_stream_window", 500};
 
     uint64_t read_ops{0};
     uint64_t write_ops{0};
     uint64_t query_ops{0};
     uint64_t total_txns{0};
     uint64_t successful_txns{0};
+    uint64_t write_commits{0};
     uint64_t abort_conflicts{0};
     uint64_t abort_too_old{0};
     uint64_t heartbeats{0};
@@ -168,6 +178,10 @@ public:
     // collection name -> (schema name -> (schema version -> schemaPtr))
     std::unordered_map<String, std::unordered_map<String, std::unordered_map<uint32_t, std::shared_ptr<dto::Schema>>>> schemas;
 
+    // the open query streams, by stream id
+    std::unordered_map<uint64_t, seastar::lw_shared_ptr<QueryStream>> queryStreams;
+    uint64_t nextQueryStreamId{1};
+
 private:
     seastar::future<Status> refreshSchemaCache(const String& collectionName);
     seastar::future<std::tuple<Status, std::shared_ptr<dto::Schema>>> getSchemaInternal(const String& collectionName, const String& schemaName, int64_t schemaVersion, bool doCPORefresh = true);
@@ -180,6 +194,8 @@ class K2TxnHandle {
 private:
     void _makeHeartbeatTimer();
     void _checkResponseStatus(Status& status);
+    // start heartbeating the transaction once a write has been accepted with the given status
+    void _maybeStartHeartbeat(const Status& status);
 
     std::unique_ptr<dto::K23SIReadRequest> _makeReadRequest(const dto::Key& key,
                                                            const String& collectionName) const;
@@ -197,8 +213,49 @@ private:
     std::unique_ptr<dto::K23SIWriteRequest> _makePartialUpdateRequest(dto::SKVRecord& record,
             std::vector<uint32_t> fieldsForPartialUpdate, dto::Key&& key);
 
+    // read the keys at the given indices with a single batch request to the partition which owns them,
+    // and place the results at the same indices in the results vector
+    seastar::future<> _readBatchGroup(const std::vector<dto::Key>& keys, const std::vector<size_t>& indices,
+                                      const String& collection, std::vector<ReadResult<dto::SKVRecord>>& results);
+
+    // turn the result for a single key from a batch read into a ReadResult
+    seastar::future<> _completeBatchRead(const dto::Key& key, const String& collection,
+                                         dto::K23SIReadBatchResult&& result, ReadResult<dto::SKVRecord>& out);
+
+    // write the requests at the given indices with a single batch request to the partition which owns them,
+    // and place the results at the same indices in the results vector
+    seastar::future<> _writeBatchGroup(std::vector<std::unique_ptr<dto::K23SIWriteRequest>>& requests,
+                                       const std::vector<size_t>& indices, std::vector<WriteResult>& results);
+
     void _prepareQueryRequest(Query& query);
 
+    // send the given write and commit the transaction with it, if the write lands on the TRH
+    seastar::future<EndResult> _writeAndCommit(std::unique_ptr<dto::K23SIWriteRequest> request);
+
+    // end the transaction, once the handle has been invalidated and there are no ongoing ops
+    seastar::future<EndResult> _end(bool shouldCommit);
+
+    // complete the end of the transaction, once the TRH has responded to ending it with the given status
+    seastar::future<EndResult> _completeEnd(Status&& status, bool shouldCommit);
+
+    // close the streaming queries which the application didn't read to the end
+    void _closeQueryStreams();
+
+    // get the next set of results for a streaming query, opening a stream to the partition if needed
+    seastar::future<QueryResult> _streamQuery(Query& query);
+
+    // open a stream for the given query, on the partition which owns the start of the remaining scan
+    seastar::future<Status> _openQueryStream(Query& query);
+
+    // grant the partition enough credits to fill up the window of the given stream
+    seastar::future<> _grantQueryStreamCredits(QueryStream& stream);
+
+    // tell the partition to drop the given stream, unless it is already done
+    seastar::future<> _closeQueryStream(seastar::lw_shared_ptr<QueryStream> stream);
+
+    // get one page of results for the query with a regular query request
+    seastar::future<QueryResult> _queryPage(Query& query);
+
     // Utility method used to register the range for a given write request, after we receive a response for it.
     // We track these ranges so that we can tell the TRH to finalize WIs in them when the transaction ends.
     template <class T>
@@ -234,6 +291,11 @@ public:
     // and not directly created by the user
     seastar::future<ReadResult<dto::SKVRecord>> read(dto::Key key, String collection);
 
+    // Reads multiple keys from the given collection. The keys are grouped by the partition which owns them and
+    // each group is read with a single request, with all groups read in parallel. The results are returned in
+    // the same order as the keys
+    seastar::future<std::vector<ReadResult<dto::SKVRecord>>> readBatch(std::vector<dto::Key> keys, String collection);
+
     // The read interface for user-defined classes with the SKV_RECORD_FIELDS macro defined
     // The class instance is automatically serialized and deserialized from an SKVRecord
     // Note that there is an explicit template instantiation of this function for the normal SKVRecord
@@ -282,6 +344,9 @@ public:
         if (!_valid) {
             return seastar::make_exception_future<WriteResult>(K23SIClientException("Invalid use of K2TxnHandle"));
         }
+        if (_options.snapshotRead) {
+            return seastar::make_exception_future<WriteResult>(K23SIClientException("Snapshot read transactions cannot write"));
+        }
         if (_failed) {
             return seastar::make_ready_future<WriteResult>(WriteResult(_failed_status, dto::K23SIWriteResponse()));
         }
@@ -308,14 +373,7 @@ public:
                 _checkResponseStatus(status);
                 _ongoing_ops--;
 
-                if ((status.is2xxOK() || status == dto::K23SIStatus::ConditionFailed) &&
-                    !_heartbeat_timer.isArmed()) {
-                    K2ASSERT(log::skvclient, _cpo_client->collections.find(_trh_collection) != _cpo_client->collections.end(), "collection not present after successful write");
-                    K2LOG_D(log::skvclient, "Starting hb, mtr={}", _mtr);
-                    _heartbeat_interval = _cpo_client->collections[_trh_collection]->collection.metadata.heartbeatDeadline / 2;
-                    _makeHeartbeatTimer();
-                    _heartbeat_timer.armPeriodic(_heartbeat_interval);
-                }
+                _maybeStartHeartbeat(status);
 
                 return seastar::make_ready_future<WriteResult>(WriteResult(std::move(status), std::move(k2response)));
             })
@@ -324,6 +382,14 @@ public:
             });
     }
 
+    // Writes the given records, which must all belong to the same collection. The records are grouped by the
+    // partition which owns them and each group is written with a single request. If the transaction has no TRH yet,
+    // the first record is used as the TRH and its group is written before the others. The remaining groups are
+    // written in parallel. The results are returned in the same order as the records. The records must have
+    // distinct keys - the server rejects a batch which contains the same key twice with BadParameter
+    seastar::future<std::vector<WriteResult>> writeBatch(std::vector<dto::SKVRecord>& records, bool erase=false,
+                                       dto::ExistencePrecondition precondition=dto::ExistencePrecondition::None);
+
     template <typename T>
     seastar::future<PartialUpdateResult> partialUpdate(T& record, std::vector<k2::String> fieldsName,
                                                        dto::Key key=dto::Key()) {
@@ -353,6 +419,9 @@ public:
         if (!_valid) {
             return seastar::make_exception_future<PartialUpdateResult>(K23SIClientException("Invalid use of K2TxnHandle"));
         }
+        if (_options.snapshotRead) {
+            return seastar::make_exception_future<PartialUpdateResult>(K23SIClientException("Snapshot read transactions cannot write"));
+        }
         if (_failed) {
             return seastar::make_ready_future<PartialUpdateResult>(PartialUpdateResult(_failed_status));
         }
@@ -407,13 +476,42 @@ public:
     }
 
     // Get one set of paginated results for a query. User may need to call again with same query
-    // object to get more results
+    // object to get more results. Streaming queries which are not done when the transaction ends are closed
     seastar::future<QueryResult> query(Query& query);
 
     // Must be called exactly once by application code and after all ongoing read and write
     // operations are completed
     seastar::future<EndResult> end(bool shouldCommit);
 
+    // Writes the given record and commits the transaction. If the record is owned by the partition which holds the
+    // TRH, the commit is done as part of the write request, which saves a round trip. Otherwise the transaction is
+    // ended with a separate request. The transaction is aborted if the write fails, and the result carries the
+    // status of the write in that case. This is an alternative to end(true) and the same rules apply
+    template <class T>
+    seastar::future<EndResult> writeAndCommit(T& record, bool erase=false,
+                                              dto::ExistencePrecondition precondition=dto::ExistencePrecondition::None) {
+        if (!_valid) {
+            return seastar::make_exception_future<EndResult>(K23SIClientException("Invalid use of K2TxnHandle"));
+        }
+        if (_options.snapshotRead) {
+            return seastar::make_exception_future<EndResult>(K23SIClientException("Snapshot read transactions cannot write"));
+        }
+        if (_ongoing_ops != 0) {
+            return seastar::make_exception_future<EndResult>(K23SIClientException("Tried to end() with ongoing ops"));
+        }
+        if (_failed) {
+            return end(true);
+        }
+
+        if constexpr (std::is_same<T, dto::SKVRecord>()) {
+            return _writeAndCommit(_makeWriteRequest(record, erase, precondition));
+        } else {
+            dto::SKVRecord skv_record(record.collectionName, record.schema);
+            record.__writeFields(skv_record);
+            return _writeAndCommit(_makeWriteRequest(skv_record, erase, precondition));
+        }
+    }
+
     // use to obtain the MTR(which acts as a unique transaction identifier) for this transaction
     const dto::K23SI_MTR& mtr() const;
 
@@ -444,6 +542,8 @@ private:
     // the trh key and home collection for this transaction
     std::optional<dto::Key> _trh_key;
     String _trh_collection;
+    // the streams opened by this transaction. They are closed when the transaction ends
+    std::vector<seastar::lw_shared_ptr<QueryStream>> _query_streams;
     // calculate Total txn duration
     k2::TimePoint _startTime;
 };
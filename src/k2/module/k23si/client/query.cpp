@@ -27,6 +27,37 @@ Copyright(c) 2020 Futurewei Cloud
 
 namespace k2 {
 
+QueryStream::QueryStream() : _timer([this] {
+    if (_waiter) {
+        _waiter->set_value(dto::K23SIQueryStreamChunk{.streamId = id, .status = Statuses::S503_Service_Unavailable("timed out waiting for query stream chunk")});
+        _waiter.reset();
+    }
+}) {}
+
+void QueryStream::push(dto::K23SIQueryStreamChunk&& chunk) {
+    if (_waiter) {
+        _timer.cancel();
+        _waiter->set_value(std::move(chunk));
+        _waiter.reset();
+        return;
+    }
+    _chunks.push_back(std::move(chunk));
+}
+
+seastar::future<dto::K23SIQueryStreamChunk> QueryStream::next(Duration timeout) {
+    if (!_chunks.empty()) {
+        auto chunk = std::move(_chunks.front());
+        _chunks.pop_front();
+        return seastar::make_ready_future<dto::K23SIQueryStreamChunk>(std::move(chunk));
+    }
+    if (_waiter) {
+        return seastar::make_exception_future<dto::K23SIQueryStreamChunk>(std::runtime_error("concurrent reads from a query stream"));
+    }
+    _waiter.emplace();
+    _timer.arm(timeout);
+    return _waiter->get_future();
+}
+
 void Query::setFilterExpression(dto::expression::Expression&& root) {
     request.filterExpression = std::move(root);
 }
@@ -43,6 +74,10 @@ void Query::setLimit(int32_t limit) {
     request.recordLimit = limit;
 }
 
+void Query::setStreaming(bool streaming) {
+    this->streaming = streaming;
+}
+
 void Query::addProjection(const String& fieldName) {
     request.projection.push_back(fieldName);
     checkKeysProjected();
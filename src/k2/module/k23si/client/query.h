@@ -23,15 +23,45 @@ Copyright(c) 2020 Futurewei Cloud
 
 #pragma once
 
+#include <deque>
+#include <optional>
 #include <vector>
 
 #include <seastar/core/future.hh>
 #include <seastar/core/future-util.hh>
+#include <seastar/core/shared_ptr.hh>
+#include <seastar/core/timer.hh>
 
 #include <k2/dto/K23SI.h>
+#include <k2/transport/TXEndpoint.h>
 
 namespace k2 {
 
+// The client side of a streaming query on a single partition. The partition pushes chunks of results as long
+// as it has credits, and they are queued here until the application asks for the next set of results
+class QueryStream {
+public:
+    QueryStream();
+
+    // queue a chunk which we received from the partition
+    void push(dto::K23SIQueryStreamChunk&& chunk);
+
+    // returns the next chunk, waiting up to the given timeout for one to arrive. If none arrives in time,
+    // the returned chunk has a 503 status
+    seastar::future<dto::K23SIQueryStreamChunk> next(Duration timeout);
+
+    uint64_t id{0};
+    // the endpoint of the partition which streams the results
+    std::unique_ptr<TXEndpoint> endpoint;
+    // credits we have granted to the partition for records which the application hasn't consumed yet
+    uint64_t outstandingCredits{0};
+
+private:
+    std::deque<dto::K23SIQueryStreamChunk> _chunks;
+    std::optional<seastar::promise<dto::K23SIQueryStreamChunk>> _waiter;
+    seastar::timer<> _timer;
+};
+
 // Represents a new or in-progress query (aka read scan with predicate and projection)
 class Query {
 public:
@@ -39,6 +69,9 @@ public:
     void setReverseDirection(bool reverseDirection);
     void setIncludeVersionMismatch(bool includeVersionMismatch);
     void setLimit(int32_t limit);
+    // If set, the partitions push the results to the client as they are produced, instead of the client
+    // requesting each page. This saves a round trip per page for large scans
+    void setStreaming(bool streaming);
 
     void addProjection(const String& fieldName);
     void addProjection(const std::vector<String>& fieldNames);
@@ -73,7 +106,10 @@ private:
     bool done = false;
     bool inprogress = false; // Used to prevent user from changing predicates after query has started
     bool keysProjected = true;
+    bool streaming = false;
     dto::K23SIQueryRequest request;
+    // the open stream for the current partition of a streaming query
+    seastar::lw_shared_ptr<QueryStream> stream;
 
     friend class K2TxnHandle;
     friend class K23SIClient;
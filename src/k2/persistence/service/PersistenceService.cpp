@@ -22,6 +22,9 @@ Copyright(c) 2020 Futurewei Cloud
 */
 
 #include "PersistenceService.h"
+
+#include <algorithm>
+
 #include <k2/dto/MessageVerbs.h>
 #include <k2/dto/K23SI.h>
 
@@ -40,18 +43,222 @@ PersistenceService::~PersistenceService() {
 
 seastar::future<> PersistenceService::gracefulStop() {
     K2LOG_I(log::psvc, "stop");
-    return seastar::make_ready_future();
+    return _snapshots.stop()
+        .then([this] {
+            return std::exchange(_trimFut, seastar::make_ready_future());
+        })
+        .then([this] {
+            return _wal.stop();
+        });
 }
 
 seastar::future<> PersistenceService::start() {
-    K2LOG_I(log::psvc, "Registering message handlers");
-    RPC().registerRPCObserver<dto::K23SI_PersistenceRequest<Payload>, dto::K23SI_PersistenceResponse>
-    (dto::Verbs::K23SI_Persist, [this](dto::K23SI_PersistenceRequest<Payload>&& request) {
-        (void) request;
-        return RPCResponse(Statuses::S200_OK("persistence success"), dto::K23SI_PersistenceResponse{});
+    return _wal.start()
+    .then([this] {
+        // snapshots live next to the log so that they share its lifetime
+        return _snapshots.start(_wal.dir());
+    })
+    .then([this] {
+        return _loadIndex();
+    })
+    .then([this] {
+        // the snapshots from before the restart may already cover some segments
+        _trimLog();
+        K2LOG_I(log::psvc, "Registering message handlers");
+        RPC().registerMessageObserver(dto::Verbs::K23SI_Persist, [this](Request&& request) {
+            (void)seastar::do_with(std::move(request), [this](auto& request) {
+                return _handlePersist(request);
+            });
+        });
+
+        RPC().registerRPCObserver<dto::K23SI_PersistenceRecoveryRequest, dto::K23SI_PersistenceRecoveryResponse>
+        (dto::Verbs::K23SI_Persist_Recovery, [this](dto::K23SI_PersistenceRecoveryRequest&& request) {
+            return _handleRecovery(std::move(request));
+        });
+
+        RPC().registerRPCObserver<dto::K23SI_PersistenceSnapshotRequest, dto::K23SI_PersistenceSnapshotResponse>
+        (dto::Verbs::K23SI_Persist_Snapshot, [this](dto::K23SI_PersistenceSnapshotRequest&& request) {
+            return _handleSnapshot(std::move(request));
+        });
+
+        RPC().registerRPCObserver<dto::K23SI_PersistenceSnapshotReadRequest, dto::K23SI_PersistenceSnapshotReadResponse>
+        (dto::Verbs::K23SI_Persist_Snapshot_Read, [this](dto::K23SI_PersistenceSnapshotReadRequest&& request) {
+            return _snapshots.read(std::move(request));
+        });
+    });
+}
+
+seastar::future<> PersistenceService::_handlePersist(Request& request) {
+    // We log the entire request so that the record is self-describing during recovery. The incoming payload is
+    // exactly the serialized request, and it carries the checksum the transport verified on receipt, so we log
+    // it as is instead of serializing the request again. The log then doesn't need another pass over the data
+    // to checksum the record
+    dto::K23SI_PersistenceRequest<Payload> batch;
+    if (!request.payload || !request.payload->read(batch)) {
+        return _sendPersistResponse(request, Statuses::S400_Bad_Request("unable to parse incoming request"));
+    }
+    request.payload->seek(0);
+    return _wal.append(std::move(*request.payload))
+        .then([this, &request, collectionName=std::move(batch.collectionName), partitionId=batch.pvid.id,
+               sequence=batch.sequence](auto&& result) {
+            auto& [status, pos] = result;
+            if (status.is2xxOK()) {
+                _indexBatch(pos, collectionName, partitionId, sequence);
+            }
+            return _sendPersistResponse(request, std::move(status));
+        });
+}
+
+seastar::future<> PersistenceService::_sendPersistResponse(Request& request, Status&& status) {
+    auto reply = request.endpoint.newPayload();
+    reply->write(status);
+    reply->write(dto::K23SI_PersistenceResponse{});
+    return RPC().sendReply(std::move(reply), request);
+}
+
+seastar::future<std::tuple<Status, dto::K23SI_PersistenceRecoveryResponse>>
+PersistenceService::_handleRecovery(dto::K23SI_PersistenceRecoveryRequest&& request) {
+    K2LOG_D(log::psvc, "recovery request: {}", request);
+    WALPosition from{.segmentId=request.continuationSegment, .offset=request.continuationOffset};
+    // the log is shared by all partitions which use this endpoint. Start reading at the next batch of the requester
+    auto next = _nextBatch(request.collectionName, request.pvid.id, from, request.fromSequence);
+    if (!next) {
+        return RPCResponse(Statuses::S200_OK("recovery read success"), dto::K23SI_PersistenceRecoveryResponse{
+            .batches={},
+            .continuationSegment=from.segmentId,
+            .continuationOffset=from.offset,
+            .done=true
+        });
+    }
+    size_t maxBytes = request.maxBytes == 0 ? _recoveryReadSize() : request.maxBytes;
+    return _wal.read(*next, maxBytes)
+        .then([this, request=std::move(request)](WALReadResult&& result) {
+            dto::K23SI_PersistenceRecoveryResponse response{
+                .batches={},
+                .continuationSegment=result.next.segmentId,
+                .continuationOffset=result.next.offset,
+                .done=false
+            };
+            // The page may have batches of other partitions, or of an older assignment of the same partition.
+            // Only return the batches for the requester
+            for (auto& record: result.records) {
+                dto::K23SI_PersistenceRequest<Payload> batch;
+                if (!record.data.read(batch)) {
+                    K2LOG_W(log::psvc, "Unable to parse persisted batch in recovery for {}", request);
+                    continue;
+                }
+                if (batch.pvid == request.pvid && batch.collectionName == request.collectionName &&
+                    batch.sequence >= request.fromSequence) {
+                    response.batches.push_back(std::move(batch));
+                }
+            }
+            // continue with the next batch of the requester, skipping the parts of the log which don't have any
+            auto next = _nextBatch(request.collectionName, request.pvid.id, result.next, request.fromSequence);
+            if (next) {
+                response.continuationSegment = next->segmentId;
+                response.continuationOffset = next->offset;
+            } else {
+                response.done = true;
+            }
+            return RPCResponse(Statuses::S200_OK("recovery read success"), std::move(response));
+        })
+        .handle_exception([](auto exc) {
+            K2LOG_W_EXC(log::psvc, exc, "Unable to read the WAL for recovery");
+            return RPCResponse(Statuses::S500_Internal_Server_Error("unable to read the WAL"), dto::K23SI_PersistenceRecoveryResponse{});
+        });
+}
+
+seastar::future<std::tuple<Status, dto::K23SI_PersistenceSnapshotResponse>>
+PersistenceService::_handleSnapshot(dto::K23SI_PersistenceSnapshotRequest&& request) {
+    bool last = request.last;
+    return _snapshots.write(std::move(request))
+        .then([this, last](Status&& status) {
+            if (last && status.is2xxOK()) {
+                _trimLog();
+            }
+            return RPCResponse(std::move(status), dto::K23SI_PersistenceSnapshotResponse{});
+        });
+}
+
+seastar::future<> PersistenceService::_loadIndex() {
+    return seastar::do_with(WALPosition{}, false, [this](auto& from, auto& done) {
+        return seastar::do_until(
+            [&done] { return done; },
+            [this, &from, &done] {
+                return _wal.read(from, _recoveryReadSize())
+                    .then([this, &from, &done](WALReadResult&& result) {
+                        for (auto& record: result.records) {
+                            dto::K23SI_PersistenceRequest<Payload> batch;
+                            if (!record.data.read(batch)) {
+                                K2LOG_W(log::psvc, "Unable to parse persisted batch at {}", record.pos);
+                                continue;
+                            }
+                            _indexBatch(record.pos, batch.collectionName, batch.pvid.id, batch.sequence);
+                        }
+                        from = result.next;
+                        done = result.done;
+                    });
+            });
+    })
+    .then([this] {
+        K2LOG_I(log::psvc, "Found batches of {} partitions in {} segments of the log", _partitionBatches.size(), _segmentPartitions.size());
+    });
+}
+
+void PersistenceService::_indexBatch(WALPosition pos, const String& collectionName, uint64_t partitionId, uint64_t sequence) {
+    auto partition = std::make_tuple(collectionName, partitionId);
+    auto& maxSequence = _segmentPartitions[pos.segmentId][partition];
+    maxSequence = std::max(maxSequence, sequence);
+    _partitionBatches[partition].push_back(IndexedBatch{.pos=pos, .sequence=sequence});
+}
+
+std::optional<WALPosition>
+PersistenceService::_nextBatch(const String& collectionName, uint64_t partitionId, WALPosition from, uint64_t fromSequence) const {
+    auto it = _partitionBatches.find(std::make_tuple(collectionName, partitionId));
+    if (it == _partitionBatches.end()) {
+        return std::nullopt;
+    }
+    auto& batches = it->second;
+    auto batchIt = std::lower_bound(batches.begin(), batches.end(), from, [](const IndexedBatch& batch, const WALPosition& pos) {
+        return std::tie(batch.pos.segmentId, batch.pos.offset) < std::tie(pos.segmentId, pos.offset);
     });
+    batchIt = std::find_if(batchIt, batches.end(), [fromSequence](const IndexedBatch& batch) {
+        return batch.sequence >= fromSequence;
+    });
+    if (batchIt == batches.end()) {
+        return std::nullopt;
+    }
+    return batchIt->pos;
+}
 
-    return seastar::make_ready_future();
+void PersistenceService::_trimLog() {
+    // only a prefix of the log can be removed. Stop at the first segment which has a batch not covered by a snapshot
+    uint64_t trimTo = _wal.currentSegmentId();
+    for (auto& [segmentId, partitions]: _segmentPartitions) {
+        if (segmentId >= trimTo) {
+            break;
+        }
+        bool covered = std::all_of(partitions.begin(), partitions.end(), [this](auto& entry) {
+            auto& [partition, maxSequence] = entry;
+            auto startSequence = _snapshots.startSequence(std::get<0>(partition), std::get<1>(partition));
+            return startSequence && *startSequence > maxSequence;
+        });
+        if (!covered) {
+            trimTo = segmentId;
+            break;
+        }
+    }
+    _segmentPartitions.erase(_segmentPartitions.begin(), _segmentPartitions.lower_bound(trimTo));
+    for (auto it = _partitionBatches.begin(); it != _partitionBatches.end();) {
+        auto& batches = it->second;
+        while (!batches.empty() && batches.front().pos.segmentId < trimTo) {
+            batches.pop_front();
+        }
+        it = batches.empty() ? _partitionBatches.erase(it) : std::next(it);
+    }
+    _trimFut = _trimFut.then([this, trimTo] {
+        return _wal.trim(trimTo);
+    });
 }
 
 } // namespace k2
@@ -23,10 +23,21 @@ Copyright(c) 2020 Futurewei Cloud
 
 #pragma once
 
+#include <deque>
+#include <map>
+#include <optional>
+#include <tuple>
+
 // third-party
 #include <seastar/core/distributed.hh>  // for distributed<>
 #include <seastar/core/future.hh>       // for future stuff
+#include <k2/dto/K23SI.h>
 #include <k2/logging/Log.h>
+#include <k2/transport/Request.h>
+#include <k2/transport/Status.h>
+
+#include "SnapshotStore.h"
+#include "WriteAheadLog.h"
 
 namespace k2 {
 namespace log {
@@ -41,6 +52,57 @@ public :  // application lifespan
     // required for seastar::distributed interface
     seastar::future<> gracefulStop();
     seastar::future<> start();
+
+private:
+    // the position and sequence of a batch in the log
+    struct IndexedBatch {
+        WALPosition pos;
+        uint64_t sequence{0};
+    };
+
+    // appends the batch in the given K23SI_Persist request to the log and replies once it is durable
+    seastar::future<> _handlePersist(Request& request);
+    seastar::future<> _sendPersistResponse(Request& request, Status&& status);
+
+    // returns a page of the batches persisted by a partition
+    seastar::future<std::tuple<Status, dto::K23SI_PersistenceRecoveryResponse>>
+    _handleRecovery(dto::K23SI_PersistenceRecoveryRequest&& request);
+
+    // writes the given snapshot chunk, and trims the log once a snapshot is complete
+    seastar::future<std::tuple<Status, dto::K23SI_PersistenceSnapshotResponse>>
+    _handleSnapshot(dto::K23SI_PersistenceSnapshotRequest&& request);
+
+    // scan the log once on startup to find the batches of all partitions
+    seastar::future<> _loadIndex();
+
+    // note that the given batch was persisted at the given position
+    void _indexBatch(WALPosition pos, const String& collectionName, uint64_t partitionId, uint64_t sequence);
+
+    // returns the position of the first batch of the given partition at or after the given position, which has at least
+    // the given sequence, if there is one
+    std::optional<WALPosition> _nextBatch(const String& collectionName, uint64_t partitionId, WALPosition from, uint64_t fromSequence) const;
+
+    // remove the oldest segments for as long as all of their batches are covered by snapshots
+    void _trimLog();
+
+    // default number of log bytes we scan for each recovery page
+    ConfigVar<uint64_t> _recoveryReadSize{"persistence_recovery_read_size", 4 * 1024 * 1024};
+
+    // all persistence requests are appended to the log and acknowledged once they are durable
+    WriteAheadLog _wal;
+
+    // the latest snapshots of the partitions which use this endpoint
+    SnapshotStore _snapshots;
+
+    // segment id -> (collection name, partition id) -> the highest sequence of the batches of that partition in the segment
+    std::map<uint64_t, std::map<std::tuple<String, uint64_t>, uint64_t>> _segmentPartitions;
+
+    // (collection name, partition id) -> the batches of the partition in log order. Recovery only reads the parts
+    // of the log which have batches of the recovering partition
+    std::map<std::tuple<String, uint64_t>, std::deque<IndexedBatch>> _partitionBatches;
+
+    // the trims of the log are done one at a time
+    seastar::future<> _trimFut = seastar::make_ready_future();
 };  // class PersistenceService
 
 } // namespace k2
@@ -0,0 +1,346 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#include "SnapshotStore.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+#include <crc32c/crc32c.h>
+#include <seastar/core/seastar.hh>
+
+#include <k2/common/Defer.h>
+#include <k2/transport/RPCDispatcher.h>
+
+#include "WriteAheadLog.h"
+
+namespace k2 {
+
+static size_t _alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static const char* SNAPSHOT_PREFIX = "snapshot_";
+
+seastar::future<> SnapshotStore::start(String dir) {
+    _dir = std::move(dir);
+    _loadSnapshots();
+    K2LOG_I(log::wal, "Started snapshot store in {} with {} snapshots", _dir, _snapshots.size());
+    return seastar::make_ready_future();
+}
+
+seastar::future<> SnapshotStore::stop() {
+    std::vector<String> names;
+    for (auto& [name, _]: _pending) {
+        names.push_back(name);
+    }
+    return seastar::do_with(std::move(names), [this](auto& names) {
+        return seastar::do_for_each(names, [this](const String& name) {
+            return _abandon(name);
+        });
+    });
+}
+
+seastar::future<Status> SnapshotStore::write(dto::K23SI_PersistenceSnapshotRequest&& request) {
+    K2LOG_D(log::wal, "snapshot write: {}", request);
+    auto name = _partitionName(request.collectionName, request.partitionId);
+    auto fut = seastar::make_ready_future();
+    if (request.chunkId == 0) {
+        fut = _begin(name, request.startSequence);
+    }
+    return fut.then([this, name, request=std::move(request)] () mutable {
+            auto it = _pending.find(name);
+            if (it == _pending.end() || it->second.startSequence != request.startSequence ||
+                it->second.nextChunkId != request.chunkId) {
+                K2LOG_W(log::wal, "Out of order snapshot chunk {}", request);
+                return seastar::make_ready_future<Status>(Statuses::S409_Conflict("out of order snapshot chunk"));
+            }
+            return _writeChunk(it->second, request.chunkId, request.data)
+                .then([this, name, last=request.last] {
+                    return last ? _complete(name) : seastar::make_ready_future();
+                })
+                .then([] {
+                    return seastar::make_ready_future<Status>(Statuses::S201_Created("snapshot chunk written"));
+                });
+        })
+        .handle_exception([this, name](auto exc) {
+            K2LOG_W_EXC(log::wal, exc, "Unable to write snapshot for {}", name);
+            return _abandon(name)
+                .then([] {
+                    return seastar::make_ready_future<Status>(Statuses::S500_Internal_Server_Error("unable to write snapshot"));
+                });
+        });
+}
+
+seastar::future<std::tuple<Status, dto::K23SI_PersistenceSnapshotReadResponse>>
+SnapshotStore::read(dto::K23SI_PersistenceSnapshotReadRequest&& request) {
+    K2LOG_D(log::wal, "snapshot read: {}", request);
+    auto it = _snapshots.find(_partitionName(request.collectionName, request.partitionId));
+    if (it == _snapshots.end()) {
+        return RPCResponse(Statuses::S200_OK("no snapshot"), dto::K23SI_PersistenceSnapshotReadResponse{.done=true});
+    }
+    auto& snapshot = it->second;
+    if (request.maxBytes == 0 || request.continuationOffset >= snapshot.size) {
+        return RPCResponse(Statuses::S200_OK("snapshot found"), dto::K23SI_PersistenceSnapshotReadResponse{
+            .found=true,
+            .startSequence=snapshot.startSequence,
+            .chunks={},
+            .continuationOffset=request.continuationOffset,
+            .done=request.continuationOffset >= snapshot.size});
+    }
+    size_t len = std::min<uint64_t>(_alignUp(request.maxBytes, _alignment), snapshot.size - request.continuationOffset);
+    return _readChunks(snapshot, request.continuationOffset, len)
+        .handle_exception([request=std::move(request)](auto exc) {
+            K2LOG_W_EXC(log::wal, exc, "Unable to read snapshot for {}", request);
+            return RPCResponse(Statuses::S500_Internal_Server_Error("unable to read snapshot"), dto::K23SI_PersistenceSnapshotReadResponse{});
+        });
+}
+
+std::optional<uint64_t> SnapshotStore::startSequence(const String& collectionName, uint64_t partitionId) const {
+    auto it = _snapshots.find(_partitionName(collectionName, partitionId));
+    if (it == _snapshots.end()) {
+        return std::nullopt;
+    }
+    return it->second.startSequence;
+}
+
+seastar::future<std::tuple<Status, dto::K23SI_PersistenceSnapshotReadResponse>>
+SnapshotStore::_readChunks(SnapshotFile snapshot, uint64_t offset, size_t len) {
+    auto path = snapshot.path;
+    // the snapshot file may get replaced while we read. We keep reading from the file we opened
+    return seastar::open_file_dma(path, seastar::open_flags::ro)
+        .then([this, snapshot=std::move(snapshot), offset, len](seastar::file file) mutable {
+            return seastar::do_with(std::move(file), [this, snapshot=std::move(snapshot), offset, len](auto& file) mutable {
+                return file.dma_read<char>(offset, len)
+                    .then([this, snapshot=std::move(snapshot), offset](seastar::temporary_buffer<char> buf) mutable {
+                        dto::K23SI_PersistenceSnapshotReadResponse response{.found=true, .startSequence=snapshot.startSequence};
+                        size_t consumed = 0;
+                        size_t needed = 0;
+                        while (consumed + sizeof(WALRecordHeader) <= buf.size()) {
+                            WALRecordHeader header;
+                            std::memcpy(&header, buf.get() + consumed, sizeof(header));
+                            if (header.magic != WALRecordHeader::MAGIC) {
+                                throw std::runtime_error(fmt::format("bad chunk header at {} in {}", offset + consumed, snapshot.path));
+                            }
+                            size_t frameLen = sizeof(WALRecordHeader) + header.size;
+                            if (consumed + frameLen > buf.size()) {
+                                needed = _alignUp(frameLen, _alignment);
+                                break;
+                            }
+                            const char* data = buf.get() + consumed + sizeof(WALRecordHeader);
+                            if (crc32c::Crc32c(data, header.size) != header.crc) {
+                                throw std::runtime_error(fmt::format("bad chunk checksum at {} in {}", offset + consumed, snapshot.path));
+                            }
+                            Payload chunk(Payload::DefaultAllocator(header.size));
+                            chunk.write(data, header.size);
+                            chunk.seek(0);
+                            response.chunks.push_back(std::move(chunk));
+                            // chunks start on aligned offsets
+                            consumed += _alignUp(frameLen, _alignment);
+                        }
+                        if (response.chunks.empty() && needed > 0) {
+                            // the next chunk is bigger than what we read. Read again, with enough room for it
+                            return _readChunks(std::move(snapshot), offset, needed);
+                        }
+                        if (response.chunks.empty()) {
+                            throw std::runtime_error(fmt::format("truncated snapshot {} at {}", snapshot.path, offset));
+                        }
+                        response.continuationOffset = offset + consumed;
+                        response.done = response.continuationOffset >= snapshot.size;
+                        return RPCResponse(Statuses::S200_OK("snapshot read success"), std::move(response));
+                    })
+                    .finally([&file] {
+                        return file.close();
+                    });
+            });
+        });
+}
+
+seastar::future<> SnapshotStore::_begin(const String& name, uint64_t startSequence) {
+    return _abandon(name)
+        .then([this, name, startSequence] {
+            auto path = _path(name, startSequence, "tmp");
+            return seastar::open_file_dma(path, seastar::open_flags::wo | seastar::open_flags::create | seastar::open_flags::truncate)
+                .then([this, name, startSequence, path](seastar::file file) {
+                    _alignment = file.disk_write_dma_alignment();
+                    _pending[name] = PendingSnapshot{
+                        .startSequence=startSequence,
+                        .nextChunkId=0,
+                        .path=path,
+                        .file=std::move(file),
+                        .offset=0
+                    };
+                });
+        });
+}
+
+seastar::future<> SnapshotStore::_abandon(const String& name) {
+    auto it = _pending.find(name);
+    if (it == _pending.end()) {
+        return seastar::make_ready_future();
+    }
+    K2LOG_I(log::wal, "Abandoning snapshot {}", it->second.path);
+    auto pending = std::move(it->second);
+    _pending.erase(it);
+    return seastar::do_with(std::move(pending), [](auto& pending) {
+        return pending.file.close()
+            .then([&pending] {
+                return seastar::remove_file(pending.path);
+            })
+            .handle_exception([&pending](auto exc) {
+                K2LOG_W_EXC(log::wal, exc, "Unable to remove abandoned snapshot {}", pending.path);
+            });
+    });
+}
+
+seastar::future<> SnapshotStore::_writeChunk(PendingSnapshot& pending, uint64_t chunkId, Payload& data) {
+    WALRecordHeader header;
+    header.size = data.getSize();
+    header.seq = chunkId;
+    size_t frameLen = sizeof(WALRecordHeader) + header.size;
+    auto buf = seastar::temporary_buffer<char>::aligned(_alignment, _alignUp(frameLen, _alignment));
+    data.seek(0);
+    data.read(buf.get_write() + sizeof(WALRecordHeader), header.size);
+    std::memset(buf.get_write() + frameLen, 0, buf.size() - frameLen);
+    header.crc = crc32c::Crc32c(buf.get() + sizeof(WALRecordHeader), header.size);
+    std::memcpy(buf.get_write(), &header, sizeof(header));
+
+    auto pos = pending.offset;
+    pending.offset += buf.size();
+    ++pending.nextChunkId;
+    // the file is a shared handle so it stays usable even if the snapshot is abandoned while we write
+    return seastar::do_with(std::move(buf), pending.file, [pos](auto& buf, auto& file) {
+        return file.dma_write(pos, buf.get(), buf.size())
+            .then([&buf](size_t written) {
+                if (written != buf.size()) {
+                    throw std::runtime_error(fmt::format("short snapshot write: {} of {}", written, buf.size()));
+                }
+            });
+    });
+}
+
+seastar::future<> SnapshotStore::_complete(const String& name) {
+    auto it = _pending.find(name);
+    if (it == _pending.end()) {
+        return seastar::make_exception_future(std::runtime_error("snapshot was abandoned"));
+    }
+    auto pending = std::move(it->second);
+    _pending.erase(it);
+    SnapshotFile snapshot{
+        .startSequence=pending.startSequence,
+        .path=_path(name, pending.startSequence, "snap"),
+        .size=pending.offset
+    };
+    return seastar::do_with(std::move(pending), std::move(snapshot), [this, name](auto& pending, auto& snapshot) {
+        return pending.file.flush()
+            .then([&pending] {
+                return pending.file.close();
+            })
+            .then([&pending, &snapshot] {
+                return seastar::rename_file(pending.path, snapshot.path);
+            })
+            .then([this] {
+                return seastar::sync_directory(_dir);
+            })
+            .then([this, name, &snapshot] {
+                K2LOG_I(log::wal, "Completed snapshot {} of {} bytes", snapshot.path, snapshot.size);
+                auto previous = std::exchange(_snapshots[name], snapshot);
+                if (previous.path.empty() || previous.path == snapshot.path) {
+                    return seastar::make_ready_future();
+                }
+                return seastar::remove_file(previous.path)
+                    .handle_exception([path=previous.path](auto exc) {
+                        K2LOG_W_EXC(log::wal, exc, "Unable to remove old snapshot {}", path);
+                    });
+            });
+    });
+}
+
+void SnapshotStore::_loadSnapshots() {
+    // this is only done once on startup so we use the plain blocking API
+    DIR* dir = ::opendir(_dir.c_str());
+    if (dir == nullptr) {
+        K2LOG_W(log::wal, "Unable to list directory {}: {}", _dir, strerror(errno));
+        return;
+    }
+    Defer d([dir] { ::closedir(dir); });
+    std::vector<String> obsolete;
+    while (auto* entry = ::readdir(dir)) {
+        std::string_view fname(entry->d_name);
+        if (fname.substr(0, ::strlen(SNAPSHOT_PREFIX)) != SNAPSHOT_PREFIX) {
+            continue;
+        }
+        auto path = fmt::format("{}/{}", _dir, fname);
+        auto dot = fname.rfind('.');
+        auto sep = fname.rfind('_', dot);
+        if (dot == std::string_view::npos || sep == std::string_view::npos || fname.substr(dot) != ".snap") {
+            // leftover from a snapshot which never completed
+            obsolete.push_back(std::move(path));
+            continue;
+        }
+        String name(fname.substr(::strlen(SNAPSHOT_PREFIX), sep - ::strlen(SNAPSHOT_PREFIX)));
+        uint64_t startSequence = std::strtoull(String(fname.substr(sep + 1, dot - sep - 1)).c_str(), nullptr, 10);
+        struct stat st;
+        if (::stat(path.c_str(), &st) != 0) {
+            K2LOG_W(log::wal, "Unable to stat snapshot {}: {}", path, strerror(errno));
+            continue;
+        }
+        SnapshotFile snapshot{.startSequence=startSequence, .path=path, .size=(uint64_t)st.st_size};
+        auto [it, inserted] = _snapshots.try_emplace(name, snapshot);
+        if (!inserted) {
+            // we crashed before we removed the previous snapshot
+            if (it->second.startSequence < startSequence) {
+                std::swap(it->second, snapshot);
+            }
+            obsolete.push_back(snapshot.path);
+        }
+    }
+    for (auto& path: obsolete) {
+        K2LOG_I(log::wal, "Removing obsolete snapshot file {}", path);
+        ::unlink(path.c_str());
+    }
+}
+
+String SnapshotStore::_partitionName(const String& collectionName, uint64_t partitionId) const {
+    // escape anything in the collection name which may not be safe in a file name
+    String name;
+    for (char c: collectionName) {
+        if (std::isalnum(static_cast<unsigned char>(c)) || c == '-') {
+            name.push_back(c);
+        } else {
+            name += fmt::format("%{:02x}", static_cast<unsigned char>(c));
+        }
+    }
+    return fmt::format("{}_{}", name, partitionId);
+}
+
+String SnapshotStore::_path(const String& name, uint64_t startSequence, const char* suffix) const {
+    return fmt::format("{}/{}{}_{:020}.{}", _dir, SNAPSHOT_PREFIX, name, startSequence, suffix);
+}
+
+} // namespace k2
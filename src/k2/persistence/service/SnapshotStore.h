@@ -0,0 +1,122 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <optional>
+#include <tuple>
+#include <unordered_map>
+
+// third-party
+#include <seastar/core/file.hh>
+#include <seastar/core/future.hh>
+#include <seastar/core/temporary_buffer.hh>
+
+#include <k2/common/Common.h>
+#include <k2/dto/K23SI.h>
+#include <k2/logging/Log.h>
+#include <k2/transport/Payload.h>
+#include <k2/transport/Status.h>
+
+namespace k2 {
+
+// Stores the latest snapshot for each partition which sends its snapshots to this shard.
+// A snapshot is written as a sequence of chunks into a temporary file, using the same record framing as the WAL, with
+// each chunk starting on an aligned offset. Once the last chunk is durable, the file is renamed into place and the
+// previous snapshot of the partition is deleted.
+class SnapshotStore {
+public:  // lifecycle
+    // start the store, keeping the snapshots in the given directory
+    seastar::future<> start(String dir);
+
+    // abandon any snapshots which are still being written
+    seastar::future<> stop();
+
+public:  // API
+    // Write the given chunk of a snapshot. A chunk with id 0 starts a new snapshot for the partition, abandoning
+    // any snapshot of the partition which is still being written
+    seastar::future<Status> write(dto::K23SI_PersistenceSnapshotRequest&& request);
+
+    // Read a page of chunks from the latest snapshot of a partition
+    seastar::future<std::tuple<Status, dto::K23SI_PersistenceSnapshotReadResponse>>
+    read(dto::K23SI_PersistenceSnapshotReadRequest&& request);
+
+    // The start sequence of the latest complete snapshot of the given partition, if there is one. All batches of the
+    // partition before this sequence are reflected in the snapshot
+    std::optional<uint64_t> startSequence(const String& collectionName, uint64_t partitionId) const;
+
+private:  // types
+    // a complete snapshot
+    struct SnapshotFile {
+        uint64_t startSequence{0};
+        String path;
+        // the size of the file, including the padding after the last chunk
+        uint64_t size{0};
+    };
+
+    // a snapshot which is being written
+    struct PendingSnapshot {
+        uint64_t startSequence{0};
+        uint64_t nextChunkId{0};
+        String path;
+        seastar::file file;
+        uint64_t offset{0};
+    };
+
+private:  // methods
+    // find the snapshots left from a previous run, and remove the incomplete ones
+    void _loadSnapshots();
+
+    // start a new snapshot for the given partition
+    seastar::future<> _begin(const String& name, uint64_t startSequence);
+
+    // abandon the snapshot which is being written for the given partition, if any
+    seastar::future<> _abandon(const String& name);
+
+    // append the given chunk to the given snapshot
+    seastar::future<> _writeChunk(PendingSnapshot& pending, uint64_t chunkId, Payload& data);
+
+    // make the pending snapshot of the given partition durable, and replace the previous snapshot with it
+    seastar::future<> _complete(const String& name);
+
+    // read the chunks of the given snapshot, which start at the given offset within the given number of bytes
+    seastar::future<std::tuple<Status, dto::K23SI_PersistenceSnapshotReadResponse>>
+    _readChunks(SnapshotFile snapshot, uint64_t offset, size_t len);
+
+    // the name we use for the snapshots of a partition. It is safe to use in file names
+    String _partitionName(const String& collectionName, uint64_t partitionId) const;
+
+    String _path(const String& name, uint64_t startSequence, const char* suffix) const;
+
+private:  // fields
+    String _dir;
+    // the DMA alignment for the snapshot files
+    size_t _alignment{4096};
+    // partition name -> latest complete snapshot
+    std::unordered_map<String, SnapshotFile> _snapshots;
+    // partition name -> snapshot being written
+    std::unordered_map<String, PendingSnapshot> _pending;
+};
+
+} // namespace k2
@@ -0,0 +1,500 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "WriteAheadLog.h"
+
+#include <dirent.h>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include <crc32c/crc32c.h>
+#include <seastar/core/seastar.hh>
+
+#include <k2/common/Defer.h>
+
+namespace k2 {
+
+static size_t _alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+seastar::future<> WriteAheadLog::start() {
+    _dir = fmt::format("{}/shard_{}", _walDir(), seastar::this_shard_id());
+    if (_syncPolicy() == "fdatasync") {
+        _syncEachGroup = true;
+    } else if (_syncPolicy() == "none") {
+        _syncEachGroup = false;
+    } else {
+        K2LOG_W(log::wal, "Unknown sync policy {}. Using fdatasync", _syncPolicy());
+        _syncEachGroup = true;
+    }
+    _registerMetrics();
+
+    return seastar::recursive_touch_directory(_dir)
+        .then([this] {
+            // we never append to segments from a previous run. Start after the last one we have
+            auto [first, last] = _findSegmentIds();
+            _nextSegmentId = last + 1;
+            _firstSegmentId = first == 0 ? _nextSegmentId : first;
+            return _recoverNextSeq(first, last);
+        })
+        .then([this] {
+            _currentSegmentId = _nextSegmentId++;
+            return _openSegment(_currentSegmentId);
+        })
+        .then([this](seastar::file file) {
+            _file = std::move(file);
+            _alignment = _file.disk_write_dma_alignment();
+            _tail = seastar::temporary_buffer<char>::aligned(_alignment, _alignment);
+            _segmentOffset = 0;
+            _tailLen = 0;
+            _stopped = false;
+            _prepareNextSegment();
+            K2LOG_I(log::wal, "Started WAL in {} with segmentSize={}, syncPolicy={}, alignment={}, nextSeq={}",
+                    _dir, _segmentSize(), _syncPolicy(), _alignment, _nextSeq);
+        });
+}
+
+seastar::future<> WriteAheadLog::stop() {
+    K2LOG_I(log::wal, "Stopping WAL in {}", _dir);
+    _stopped = true;
+    // the flush loop drains all records which were accepted before we stopped
+    return seastar::do_until(
+        [this] { return !_flushing; },
+        [this] { return std::exchange(_flushFut, seastar::make_ready_future()); })
+        .then([this] {
+            if (!_file) {
+                return seastar::make_ready_future();
+            }
+            return _file.flush().then([this] { return _file.close(); });
+        })
+        .then([this] {
+            return std::exchange(_nextFile, seastar::make_ready_future<seastar::file>());
+        })
+        .then([](seastar::file next) {
+            return next ? next.close() : seastar::make_ready_future();
+        })
+        .handle_exception([this](auto exc) {
+            K2LOG_W_EXC(log::wal, exc, "Error while closing WAL in {}", _dir);
+        });
+}
+
+void WriteAheadLog::_registerMetrics() {
+    _metricGroups.clear();
+    std::vector<sm::label_instance> labels;
+    labels.push_back(sm::label_instance("total_cores", seastar::smp::count));
+
+    _metricGroups.add_group("persistence", {
+        sm::make_counter("appended_records", _appendedRecords, sm::description("Number of records appended to the WAL"), labels),
+        sm::make_counter("appended_bytes", _appendedBytes, sm::description("Number of bytes appended to the WAL"), labels),
+        sm::make_counter("segments_created", _segmentsCreated, sm::description("Number of WAL segments created"), labels),
+        sm::make_counter("segments_removed", _segmentsRemoved, sm::description("Number of WAL segments removed by trimming"), labels),
+        sm::make_counter("group_commits", _groupCommits, sm::description("Number of group commits written to the WAL"), labels),
+        sm::make_histogram("ack_latency", [this]{ return _ackLatency.getHistogram();},
+                sm::description("Latency from receiving a record until it is durable and acknowledged"), labels),
+        sm::make_histogram("sync_latency", [this]{ return _syncLatency.getHistogram();},
+                sm::description("Latency of fdatasync calls on the WAL"), labels),
+        sm::make_histogram("group_records", [this]{ return _groupRecords.getHistogram();},
+                sm::description("Number of records written in each group commit"), labels)
+    });
+}
+
+seastar::future<std::tuple<Status, WALPosition>> WriteAheadLog::append(Payload&& record) {
+    if (_stopped) {
+        return seastar::make_ready_future<std::tuple<Status, WALPosition>>(Statuses::S503_Service_Unavailable("WAL is stopped"), WALPosition{});
+    }
+    if (!_failure.is2xxOK()) {
+        return seastar::make_ready_future<std::tuple<Status, WALPosition>>(_failure, WALPosition{});
+    }
+    _pending.push_back(PendingRecord{.data=std::move(record), .prom={}, .arrival=Clock::now(), .pos={}});
+    auto fut = _pending.back().prom.get_future();
+    _kickFlush();
+    return fut;
+}
+
+void WriteAheadLog::_kickFlush() {
+    if (_flushing) {
+        return;
+    }
+    _flushing = true;
+    _flushFut = _flushFut
+        .then([this] {
+            return seastar::do_until([this] { return _pending.empty(); }, [this] { return _writeGroup(); });
+        })
+        .then([this] {
+            _flushing = false;
+            // records may have arrived after we decided we're done
+            if (!_pending.empty()) {
+                _kickFlush();
+            }
+        });
+}
+
+seastar::future<> WriteAheadLog::_writeGroup() {
+    // Take all pending records which fit into one group. All of them become durable with a single write
+    std::vector<PendingRecord> group;
+    size_t groupBytes = 0;
+    while (!_pending.empty()) {
+        size_t recordBytes = sizeof(WALRecordHeader) + _pending.front().data.getSize();
+        if (!group.empty() && groupBytes + recordBytes > _maxGroupBytes()) {
+            break;
+        }
+        groupBytes += recordBytes;
+        group.push_back(std::move(_pending.front()));
+        _pending.pop_front();
+    }
+
+    return seastar::do_with(std::move(group), [this, groupBytes](auto& group) {
+        return _maybeRotate(groupBytes)
+            .then([this, &group, groupBytes] {
+                return _writeRecords(group, groupBytes);
+            })
+            .then_wrapped([this, &group, groupBytes](auto&& fut) {
+                if (fut.failed()) {
+                    auto exc = fut.get_exception();
+                    K2LOG_W_EXC(log::wal, exc, "Unable to write to the WAL in {}", _dir);
+                    _failure = Statuses::S500_Internal_Server_Error("unable to write to the WAL");
+                    for (auto& rec : group) {
+                        rec.prom.set_value(_failure, WALPosition{});
+                    }
+                    _failPending(_failure);
+                    return;
+                }
+                auto now = Clock::now();
+                _groupRecords.add(double(group.size()));
+                ++_groupCommits;
+                _appendedRecords += group.size();
+                _appendedBytes += groupBytes;
+                for (auto& rec : group) {
+                    _ackLatency.add(now - rec.arrival);
+                    rec.prom.set_value(Statuses::S200_OK("persisted"), rec.pos);
+                }
+            });
+    });
+}
+
+seastar::future<> WriteAheadLog::_writeRecords(std::vector<PendingRecord>& group, size_t groupBytes) {
+    // We always write whole aligned blocks, starting with the block which holds the end of the previous group
+    uint64_t writePos = _segmentOffset - _tailLen;
+    size_t dataLen = _tailLen + groupBytes;
+    size_t writeLen = _alignUp(dataLen, _alignment);
+    auto buf = seastar::temporary_buffer<char>::aligned(_alignment, writeLen);
+    char* out = buf.get_write();
+    std::memcpy(out, _tail.get(), _tailLen);
+
+    size_t offset = _tailLen;
+    for (auto& rec : group) {
+        WALRecordHeader header{};
+        header.size = rec.data.getSize();
+        header.seq = _nextSeq++;
+        rec.pos = WALPosition{.segmentId=_currentSegmentId, .offset=writePos + offset};
+        char* data = out + offset + sizeof(WALRecordHeader);
+        rec.data.seek(0);
+        // records usually come with a known checksum (e.g. verified by the transport), so this is not another pass
+        header.crc = rec.data.computeCrc32c();
+        rec.data.read(data, header.size);
+        std::memcpy(out + offset, &header, sizeof(header));
+        offset += sizeof(WALRecordHeader) + header.size;
+    }
+    // zero-fill past the end of the data so that readers know where the records stop
+    std::memset(out + dataLen, 0, writeLen - dataLen);
+
+    K2LOG_D(log::wal, "writing {} records with {} bytes at pos={}, len={}", group.size(), groupBytes, writePos, writeLen);
+    auto fut = _file.dma_write(writePos, buf.get(), writeLen)
+        .then([writeLen](size_t written) {
+            if (written != writeLen) {
+                return seastar::make_exception_future<>(std::runtime_error(fmt::format("short write of {} out of {} bytes", written, writeLen)));
+            }
+            return seastar::make_ready_future();
+        });
+    if (_syncEachGroup) {
+        fut = fut.then([this] {
+            return seastar::do_with(k2::OperationLatencyReporter(_syncLatency), [this](auto& reporter) {
+                return _file.flush().then([&reporter] { reporter.report(); });
+            });
+        });
+    }
+
+    return fut.then([this, buf=std::move(buf), writePos, dataLen] {
+        // keep the data in the last partial block around for the next write
+        uint64_t endOffset = writePos + dataLen;
+        _tailLen = endOffset % _alignment;
+        std::memcpy(_tail.get_write(), buf.get() + dataLen - _tailLen, _tailLen);
+        _segmentOffset = endOffset;
+        _lastRecordSegmentId = _currentSegmentId;
+    });
+}
+
+seastar::future<> WriteAheadLog::_maybeRotate(size_t groupBytes) {
+    if (_segmentOffset == 0 || _segmentOffset + groupBytes <= _segmentSize()) {
+        // Note that a group bigger than the segment size goes in a fresh segment by itself
+        return seastar::make_ready_future();
+    }
+    K2LOG_D(log::wal, "rotating segment in {} at offset {}", _dir, _segmentOffset);
+    auto old = std::move(_file);
+    return old.flush()
+        .then([old]() mutable {
+            return old.close();
+        })
+        .then([this] {
+            return std::exchange(_nextFile, seastar::make_ready_future<seastar::file>());
+        })
+        .then([this](seastar::file file) {
+            _file = std::move(file);
+            ++_currentSegmentId;
+            _segmentOffset = 0;
+            _tailLen = 0;
+            _prepareNextSegment();
+        });
+}
+
+seastar::future<WALReadResult> WriteAheadLog::read(WALPosition from, size_t maxBytes) {
+    if (from.segmentId < _firstSegmentId) {
+        // either a read from the start, or the segment was trimmed since
+        from = WALPosition{.segmentId=_firstSegmentId, .offset=0};
+    }
+    if (_stopped || _atEnd(from)) {
+        return seastar::make_ready_future<WALReadResult>(WALReadResult{.records={}, .next=from, .done=true});
+    }
+    // we only return acknowledged records so we never read past the data end of the current segment
+    uint64_t endOffset = from.segmentId == _currentSegmentId ? _segmentOffset : std::numeric_limits<uint64_t>::max();
+    size_t readLen = std::min<uint64_t>(std::max(maxBytes, sizeof(WALRecordHeader)), endOffset - from.offset);
+
+    return seastar::open_file_dma(_segmentPath(from.segmentId), seastar::open_flags::ro)
+        .then([this, from, readLen, endOffset](seastar::file file) {
+            return seastar::do_with(std::move(file), [this, from, readLen, endOffset](auto& file) {
+                return file.dma_read<char>(from.offset, readLen)
+                    .then([this, from, readLen, endOffset](seastar::temporary_buffer<char> buf) {
+                        WALReadResult result;
+                        auto needed = _parseRecords(buf, from, readLen, endOffset, result);
+                        if (result.records.empty() && needed > 0) {
+                            // the next record is bigger than what we read. Read again, with enough room for it
+                            return read(from, needed);
+                        }
+                        result.done = _atEnd(result.next);
+                        return seastar::make_ready_future<WALReadResult>(std::move(result));
+                    })
+                    .finally([&file] {
+                        return file.close();
+                    });
+            });
+        });
+}
+
+size_t WriteAheadLog::_parseRecords(const seastar::temporary_buffer<char>& buf, WALPosition pos, size_t requestedLen, uint64_t endOffset, WALReadResult& result) {
+    // a short read means we reached the end of the segment file
+    bool eof = buf.size() < requestedLen && pos.offset + buf.size() < endOffset;
+    WALPosition nextSegment{.segmentId=pos.segmentId + 1, .offset=0};
+    size_t consumed = 0;
+    while (true) {
+        result.next = WALPosition{.segmentId=pos.segmentId, .offset=pos.offset + consumed};
+        size_t remaining = buf.size() - consumed;
+        if (remaining < sizeof(WALRecordHeader)) {
+            if (eof) {
+                result.next = nextSegment;
+                return 0;
+            }
+            return remaining == 0 ? 0 : sizeof(WALRecordHeader);
+        }
+        WALRecordHeader header;
+        std::memcpy(&header, buf.get() + consumed, sizeof(header));
+        if (header.magic != WALRecordHeader::MAGIC) {
+            // the rest of the segment is zero-filled
+            result.next = nextSegment;
+            return 0;
+        }
+        size_t recordBytes = sizeof(WALRecordHeader) + header.size;
+        if (remaining < recordBytes) {
+            if (eof) {
+                K2LOG_W(log::wal, "Found truncated record at {} in {}", result.next, _dir);
+                result.next = nextSegment;
+                return 0;
+            }
+            return recordBytes;
+        }
+        const char* data = buf.get() + consumed + sizeof(WALRecordHeader);
+        if (crc32c::Crc32c(data, header.size) != header.crc) {
+            // this can happen if we crashed in the middle of a write. Nothing after this point was acknowledged
+            K2LOG_W(log::wal, "Found record with bad checksum at {} in {}", result.next, _dir);
+            result.next = nextSegment;
+            return 0;
+        }
+        Payload record(Payload::DefaultAllocator(header.size));
+        record.write(data, header.size);
+        record.seek(0);
+        result.records.push_back(WALRecord{.data=std::move(record), .pos=result.next, .seq=header.seq});
+        consumed += recordBytes;
+    }
+}
+
+seastar::future<> WriteAheadLog::trim(uint64_t segmentId) {
+    // we keep the newest segment with a record so that the record sequence continues after a restart
+    uint64_t trimTo = std::min({segmentId, _currentSegmentId, _lastRecordSegmentId});
+    if (trimTo <= _firstSegmentId) {
+        return seastar::make_ready_future();
+    }
+    K2LOG_I(log::wal, "Trimming segments [{}, {}) in {}", _firstSegmentId, trimTo, _dir);
+    // new reads skip the removed segments right away. Reads which already opened a segment keep their file
+    std::vector<uint64_t> ids;
+    for (uint64_t id = _firstSegmentId; id < trimTo; ++id) {
+        ids.push_back(id);
+    }
+    _firstSegmentId = trimTo;
+    return seastar::do_with(std::move(ids), [this](auto& ids) {
+        return seastar::do_for_each(ids, [this](uint64_t id) {
+                auto path = _segmentPath(id);
+                return seastar::remove_file(path)
+                    .then([this] {
+                        ++_segmentsRemoved;
+                    })
+                    .handle_exception([path](auto exc) {
+                        K2LOG_W_EXC(log::wal, exc, "Unable to remove segment {}", path);
+                    });
+            })
+            .then([this] {
+                return seastar::sync_directory(_dir);
+            });
+    });
+}
+
+seastar::future<> WriteAheadLog::_recoverNextSeq(uint64_t firstSegmentId, uint64_t lastSegmentId) {
+    if (lastSegmentId == 0) {
+        return seastar::make_ready_future();
+    }
+    // the newest segments may be empty, e.g. if we restarted without appending. Look back until we find a record
+    return seastar::do_with(lastSegmentId, false, [this, firstSegmentId](uint64_t& segmentId, bool& found) {
+        return seastar::do_until(
+            [&segmentId, &found, firstSegmentId] { return found || segmentId < firstSegmentId; },
+            [this, &segmentId, &found] {
+                return _findLastSeq(segmentId)
+                    .then([this, &segmentId, &found](std::optional<uint64_t> lastSeq) {
+                        if (lastSeq) {
+                            found = true;
+                            _nextSeq = *lastSeq + 1;
+                            _lastRecordSegmentId = segmentId;
+                        }
+                        --segmentId;
+                    });
+            });
+    });
+}
+
+seastar::future<std::optional<uint64_t>> WriteAheadLog::_findLastSeq(uint64_t segmentId) {
+    auto path = _segmentPath(segmentId);
+    return seastar::open_file_dma(path, seastar::open_flags::ro)
+        .then([this, segmentId](seastar::file file) {
+            return seastar::do_with(std::move(file), WALPosition{.segmentId=segmentId, .offset=0}, std::optional<uint64_t>(), size_t(_maxGroupBytes()),
+                [this, segmentId](auto& file, auto& pos, auto& lastSeq, auto& readLen) {
+                // parsing moves the position to the next segment once it reaches the end of the valid records
+                return seastar::do_until(
+                    [&pos, segmentId] { return pos.segmentId != segmentId; },
+                    [this, &file, &pos, &lastSeq, &readLen] {
+                        return file.dma_read<char>(pos.offset, readLen)
+                            .then([this, &pos, &lastSeq, &readLen](seastar::temporary_buffer<char> buf) {
+                                WALReadResult result;
+                                auto needed = _parseRecords(buf, pos, readLen, std::numeric_limits<uint64_t>::max(), result);
+                                if (!result.records.empty()) {
+                                    lastSeq = result.records.back().seq;
+                                }
+                                // make sure we can fit the next record if it is bigger than what we read
+                                readLen = std::max<size_t>(needed, _maxGroupBytes());
+                                pos = result.next;
+                            });
+                    })
+                    .finally([&file] {
+                        return file.close();
+                    })
+                    .then([&lastSeq] {
+                        return lastSeq;
+                    });
+            });
+        })
+        .handle_exception([path](auto exc) {
+            K2LOG_W_EXC(log::wal, exc, "Unable to scan segment {}", path);
+            return std::optional<uint64_t>();
+        });
+}
+
+bool WriteAheadLog::_atEnd(WALPosition pos) const {
+    return pos.segmentId > _currentSegmentId || (pos.segmentId == _currentSegmentId && pos.offset >= _segmentOffset);
+}
+
+seastar::future<seastar::file> WriteAheadLog::_openSegment(uint64_t segmentId) {
+    auto path = _segmentPath(segmentId);
+    K2LOG_D(log::wal, "creating segment {}", path);
+    return seastar::open_file_dma(path, seastar::open_flags::wo | seastar::open_flags::create | seastar::open_flags::exclusive)
+        .then([this, path](seastar::file file) {
+            // preallocate so that our writes don't have to allocate blocks or update the file size as we go
+            return file.allocate(0, _segmentSize())
+                .handle_exception([path](auto exc) {
+                    K2LOG_W_EXC(log::wal, exc, "Unable to preallocate segment {}", path);
+                })
+                .then([this] {
+                    // make sure the new file entry is durable
+                    return seastar::sync_directory(_dir);
+                })
+                .then([this, file]() mutable {
+                    ++_segmentsCreated;
+                    return std::move(file);
+                });
+        });
+}
+
+void WriteAheadLog::_prepareNextSegment() {
+    _nextFile = _openSegment(_nextSegmentId++);
+}
+
+std::pair<uint64_t, uint64_t> WriteAheadLog::_findSegmentIds() const {
+    // this is only done once on startup so we use the plain blocking API
+    uint64_t firstId = 0;
+    uint64_t lastId = 0;
+    DIR* dir = ::opendir(_dir.c_str());
+    if (dir == nullptr) {
+        K2LOG_W(log::wal, "Unable to list directory {}: {}", _dir, strerror(errno));
+        return {firstId, lastId};
+    }
+    Defer d([dir] { ::closedir(dir); });
+    while (auto* entry = ::readdir(dir)) {
+        uint64_t id = 0;
+        char suffix[8] = {0};
+        if (::sscanf(entry->d_name, "segment_%lu.%7s", &id, suffix) == 2 && ::strcmp(suffix, "wal") == 0) {
+            firstId = firstId == 0 ? id : std::min(firstId, id);
+            lastId = std::max(lastId, id);
+        }
+    }
+    return {firstId, lastId};
+}
+
+String WriteAheadLog::_segmentPath(uint64_t segmentId) const {
+    return fmt::format("{}/segment_{:020}.wal", _dir, segmentId);
+}
+
+void WriteAheadLog::_failPending(const Status& status) {
+    while (!_pending.empty()) {
+        _pending.front().prom.set_value(status, WALPosition{});
+        _pending.pop_front();
+    }
+}
+
+} // namespace k2
@@ -0,0 +1,232 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <deque>
+#include <optional>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// third-party
+#include <seastar/core/file.hh>
+#include <seastar/core/future.hh>
+#include <seastar/core/temporary_buffer.hh>
+
+#include <k2/appbase/AppEssentials.h>
+#include <k2/common/Common.h>
+#include <k2/config/Config.h>
+#include <k2/logging/Log.h>
+#include <k2/transport/Payload.h>
+#include <k2/transport/Prometheus.h>
+#include <k2/transport/Status.h>
+
+namespace k2 {
+namespace log {
+inline thread_local k2::logging::Logger wal("k2::persistence_wal");
+}
+
+// The header which precedes each record in a WAL segment file
+struct __attribute__((packed)) WALRecordHeader {
+    // marks the start of a valid record. Space past the last record in a segment is zero-filled
+    static constexpr uint32_t MAGIC = 0x574C324B; // "K2LW"
+    uint32_t magic{MAGIC};
+    // crc32c of the record data
+    uint32_t crc{0};
+    // the size of the record data which follows the header
+    uint32_t size{0};
+    uint32_t reserved{0};
+    // the sequence number of the record in the log of this shard
+    uint64_t seq{0};
+};
+
+// A position in the WAL of a shard
+struct WALPosition {
+    uint64_t segmentId{0};
+    uint64_t offset{0};
+    K2_DEF_FMT(WALPosition, segmentId, offset);
+};
+
+// A record read back from the WAL
+struct WALRecord {
+    Payload data;
+    // where the record starts in the log
+    WALPosition pos;
+    // the sequence number of the record
+    uint64_t seq{0};
+};
+
+// The result of reading a chunk of the WAL
+struct WALReadResult {
+    std::vector<WALRecord> records;
+    // where to continue reading from
+    WALPosition next;
+    // set when there is nothing more to read
+    bool done{false};
+};
+
+// A write-ahead log of opaque records, backed by segment files in a local directory.
+// Each shard owns a separate log in <persistence_wal_dir>/shard_<id>. Every (re)start begins a new segment, and
+// the record sequence numbers continue from the last record found in the existing segments.
+// Records are written with DMA I/O and are acknowledged only after they are durable, according to the sync policy.
+// Records which arrive while a write is in progress are grouped and made durable together with a single
+// write and fdatasync (group commit).
+// Segments are rotated once they reach the configured size. The next segment is created and preallocated
+// in the background so that rotation doesn't stall appends. Segments which are no longer needed for recovery
+// are removed with trim().
+class WriteAheadLog {
+public:  // lifecycle
+    seastar::future<> start();
+
+    // Stops accepting new records and waits for the records which were already accepted to be written out
+    seastar::future<> stop();
+
+public:  // API
+    // Appends the given record to the log. The returned future completes with the status of the append
+    // once the record is durable
+    seastar::future<Status> append(Payload&& record);
+
+    // Reads the records starting at the given position, scanning up to about maxBytes of the log.
+    // A default position means start from the beginning of the log. Only acknowledged records are returned
+    seastar::future<WALReadResult> read(WALPosition from, size_t maxBytes);
+
+    // Removes all segments before the given one. The current segment and the newest segment with a record are never removed.
+    // Reads from a removed segment continue with the first segment which remains
+    seastar::future<> trim(uint64_t segmentId);
+
+    // the segment which we currently append to
+    uint64_t currentSegmentId() const { return _currentSegmentId; }
+
+    // the sequence number which the next appended record will get
+    uint64_t nextSeq() const { return _nextSeq; }
+
+    // the number of group commits we have written
+    uint64_t groupCommits() const { return _groupCommits; }
+
+    // the directory which holds the segments for this shard
+    const String& dir() const { return _dir; }
+
+private:  // types
+    struct PendingRecord {
+        Payload data;
+        seastar::promise<std::tuple<Status, WALPosition>> prom;
+        TimePoint arrival;
+        WALPosition pos;
+    };
+
+private:  // methods
+    void _registerMetrics();
+
+    // start the flush loop if it isn't running already
+    void _kickFlush();
+
+    // write out the next group of pending records
+    seastar::future<> _writeGroup();
+
+    // write the given group of records, which add up to groupBytes in the log
+    seastar::future<> _writeRecords(std::vector<PendingRecord>& group, size_t groupBytes);
+
+    // switch to the next segment if the given number of bytes would not fit in the current one
+    seastar::future<> _maybeRotate(size_t groupBytes);
+
+    // create and preallocate a new segment
+    seastar::future<seastar::file> _openSegment(uint64_t segmentId);
+
+    // start creating the next segment in the background
+    void _prepareNextSegment();
+
+    // returns the lowest and highest segment ids present in our directory, or (0, 0) if there are no segments
+    std::pair<uint64_t, uint64_t> _findSegmentIds() const;
+
+    // set the next record sequence to follow the last valid record in the segments in the given range
+    seastar::future<> _recoverNextSeq(uint64_t firstSegmentId, uint64_t lastSegmentId);
+
+    // returns the sequence number of the last valid record in the given segment, if there is any
+    seastar::future<std::optional<uint64_t>> _findLastSeq(uint64_t segmentId);
+
+    // Parse the records in the given buffer, which was read from the given position. Sets the position
+    // to continue from in the result. If the buffer ends with an incomplete record, returns the number
+    // of bytes we have to read in order to parse that record.
+    size_t _parseRecords(const seastar::temporary_buffer<char>& buf, WALPosition pos, size_t requestedLen, uint64_t endOffset, WALReadResult& result);
+
+    // returns true if the given position is at the end of the acknowledged data in the log
+    bool _atEnd(WALPosition pos) const;
+
+    String _segmentPath(uint64_t segmentId) const;
+
+    // fail all records which are waiting to be written
+    void _failPending(const Status& status);
+
+private:  // config
+    ConfigVar<String> _walDir{"persistence_wal_dir", "/tmp/k2_persistence_wal"};
+    // the size at which we rotate segments. Segments are preallocated to this size
+    ConfigVar<uint64_t> _segmentSize{"persistence_segment_size", 64 * 1024 * 1024};
+    // "fdatasync" to acknowledge records after they are synced to the device, or "none" to acknowledge them as soon
+    // as the write completes. The latter is not safe against power loss
+    ConfigVar<String> _syncPolicy{"persistence_sync_policy", "fdatasync"};
+    // the maximum number of bytes we write out in one group commit
+    ConfigVar<uint64_t> _maxGroupBytes{"persistence_max_group_bytes", 1024 * 1024};
+
+private:  // fields
+    String _dir;
+    bool _syncEachGroup{true};
+    bool _stopped{true};
+    // set if we failed to write. The log refuses all further appends in that case
+    Status _failure{Statuses::S200_OK};
+
+    // records waiting to be written
+    std::deque<PendingRecord> _pending;
+    // set while the flush loop is running
+    bool _flushing{false};
+    seastar::future<> _flushFut = seastar::make_ready_future();
+
+    seastar::file _file;
+    seastar::future<seastar::file> _nextFile = seastar::make_ready_future<seastar::file>();
+    uint64_t _firstSegmentId{1};
+    uint64_t _currentSegmentId{0};
+    uint64_t _nextSegmentId{1};
+    uint64_t _nextSeq{0};
+    // the newest segment which has a record
+    uint64_t _lastRecordSegmentId{0};
+    // the DMA alignment for the segment files
+    size_t _alignment{4096};
+    // the logical end of the data in the current segment
+    uint64_t _segmentOffset{0};
+    // DMA writes are done in aligned blocks. We keep a copy of the data in the last partially-filled block so
+    // that we can re-write that block with the next group
+    seastar::temporary_buffer<char> _tail;
+    size_t _tailLen{0};
+
+    sm::metric_groups _metricGroups;
+    k2::ExponentialHistogram _ackLatency;
+    k2::ExponentialHistogram _syncLatency;
+    k2::ExponentialHistogram _groupRecords;
+    uint64_t _appendedRecords{0};
+    uint64_t _appendedBytes{0};
+    uint64_t _segmentsCreated{0};
+    uint64_t _segmentsRemoved{0};
+    uint64_t _groupCommits{0};
+};
+
+} // namespace k2
@@ -0,0 +1,98 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#include "Crc32c.h"
+
+#include <crc32c/crc32c.h>
+
+namespace k2 {
+
+namespace {
+// the crc32c polynomial in reflected bit order
+constexpr uint32_t CRC32C_POLY = 0x82F63B78;
+
+// Multiplies a and b modulo the crc32c polynomial. Polynomials are in reflected order, so x^0 is the MSB
+uint32_t _multModP(uint32_t a, uint32_t b) {
+    uint32_t m = 1u << 31;
+    uint32_t p = 0;
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) {
+                break;
+            }
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return p;
+}
+
+// x^(2^k) modulo the crc32c polynomial, for k=0..63
+struct X2NTable {
+    uint32_t powers[64];
+    X2NTable() {
+        uint32_t p = 1u << 30;  // x^1
+        powers[0] = p;
+        for (int k = 1; k < 64; ++k) {
+            powers[k] = p = _multModP(p, p);
+        }
+    }
+};
+const X2NTable x2nTable;
+
+// returns x^(8*nbytes) modulo the crc32c polynomial, i.e. the operator which appends nbytes of zeros to a crc
+uint32_t _zerosOperator(size_t nbytes) {
+    uint32_t p = 1u << 31;  // x^0
+    int k = 3;
+    while (nbytes) {
+        if (nbytes & 1) {
+            p = _multModP(x2nTable.powers[k & 63], p);
+        }
+        nbytes >>= 1;
+        ++k;
+    }
+    return p;
+}
+} // namespace
+
+uint32_t crc32cExtend(uint32_t crc, const void* data, size_t size) {
+    return crc32c::Extend(crc, reinterpret_cast<const uint8_t*>(data), size);
+}
+
+uint32_t crc32cCombine(uint32_t crcA, uint32_t crcB, size_t lenB) {
+    if (lenB == 0) {
+        return crcA;
+    }
+    return _multModP(_zerosOperator(lenB), crcA) ^ crcB;
+}
+
+uint32_t crc32cPatch(const void* delta, size_t size, size_t trailingBytes) {
+    // The crc is affine in the data, so the change only depends on the delta. The delta's contribution is its raw
+    // crc (zero initial value and no final inversion), followed by the trailing bytes as zeros
+    uint32_t raw = crc32c::Extend(0xFFFFFFFF, reinterpret_cast<const uint8_t*>(delta), size) ^ 0xFFFFFFFF;
+    return _multModP(_zerosOperator(trailingBytes), raw);
+}
+
+} // namespace k2
@@ -0,0 +1,48 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace k2 {
+
+// Helpers for streaming crc32c (Castagnoli) checksums. The data is processed by the crc32c library, which
+// dispatches to the SSE4.2 crc32 instruction when the CPU supports it.
+
+// returns the crc32c of data that is the concatenation of data with checksum crc followed by the given bytes.
+// Use crc=0 to start a new checksum
+uint32_t crc32cExtend(uint32_t crc, const void* data, size_t size);
+
+// returns the crc32c of the concatenation A+B, given the checksums of A and B and the length of B.
+// The cost is logarithmic in lenB and independent of the data
+uint32_t crc32cCombine(uint32_t crcA, uint32_t crcB, size_t lenB);
+
+// returns the value to xor into the crc32c of a message when the bytes of a region of the message are xor-ed
+// with the given delta, and the region is followed by trailingBytes bytes of the message.
+// This allows patching a checksum after a small overwrite without another pass over the message
+uint32_t crc32cPatch(const void* delta, size_t size, size_t trailingBytes);
+
+} // namespace k2
@@ -33,6 +33,7 @@ Copyright(c) 2020 Futurewei Cloud
 #include "RPCDispatcher.h"  // for RPC
 #include "RPCTypes.h"
 #include "RRDMARPCProtocol.h"
+#include "ShmRPCProtocol.h"
 #include "Log.h"
 
 namespace k2 {
@@ -52,6 +53,16 @@ public :  // application lifespan
                 eps.push_back(std::move(ep));
             }
         }
+        // look for shared memory. It only works if the remote end is on the same host
+        auto shmEp = RPC().getServerEndpoint(ShmRPCProtocol::proto);
+        if (shmEp) {
+            for (auto& ep: eps) {
+                if (ep->protocol == ShmRPCProtocol::proto && ep->ip == shmEp->ip) {
+                    return std::move(ep);
+                }
+            }
+        }
+
         // look for rdma
         if (seastar::engine()._rdma_stack) {
             for (auto& ep: eps) {
@@ -75,10 +86,15 @@ public :  // application lifespan
     template<typename StringContainer>
     static String selectBestEndpointString(const StringContainer& urls) {
         bool rdma = seastar::engine()._rdma_stack != nullptr;
+        auto shmEp = RPC().getServerEndpoint(ShmRPCProtocol::proto);
         String selectedEP = "";
 
         for (const String& ep : urls) {
-            if (ep.find(RRDMARPCProtocol::proto) != String::npos && rdma) {
+            if (shmEp && ep.find(ShmRPCProtocol::proto) == 0 && ep.find("[" + shmEp->ip + "]") != String::npos) {
+                // shared memory on the same host beats everything else
+                return ep;
+            }
+            else if (ep.find(RRDMARPCProtocol::proto) != String::npos && rdma) {
                 selectedEP = ep;
             }
             else if (ep.find(TCPRPCProtocol::proto) != String::npos && !rdma) {
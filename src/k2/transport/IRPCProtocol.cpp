@@ -50,6 +50,14 @@ IRPCProtocol::~IRPCProtocol() {
     K2LOG_D(log::tx, "dtor");
 }
 
+void IRPCProtocol::connect(TXEndpoint&) {
+}
+
+void IRPCProtocol::sendOrdered(Verb verb, std::unique_ptr<Payload> payload, TXEndpoint& endpoint, MessageMetadata metadata,
+                               uint64_t) {
+    send(verb, std::move(payload), endpoint, std::move(metadata));
+}
+
 const String& IRPCProtocol::supportedProtocol() {
     return _protocol;
 }
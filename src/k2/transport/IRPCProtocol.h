@@ -102,6 +102,16 @@ public: // API
     // This is an asyncronous API. No guarantees are made on the delivery of the payload after the call returns.
     virtual void send(Verb verb, std::unique_ptr<Payload> payload, TXEndpoint& endpoint, MessageMetadata metadata) = 0;
 
+    // Same as send(), but all messages sent to the endpoint with the same ordering key are delivered in order, over
+    // the same connection, so the receiver sees them coming from the same remote endpoint.
+    // Protocols with a single channel per endpoint deliver all messages in order, so the default is to just send()
+    virtual void sendOrdered(Verb verb, std::unique_ptr<Payload> payload, TXEndpoint& endpoint, MessageMetadata metadata,
+                             uint64_t orderingKey);
+
+    // Establishes the connections to the given endpoint ahead of time, so that the first message sent there doesn't
+    // have to wait for connection setup. Does nothing for connectionless protocols
+    virtual void connect(TXEndpoint& endpoint);
+
     // Returns the endpoint where this protocol accepts incoming connections.
     virtual seastar::lw_shared_ptr<TXEndpoint> getServerEndpoint() = 0;
 
@@ -22,7 +22,7 @@ Copyright(c) 2020 Futurewei Cloud
 */
 
 #include "Payload.h"
-#include <crc32c/crc32c.h>
+#include "Crc32c.h"
 
 namespace k2 {
 
@@ -89,6 +89,7 @@ void Payload::clear() {
     _buffers.resize(0);
     _size = 0;
     _capacity = 0;
+    _crcStart = CRC_NONE;
 }
 
 void Payload::appendBinary(Binary&& binary) {
@@ -259,10 +260,21 @@ void Payload::reserve(size_t advance) {
 void Payload::truncateToCurrent() {
     if (_size == 0) return; // nothing to do
     _size = _currentPosition.offset;
+    if (_crcEnd > _size) {
+        // we dropped some of the checksummed data
+        _crcStart = CRC_NONE;
+    }
 
     if (_currentPosition.bufferIndex == _buffers.size()) return; // we're past the end already
 
     // make the current position the end, and place our cursor just past the end
+    if (_currentPosition.bufferOffset == 0) {
+        // the cursor is at the start of a buffer. Drop it along with the rest instead of keeping an empty buffer,
+        // which the read/write loops cannot step over
+        _buffers.resize(_currentPosition.bufferIndex);
+        _capacity = _size;
+        return;
+    }
 
     // drop any extra buffers we might have
     _buffers.resize(_currentPosition.bufferIndex + 1);
@@ -277,12 +289,15 @@ void Payload::truncateToCurrent() {
 
 void Payload::write(char b) {
     ensureCapacity(_currentPosition.offset + 1);
+    _crcBeforeWrite(&b, 1);
     _buffers[_currentPosition.bufferIndex].get_write()[_currentPosition.bufferOffset] = b;
     skip(1);
+    _crcAfterWrite();
 }
 
 void Payload::write(const void* data, size_t size) {
     ensureCapacity(_currentPosition.offset + size);
+    _crcBeforeWrite(data, size);
 
     while (size > 0) {
         Binary& buffer = _buffers[_currentPosition.bufferIndex];
@@ -294,6 +309,7 @@ void Payload::write(const void* data, size_t size) {
         data = (void*)((char*)data + needToCopySize);
         size -= needToCopySize;
     }
+    _crcAfterWrite();
 }
 
 void Payload::write(const String& value) {
@@ -330,10 +346,37 @@ void Payload::write(const Payload& other) {
     // write out how many bytes are following
     write(size);
 
+    if (size < SPLICE_THRESHOLD) {
+        for (size_t i = 0; i < other._buffers.size() && size > 0; ++i) {
+            auto& buf = other._buffers[i];
+            auto toCopy = std::min(size, buf.size());
+            write(buf.get(), toCopy);
+            size -= toCopy;
+        }
+        return;
+    }
+
+    // Hold on to the unused space in the buffer we're writing into. We put it back after the spliced buffers so
+    // that whatever is written after this payload doesn't need a new allocation
+    Binary tail;
+    if (_currentPosition.bufferIndex < _buffers.size()) {
+        auto& buf = _buffers[_currentPosition.bufferIndex];
+        tail = buf.share(_currentPosition.bufferOffset, buf.size() - _currentPosition.bufferOffset);
+    }
+
     // reset ourselves so that we are exactly as big as the data we're currently holding
     // truncate to the current cursor
     truncateToCurrent();
 
+    // the spliced data is not copied, so we pick up its checksum from the other payload if it is known.
+    // Otherwise it is folded into our checksum like any other data
+    uint32_t otherCrc = 0;
+    if (_crcStart != CRC_NONE && other._cachedCrc32c(0, otherCrc)) {
+        _crcFold(_size);
+        _crc = crc32cCombine(_crc, otherCrc, size);
+        _crcEnd += size;
+    }
+
     auto shared = const_cast<Payload*>(&other)->shareAll();
     for (size_t i= 0; i < shared._buffers.size() && size > 0; ++i) {
         // now we can extend our buffer list with shared buffers from the other payload
@@ -349,6 +392,12 @@ void Payload::write(const Payload& other) {
         size -= toMove;
         skip(toMove);
     }
+
+    if (tail.size() > 0) {
+        // our cursor points just past the last buffer, which is exactly where the tail goes
+        _capacity += tail.size();
+        _buffers.push_back(std::move(tail));
+    }
 }
 
 void Payload::writeMany() {
@@ -404,26 +453,82 @@ void Payload::skip(size_t numBytes) {
 }
 
 uint32_t Payload::computeCrc32c() {
-    // remember where we started
-    auto curpos = getCurrentPosition();
-
+    auto offset = _currentPosition.offset;
+    if (_crcStart != CRC_NONE && offset <= _crcStart) {
+        // bring the running checksum up to date so that we don't fold the same data again next time
+        _crcFold(_size);
+    }
     uint32_t checksum = 0;
-    size_t size = getSize() - curpos.offset;
+    if (_cachedCrc32c(offset, checksum)) {
+        return checksum;
+    }
+    return _extendCrc(0, offset, _size - offset);
+}
+
+void Payload::setCrc32c(uint32_t crc) {
+    _crcStart = 0;
+    _crcEnd = _size;
+    _crc = crc;
+}
 
+uint32_t Payload::_extendCrc(uint32_t crc, size_t offset, size_t size) const {
+    // find the buffer which holds the offset
+    size_t bufIdx = 0;
+    while (bufIdx < _buffers.size() && offset >= _buffers[bufIdx].size()) {
+        offset -= _buffers[bufIdx].size();
+        ++bufIdx;
+    }
     while (size > 0) {
-        const Binary& buffer = _buffers[_currentPosition.bufferIndex];
-        size_t currentBufferRemaining = buffer.size() - _currentPosition.bufferOffset;
-        size_t needToCopySize = std::min(size, currentBufferRemaining);
+        const Binary& buffer = _buffers[bufIdx];
+        size_t toCrc = std::min(size, buffer.size() - offset);
+        crc = crc32cExtend(crc, buffer.get() + offset, toCrc);
+        size -= toCrc;
+        offset = 0;
+        ++bufIdx;
+    }
+    return crc;
+}
 
-        checksum = crc32c::Extend(checksum, reinterpret_cast<const uint8_t*>(buffer.get() + _currentPosition.bufferOffset), needToCopySize);
+bool Payload::_cachedCrc32c(size_t offset, uint32_t& crc) const {
+    if (_crcStart == CRC_NONE || offset > _crcStart) {
+        return false;
+    }
+    // the data we haven't folded yet
+    crc = _extendCrc(_crc, _crcEnd, _size - _crcEnd);
+    if (offset < _crcStart) {
+        // and the data before the first write, e.g. a reserved header
+        crc = crc32cCombine(_extendCrc(0, offset, _crcStart - offset), crc, _size - _crcStart);
+    }
+    return true;
+}
 
-        size -= needToCopySize;
-        skip(needToCopySize);
+void Payload::_crcFold(size_t end) {
+    if (end > _crcEnd) {
+        _crc = _extendCrc(_crc, _crcEnd, end - _crcEnd);
+        _crcEnd = end;
     }
+}
 
-    // put the cursor back where it was before we started
-    seek(curpos);
-    return checksum;
+void Payload::_crcPatch(size_t pos, const void* data, size_t size) {
+    auto start = std::max(pos, _crcStart);
+    auto end = std::min(pos + size, _crcEnd);
+    if (end - start > CRC_MAX_PATCH) {
+        // start over with the next write
+        _crcStart = CRC_NONE;
+        return;
+    }
+    // This is usually a size field which is filled in after the data which follows it, as in
+    // write(SerializeAsPayload). Patch the checksum with the difference between the old and new bytes
+    uint8_t delta[CRC_MAX_PATCH];
+    auto savedPos = _currentPosition;
+    seek(start);
+    read(delta, end - start);
+    _currentPosition = savedPos;
+    auto newBytes = (const uint8_t*)data + (start - pos);
+    for (size_t i = 0; i < end - start; ++i) {
+        delta[i] ^= newBytes[i];
+    }
+    _crc ^= crc32cPatch(delta, end - start, _crcEnd - end);
 }
 
 
@@ -479,6 +584,10 @@ Payload Payload::copy(BinaryAllocator&& allocator) {
 
     copied.appendBinary(std::move(b));
     copied._allocator = std::move(allocator);
+    // the copy has exactly our data so our running checksum applies to it
+    copied._crcStart = _crcStart;
+    copied._crcEnd = _crcEnd;
+    copied._crc = _crc;
     return copied;
 }
 
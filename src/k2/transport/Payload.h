@@ -29,6 +29,7 @@ Copyright(c) 2020 Futurewei Cloud
 #include <unordered_set>
 #include <set>
 #include <limits>
+#include <tuple>
 
 #include <k2/common/Common.h>
 #include <k2/logging/Log.h>
@@ -89,6 +90,19 @@ struct IsPayloadCopyableTypeTrait : std::false_type {};
 template <typename T>
 struct IsPayloadCopyableTypeTrait<T, typename enable_if_type<typename T::__K2PayloadCopyableTraitTag__>::type> : std::true_type {};
 
+template <typename T>
+struct IsVectorTypeTrait : std::false_type {};
+
+template <typename T>
+struct IsVectorTypeTrait<std::vector<T>> : std::true_type {};
+
+// Types declared with K2_PAYLOAD_FIELDS expose their fields as a tuple of references via __k2Fields()
+template <typename T, typename = void>
+struct HasPayloadFieldsTrait : std::false_type {};
+
+template <typename T>
+struct HasPayloadFieldsTrait<T, std::void_t<decltype(std::declval<const T&>().__k2Fields())>> : std::true_type {};
+
 template <typename T>  //  Type that can be just copy to/from payload, though may not have reference
 constexpr bool isNumericType() { return std::is_arithmetic<T>::value || std::is_enum<T>::value; }
 
@@ -195,9 +209,16 @@ public: // API
     // returns the total bytes left for reading in this payload
     size_t getDataRemaining() const;
 
-    // This method computes crc32c over the remaining data in the buffer
+    // This method computes crc32c over the remaining data in the buffer.
+    // The write API keeps a running crc32c of the data written through it, so this is normally cheap when
+    // called from a position at or before the first write (e.g. right after the reserved message header).
+    // Data shared with other payloads and modified through them is not tracked here.
     uint32_t computeCrc32c();
 
+    // Records the crc32c of all data in this payload, e.g. one that was verified when the data was received, so
+    // that later calls to computeCrc32c() don't need a pass over the data
+    void setCrc32c(uint32_t crc);
+
     // compare with the given payload. linear in complexity of number of bytes stored in the payload
     bool operator==(const Payload& o) const;
 
@@ -365,6 +386,59 @@ public:  // Read API
     // no-arg version to satisfy the template expansion above in the terminal case
     bool readMany();
 
+    // Reads the fields of a K2_PAYLOAD_FIELDS struct. Same result as readMany(), but flat fields (see _isFlat())
+    // are loaded with bounds-checked copies straight out of the current buffer, and the cursor is moved once per
+    // run of such fields. Fields which cross a buffer boundary, and non-flat fields, are read one by one
+    template <typename... T>
+    bool readFields(T&... fields) {
+        if constexpr (!(_isFlat<T>() || ...)) {
+            return readMany(fields...);
+        }
+        else {
+            const char* start = nullptr;
+            const char* cur = nullptr;
+            const char* end = nullptr;
+            auto open = [&] {
+                start = cur = end = nullptr;
+                if (getDataRemaining() > 0 && _currentPosition.bufferIndex < _buffers.size()) {
+                    const Binary& buffer = _buffers[_currentPosition.bufferIndex];
+                    start = cur = buffer.get() + _currentPosition.bufferOffset;
+                    end = start + std::min(buffer.size() - _currentPosition.bufferOffset, getDataRemaining());
+                }
+            };
+            auto flush = [&] {
+                if (cur != start) {
+                    skip(cur - start);
+                }
+                start = cur;
+            };
+            auto readOne = [&](auto& field) {
+                using FieldT = std::decay_t<decltype(field)>;
+                if constexpr (_isFlat<FieldT>()) {
+                    auto mark = cur;
+                    // vectors nested in a struct would keep the elements of a partial load, so make sure it all fits
+                    bool fits = true;
+                    if constexpr (isPayloadSerializableType<FieldT>() && _hasVector<FieldT>()) {
+                        auto probe = cur;
+                        fits = _flatSkip<FieldT>(probe, end);
+                    }
+                    if (fits && _flatLoad(cur, end, field)) {
+                        return true;
+                    }
+                    cur = mark;
+                }
+                flush();
+                bool success = read(field);
+                open();
+                return success;
+            };
+            open();
+            bool success = (readOne(fields) && ...);
+            flush();
+            return success;
+        }
+    }
+
 public: // Write API
 
     // Truncates this payload to the current cursor position, dropping the remaining data
@@ -384,8 +458,11 @@ public: // Write API
     void write(const DecimalD50& value);
     void write(const DecimalD100& value);
 
-    // write another Payload
+    // write another Payload. Payloads of at least SPLICE_THRESHOLD bytes are not copied: their buffers are
+    // shared and spliced into ours by reference. Smaller payloads are copied since carrying them as separate
+    // fragments costs more than the copy. The running crc32c of a spliced payload is combined into ours
     void write(const Payload& other);
+    static constexpr size_t SPLICE_THRESHOLD = 512;
 
     // write(copy) a Binary
     void write(const Binary& other);
@@ -503,6 +580,57 @@ public: // Write API
     // no-arg version to satisfy the template expansion above in the terminal case
     void writeMany();
 
+    // Writes the fields of a K2_PAYLOAD_FIELDS struct. Produces the same bytes as writeMany(), but when appending
+    // we reserve capacity for all flat fields (see _isFlat()) once, store them with plain copies straight into the
+    // current buffer and move the cursor once per run of such fields. Fields which don't fit in the current
+    // buffer, and non-flat fields, go through the regular write()
+    template <typename... T>
+    void writeFields(const T&... fields) {
+        if constexpr (!(_isFlat<T>() || ...)) {
+            writeMany(fields...);
+        }
+        else {
+            size_t bound = (_flatBoundIfFlat(fields) + ...);
+            char* start = nullptr;
+            char* cur = nullptr;
+            char* end = nullptr;
+            auto open = [&] {
+                start = cur = end = nullptr;
+                // only when appending, so that there is nothing to patch in the running checksum
+                if (bound > 0 && _currentPosition.offset >= _size) {
+                    ensureCapacity(_currentPosition.offset + bound);
+                    Binary& buffer = _buffers[_currentPosition.bufferIndex];
+                    start = cur = buffer.get_write() + _currentPosition.bufferOffset;
+                    end = buffer.get_write() + buffer.size();
+                }
+            };
+            auto flush = [&] {
+                if (cur != start) {
+                    _crcBeforeWrite(start, 0);
+                    skip(cur - start);
+                    _crcAfterWrite();
+                }
+                start = cur;
+            };
+            auto writeOne = [&](const auto& field) {
+                if constexpr (_isFlat<std::decay_t<decltype(field)>>()) {
+                    auto size = _flatBound(field);
+                    bound -= size;
+                    if (size_t(end - cur) >= size) {
+                        _flatStore(cur, field);
+                        return;
+                    }
+                }
+                flush();
+                write(field);
+                open();
+            };
+            open();
+            (writeOne(fields), ...);
+            flush();
+        }
+    }
+
 public: // getSerializedSizeOf api
 
     // for type: String
@@ -680,10 +808,307 @@ private:  // types and fields
     BinaryAllocator _allocator;
     PayloadPosition _currentPosition;
 
+    // Running crc32c of the data in [_crcStart, _crcEnd), which is maintained by the write API.
+    // The data written past _crcEnd is folded in lazily, in chunks of CRC_FOLD_BYTES while it is still hot.
+    // _crcStart is CRC_NONE until the first write, and after changes we could not track.
+    static constexpr size_t CRC_NONE = std::numeric_limits<size_t>::max();
+    static constexpr size_t CRC_FOLD_BYTES = 4096;
+    // overwrites of checksummed data up to this size are patched into the checksum. Larger ones drop it
+    static constexpr size_t CRC_MAX_PATCH = 64;
+    size_t _crcStart{CRC_NONE};
+    size_t _crcEnd{0};
+    uint32_t _crc{0};
+
 private: // helper methods
     // used to allocate additional space
     bool _allocateBuffer();
 
+    // extends the given crc32c with the given range of our data. Doesn't move the cursor
+    uint32_t _extendCrc(uint32_t crc, size_t offset, size_t size) const;
+
+    // computes the crc32c of the data in [offset, end) using the running checksum.
+    // Returns false if the running checksum doesn't cover that range
+    bool _cachedCrc32c(size_t offset, uint32_t& crc) const;
+
+    // called before/after writing the given bytes at the cursor, to maintain the running checksum
+    void _crcBeforeWrite(const void* data, size_t size) {
+        auto pos = _currentPosition.offset;
+        if (_crcStart == CRC_NONE) {
+            _crcStart = _crcEnd = pos;
+            _crc = 0;
+        }
+        else if (pos < _crcEnd && pos + size > _crcStart) {
+            _crcPatch(pos, data, size);
+        }
+    }
+    void _crcAfterWrite() {
+        if (_currentPosition.offset >= _crcEnd + CRC_FOLD_BYTES && _crcStart != CRC_NONE) {
+            _crcFold(_currentPosition.offset);
+        }
+    }
+
+    // fold our data up to the given offset into the running checksum
+    void _crcFold(size_t end);
+
+    // Flat types are the ones which can be (de)serialized with plain copies to/from contiguous memory: numeric and
+    // copyable types, strings, decimals, durations, vectors of those and K2_PAYLOAD_FIELDS structs with only
+    // flat fields. Payloads, Binaries, maps and sets are not flat
+    template <typename T>
+    static constexpr bool _isFlat() {
+        if constexpr (isNumericType<T>() || isPayloadCopyableType<T>() || std::is_same_v<T, String> ||
+                      std::is_same_v<T, DecimalD25> || std::is_same_v<T, DecimalD50> || std::is_same_v<T, DecimalD100>) {
+            return true;
+        }
+        else if constexpr (std::is_same_v<T, Duration>) {
+            return std::is_same_v<Duration::rep, long int>;
+        }
+        else if constexpr (IsVectorTypeTrait<T>::value) {
+            // vectors of structs are left to write(), which serializes each element with its own fast path. This
+            // also keeps self-referencing structs (e.g. expression trees) from recursing here
+            if constexpr (isPayloadSerializableType<typename T::value_type>()) {
+                return false;
+            }
+            else {
+                return _isFlat<typename T::value_type>();
+            }
+        }
+        else if constexpr (isPayloadSerializableType<T>() && HasPayloadFieldsTrait<T>::value) {
+            return _allFlat((decltype(std::declval<const T&>().__k2Fields())*)nullptr);
+        }
+        else {
+            return false;
+        }
+    }
+
+    template <typename... T>
+    static constexpr bool _allFlat(std::tuple<T...>*) {
+        return (_isFlat<std::decay_t<T>>() && ...);
+    }
+
+    // The serialized size of a flat type, known at compile time. 0 if it depends on the value
+    template <typename T>
+    static constexpr size_t _fixedSize() {
+        if constexpr (isNumericType<T>() || isPayloadCopyableType<T>() || std::is_same_v<T, DecimalD25> ||
+                      std::is_same_v<T, DecimalD50> || std::is_same_v<T, DecimalD100>) {
+            return sizeof(T);
+        }
+        else if constexpr (std::is_same_v<T, Duration>) {
+            return sizeof(long int);
+        }
+        else if constexpr (isPayloadSerializableType<T>() && _isFlat<T>()) {
+            return _fixedSizeOf((decltype(std::declval<const T&>().__k2Fields())*)nullptr);
+        }
+        else {
+            return 0;
+        }
+    }
+
+    template <typename... T>
+    static constexpr size_t _fixedSizeOf(std::tuple<T...>*) {
+        if constexpr (sizeof...(T) > 0) {
+            return ((_fixedSize<std::decay_t<T>>() > 0) && ...) ? (_fixedSize<std::decay_t<T>>() + ...) : 0;
+        }
+        return 0;
+    }
+
+    // The serialized size of the given value of a flat type
+    template <typename T>
+    static size_t _flatBound(const T& value) {
+        if constexpr (_fixedSize<T>() > 0) {
+            return _fixedSize<T>();
+        }
+        else if constexpr (std::is_same_v<T, String>) {
+            return sizeof(_Size) + value.size() + 1;
+        }
+        else if constexpr (IsVectorTypeTrait<T>::value) {
+            using ValueT = typename T::value_type;
+            if constexpr (_fixedSize<ValueT>() > 0) {
+                return sizeof(_Size) + value.size() * _fixedSize<ValueT>();
+            }
+            else {
+                size_t size = sizeof(_Size);
+                for (const ValueT& v : value) {
+                    size += _flatBound(v);
+                }
+                return size;
+            }
+        }
+        else {
+            return std::apply([](const auto&... fields) { return (size_t(0) + ... + _flatBound(fields)); },
+                              value.__k2Fields());
+        }
+    }
+
+    template <typename T>
+    static size_t _flatBoundIfFlat(const T& value) {
+        if constexpr (_isFlat<T>()) {
+            return _flatBound(value);
+        }
+        return 0;
+    }
+
+    template <typename T>
+    static constexpr bool _hasVector() {
+        if constexpr (IsVectorTypeTrait<T>::value) {
+            return true;
+        }
+        else if constexpr (isPayloadSerializableType<T>() && _isFlat<T>()) {
+            return _anyVector((decltype(std::declval<const T&>().__k2Fields())*)nullptr);
+        }
+        else {
+            return false;
+        }
+    }
+
+    template <typename... T>
+    static constexpr bool _anyVector(std::tuple<T...>*) {
+        return (_hasVector<std::decay_t<T>>() || ...);
+    }
+
+    // Advances src over a serialized flat value of type T. Returns false if it doesn't fit in [src, end)
+    template <typename T>
+    static bool _flatSkip(const char*& src, const char* end) {
+        if constexpr (_fixedSize<T>() > 0) {
+            if (size_t(end - src) < _fixedSize<T>()) return false;
+            src += _fixedSize<T>();
+            return true;
+        }
+        else if constexpr (std::is_same_v<T, String> || IsVectorTypeTrait<T>::value) {
+            _Size size;
+            if (size_t(end - src) < sizeof(size)) return false;
+            std::memcpy(&size, src, sizeof(size));
+            src += sizeof(size);
+            if constexpr (std::is_same_v<T, String>) {
+                if (size == 0 || size_t(end - src) < size) return false;
+                src += size;
+            }
+            else if constexpr (_fixedSize<typename T::value_type>() > 0) {
+                if (size_t(end - src) < size * _fixedSize<typename T::value_type>()) return false;
+                src += size * _fixedSize<typename T::value_type>();
+            }
+            else {
+                for (_Size i = 0; i < size; ++i) {
+                    if (!_flatSkip<typename T::value_type>(src, end)) return false;
+                }
+            }
+            return true;
+        }
+        else {
+            return _flatSkipFields((decltype(std::declval<const T&>().__k2Fields())*)nullptr, src, end);
+        }
+    }
+
+    template <typename... T>
+    static bool _flatSkipFields(std::tuple<T...>*, const char*& src, const char* end) {
+        return (_flatSkip<std::decay_t<T>>(src, end) && ...);
+    }
+
+    // Stores the given flat value at dest, which must have room for _flatBound(value) bytes, and advances dest.
+    // The bytes are the same as the ones written by the corresponding write() method
+    template <typename T>
+    static void _flatStore(char*& dest, const T& value) {
+        if constexpr (std::is_same_v<T, Duration>) {
+            long int ticks = value.count();
+            std::memcpy(dest, &ticks, sizeof(ticks));
+            dest += sizeof(ticks);
+        }
+        else if constexpr (_fixedSize<T>() > 0 && !isPayloadSerializableType<T>()) {
+            std::memcpy(dest, (const void*)&value, sizeof(T));
+            dest += sizeof(T);
+        }
+        else if constexpr (std::is_same_v<T, String>) {
+            _Size size = value.size() + 1;  // count the null character too
+            std::memcpy(dest, &size, sizeof(size));
+            std::memcpy(dest + sizeof(size), value.data(), size);
+            dest += sizeof(size) + size;
+        }
+        else if constexpr (IsVectorTypeTrait<T>::value) {
+            using ValueT = typename T::value_type;
+            K2ASSERT(log::tx, value.size() < std::numeric_limits<_Size>::max(), "vector is too long to write out");
+            _Size size = value.size();
+            std::memcpy(dest, &size, sizeof(size));
+            dest += sizeof(size);
+            if constexpr (isNumericType<ValueT>() && !std::is_same_v<ValueT, bool>) {
+                std::memcpy(dest, value.data(), size * sizeof(ValueT));
+                dest += size * sizeof(ValueT);
+            }
+            else {
+                for (const ValueT& v : value) {
+                    _flatStore(dest, v);
+                }
+            }
+        }
+        else {
+            std::apply([&dest](const auto&... fields) { (_flatStore(dest, fields), ...); }, value.__k2Fields());
+        }
+    }
+
+    // Loads a flat value from [src, end) and advances src. Returns false if there isn't enough data in the range,
+    // in which case src and value may be partially consumed/filled and the caller should fall back to read()
+    template <typename T>
+    static bool _flatLoad(const char*& src, const char* end, T& value) {
+        if constexpr (std::is_same_v<T, Duration>) {
+            long int ticks = 0;
+            if (size_t(end - src) < sizeof(ticks)) return false;
+            std::memcpy(&ticks, src, sizeof(ticks));
+            src += sizeof(ticks);
+            value = Duration(ticks);
+            return true;
+        }
+        else if constexpr (_fixedSize<T>() > 0 && !isPayloadSerializableType<T>()) {
+            if (size_t(end - src) < sizeof(T)) return false;
+            std::memcpy((void*)&value, src, sizeof(T));
+            src += sizeof(T);
+            return true;
+        }
+        else if constexpr (std::is_same_v<T, String>) {
+            _Size size;
+            if (size_t(end - src) < sizeof(size)) return false;
+            std::memcpy(&size, src, sizeof(size));
+            if (size == 0 || size_t(end - src) - sizeof(size) < size) return false;
+            value.resize(size - 1);  // the resulting string's size will be one less than what we read since '\0' doesn't count
+            std::memcpy(value.data(), src + sizeof(size), size);
+            src += sizeof(size) + size;
+            return true;
+        }
+        else if constexpr (IsVectorTypeTrait<T>::value) {
+            using ValueT = typename T::value_type;
+            _Size size;
+            if (size_t(end - src) < sizeof(size)) return false;
+            std::memcpy(&size, src, sizeof(size));
+            src += sizeof(size);
+            auto oldSize = value.size();
+            if constexpr (isNumericType<ValueT>() && !std::is_same_v<ValueT, bool>) {
+                if (size_t(end - src) < size * sizeof(ValueT)) return false;
+                value.resize(oldSize + size);
+                std::memcpy(value.data() + oldSize, src, size * sizeof(ValueT));
+                src += size * sizeof(ValueT);
+            }
+            else {
+                if constexpr (_fixedSize<ValueT>() > 0) {
+                    if (size_t(end - src) < size * _fixedSize<ValueT>()) return false;
+                }
+                value.reserve(oldSize + size);
+                for (_Size i = 0; i < size; ++i) {
+                    ValueT v;
+                    if (!_flatLoad(src, end, v)) {
+                        value.resize(oldSize);
+                        return false;
+                    }
+                    value.push_back(std::move(v));
+                }
+            }
+            return true;
+        }
+        else {
+            return std::apply([&src, end](auto&... fields) { return (_flatLoad(src, end, fields) && ...); },
+                              value.__k2Fields());
+        }
+    }
+
+    // update the running checksum for an overwrite of data which is already part of it
+    void _crcPatch(size_t pos, const void* data, size_t size);
+
 private: // deleted
     Payload(const Payload&) = delete;
     Payload& operator=(const Payload&) = delete;
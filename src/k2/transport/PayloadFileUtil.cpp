@@ -23,6 +23,9 @@ Copyright(c) 2020 Futurewei Cloud
 
 #include "PayloadFileUtil.h"
 
+#include <seastar/core/file.hh>
+#include <seastar/core/reactor.hh>
+
 namespace k2 {
 
 // create a directory if it doesn't exist already
@@ -91,7 +94,7 @@ bool fileutil::writeFile(Payload&& payload, String path) {
     payload.truncateToCurrent();
     auto leftBytes = payload.getSize();
 
-    int fd = ::open(path.c_str(), O_CREAT | O_WRONLY);
+    int fd = ::open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
     if (fd < 0) {
         K2LOG_E(log::tx, "Unable to open file for writing {}: {}", path, strerror(errno));
         return false;
@@ -113,4 +116,99 @@ bool fileutil::writeFile(Payload&& payload, String path) {
     return true;
 }
 
+namespace {
+// DMA I/O is not supported by the file system, so we have to use the blocking calls
+bool dmaNotSupported(std::exception_ptr exc) {
+    try {
+        std::rethrow_exception(exc);
+    } catch (std::system_error& err) {
+        return err.code().value() == EINVAL;
+    } catch (...) {
+    }
+    return false;
+}
+} // namespace
+
+seastar::future<std::optional<Payload>> fileutil::readFileAsync(String path) {
+    return seastar::open_file_dma(path, seastar::open_flags::ro)
+        .then([path](seastar::file file) {
+            return seastar::do_with(std::move(file), [path](auto& file) {
+                return file.size()
+                    .then([&file](uint64_t size) {
+                        return file.template dma_read_bulk<char>(0, size);
+                    })
+                    .then([](Binary buf) {
+                        Payload payload;
+                        if (buf.size() > 0) {
+                            payload.appendBinary(std::move(buf));
+                        }
+                        return std::optional<Payload>(std::move(payload));
+                    })
+                    .finally([&file] {
+                        return file.close();
+                    });
+            });
+        })
+        .handle_exception([path](auto exc) {
+            if (dmaNotSupported(exc)) {
+                Payload payload;
+                return readFile(payload, path) ? std::optional<Payload>(std::move(payload)) : std::nullopt;
+            }
+            try {
+                std::rethrow_exception(exc);
+            } catch (std::system_error& err) {
+                if (err.code().value() != ENOENT) {
+                    K2LOG_E(log::tx, "problem reading file {}: {}", path, err.what());
+                }
+            } catch (std::exception& err) {
+                K2LOG_E(log::tx, "problem reading file {}: {}", path, err.what());
+            }
+            return std::optional<Payload>();
+        });
+}
+
+seastar::future<bool> fileutil::writeFileAsync(Payload&& payload, String path) {
+    payload.truncateToCurrent();
+    return seastar::do_with(std::move(payload), std::move(path), [](auto& payload, auto& path) {
+        return seastar::open_file_dma(path, seastar::open_flags::wo | seastar::open_flags::create | seastar::open_flags::truncate)
+            .then([&payload](seastar::file file) {
+                // DMA writes are done in whole blocks, from aligned memory. We write the data padded to a whole
+                // number of blocks, and then truncate the file to the real size
+                size_t size = payload.getSize();
+                size_t alignment = file.disk_write_dma_alignment();
+                size_t padded = (size + alignment - 1) / alignment * alignment;
+                auto buf = Binary::aligned(file.memory_dma_alignment(), std::max(padded, alignment));
+                payload.seek(0);
+                payload.read(buf.get_write(), size);
+                std::memset(buf.get_write() + size, 0, buf.size() - size);
+                return seastar::do_with(std::move(file), std::move(buf), [size, padded](auto& file, auto& buf) {
+                    return file.dma_write(0, buf.get(), padded)
+                        .then([&file, size, padded](size_t written) {
+                            if (written != padded) {
+                                throw std::runtime_error("short write");
+                            }
+                            return file.truncate(size);
+                        })
+                        .then([&file] {
+                            return file.flush();
+                        })
+                        .finally([&file] {
+                            return file.close();
+                        });
+                });
+            })
+            .then([] {
+                return true;
+            })
+            .handle_exception([&payload, &path](auto exc) {
+                if (dmaNotSupported(exc)) {
+                    payload.seek(payload.getSize());
+                    return writeFile(std::move(payload), path);
+                }
+                K2LOG_W_EXC(log::tx, exc, "Unable to write file {}", path);
+                return false;
+            });
+    });
+}
+
 } // ns k2
@@ -28,6 +28,10 @@ Copyright(c) 2020 Futurewei Cloud
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <optional>
+
+#include <seastar/core/future.hh>
+
 #include "Payload.h"
 
 #include <k2/common/Defer.h>
@@ -45,8 +49,15 @@ static bool fileExists(String path);
 // read an entire file into a payload
 static bool readFile(Payload& payload, String path);
 
-// write an entire payload into the given file
+// write an entire payload into the given file, replacing its contents
 static bool writeFile(Payload&& payload, String path);
 
+// Versions of readFile/writeFile which don't block the reactor. The I/O is done with DMA files, through the I/O
+// backend of the reactor (--reactor-backend or --io_uring). File systems which don't support DMA (e.g. tmpfs) fall
+// back to the blocking calls above.
+// resolves to an empty optional if the file doesn't exist or can't be read
+static seastar::future<std::optional<Payload>> readFileAsync(String path);
+static seastar::future<bool> writeFileAsync(Payload&& payload, String path);
+
 }; // struct fileutil
 } // ns k2
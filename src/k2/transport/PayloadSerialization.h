@@ -29,15 +29,18 @@ Copyright(c) 2020 Futurewei Cloud
 
 // General purpose macro for creating serializable structures of any field types.
 // You have to pass your fields here in order for them to be (de)serialized. This macro works for any
-// field types (both primitive/simple as well as nested/complex) but it does the (de)serialization
-// on a field-by-field basis so it may be less efficient than the one-shot macro below
+// field types (both primitive/simple as well as nested/complex). Runs of fields with flat types (numbers,
+// copyable structs, strings, vectors of those, etc) are (de)serialized with plain copies into/out of the
+// payload buffer (see Payload::writeFields/readFields). Other fields are (de)serialized one by one
 #define K2_PAYLOAD_FIELDS(...)                                             \
     struct __K2PayloadSerializableTraitTag__ {};                           \
+    auto __k2Fields() const { return std::tie(__VA_ARGS__); }              \
+    auto __k2Fields() { return std::tie(__VA_ARGS__); }                    \
     void __writeFields(k2::Payload& ___payload_local_macro_var___) const { \
-        ___payload_local_macro_var___.writeMany(__VA_ARGS__);              \
+        ___payload_local_macro_var___.writeFields(__VA_ARGS__);            \
     }                                                                      \
     bool __readFields(k2::Payload& ___payload_local_macro_var___) {        \
-        return ___payload_local_macro_var___.readMany(__VA_ARGS__);        \
+        return ___payload_local_macro_var___.readFields(__VA_ARGS__);      \
     }                                                                      \
     size_t __getFieldsSize(k2::Payload& ___payload_local_macro_var___) {   \
         return ___payload_local_macro_var___.getFieldsSize(__VA_ARGS__);   \
@@ -220,4 +220,20 @@ void ExponentialHistogram::add(double sample) {
     _histogram.sample_count += 1;           // global count
     _histogram.sample_sum += sample;        // global sum
 }
+
+double ExponentialHistogram::percentile(double pct) const {
+    if (_histogram.sample_count == 0) {
+        return 0;
+    }
+    // the rank of the sample we're looking for, counting from 1
+    uint64_t rank = std::max(uint64_t(1), uint64_t(std::ceil(_histogram.sample_count * pct / 100)));
+    uint64_t total = 0;
+    for (auto& bucket: _histogram.buckets) {
+        total += bucket.count;
+        if (total >= rank) {
+            return bucket.upper_bound;
+        }
+    }
+    return _histogram.buckets.back().upper_bound;
+}
 }// namespace k2
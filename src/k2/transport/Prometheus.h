@@ -168,6 +168,10 @@ public:
         add(sample_usecs.count());
     }
 
+    // Returns the upper bound of the bucket which holds the given percentile(0..100) of the samples, or 0 if there
+    // are no samples
+    double percentile(double pct) const;
+
 private:
     double _rate;
     double _lograte;
@@ -86,6 +86,7 @@ void RPCDispatcher::registerMessageObserver(Verb verb, RequestObserver_t observe
     K2LOG_D(log::tx, "registering message observer for verb: {}", int(verb));
     if (observer == nullptr) {
         _observers.erase(verb);
+        _rejectReplies.erase(verb);
         K2LOG_D(log::tx, "Removing message observer for verb: {}", int(verb));
         return;
     }
@@ -102,6 +103,45 @@ void RPCDispatcher::registerMessageObserver(Verb verb, RequestObserver_t observe
 
 void RPCDispatcher::start() {
     K2LOG_D(log::tx, "start");
+    _registerMetrics();
+}
+
+void RPCDispatcher::_registerMetrics() {
+    namespace sm = seastar::metrics;
+    _metricGroups.clear();
+    std::vector<sm::label_instance> labels;
+    labels.push_back(sm::label_instance("total_cores", seastar::smp::count));
+
+    _metricGroups.add_group("rpc_window", {
+        sm::make_gauge("queue_depth", [this] {
+                size_t depth = 0;
+                for (auto& [url, flow] : _flows) depth += flow.window.queued();
+                return depth;
+            }, sm::description("Number of requests queued for a slot in the window of their endpoint"), labels),
+        sm::make_gauge("in_flight", [this] {
+                size_t inFlight = 0;
+                for (auto& [url, flow] : _flows) inFlight += flow.window.inFlight();
+                return inFlight;
+            }, sm::description("Number of requests in flight in endpoint windows"), labels),
+        sm::make_counter("window_decreases", [this] {
+                uint64_t decreases = 0;
+                for (auto& [url, flow] : _flows) decreases += flow.window.decreases();
+                return decreases;
+            }, sm::description("Number of times an endpoint window was decreased due to slow responses or timeouts"), labels),
+        sm::make_counter("queued_requests", _queuedRequests, sm::description("Number of requests which had to wait for a slot in the window of their endpoint"), labels),
+        sm::make_counter("rejected_requests", _rejectedRequests, sm::description("Number of requests rejected because the queue of their endpoint was full"), labels),
+        sm::make_counter("expired_requests", _expiredRequests, sm::description("Number of requests which timed out while queued, and were never sent"), labels),
+        sm::make_histogram("queue_wait", [this]{ return _queueWait.getHistogram();},
+                sm::description("Time requests spent queued for a slot in the window of their endpoint, in usecs"), labels),
+    });
+
+    _metricGroups.add_group("rpc_admission", {
+        sm::make_gauge("outstanding_requests", _outstandingRequests, sm::description("Number of incoming requests being handled"), labels),
+        sm::make_gauge("handler_latency", [this] { return k2::usec(_handlerLatency).count(); },
+                sm::description("Moving average of the time to handle incoming requests, in usecs"), labels),
+        sm::make_counter("expired_requests", _droppedExpiredRequests, sm::description("Number of incoming requests dropped since their sender's deadline had passed, or would pass before we could handle them"), labels),
+        sm::make_counter("shed_requests", _shedRequests, sm::description("Number of incoming requests rejected due to overload"), labels),
+    });
 }
 
 seastar::future<> RPCDispatcher::stop() {
@@ -113,11 +153,14 @@ seastar::future<> RPCDispatcher::stop() {
     }
     _protocols.clear();
 
+    _metricGroups.clear();
+
     // complete all promises
     for(auto&& promise: _rrPromises) {
         promise.second.promise.set_exception(DispatcherShutdown());
     }
     _rrPromises.clear();
+    _flows.clear();
     return seastar::make_ready_future<>();
 }
 
@@ -136,12 +179,27 @@ void RPCDispatcher::_handleNewMessage(Request&& request) {
         // we have a response
         nodei->second.timer.cancel();
         nodei->second.promise.set_value(std::move(request.payload));
+        auto flow = nodei->second.inFlight ? nodei->second.flow : nullptr;
+        auto sentAt = nodei->second.sentAt;
         _rrPromises.erase(nodei);
+        if (flow) {
+            auto now = Clock::now();
+            flow->window.release(now - sentAt, now);
+            _sendQueued(*flow);
+        }
         return;
     }
+    if (request.metadata.isRequestIDSet()) {
+        if (!_admit(request)) {
+            return;
+        }
+    }
     auto iter = _observers.find(request.verb);
     if (iter != _observers.end()) {
         K2LOG_D(log::tx, "Dispatching request for verb={}, from ep={}", int(request.verb), request.endpoint.url);
+        if (request.metadata.isRequestIDSet() && _rejectReplies.count(request.verb)) {
+            ++_outstandingRequests;
+        }
         // TODO emit verb-dimension metric for duration of handling
         try {
             iter->second(std::move(request));
@@ -159,7 +217,8 @@ void RPCDispatcher::_handleNewMessage(Request&& request) {
 
 
 seastar::future<>
-RPCDispatcher::_send(Verb verb, std::unique_ptr<Payload> payload, TXEndpoint& endpoint, MessageMetadata meta) {
+RPCDispatcher::_send(Verb verb, std::unique_ptr<Payload> payload, TXEndpoint& endpoint, MessageMetadata meta,
+                     std::optional<uint64_t> orderingKey) {
     auto ep = RPC().getServerEndpoint(endpoint.protocol);
     auto protoi = _protocols.find(endpoint.protocol);
     if (protoi == _protocols.end()) {
@@ -192,7 +251,12 @@ RPCDispatcher::_send(Verb verb, std::unique_ptr<Payload> payload, TXEndpoint& en
             return seastar::make_ready_future<>();
         }
     }
-    protoi->second->send(verb, std::move(payload), endpoint, std::move(meta));
+    if (orderingKey) {
+        protoi->second->sendOrdered(verb, std::move(payload), endpoint, std::move(meta), *orderingKey);
+    }
+    else {
+        protoi->second->send(verb, std::move(payload), endpoint, std::move(meta));
+    }
     return seastar::make_ready_future<>();
 }
 
@@ -203,21 +267,67 @@ RPCDispatcher::send(Verb verb, std::unique_ptr<Payload> payload, TXEndpoint& end
     return _send(verb, std::move(payload), endpoint, std::move(metadata));
 }
 
+seastar::future<>
+RPCDispatcher::send(Verb verb, std::unique_ptr<Payload> payload, TXEndpoint& endpoint, uint64_t orderingKey) {
+    MessageMetadata metadata;
+    return _send(verb, std::move(payload), endpoint, std::move(metadata), orderingKey);
+}
+
 seastar::future<>
 RPCDispatcher::setAddressCore(std::pair<String, int> url_core) {
     _url_cores.insert(std::move(url_core));
     return seastar::make_ready_future<>();
 }
 
+bool RPCDispatcher::_admit(Request& request) {
+    if (request.receivedAt >= request.deadline) {
+        K2LOG_D(log::tx, "dropping expired request for verb={}, from ep={}", int(request.verb), request.endpoint.url);
+        ++_droppedExpiredRequests;
+        return false;
+    }
+    // we look at the latency only while there are requests being handled, so that we start admitting requests
+    // again once the ones which made us slow are done
+    bool overloaded = (_shedMaxOutstanding() > 0 && _outstandingRequests >= _shedMaxOutstanding()) ||
+        (_shedMaxLatency() > 0us && _outstandingRequests > 0 && _handlerLatency >= _shedMaxLatency());
+    if (!overloaded) {
+        return true;
+    }
+    if (request.deadline - request.receivedAt < _handlerLatency) {
+        // the sender will likely give up before we can handle this request
+        K2LOG_D(log::tx, "dropping request which will likely expire for verb={}, from ep={}", int(request.verb), request.endpoint.url);
+        ++_droppedExpiredRequests;
+        return false;
+    }
+    // we can only reject requests for RPC verbs, since we don't know how to build replies for other messages
+    auto rejecti = _rejectReplies.find(request.verb);
+    if (rejecti == _rejectReplies.end() || !request.metadata.isPrioritySet() || request.metadata.priority < _shedPriority()) {
+        return true;
+    }
+    K2LOG_D(log::tx, "shedding request for verb={}, priority={}, from ep={}", int(request.verb), request.metadata.priority, request.endpoint.url);
+    ++_shedRequests;
+    MessageMetadata metadata;
+    metadata.setResponseID(request.metadata.requestID);
+    auto reply = rejecti->second(request.endpoint, Statuses::S503_Service_Unavailable("server overloaded"));
+    (void)_send(InternalVerbs::NIL, std::move(reply), request.endpoint, std::move(metadata));
+    return false;
+}
+
 seastar::future<>
 RPCDispatcher::sendReply(std::unique_ptr<Payload> payload, Request& forRequest) {
+    if (_rejectReplies.count(forRequest.verb)) {
+        if (_outstandingRequests > 0) {
+            --_outstandingRequests;
+        }
+        _handlerLatency += (Duration(Clock::now() - forRequest.receivedAt) - _handlerLatency) / 8;
+    }
     MessageMetadata metadata;
     metadata.setResponseID(forRequest.metadata.requestID);
     return _send(InternalVerbs::NIL, std::move(payload), forRequest.endpoint, std::move(metadata));
 }
 
 seastar::future<std::unique_ptr<Payload>>
-RPCDispatcher::sendRequest(Verb verb, std::unique_ptr<Payload> payload, TXEndpoint& endpoint, Duration timeout) {
+RPCDispatcher::sendRequest(Verb verb, std::unique_ptr<Payload> payload, TXEndpoint& endpoint, Duration timeout,
+                           std::optional<uint8_t> priority) {
     uint64_t msgid = _msgSequenceID++;
     K2LOG_D(log::tx, "Request send with msgid={}, timeout={}, ep={}", msgid, timeout, endpoint.url);
 
@@ -226,6 +336,10 @@ RPCDispatcher::sendRequest(Verb verb, std::unique_ptr<Payload> payload, TXEndpoi
     // record the promise so that we can fulfil it if we get a response
     MessageMetadata metadata;
     metadata.setRequestID(msgid);
+    metadata.setDeadline(timeout);
+    if (priority) {
+        metadata.setPriority(*priority);
+    }
 
     seastar::timer<> timer([this, msgid] {
         // raise an exception in the promise for this request.
@@ -234,12 +348,49 @@ RPCDispatcher::sendRequest(Verb verb, std::unique_ptr<Payload> payload, TXEndpoi
         auto iter = this->_rrPromises.find(msgid);
         K2ASSERT(log::tx, iter != this->_rrPromises.end(), "unable to find promise for timer");
         iter->second.promise.set_exception(RequestTimeoutException());
+        auto flow = iter->second.flow;
+        bool inFlight = iter->second.inFlight;
         this->_rrPromises.erase(iter);
+        if (flow && inFlight) {
+            flow->window.releaseTimedOut(Clock::now());
+            this->_sendQueued(*flow);
+        }
+        else if (flow) {
+            // the request is still queued. It no longer counts as waiting, and is dropped from the queue when it
+            // reaches the front
+            flow->window.unqueue();
+            ++this->_expiredRequests;
+        }
     });
     timer.arm(timeout);
 
     auto fut = prom.get_future();
-    _rrPromises.emplace(msgid, ResponseTracker{std::move(prom), std::move(timer)});
+    auto [iter, inserted] = _rrPromises.emplace(msgid, ResponseTracker{std::move(prom), std::move(timer)});
+    (void)inserted;
+
+    auto flow = _getFlow(endpoint);
+    if (flow) {
+        auto& tracker = iter->second;
+        tracker.flow = flow;
+        if (flow->window.queued() == 0 && flow->window.tryAcquire()) {
+            tracker.inFlight = true;
+            tracker.sentAt = Clock::now();
+        }
+        else if (!flow->window.tryQueue(_rpcWindowMaxQueue())) {
+            K2LOG_D(log::tx, "rejecting request msgid={} to overloaded ep={}", msgid, endpoint.url);
+            ++_rejectedRequests;
+            tracker.timer.cancel();
+            tracker.promise.set_exception(EndpointOverloadedException());
+            _rrPromises.erase(iter);
+            return fut;
+        }
+        else {
+            ++_queuedRequests;
+            auto now = Clock::now();
+            flow->queue.push_back(QueuedRequest{msgid, verb, std::move(payload), endpoint, now, now + timeout, priority});
+            return fut;
+        }
+    }
 
     return _send(verb, std::move(payload), endpoint, std::move(metadata)).
     then([fut=std::move(fut)] () mutable {
@@ -249,6 +400,48 @@ RPCDispatcher::sendRequest(Verb verb, std::unique_ptr<Payload> payload, TXEndpoi
 
 }
 
+RPCDispatcher::EndpointFlow* RPCDispatcher::_getFlow(const TXEndpoint& endpoint) {
+    if (_rpcWindow() == 0) {
+        return nullptr;
+    }
+    auto iter = _flows.find(endpoint.url);
+    if (iter == _flows.end()) {
+        iter = _flows.emplace(endpoint.url, EndpointFlow{RPCWindow(_rpcWindow(), _rpcWindowMax(), _rpcWindowTargetLatency()), {}}).first;
+    }
+    return &iter->second;
+}
+
+void RPCDispatcher::_sendQueued(EndpointFlow& flow) {
+    while (!flow.queue.empty()) {
+        auto& front = flow.queue.front();
+        auto iter = _rrPromises.find(front.msgid);
+        if (iter == _rrPromises.end()) {
+            // timed out while queued
+            flow.queue.pop_front();
+            continue;
+        }
+        if (!flow.window.tryAcquire()) {
+            return;
+        }
+        flow.window.unqueue();
+        auto now = Clock::now();
+        iter->second.inFlight = true;
+        iter->second.sentAt = now;
+        _queueWait.add(k2::usec(now - front.queuedAt).count());
+
+        auto request = std::move(front);
+        flow.queue.pop_front();
+        MessageMetadata metadata;
+        metadata.setRequestID(request.msgid);
+        metadata.setDeadline(request.deadline - now);
+        if (request.priority) {
+            metadata.setPriority(*request.priority);
+        }
+        // _send completes right away: the message is handed over to the protocol before it returns
+        (void)_send(request.verb, std::move(request.payload), request.endpoint, std::move(metadata));
+    }
+}
+
 void RPCDispatcher::registerLowTransportMemoryObserver(LowTransportMemoryObserver_t observer) {
     K2LOG_D(log::tx, "register low mem observer");
     if (observer == nullptr) {
@@ -279,6 +472,15 @@ std::unique_ptr<TXEndpoint> RPCDispatcher::getTXEndpoint(String url) {
     return protoi->second->getTXEndpoint(std::move(url));
 }
 
+void RPCDispatcher::connect(TXEndpoint& endpoint) {
+    auto protoi = _protocols.find(endpoint.protocol);
+    if (protoi == _protocols.end()) {
+        K2LOG_W(log::tx, "Unsupported protocol: {}", endpoint.protocol);
+        return;
+    }
+    protoi->second->connect(endpoint);
+}
+
 seastar::lw_shared_ptr<TXEndpoint> RPCDispatcher::getServerEndpoint(const String& protocol) {
     auto protoi = _protocols.find(protocol);
     if (protoi == _protocols.end()) {
@@ -288,6 +490,14 @@ seastar::lw_shared_ptr<TXEndpoint> RPCDispatcher::getServerEndpoint(const String
     return protoi->second->getServerEndpoint();
 }
 
+seastar::shared_ptr<IRPCProtocol> RPCDispatcher::getProtocol(const String& protocol) {
+    auto protoi = _protocols.find(protocol);
+    if (protoi == _protocols.end()) {
+        return nullptr;
+    }
+    return protoi->second;
+}
+
 std::vector<seastar::lw_shared_ptr<TXEndpoint>> RPCDispatcher::getServerEndpoints() const {
     std::vector<seastar::lw_shared_ptr<TXEndpoint>> result;
     for(const auto& kvp : _protocols) {
@@ -24,12 +24,15 @@ Copyright(c) 2020 Futurewei Cloud
 #pragma once
 
 // stl
+#include <deque>
 #include <functional>
 #include <unordered_map>
 #include <exception>
+#include <optional>
 
 // third party
 #include <seastar/core/distributed.hh>
+#include <seastar/core/metrics_registration.hh>
 #include <seastar/core/shared_ptr.hh>
 #include <seastar/core/weak_ptr.hh>
 #include <seastar/util/reference_wrapper.hh> // for seastar::ref
@@ -37,7 +40,9 @@ Copyright(c) 2020 Futurewei Cloud
 // k2
 #include <k2/common/Common.h>
 #include <k2/config/Config.h>
+#include "Prometheus.h"
 #include "RPCProtocolFactory.h"
+#include "RPCWindow.h"
 #include "Request.h"
 #include "Status.h"
 #include "Log.h"
@@ -77,6 +82,11 @@ public: // types
         virtual const char* what() const noexcept override{ return "protocol not supported";}
     };
 
+    // raised in sendRequest when the request window of the endpoint is full and too many requests are queued for it
+    struct EndpointOverloadedException : public std::exception {
+        virtual const char* what() const noexcept override { return "Endpoint overloaded"; }
+    };
+
     // we use this to resolve promises for replies in the sendRequest call
     struct RequestTimeoutException : public std::exception {
         virtual const char* what() const noexcept override{ return "request timed out";}
@@ -127,9 +137,15 @@ public: // message-oriented API
     // returns blank pointer if we failed to parse the url or if the protocol is not supported
     std::unique_ptr<TXEndpoint> getTXEndpoint(String url);
 
+    // Establishes the connections to the given endpoint ahead of the first message sent there
+    void connect(TXEndpoint& endpoint);
+
     // Returns the listener endpoint for the given protocol (or empty pointer if not supported)
     seastar::lw_shared_ptr<TXEndpoint> getServerEndpoint(const String& protocol);
 
+    // Returns the protocol registered under the given name (or empty pointer if not supported)
+    seastar::shared_ptr<IRPCProtocol> getProtocol(const String& protocol);
+
     //  List all server endpoint supported by this dispatcher
     std::vector<seastar::lw_shared_ptr<TXEndpoint>> getServerEndpoints() const;
 
@@ -138,14 +154,27 @@ public: // message-oriented API
     // This is a lower-level API which is useful for sending messages that do not expect replies.
     seastar::future<> send(Verb verb, std::unique_ptr<Payload> payload, TXEndpoint& endpoint);
 
+    // Same as send() above, but the messages sent to the endpoint with the same ordering key are delivered in
+    // order and arrive from the same remote endpoint, even if the protocol spreads messages over many connections.
+    // Use it for a sequence of messages which the receiver relates to each other, e.g. by the sender's endpoint
+    seastar::future<> send(Verb verb, std::unique_ptr<Payload> payload, TXEndpoint& endpoint, uint64_t orderingKey);
+
     // Invokes the remote rpc for the given verb with the given payload. This is an asynchronous API. No guarantees
     // are made on the delivery of the payload.
     // This API is provided to allow users to send requests which expect replies (as opposed to send() above).
     // The method provides a future<> based callback support via the return value.
     // The future will complete with exception if the given timeout is reached before we receive a response.
     // if we receive a response after the timeout is reached, we will ignore it internally.
+    // If request windows are enabled (--rpc_window), at most a window's worth of requests are in flight to the
+    // endpoint. Further requests are queued and sent as responses come back. A queued request which reaches its
+    // timeout is failed with RequestTimeoutException without being sent, and a request which finds the queue
+    // full (--rpc_window_max_queue) is failed right away with EndpointOverloadedException
+    // The time left until the timeout is sent along with the request, so that the receiver can drop it once we
+    // have given up on it. The optional priority (0 is the highest, as in dto::TxnPriority) is sent as well, and
+    // is used by overloaded receivers to decide which requests to shed
     seastar::future<std::unique_ptr<Payload>>
-    sendRequest(Verb verb, std::unique_ptr<Payload> payload, TXEndpoint& endpoint, Duration timeout);
+    sendRequest(Verb verb, std::unique_ptr<Payload> payload, TXEndpoint& endpoint, Duration timeout,
+                std::optional<uint8_t> priority = std::nullopt);
 
     // Use this method to reply to a given Request, with the given payload. This method should be normally used
     // in message observers to respond to clients.
@@ -158,12 +187,13 @@ public: // message-oriented API
 public: // RPC-oriented interface. Small convenience so that users don't have to deal with Payloads directly
     // Same as sendRequest but for RPC types, not raw payloads
     template<class Request_t, class Response_t>
-    seastar::future<std::tuple<Status, Response_t>> callRPC(Verb verb, Request_t& request, TXEndpoint& endpoint, Duration timeout) {
+    seastar::future<std::tuple<Status, Response_t>> callRPC(Verb verb, Request_t& request, TXEndpoint& endpoint, Duration timeout,
+                                                            std::optional<uint8_t> priority = std::nullopt) {
         auto payload = endpoint.newPayload();
         payload->write(request);
         K2LOG_D(log::tx, "RPC Request call to endpoint: {}", endpoint.url);
 
-        return sendRequest(verb, std::move(payload), endpoint, timeout)
+        return sendRequest(verb, std::move(payload), endpoint, timeout, priority)
             .then([](std::unique_ptr<Payload>&& responsePayload) {
                 // parse status
                 auto result = std::make_tuple<Status, Response_t>(Status(), Response_t());
@@ -185,6 +215,9 @@ public: // RPC-oriented interface. Small convenience so that users don't have to
                 catch (const RPCDispatcher::RequestTimeoutException&) {
                     return std::make_tuple<Status, Response_t>(Statuses::S503_Service_Unavailable("client timed out"), Response_t());
                 }
+                catch (const RPCDispatcher::EndpointOverloadedException&) {
+                    return std::make_tuple<Status, Response_t>(Statuses::S503_Service_Unavailable("endpoint overloaded"), Response_t());
+                }
                 catch (const std::exception &e) {
                     K2LOG_E(log::tx, "RPC send failed with uncaught exception: {}", e.what());
                 }
@@ -198,8 +231,15 @@ public: // RPC-oriented interface. Small convenience so that users don't have to
 
     // Register a handler for requests of type Request_t. You are required to respond with an object of type Response_t
     // and a Status for your request
+    // Requests which are shed due to overload are answered with a 503 status without reaching the observer
     template <class Request_t, class Response_t>
     void registerRPCObserver(Verb verb, RPCRequestObserver_t<Request_t, Response_t> observer) {
+        _rejectReplies[verb] = [](TXEndpoint& endpoint, Status&& status) {
+            auto reply = endpoint.newPayload();
+            reply->write(status);
+            reply->write(Response_t{});
+            return reply;
+        };
         // wrap the RPC observer into a message observer
         registerMessageObserver(verb, [this, observer=std::move(observer)](Request&& request) mutable {
             // we're ignoring the returned future here so we can't wait for it before the rpc dispatcher exits
@@ -249,7 +289,21 @@ private:  // methods
     void _handleNewMessage(Request&& request);
 
     // Helper method useds to send messages
-    seastar::future<> _send(Verb verb, std::unique_ptr<Payload> payload, TXEndpoint& endpoint, MessageMetadata meta);
+    seastar::future<> _send(Verb verb, std::unique_ptr<Payload> payload, TXEndpoint& endpoint, MessageMetadata meta,
+                            std::optional<uint64_t> orderingKey=std::nullopt);
+
+    struct EndpointFlow;
+    // Returns the request flow for the given endpoint, or nullptr if request windows are disabled
+    EndpointFlow* _getFlow(const TXEndpoint& endpoint);
+
+    // Sends queued requests of the given flow while its window allows
+    void _sendQueued(EndpointFlow& flow);
+
+    void _registerMetrics();
+
+    // Admission control for incoming requests. Returns false if the request should not be dispatched, because it
+    // has expired or because we are overloaded and the request can be shed
+    bool _admit(Request& request);
 
 private: // fields
     // the protocols this dispatcher will be able to support
@@ -266,8 +320,33 @@ private: // fields
     struct ResponseTracker {
         PayloadPromise promise;
         seastar::timer<> timer;
+        // the flow of the endpoint the request was sent to, if request windows are enabled
+        EndpointFlow* flow = nullptr;
+        // set while the request holds a slot in the window of its flow, i.e. it was sent and not queued
+        bool inFlight = false;
+        TimePoint sentAt{};
+    };
+
+    // a request waiting for a slot in the window of its endpoint
+    struct QueuedRequest {
+        uint64_t msgid;
+        Verb verb;
+        std::unique_ptr<Payload> payload;
+        TXEndpoint endpoint;
+        TimePoint queuedAt;
+        TimePoint deadline;
+        std::optional<uint8_t> priority;
     };
 
+    // the request window and queue for one endpoint
+    struct EndpointFlow {
+        RPCWindow window;
+        std::deque<QueuedRequest> queue;
+    };
+
+    // flows by endpoint url
+    std::unordered_map<String, EndpointFlow> _flows;
+
     // map of all pending request-reply
     std::unordered_map<uint64_t, ResponseTracker> _rrPromises;
 
@@ -285,6 +364,37 @@ private: // don't need
     RPCDispatcher& operator=(RPCDispatcher&& o) = delete;
 
     ConfigVar<bool> _txUseCrossCoreLoopback{"tx_xcore_loopback", true};
+
+    // request windows. A window of 0 disables them. The window adapts to the observed response latency if a
+    // target latency is given. See RPCWindow
+    ConfigVar<uint64_t> _rpcWindow{"rpc_window", 0};
+    ConfigVar<uint64_t> _rpcWindowMax{"rpc_window_max", 1024};
+    ConfigDuration _rpcWindowTargetLatency{"rpc_window_target_latency", 0us};
+    ConfigVar<uint64_t> _rpcWindowMaxQueue{"rpc_window_max_queue", 10000};
+
+    // Admission control. Incoming requests are shed once either the number of requests being handled or the
+    // average time to handle them reaches the given limit (0 disables the limit). Only requests with a priority of
+    // rpc_shed_priority or lower (i.e. numerically greater or equal) are shed.
+    ConfigVar<uint64_t> _shedMaxOutstanding{"rpc_shed_max_outstanding", 0};
+    ConfigDuration _shedMaxLatency{"rpc_shed_max_latency", 0us};
+    ConfigVar<uint32_t> _shedPriority{"rpc_shed_priority", 128};
+
+    // builders of the replies to requests we reject, for verbs registered with registerRPCObserver
+    std::unordered_map<Verb, std::function<std::unique_ptr<Payload>(TXEndpoint&, Status&&)>> _rejectReplies;
+
+    // number of requests dispatched to RPC observers and not replied to yet
+    uint64_t _outstandingRequests{0};
+    // moving average of the time from receiving a request to replying to it
+    Duration _handlerLatency{0};
+
+    // request window and admission metrics
+    seastar::metrics::metric_groups _metricGroups;
+    uint64_t _droppedExpiredRequests{0};
+    uint64_t _shedRequests{0};
+    uint64_t _queuedRequests{0};
+    uint64_t _rejectedRequests{0};
+    uint64_t _expiredRequests{0};
+    k2::ExponentialHistogram _queueWait;
 };
 
 // global RPC dist container which can be initialized by main() of an application so that
@@ -63,11 +63,32 @@ bool MessageMetadata::isChecksumSet() const {
     return this->features & (1 << 3);  // bit3
 }
 
+void MessageMetadata::setDeadline(Duration remaining) {
+    auto usecs = std::max(int64_t(0), int64_t(k2::usec(remaining).count()));
+    this->deadlineUsecs = uint32_t(std::min(usecs, int64_t(std::numeric_limits<uint32_t>::max())));
+    this->features |= (1 << 4);  // bit4
+}
+
+bool MessageMetadata::isDeadlineSet() const {
+    return this->features & (1 << 4);  // bit4
+}
+
+void MessageMetadata::setPriority(uint8_t priority) {
+    this->priority = priority;
+    this->features |= (1 << 5);  // bit5
+}
+
+bool MessageMetadata::isPrioritySet() const {
+    return this->features & (1 << 5);  // bit5
+}
+
 size_t MessageMetadata::wireByteCount() {
     return isPayloadSizeSet() * sizeof(payloadSize) +
             isRequestIDSet() * sizeof(requestID) +
             isResponseIDSet() * sizeof(responseID) +
-            isChecksumSet() * sizeof(checksum);
+            isChecksumSet() * sizeof(checksum) +
+            isDeadlineSet() * sizeof(deadlineUsecs) +
+            isPrioritySet() * sizeof(priority);
 }
 
 } // namespace k2
@@ -57,6 +57,8 @@ constexpr uint8_t MAX_HEADER_SIZE = 128;
 // | 4          | RequestID       | The request message ID - short-term unique number
 // | 4          | ResponseID      | The response message ID - repeat from a previous msg.RequestID
 // | 4          | Checksum        | The optional checksum for the message
+// | 4          | Deadline        | The time the sender will wait for a response, in usecs, as of sending the message
+// | 1          | Priority        | The priority of the request. 0 is the highest, as in dto::TxnPriority
 //
 // Note that since the message is likely to be binaried, the payload will be stored and presented as
 // a Payload, which is basically an iovec which exposes the binaries for the payload.
@@ -92,6 +94,15 @@ public: // API
     void setChecksum(uint32_t checksum);
     bool isChecksumSet() const;
 
+    // deadline at position 4. We send the time remaining until the deadline rather than the deadline itself, since
+    // clocks aren't synchronized across hosts. Durations which don't fit are capped
+    void setDeadline(Duration remaining);
+    bool isDeadlineSet() const;
+
+    // priority at position 5
+    void setPriority(uint8_t priority);
+    bool isPrioritySet() const;
+
     // this method is used to determine how many wire bytes are needed given the set features
     size_t wireByteCount();
 
@@ -101,6 +112,8 @@ public: // fields
     uint32_t requestID = 0;
     uint32_t responseID = 0;
     uint32_t checksum = 0;
+    uint32_t deadlineUsecs = 0;
+    uint8_t priority = 0;
     // MAYBE TODO  crypto, sender endpoint
 };
 } // k2
@@ -97,11 +97,47 @@ bool RPCParser::writeHeader(Binary& binary, Verb verb, MessageMetadata meta) {
         if (!appendRaw(binary, writeOffset, meta.checksum))
             return false;
     }
+    if (meta.isDeadlineSet()) {
+        if (!appendRaw(binary, writeOffset, meta.deadlineUsecs))
+            return false;
+    }
+    if (meta.isPrioritySet()) {
+        if (!appendRaw(binary, writeOffset, meta.priority))
+            return false;
+    }
     // all done.
 
     return true;
 }
 
+const char* RPCParser::_readVariableHeader(MessageMetadata& meta, const char* data) {
+    if (meta.isPayloadSizeSet()) {
+        std::memcpy((char*)&meta.payloadSize, data, sizeof(meta.payloadSize));
+        data += sizeof(meta.payloadSize);
+    }
+    if (meta.isRequestIDSet()) {
+        std::memcpy((char*)&meta.requestID, data, sizeof(meta.requestID));
+        data += sizeof(meta.requestID);
+    }
+    if (meta.isResponseIDSet()) {
+        std::memcpy((char*)&meta.responseID, data, sizeof(meta.responseID));
+        data += sizeof(meta.responseID);
+    }
+    if (meta.isChecksumSet()) {
+        std::memcpy((char*)&meta.checksum, data, sizeof(meta.checksum));
+        data += sizeof(meta.checksum);
+    }
+    if (meta.isDeadlineSet()) {
+        std::memcpy((char*)&meta.deadlineUsecs, data, sizeof(meta.deadlineUsecs));
+        data += sizeof(meta.deadlineUsecs);
+    }
+    if (meta.isPrioritySet()) {
+        std::memcpy((char*)&meta.priority, data, sizeof(meta.priority));
+        data += sizeof(meta.priority);
+    }
+    return data;
+}
+
 void RPCParser::registerMessageObserver(MessageObserver_t messageObserver) {
     if (messageObserver == nullptr) {
         _messageObserver = [](Verb verb, MessageMetadata, std::unique_ptr<Payload>) {
@@ -183,16 +219,61 @@ void RPCParser::_parseAndDispatchOne() {
     }
 }
 
+bool RPCParser::_parseWholeMessage() {
+    auto available = _currentBinary.size();
+    if (available < sizeof(FixedHeader)) {
+        return false;
+    }
+    const char* data = _currentBinary.get();
+    FixedHeader fixedHeader;
+    std::memcpy((char*)&fixedHeader, data, sizeof(fixedHeader));
+    if (fixedHeader.magic != txconstants::K2RPCMAGIC) {
+        return false;  // the regular path reports the failure
+    }
+
+    MessageMetadata metadata;
+    metadata.features = fixedHeader.features;
+    size_t headerSize = sizeof(fixedHeader) + metadata.wireByteCount();
+    if (available < headerSize) {
+        return false;
+    }
+    _readVariableHeader(metadata, data + sizeof(fixedHeader));
+    size_t payloadSize = metadata.isPayloadSizeSet() ? metadata.payloadSize : 0;
+    if (available - headerSize < payloadSize) {
+        return false;
+    }
+
+    _fixedHeader = fixedHeader;
+    _metadata = metadata;
+    if (metadata.isPayloadSizeSet()) {
+        // a single slice of the incoming binary. The data is shared, not copied
+        _payload = std::make_unique<Payload>();
+        if (payloadSize > 0) {
+            _payload->appendBinary(_currentBinary.share(headerSize, payloadSize));
+            _updatePayloadCrc(data + headerSize, payloadSize);
+        }
+    }
+    _currentBinary.trim_front(headerSize + payloadSize);
+    _pState = ParseState::READY_TO_DISPATCH;
+    return true;
+}
+
 void RPCParser::_stWAIT_FOR_FIXED_HEADER() {
     // we come to this state when we think we have enough data to parse a new message from
     // the current binary.
     _payload.reset();  // get rid of any previous payload
+    _payloadCrc = 0;
 
     if (_currentBinary.size() == 0) {
         _shouldParse = false;  // stop trying to parse
         return;                // nothing to do - no new data, so remain in this state waiting for new data
     }
 
+    // common case: the entire message is in the current binary
+    if (_parseWholeMessage()) {
+        return;
+    }
+
     if (_currentBinary.size() < sizeof(_fixedHeader)) {
         // we have some new data, but not enough to parse the fixed header. move it to the partial segment
         // and setup for state change to IN_PARTIAL_FIXED_HEADER
@@ -228,24 +309,28 @@ void RPCParser::_stIN_PARTIAL_FIXED_HEADER() {
     auto curSize = _currentBinary.size();
     auto totalNeed = sizeof(_fixedHeader);
 
-    // 1. copy whatever was left in the partial binary
-    std::memcpy((char*)&_fixedHeader, _partialBinary.get_write(), partSize);
-    // done with the partial binary.
-    std::move(_partialBinary).prefix(0);
-
     // check to make sure we have enough data in the incoming binary
     if (curSize < totalNeed - partSize) {
-        K2LOG_W(log::tx, "Received continuation segment which doesn't have enough data: {}, total: {}, have: {}",
-            curSize, totalNeed, partSize);
-        _setParserFailure(NonContinuationSegmentException());
+        K2LOG_D(log::tx, "Fixed header continues past segment: {}, total: {}, have: {}", curSize, totalNeed, partSize);
+        _extendPartialBinary();
         return;
     }
 
+    // 1. copy whatever was left in the partial binary
+    std::memcpy((char*)&_fixedHeader, _partialBinary.get_write(), partSize);
+    // done with the partial binary.
+    std::move(_partialBinary).prefix(0);
+
     // and copy the rest of what we need from the current binary
     std::memcpy((char*)&_fixedHeader + partSize, _currentBinary.get_write(), totalNeed - partSize);
     // rewind the current binary
     _currentBinary.trim_front(totalNeed - partSize);
 
+    if (_fixedHeader.magic != txconstants::K2RPCMAGIC) {
+        K2LOG_W(log::tx, "Received message with magic bit mismatch: {} vs {}", int(_fixedHeader.magic), int(txconstants::K2RPCMAGIC));
+        _setParserFailure(MagicMismatchException());
+        return;
+    }
     _pState = WAIT_FOR_VARIABLE_HEADER;  // onto getting the variable header
 }
 
@@ -272,22 +357,8 @@ void RPCParser::_stWAIT_FOR_VARIABLE_HEADER() {
     // if we came here, we either don't need any bytes, or we have all the bytes we need in _currentBinary
 
     // now for variable stuff
-    if (_metadata.isPayloadSizeSet()) {
-        std::memcpy((char*)&_metadata.payloadSize, _currentBinary.get_write(), sizeof(_metadata.payloadSize));
-        _currentBinary.trim_front(sizeof(_metadata.payloadSize));
-    }
-    if (_metadata.isRequestIDSet()) {
-        std::memcpy((char*)&_metadata.requestID, _currentBinary.get_write(), sizeof(_metadata.requestID));
-        _currentBinary.trim_front(sizeof(_metadata.requestID));
-    }
-    if (_metadata.isResponseIDSet()) {
-        std::memcpy((char*)&_metadata.responseID, _currentBinary.get_write(), sizeof(_metadata.responseID));
-        _currentBinary.trim_front(sizeof(_metadata.responseID));
-    }
-    if (_metadata.isChecksumSet()) {
-        std::memcpy((char*)&_metadata.checksum, _currentBinary.get_write(), sizeof(_metadata.checksum));
-        _currentBinary.trim_front(sizeof(_metadata.checksum));
-    }
+    _readVariableHeader(_metadata, _currentBinary.get());
+    _currentBinary.trim_front(needBytes);
     _pState = ParseState::WAIT_FOR_PAYLOAD;  // onto getting the payload
 }
 
@@ -305,10 +376,8 @@ void RPCParser::_stIN_PARTIAL_VARIABLE_HEADER() {
     auto totalNeed = _metadata.wireByteCount();
 
     if (totalNeed > partSize + curSize) {
-        K2LOG_W(log::tx,
-        "Received partial variable header continuation segment which doesn't have enough data: cursz={}, total={}, have={}",
-        curSize, totalNeed, partSize);
-        _setParserFailure(NonContinuationSegmentException());
+        K2LOG_D(log::tx, "Variable header continues past segment: cursz={}, total={}, have={}", curSize, totalNeed, partSize);
+        _extendPartialBinary();
         return;
     }
     K2ASSERT(log::tx, totalNeed <= txconstants::MAX_HEADER_SIZE, "invalid needed bytes determined: {}", totalNeed);
@@ -325,25 +394,20 @@ void RPCParser::_stIN_PARTIAL_VARIABLE_HEADER() {
     _currentBinary.trim_front(totalNeed - partSize);
 
     // now set the variable fields
-    if (_metadata.isPayloadSizeSet()) {
-        std::memcpy((char*)&_metadata.payloadSize, data, sizeof(_metadata.payloadSize));
-        data += sizeof(_metadata.payloadSize);
-    }
-    if (_metadata.isRequestIDSet()) {
-        std::memcpy((char*)&_metadata.requestID, data, sizeof(_metadata.requestID));
-        data += sizeof(_metadata.requestID);
-    }
-    if (_metadata.isResponseIDSet()) {
-        std::memcpy((char*)&_metadata.responseID, data, sizeof(_metadata.responseID));
-        data += sizeof(_metadata.responseID);
-    }
-    if (_metadata.isChecksumSet()) {
-        std::memcpy((char*)&_metadata.checksum, data, sizeof(_metadata.checksum));
-        data += sizeof(_metadata.checksum);
-    }
+    _readVariableHeader(_metadata, data);
     _pState = ParseState::WAIT_FOR_PAYLOAD;  // onto getting the payload
 }
 
+void RPCParser::_extendPartialBinary() {
+    // headers are small, so it is cheap to copy the pieces we have so far into one binary
+    Binary combined(_partialBinary.size() + _currentBinary.size());
+    std::memcpy(combined.get_write(), _partialBinary.get(), _partialBinary.size());
+    std::memcpy(combined.get_write() + _partialBinary.size(), _currentBinary.get(), _currentBinary.size());
+    _partialBinary = std::move(combined);
+    std::move(_currentBinary).prefix(0);
+    _shouldParse = false;  // wait for more data in the same state
+}
+
 void RPCParser::_stWAIT_FOR_PAYLOAD() {
     // check to see if we're expecting payload
     if (!_metadata.isPayloadSizeSet()) {
@@ -373,17 +437,20 @@ void RPCParser::_stWAIT_FOR_PAYLOAD() {
     auto bytesThisRound = std::min(needed, available);
     // last case, we have more data than we need. Extract a slice from the binary
     _payload->appendBinary(_currentBinary.share(0, bytesThisRound));
+    _updatePayloadCrc(_currentBinary.get(), bytesThisRound);
     // rewind the binary
     _currentBinary.trim_front(bytesThisRound);
 }
 
 void RPCParser::_stREADY_TO_DISPATCH() {
     if (_useChecksum && _payload && _metadata.isChecksumSet()) {
-        auto checksum = _payload->computeCrc32c();
-        if (checksum != _metadata.checksum) {
+        // the checksum was computed as the payload fragments came in
+        if (_payloadCrc != _metadata.checksum) {
             _setParserFailure(ChecksumValidationException());
             return;
         }
+        // let the users of the payload reuse the checksum, e.g. when persisting it
+        _payload->setCrc32c(_payloadCrc);
     }
     _messageObserver(_fixedHeader.verb, std::move(_metadata), std::move(_payload));
 
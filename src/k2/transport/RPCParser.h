@@ -31,6 +31,7 @@ Copyright(c) 2020 Futurewei Cloud
 #include "RPCHeader.h"
 #include <k2/common/Common.h>
 #include <k2/logging/Log.h>
+#include "Crc32c.h"
 #include "Payload.h"
 #include "Status.h"
 
@@ -134,6 +135,26 @@ private: // methods
 
     void _setParserFailure(std::exception&& exc);
 
+    // Fast path used when the current binary holds an entire message: parses the headers in place, slices the
+    // payload out of the binary and moves straight to READY_TO_DISPATCH. Returns false, without consuming
+    // anything, if the message isn't complete
+    bool _parseWholeMessage();
+
+    // Extends the checksum of the current payload with a newly received fragment, while the fragment is still hot.
+    // Only done if the message carries a checksum which we have to validate
+    void _updatePayloadCrc(const char* data, size_t size) {
+        if (_useChecksum && _metadata.isChecksumSet()) {
+            _payloadCrc = crc32cExtend(_payloadCrc, data, size);
+        }
+    }
+
+    // A header continues past the current binary. Appends the current binary to the partial one
+    void _extendPartialBinary();
+
+    // reads the variable header fields which are set in the given metadata from the given contiguous data.
+    // Returns a pointer just past the fields we read
+    static const char* _readVariableHeader(MessageMetadata& meta, const char* data);
+
     static bool append(Binary& binary, size_t& writeOffset, const void* data, size_t size);
 
     template <typename T>
@@ -171,7 +192,10 @@ private: // methods
     // the payload for the current message;
     std::unique_ptr<Payload> _payload;
 
-    // partial binary left over from previous parsing. Only used when header(variable or fixed) spans two binarys
+    // running crc32c of the payload data we've received so far for the current message
+    uint32_t _payloadCrc{0};
+
+    // partial binary left over from previous parsing. Only used when a header(variable or fixed) spans binaries
     Binary _partialBinary;
 
     // current incoming binary
@@ -0,0 +1,108 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#include "RPCWindow.h"
+
+namespace k2 {
+
+RPCWindow::RPCWindow(size_t initialSize, size_t maxSize, Duration targetLatency) :
+    _size(std::max(size_t(1), initialSize)),
+    _maxSize(std::max(std::max(size_t(1), initialSize), maxSize)),
+    _targetLatency(targetLatency) {
+}
+
+bool RPCWindow::tryAcquire() {
+    if (_inFlight >= size()) {
+        return false;
+    }
+    ++_inFlight;
+    return true;
+}
+
+void RPCWindow::release(Duration latency, TimePoint now) {
+    if (_inFlight > 0) {
+        --_inFlight;
+    }
+    if (_targetLatency == Duration::zero()) {
+        return;
+    }
+    if (latency > _targetLatency) {
+        _decrease(now);
+    }
+    else {
+        // additive increase: one slot per window's worth of fast responses
+        _size = std::min(double(_maxSize), _size + 1.0 / _size);
+    }
+}
+
+void RPCWindow::releaseTimedOut(TimePoint now) {
+    if (_inFlight > 0) {
+        --_inFlight;
+    }
+    if (_targetLatency != Duration::zero()) {
+        _decrease(now);
+    }
+}
+
+bool RPCWindow::tryQueue(size_t maxQueued) {
+    if (_queued >= maxQueued) {
+        return false;
+    }
+    ++_queued;
+    return true;
+}
+
+void RPCWindow::unqueue() {
+    if (_queued > 0) {
+        --_queued;
+    }
+}
+
+void RPCWindow::_decrease(TimePoint now) {
+    if (_decreases > 0 && now - _lastDecrease < _targetLatency) {
+        // we already reacted to this round of slow responses
+        return;
+    }
+    _size = std::max(1.0, _size / 2);
+    _lastDecrease = now;
+    ++_decreases;
+}
+
+size_t RPCWindow::size() const {
+    return size_t(_size);
+}
+
+size_t RPCWindow::inFlight() const {
+    return _inFlight;
+}
+
+size_t RPCWindow::queued() const {
+    return _queued;
+}
+
+uint64_t RPCWindow::decreases() const {
+    return _decreases;
+}
+
+} // namespace k2
@@ -0,0 +1,84 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <k2/common/Common.h>
+
+namespace k2 {
+
+// The admission window for requests sent to a single endpoint. It bounds the number of requests which are in flight
+// (sent and not yet answered or timed out). The window is either fixed, or adaptive: it grows additively
+// (by about one request per window's worth of responses) while the observed response latency stays under the
+// target latency, and it is halved when responses come slower than the target, or time out. Decreases are spaced
+// at least one target latency apart, so that a single slow round of responses only halves the window once.
+// The window is only the accounting. Requests which can't be admitted are queued by the RPCDispatcher, and the
+// window counts the ones which are still waiting, so that requests which timed out while queued don't take up room
+// in the queue until they reach its front
+class RPCWindow {
+public:
+    // a window of the given initial size, which never grows past maxSize. With a targetLatency of 0, the
+    // window is fixed at its initial size
+    RPCWindow(size_t initialSize, size_t maxSize, Duration targetLatency);
+
+    // takes a slot in the window for a new request. Returns false if the window is full
+    bool tryAcquire();
+
+    // releases the slot of a request which completed after the given latency
+    void release(Duration latency, TimePoint now);
+
+    // releases the slot of a request which timed out
+    void releaseTimedOut(TimePoint now);
+
+    // counts a request queued for a slot in the window. Returns false if maxQueued requests are waiting already
+    bool tryQueue(size_t maxQueued);
+
+    // a queued request stopped waiting, either because it got a slot or because it timed out
+    void unqueue();
+
+    // number of queued requests which are still waiting for a slot
+    size_t queued() const;
+
+    // the current window size
+    size_t size() const;
+
+    // number of requests in flight
+    size_t inFlight() const;
+
+    // number of times the window was decreased
+    uint64_t decreases() const;
+
+private:
+    void _decrease(TimePoint now);
+
+    double _size;
+    size_t _maxSize;
+    Duration _targetLatency;
+    size_t _inFlight{0};
+    size_t _queued{0};
+    TimePoint _lastDecrease{};
+    uint64_t _decreases{0};
+};
+
+} // namespace k2
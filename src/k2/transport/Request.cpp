@@ -31,7 +31,9 @@ Request::Request(Verb verb, TXEndpoint& endpoint, MessageMetadata metadata, std:
     verb(verb),
     endpoint(endpoint),
     metadata(std::move(metadata)),
-    payload(std::move(payload)) {
+    payload(std::move(payload)),
+    receivedAt(Clock::now()),
+    deadline(this->metadata.isDeadlineSet() ? receivedAt + 1us * this->metadata.deadlineUsecs : TimePoint::max()) {
     K2LOG_D(log::tx, "ctor Request @{}, with verb={}, from {}", ((void*)this), int(verb), endpoint.url);
 }
 
@@ -43,7 +45,9 @@ Request::Request(Request&& o):
     verb(o.verb),
     endpoint(std::move(o.endpoint)),
     metadata(std::move(o.metadata)),
-    payload(std::move(o.payload)) {
+    payload(std::move(o.payload)),
+    receivedAt(o.receivedAt),
+    deadline(o.deadline) {
     o.verb = InternalVerbs::NIL;
     K2LOG_D(log::tx, "move Request @{}, with verb={}, from {}", ((void*)this), int(verb), endpoint.url);
 }
@@ -57,6 +57,12 @@ public: // fields
     // the payload of this request
     std::unique_ptr<Payload> payload;
 
+    // when we received the request
+    TimePoint receivedAt;
+
+    // the deadline of the sender, if it sent one (see MessageMetadata::setDeadline). TimePoint::max() otherwise
+    TimePoint deadline;
+
 private: // don't need
     Request() = delete;
     Request(const Request& o) = delete;
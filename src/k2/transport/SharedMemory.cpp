@@ -0,0 +1,106 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#include "SharedMemory.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <system_error>
+#include <utility>
+
+namespace k2 {
+
+ShmSegment ShmSegment::create(const String& name, size_t size) {
+    ::shm_unlink(name.c_str());
+    int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "unable to create shared memory segment " + name);
+    }
+    if (::ftruncate(fd, size) != 0) {
+        auto err = errno;
+        ::close(fd);
+        ::shm_unlink(name.c_str());
+        throw std::system_error(err, std::generic_category(), "unable to size shared memory segment " + name);
+    }
+    void* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    auto err = errno;
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        ::shm_unlink(name.c_str());
+        throw std::system_error(err, std::generic_category(), "unable to map shared memory segment " + name);
+    }
+    return ShmSegment(static_cast<char*>(data), size);
+}
+
+ShmSegment ShmSegment::open(const String& name) {
+    int fd = ::shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            return ShmSegment();
+        }
+        throw std::system_error(errno, std::generic_category(), "unable to open shared memory segment " + name);
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        auto err = errno;
+        ::close(fd);
+        throw std::system_error(err, std::generic_category(), "unable to stat shared memory segment " + name);
+    }
+    void* data = ::mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    auto err = errno;
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        throw std::system_error(err, std::generic_category(), "unable to map shared memory segment " + name);
+    }
+    return ShmSegment(static_cast<char*>(data), st.st_size);
+}
+
+void ShmSegment::unlink(const String& name) {
+    ::shm_unlink(name.c_str());
+}
+
+ShmSegment::ShmSegment(ShmSegment&& o) : _data(std::exchange(o._data, nullptr)), _size(std::exchange(o._size, 0)) {
+}
+
+ShmSegment& ShmSegment::operator=(ShmSegment&& o) {
+    if (this != &o) {
+        if (_data) {
+            ::munmap(_data, _size);
+        }
+        _data = std::exchange(o._data, nullptr);
+        _size = std::exchange(o._size, 0);
+    }
+    return *this;
+}
+
+ShmSegment::~ShmSegment() {
+    if (_data) {
+        ::munmap(_data, _size);
+    }
+}
+
+} // namespace k2
@@ -0,0 +1,139 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+#include <k2/common/Common.h>
+#include "Log.h"
+
+namespace k2 {
+
+// A POSIX shared memory segment (shm_open + mmap). The segment is unmapped when this object is destroyed.
+// Segments are identified by name across processes on the same host. Errors are reported via std::system_error
+class ShmSegment {
+public:
+    // Creates a new zero-filled segment with the given name and size. Any existing segment with the same name is replaced
+    static ShmSegment create(const String& name, size_t size);
+
+    // Maps the existing segment with the given name. Returns an empty segment if there is no such segment
+    static ShmSegment open(const String& name);
+
+    // Removes the given name. Processes which have the segment mapped can keep using it
+    static void unlink(const String& name);
+
+    ShmSegment() = default;
+    ShmSegment(ShmSegment&& o);
+    ShmSegment& operator=(ShmSegment&& o);
+    ~ShmSegment();
+
+    char* data() const { return _data; }
+    size_t size() const { return _size; }
+    explicit operator bool() const { return _data != nullptr; }
+
+private:
+    ShmSegment(char* data, size_t size) : _data(data), _size(size) {}
+    ShmSegment(const ShmSegment&) = delete;
+    ShmSegment& operator=(const ShmSegment&) = delete;
+
+    char* _data{nullptr};
+    size_t _size{0};
+};
+
+// A single-producer/single-consumer ring of bytes, which is placed in shared memory.
+// The producer and the consumer may be in different processes. The ring carries a stream of bytes, so
+// writes and reads may be partial. The data follows the ring object in memory.
+class ShmRing {
+public:
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory rings need lock-free atomics");
+
+    // the number of bytes needed to place a ring with the given capacity
+    static size_t sizeFor(uint64_t capacity) { return sizeof(ShmRing) + capacity; }
+
+    // Initializes a new ring in the given memory, which must be at least sizeFor(capacity) bytes.
+    // The capacity must be a power of 2
+    static ShmRing* init(void* mem, uint64_t capacity) {
+        K2ASSERT(log::tx, capacity > 0 && (capacity & (capacity - 1)) == 0, "ring capacity must be a power of 2: {}", capacity);
+        auto ring = new (mem) ShmRing();
+        ring->_capacity = capacity;
+        return ring;
+    }
+
+    // Attaches to a ring which was initialized by another process
+    static ShmRing* attach(void* mem) { return static_cast<ShmRing*>(mem); }
+
+    uint64_t capacity() const { return _capacity; }
+
+    // the number of bytes which can be read
+    size_t readable() const {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_relaxed);
+    }
+
+    // the number of bytes which can be written
+    size_t writable() const {
+        return _capacity - (_head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_acquire));
+    }
+
+    // Producer only. Writes up to len bytes and returns the number of bytes written
+    size_t write(const char* src, size_t len) {
+        auto head = _head.load(std::memory_order_relaxed);
+        len = std::min(len, writable());
+        auto pos = head & (_capacity - 1);
+        auto first = std::min(len, _capacity - pos);
+        std::memcpy(_data() + pos, src, first);
+        std::memcpy(_data(), src + first, len - first);
+        _head.store(head + len, std::memory_order_release);
+        return len;
+    }
+
+    // Consumer only. Reads up to len bytes and returns the number of bytes read
+    size_t read(char* dst, size_t len) {
+        auto tail = _tail.load(std::memory_order_relaxed);
+        len = std::min(len, readable());
+        auto pos = tail & (_capacity - 1);
+        auto first = std::min(len, _capacity - pos);
+        std::memcpy(dst, _data() + pos, first);
+        std::memcpy(dst + first, _data(), len - first);
+        _tail.store(tail + len, std::memory_order_release);
+        return len;
+    }
+
+private:
+    ShmRing() = default;
+    char* _data() { return reinterpret_cast<char*>(this + 1); }
+
+    // the producer and the consumer positions are on separate cache lines so that they don't contend
+    // total number of bytes written
+    alignas(64) std::atomic<uint64_t> _head{0};
+    // total number of bytes read
+    alignas(64) std::atomic<uint64_t> _tail{0};
+    alignas(64) uint64_t _capacity{0};
+};
+
+} // namespace k2
@@ -0,0 +1,274 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#include "ShmRPCChannel.h"
+
+#include <signal.h>
+#include <unistd.h>
+
+// third-party
+#include <seastar/core/future-util.hh>
+#include <seastar/core/sleep.hh>
+
+#include <k2/config/Config.h>
+#include "Log.h"
+
+namespace k2 {
+
+// the rings start on a cache line after the header
+static constexpr size_t ringOffset = (sizeof(ShmConnectionHeader) + 63) & ~size_t(63);
+
+size_t ShmRPCChannel::segmentSize(uint64_t ringCapacity) {
+    return ringOffset + 2 * ShmRing::sizeFor(ringCapacity);
+}
+
+void ShmRPCChannel::initSegment(ShmSegment& segment, uint64_t ringCapacity) {
+    auto header = new (segment.data()) ShmConnectionHeader();
+    header->ringCapacity = ringCapacity;
+    header->pids[CLIENT] = ::getpid();
+    ShmRing::init(segment.data() + ringOffset, ringCapacity);
+    ShmRing::init(segment.data() + ringOffset + ShmRing::sizeFor(ringCapacity), ringCapacity);
+}
+
+bool ShmRPCChannel::isProcessGone(int32_t pid) {
+    return ::kill(pid, 0) != 0 && errno == ESRCH;
+}
+
+ShmRPCChannel::ShmRPCChannel(ShmSegment segment, Side side, TXEndpoint endpoint,
+                             RequestObserver_t requestObserver, FailureObserver_t failureObserver,
+                             String segmentName, uint64_t maxPendingBytes):
+    _rpcParser([]{return seastar::need_preempt();}, Config()["enable_tx_checksum"].as<bool>()),
+    _endpoint(std::move(endpoint)),
+    _segment(std::move(segment)),
+    _header(reinterpret_cast<ShmConnectionHeader*>(_segment.data())),
+    _side(side),
+    _segmentName(std::move(segmentName)),
+    _maxPendingBytes(maxPendingBytes) {
+    K2LOG_D(log::tx, "new shm channel to {}", _endpoint.url);
+    auto rings = _segment.data() + ringOffset;
+    auto ringSize = ShmRing::sizeFor(_header->ringCapacity);
+    _tx = ShmRing::attach(rings + _side * ringSize);
+    _rx = ShmRing::attach(rings + (1 - _side) * ringSize);
+    if (_side == SERVER) {
+        _header->pids[SERVER] = ::getpid();
+        _header->attached.store(1, std::memory_order_release);
+    }
+
+    registerMessageObserver(requestObserver);
+    registerFailureObserver(failureObserver);
+    _rpcParser.registerMessageObserver(
+        [this](Verb verb, MessageMetadata metadata, std::unique_ptr<Payload> payload) {
+            K2LOG_D(log::tx, "Received message with verb: {}", int(verb));
+            this->_messageObserver(Request(verb, _endpoint, std::move(metadata), std::move(payload)));
+        }
+    );
+    _rpcParser.registerParserFailureObserver(
+        [this](std::exception_ptr exc) {
+            K2LOG_W_EXC(log::tx, exc, "Received parser exception");
+            _close(exc);
+        }
+    );
+}
+
+ShmRPCChannel::~ShmRPCChannel() {
+    K2LOG_D(log::tx, "dtor");
+    if (!_closingInProgress) {
+        K2LOG_W(log::tx, "destructor without graceful close: {}", _endpoint.url);
+    }
+}
+
+void ShmRPCChannel::send(Verb verb, std::unique_ptr<Payload> payload, MessageMetadata metadata) {
+    K2LOG_D(log::tx, "send: verb={}", int(verb));
+    if (_closingInProgress) {
+        K2LOG_W(log::tx, "channel is going down. ignoring send");
+        return;
+    }
+    for (auto& buf: _rpcParser.prepareForSend(verb, std::move(payload), std::move(metadata))) {
+        if (_pendingWrites.empty()) {
+            // write what we can right away. The rest goes out as the peer drains the ring
+            buf.trim_front(_tx->write(buf.get(), buf.size()));
+            if (buf.empty()) {
+                continue;
+            }
+        }
+        _pendingBytes += buf.size();
+        _pendingWrites.push_back(std::move(buf));
+    }
+    if (_pendingBytes > _maxPendingBytes) {
+        // the peer is alive but isn't draining the ring. Don't buffer without bound
+        K2LOG_W(log::tx, "{} bytes are pending on channel {}, which is more than the limit of {}",
+                _pendingBytes, _endpoint.url, _maxPendingBytes);
+        _close(std::make_exception_ptr(std::runtime_error("shared memory peer is not draining the ring")));
+    }
+}
+
+bool ShmRPCChannel::_flushPendingWrites() {
+    bool wrote = false;
+    while (!_pendingWrites.empty()) {
+        auto& buf = _pendingWrites.front();
+        auto written = _tx->write(buf.get(), buf.size());
+        if (written == 0) {
+            break;
+        }
+        wrote = true;
+        _pendingBytes -= written;
+        buf.trim_front(written);
+        if (!buf.empty()) {
+            break;
+        }
+        _pendingWrites.pop_front();
+    }
+    return wrote;
+}
+
+bool ShmRPCChannel::poll() {
+    if (_closingInProgress) {
+        return false;
+    }
+    if (!_segmentName.empty() && _header->attached.load(std::memory_order_acquire)) {
+        _unlinkSegment();
+    }
+    bool busy = _flushPendingWrites();
+    if (_rpcParser.canDispatch()) {
+        _rpcParser.dispatchSome();
+        return true;
+    }
+    auto readable = _rx->readable();
+    if (readable > 0) {
+        // the ring memory is reused once we consume it, so the data has to be copied out.
+        // The parser shares the payloads of the messages from this buffer
+        Binary buf(readable);
+        _rx->read(buf.get_write(), buf.size());
+        _rpcParser.feed(std::move(buf));
+        _rpcParser.dispatchSome();
+        return true;
+    }
+    if (_header->closed[1 - _side].load(std::memory_order_acquire)) {
+        K2LOG_D(log::tx, "remote end closed channel {}", _endpoint.url);
+        _close(nullptr);
+        return true;
+    }
+    return busy;
+}
+
+void ShmRPCChannel::checkPeer() {
+    auto pid = _header->pids[1 - _side];
+    if (_closingInProgress || pid == 0) {
+        return;
+    }
+    if (isProcessGone(pid)) {
+        K2LOG_W(log::tx, "peer process {} for channel {} is gone", pid, _endpoint.url);
+        _close(std::make_exception_ptr(std::runtime_error("shared memory peer process is gone")));
+    }
+}
+
+void ShmRPCChannel::registerMessageObserver(RequestObserver_t observer) {
+    K2LOG_D(log::tx, "register msg observer");
+    if (observer == nullptr) {
+        K2LOG_D(log::tx, "Setting default message observer");
+        _messageObserver = [this](Request&& request) {
+            if (!_closingInProgress) {
+                K2LOG_W(log::tx, "Message: {} ignored since there is no message observer registered...", request.verb);
+            }
+        };
+    }
+    else {
+        _messageObserver = observer;
+    }
+}
+
+void ShmRPCChannel::registerFailureObserver(FailureObserver_t observer) {
+    K2LOG_D(log::tx, "register failure observer");
+    if (observer == nullptr) {
+        K2LOG_D(log::tx, "Setting default failure observer");
+        _failureObserver = [this](TXEndpoint&, std::exception_ptr) {
+            if (!_closingInProgress) {
+                K2LOG_W(log::tx, "Ignoring failure, since there is no failure observer registered...");
+            }
+        };
+    }
+    else {
+        _failureObserver = observer;
+    }
+}
+
+seastar::future<> ShmRPCChannel::gracefulClose(Duration timeout) {
+    K2LOG_D(log::tx, "graceful close");
+    if (_closingInProgress) {
+        return seastar::make_ready_future();
+    }
+    // no more sends or reads from here on
+    _closingInProgress = true;
+    auto deadline = Clock::now() + timeout;
+    // we only mark our end closed once the pending writes are in the ring. Otherwise the peer could see the
+    // close after draining the ring and stop reading before the rest of the data gets there
+    return seastar::do_until(
+        [this, deadline] {
+            _flushPendingWrites();
+            return _pendingWrites.empty() || Clock::now() >= deadline ||
+                   _header->closed[1 - _side].load(std::memory_order_acquire) ||
+                   isProcessGone(_header->pids[1 - _side]);
+        },
+        [] {
+            return seastar::sleep(50us);
+        })
+    .then([this] {
+        _dropPendingWrites();
+        _header->closed[_side].store(1, std::memory_order_release);
+        _unlinkSegment();
+    });
+}
+
+void ShmRPCChannel::_close(std::exception_ptr exc) {
+    K2LOG_D(log::tx, "Closing channel: ipr={}", _closingInProgress);
+    if (!_closingInProgress) {
+        _closingInProgress = true;
+        _dropPendingWrites();
+        _header->closed[_side].store(1, std::memory_order_release);
+        _unlinkSegment();
+        // signal the Protocol that this channel has closed
+        _failureObserver(_endpoint, exc);
+    }
+}
+
+void ShmRPCChannel::_dropPendingWrites() {
+    if (!_pendingWrites.empty()) {
+        // the RPC layer times out any requests which are waiting for replies to these messages
+        K2LOG_W(log::tx, "dropping {} bytes which were not written to channel {}", _pendingBytes, _endpoint.url);
+        _pendingWrites.clear();
+        _pendingBytes = 0;
+    }
+}
+
+void ShmRPCChannel::_unlinkSegment() {
+    if (!_segmentName.empty()) {
+        K2LOG_D(log::tx, "removing connection segment name {}", _segmentName);
+        ShmSegment::unlink(_segmentName);
+        _segmentName.clear();
+    }
+}
+
+TXEndpoint& ShmRPCChannel::getTXEndpoint() { return _endpoint; }
+
+} // k2
@@ -0,0 +1,164 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <deque>
+
+// third-party
+#include <seastar/core/future.hh>
+
+// k2
+#include <k2/common/Common.h>
+#include "BaseTypes.h"
+#include "RPCHeader.h"
+#include "RPCParser.h"
+#include "Request.h"
+#include "SharedMemory.h"
+#include "TXEndpoint.h"
+
+namespace k2 {
+
+// The header of a shared memory connection segment. It is followed by two rings: client->server and server->client
+struct ShmConnectionHeader {
+    static constexpr uint32_t MAGIC = 0x4D53324B; // "K2SM"
+    uint32_t magic{MAGIC};
+    // set by the server once it has the segment mapped. The client then removes the segment name
+    std::atomic<uint32_t> attached{0};
+    uint64_t ringCapacity{0};
+    // the process ids of the client and the server
+    int32_t pids[2]{0, 0};
+    // set by each side when it closes the connection
+    std::atomic<uint32_t> closed[2]{0, 0};
+};
+
+// A shared memory channel connects a pair of cores, possibly in different processes on the same host.
+// Messages are framed by an RPCParser, just like on TCP, and are written into an SPSC ring in the connection segment.
+// The channel does not have a thread of its own. The owning protocol calls poll() to move data in both directions.
+class ShmRPCChannel {
+public: // types
+    // which end of the connection we are
+    enum Side: uint8_t {
+        CLIENT = 0,
+        SERVER = 1
+    };
+
+    // the size of a connection segment with rings of the given capacity
+    static size_t segmentSize(uint64_t ringCapacity);
+
+    // initialize a new connection segment, created by the client
+    static void initSegment(ShmSegment& segment, uint64_t ringCapacity);
+
+    // returns true if the given process no longer exists
+    static bool isProcessGone(int32_t pid);
+
+public: // lifecycle
+    // Construct a new channel over an initialized connection segment, to the peer at the given endpoint.
+    // The client passes the name of the segment, which it removes once the server has attached, or when the
+    // channel closes. The channel fails if more than maxPendingBytes are waiting for room in the outgoing ring
+    ShmRPCChannel(ShmSegment segment, Side side, TXEndpoint endpoint,
+                  RequestObserver_t requestObserver, FailureObserver_t failureObserver,
+                  String segmentName, uint64_t maxPendingBytes);
+
+    // destructor
+    ~ShmRPCChannel();
+
+    // close the channel. Pending writes are flushed into the ring for up to the given timeout, while the peer
+    // keeps reading. Writes which still don't fit after that are dropped and reported in the log
+    seastar::future<> gracefulClose(Duration timeout={});
+
+public: // API
+    // Invokes the remote rpc for the given verb with the given payload. This is an asyncronous API. No guarantees
+    // are made on the delivery of the payload after the call returns.
+    // The RPC message is configured with the given metadata
+    void send(Verb verb, std::unique_ptr<Payload> payload, MessageMetadata meta);
+
+    // Moves pending writes into the outgoing ring, and dispatches some incoming messages.
+    // Returns true if there was any work to do
+    bool poll();
+
+    // Checks if the peer process is still alive, failing the channel if it isn't
+    void checkPeer();
+
+    // Call this method with a callback to observe incoming RPC messages
+    void registerMessageObserver(RequestObserver_t observer);
+
+    // Call this method with a callback to observe the failure of this channel (e.g. the peer went away)
+    void registerFailureObserver(FailureObserver_t observer);
+
+    // Obtain the endpoint for this channel
+    TXEndpoint& getTXEndpoint();
+
+private: // methods
+    // write as much of the pending data as fits in the outgoing ring. Returns true if anything was written
+    bool _flushPendingWrites();
+
+    // close the channel and notify the failure observer
+    void _close(std::exception_ptr exc);
+
+    // drop any writes which are still pending, e.g. when closing
+    void _dropPendingWrites();
+
+    // remove the name of the connection segment, if we still own it
+    void _unlinkSegment();
+
+private: // fields
+    // this is the RPC message parser
+    RPCParser _rpcParser;
+
+    // the observer for rpc messages
+    RequestObserver_t _messageObserver;
+
+    // the observer for channel failures
+    FailureObserver_t _failureObserver;
+
+    // the endpoint for the channel
+    TXEndpoint _endpoint;
+
+    // the connection segment and the rings inside it
+    ShmSegment _segment;
+    ShmConnectionHeader* _header;
+    ShmRing* _tx;
+    ShmRing* _rx;
+    Side _side;
+
+    // the name of the connection segment, until it is removed. Only set on the client side
+    String _segmentName;
+
+    // data which didn't fit in the outgoing ring yet
+    std::deque<Binary> _pendingWrites;
+    size_t _pendingBytes{0};
+    uint64_t _maxPendingBytes;
+
+    // flag to tell if the channel is closing
+    bool _closingInProgress{false};
+
+private: // Not needed
+    ShmRPCChannel(const ShmRPCChannel& o) = delete;
+    ShmRPCChannel(ShmRPCChannel&& o) = delete;
+    ShmRPCChannel& operator=(const ShmRPCChannel& o) = delete;
+    ShmRPCChannel& operator=(ShmRPCChannel&& o) = delete;
+}; // ShmRPCChannel
+
+} // k2
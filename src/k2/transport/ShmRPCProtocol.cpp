@@ -0,0 +1,372 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#include "ShmRPCProtocol.h"
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+// third-party
+#include <seastar/core/future-util.hh>
+#include <seastar/core/sleep.hh>
+#include <seastar/net/rdma.hh>
+
+//k2
+#include "Log.h"
+
+namespace k2 {
+
+ShmRPCProtocol::ShmRPCProtocol(VirtualNetworkStack::Dist_t& vnet):
+    IRPCProtocol(vnet, proto) {
+    K2LOG_D(log::tx, "ctor");
+}
+
+ShmRPCProtocol::~ShmRPCProtocol() {
+    K2LOG_D(log::tx, "dtor");
+}
+
+RPCProtocolFactory::BuilderFunc_t ShmRPCProtocol::builder(VirtualNetworkStack::Dist_t& vnet) {
+    K2LOG_D(log::tx, "builder creating");
+    return [&vnet]() mutable -> seastar::shared_ptr<IRPCProtocol> {
+        K2LOG_D(log::tx, "builder running");
+        return seastar::static_pointer_cast<IRPCProtocol>(
+            seastar::make_shared<ShmRPCProtocol>(vnet));
+    };
+}
+
+void ShmRPCProtocol::start() {
+    K2LOG_D(log::tx, "start");
+    if (!_enabled()) {
+        K2LOG_D(log::tx, "shared memory RPC is disabled");
+        return;
+    }
+    if (seastar::this_shard_id() == 0) {
+        _removeStaleSegments();
+    }
+    // the port identifies the process and the core. Pids fit in 22 bits
+    uint32_t port = (uint32_t(::getpid()) << SHARD_BITS) | seastar::this_shard_id();
+    _svrEndpoint = seastar::make_lw_shared<TXEndpoint>(String(proto), _hostId(), port, _vnet.local().getTCPAllocator());
+
+    _listenerSegment = ShmSegment::create(_listenerName(port), sizeof(ListenerHeader));
+    _listener = new (_listenerSegment.data()) ListenerHeader();
+    _listener->pid = ::getpid();
+    K2LOG_I(log::tx, "Starting listening shared memory Proto on: {}", _svrEndpoint->url);
+
+    _stopped = false;
+    _lastActivity = Clock::now();
+    _pollLoopDone = seastar::do_until(
+        [this] { return _stopped; },
+        [this] {
+            auto now = Clock::now();
+            if (_pollOnce()) {
+                _lastActivity = now;
+            }
+            else if (now - _lastActivity > _spinDuration()) {
+                // nothing has happened for a while. Check on our peers and slow down
+                for (auto& chan: _pollList) {
+                    chan->checkPeer();
+                }
+                return seastar::sleep(_idlePollInterval());
+            }
+            // yield to the reactor so that it can run other tasks and poll for other events
+            return seastar::sleep(0us);
+        }).or_terminate();
+}
+
+seastar::future<> ShmRPCProtocol::stop() {
+    K2LOG_D(log::tx, "stop");
+    if (_stopped) {
+        return seastar::make_ready_future();
+    }
+    // immediately prevent accepting further read/write work
+    _stopped = true;
+    ShmSegment::unlink(_listenerName(_svrEndpoint->port));
+
+    // place all channels in a list so that we can clear the map
+    std::vector<seastar::lw_shared_ptr<ShmRPCChannel>> channels;
+    for (auto&& iter: _channels) {
+        channels.push_back(iter.second);
+    }
+    _channels.clear();
+    _pollList.clear();
+
+    // now schedule futures for graceful close of all channels
+    std::vector<seastar::future<>> futs;
+    futs.push_back(std::move(_pollLoopDone));
+    for (auto chan: channels) {
+        // schedule a graceful close. Note the empty continuation which captures the shared pointer to the channel
+        // by copy so that the channel isn't going to get destroyed mid-sentence
+        // we're about to kill this so unregister observers
+        chan->registerFailureObserver(nullptr);
+        chan->registerMessageObserver(nullptr);
+
+        futs.push_back(chan->gracefulClose(_closeTimeout()).then([chan](){}));
+    }
+
+    // here we return a future which completes once all GracefulClose futures complete.
+    return seastar::when_all_succeed(futs.begin(), futs.end()).discard_result();
+}
+
+std::unique_ptr<TXEndpoint> ShmRPCProtocol::getTXEndpoint(String url) {
+    if (_stopped) {
+        // this is normal when shared memory is disabled here, but the remote end advertises it
+        K2LOG_D(log::tx, "Unable to create endpoint since we're stopped for url {}", url);
+        return nullptr;
+    }
+    auto ep = TXEndpoint::fromURL(url, _vnet.local().getTCPAllocator());
+    if (!ep || ep->protocol != proto) {
+        K2LOG_W(log::tx, "Cannot construct non-`{}` endpoint from url {}", proto, url);
+        return nullptr;
+    }
+    return ep;
+}
+
+seastar::lw_shared_ptr<TXEndpoint> ShmRPCProtocol::getServerEndpoint() {
+    return _svrEndpoint;
+}
+
+void ShmRPCProtocol::send(Verb verb, std::unique_ptr<Payload> payload, TXEndpoint& endpoint, MessageMetadata metadata) {
+    if (_stopped) {
+        K2LOG_W(log::tx, "Dropping message since we're stopped: verb={}, url={}", int(verb), endpoint.url);
+        return;
+    }
+
+    auto&& chan = _getOrMakeChannel(endpoint);
+    if (!chan) {
+        K2LOG_W(log::tx, "Dropping message: Unable to create connection for endpoint {}", endpoint.url);
+        return;
+    }
+    chan->send(verb, std::move(payload), std::move(metadata));
+}
+
+seastar::lw_shared_ptr<ShmRPCChannel> ShmRPCProtocol::_getOrMakeChannel(TXEndpoint& endpoint) {
+    // look for an existing channel
+    auto iter = _channels.find(endpoint);
+    if (iter != _channels.end()) {
+        return iter->second;
+    }
+    K2LOG_D(log::tx, "creating new channel for {}", endpoint.url);
+    if (endpoint.ip != _svrEndpoint->ip) {
+        K2LOG_W(log::tx, "Endpoint {} is not on this host", endpoint.url);
+        return nullptr;
+    }
+
+    try {
+        auto listenerSegment = ShmSegment::open(_listenerName(endpoint.port));
+        if (!listenerSegment || listenerSegment.size() < sizeof(ListenerHeader)) {
+            K2LOG_W(log::tx, "No shared memory listener for endpoint {}", endpoint.url);
+            return nullptr;
+        }
+        auto listener = reinterpret_cast<ListenerHeader*>(listenerSegment.data());
+        if (listener->magic != ListenerHeader::MAGIC) {
+            K2LOG_W(log::tx, "Invalid shared memory listener for endpoint {}", endpoint.url);
+            return nullptr;
+        }
+        if (ShmRPCChannel::isProcessGone(listener->pid)) {
+            // the listener crashed without removing its segment. Nobody would ever accept our connection
+            K2LOG_W(log::tx, "Removing stale shared memory listener for endpoint {}", endpoint.url);
+            ShmSegment::unlink(_listenerName(endpoint.port));
+            return nullptr;
+        }
+
+        // round the ring size up to a power of 2
+        uint64_t ringCapacity = 4096;
+        while (ringCapacity < _ringSize()) {
+            ringCapacity <<= 1;
+        }
+        auto connId = ++_nextConnId;
+        auto connName = _connectionName(endpoint.port, _svrEndpoint->port, connId);
+        auto segment = ShmSegment::create(connName, ShmRPCChannel::segmentSize(ringCapacity));
+        ShmRPCChannel::initSegment(segment, ringCapacity);
+        auto header = reinterpret_cast<ShmConnectionHeader*>(segment.data());
+        header->pids[ShmRPCChannel::SERVER] = listener->pid;
+
+        // ask the listener to accept the connection. The listener unlinks the segment once it has it mapped,
+        // and so do we once we see it attached, or if we close before that happens
+        for (auto& slot: listener->slots) {
+            uint32_t expected = AcceptSlot::FREE;
+            if (slot.state.compare_exchange_strong(expected, AcceptSlot::CLAIMED, std::memory_order_acquire)) {
+                slot.port = _svrEndpoint->port;
+                slot.connId = connId;
+                slot.state.store(AcceptSlot::READY, std::memory_order_release);
+                // we can start writing right away. The messages wait in the ring until the listener accepts
+                return _handleNewChannel(std::move(segment), ShmRPCChannel::CLIENT, endpoint, std::move(connName));
+            }
+        }
+        K2LOG_W(log::tx, "Shared memory listener for endpoint {} has no free slots", endpoint.url);
+        ShmSegment::unlink(connName);
+    }
+    catch (const std::exception& exc) {
+        K2LOG_W(log::tx, "Unable to connect to endpoint {}: {}", endpoint.url, exc.what());
+    }
+    return nullptr;
+}
+
+bool ShmRPCProtocol::_acceptConnections() {
+    bool accepted = false;
+    for (auto& slot: _listener->slots) {
+        if (slot.state.load(std::memory_order_acquire) != AcceptSlot::READY) {
+            continue;
+        }
+        accepted = true;
+        auto port = slot.port;
+        auto connName = _connectionName(_svrEndpoint->port, port, slot.connId);
+        slot.state.store(AcceptSlot::FREE, std::memory_order_release);
+
+        TXEndpoint ep(String(proto), String(_svrEndpoint->ip), port, _vnet.local().getTCPAllocator());
+        try {
+            auto segment = ShmSegment::open(connName);
+            ShmSegment::unlink(connName);
+            if (!segment || segment.size() < sizeof(ShmConnectionHeader) ||
+                reinterpret_cast<ShmConnectionHeader*>(segment.data())->magic != ShmConnectionHeader::MAGIC) {
+                K2LOG_W(log::tx, "Invalid shared memory connection request from {}", ep.url);
+                continue;
+            }
+            K2LOG_D(log::tx, "Accepted connection from {}", ep.url);
+            auto iter = _channels.find(ep);
+            if (iter != _channels.end()) {
+                // the peer reconnected. It isn't going to use the old channel any more
+                auto chan = iter->second;
+                _channels.erase(iter);
+                _channelsChanged = true;
+                chan->registerFailureObserver(nullptr);
+                (void)chan->gracefulClose().then([chan] {});
+            }
+            _handleNewChannel(std::move(segment), ShmRPCChannel::SERVER, std::move(ep));
+        }
+        catch (const std::exception& exc) {
+            K2LOG_W(log::tx, "Unable to accept connection from {}: {}", ep.url, exc.what());
+        }
+    }
+    return accepted;
+}
+
+seastar::lw_shared_ptr<ShmRPCChannel>
+ShmRPCProtocol::_handleNewChannel(ShmSegment segment, ShmRPCChannel::Side side, TXEndpoint endpoint, String segmentName) {
+    K2LOG_D(log::tx, "processing channel: {}", endpoint.url);
+    auto chan = seastar::make_lw_shared<ShmRPCChannel>(std::move(segment), side, std::move(endpoint),
+        [this] (Request&& request) {
+            if (!_stopped) {
+                _messageObserver(std::move(request));
+            }
+        },
+        [this] (TXEndpoint& endpoint, auto exc) {
+            if (!_stopped) {
+                if (exc) {
+                    K2LOG_W_EXC(log::tx, exc, "Channel {} failed", endpoint.url);
+                }
+                auto chanIter = _channels.find(endpoint);
+                if (chanIter != _channels.end()) {
+                    auto chan = chanIter->second;
+                    _channels.erase(chanIter);
+                    _channelsChanged = true;
+                    (void)chan->gracefulClose().then([chan] {});
+                }
+            }
+        },
+        std::move(segmentName), _maxPendingBytes());
+    _channels.emplace(chan->getTXEndpoint(), chan);
+    _channelsChanged = true;
+    return chan;
+}
+
+bool ShmRPCProtocol::_pollOnce() {
+    bool busy = _acceptConnections();
+    if (_channelsChanged) {
+        _channelsChanged = false;
+        _pollList.clear();
+        for (auto& [ep, chan]: _channels) {
+            _pollList.push_back(chan);
+        }
+    }
+    // channels may be removed from the map while we poll. The list keeps them alive until the next rebuild
+    for (size_t i = 0; i < _pollList.size() && !_stopped; ++i) {
+        busy |= _pollList[i]->poll();
+    }
+    return busy;
+}
+
+void ShmRPCProtocol::_removeStaleSegments() {
+    // on linux, shm_open() names are files in /dev/shm
+    DIR* dir = ::opendir("/dev/shm");
+    if (!dir) {
+        K2LOG_W(log::tx, "Unable to list shared memory segments: {}", strerror(errno));
+        return;
+    }
+    while (auto entry = ::readdir(dir)) {
+        // listeners are named k2rpc.<port> and connections are named k2rpc.<server port>.<client port>.<conn id>
+        unsigned long long serverPort = 0, clientPort = 0, connId = 0;
+        int consumed = 0;
+        int len = int(::strlen(entry->d_name));
+        bool stale = false;
+        if (::sscanf(entry->d_name, "k2rpc.%llu%n", &serverPort, &consumed) == 1 && consumed == len) {
+            stale = ShmRPCChannel::isProcessGone(_portPid(serverPort));
+        }
+        else if (::sscanf(entry->d_name, "k2rpc.%llu.%llu.%llu%n", &serverPort, &clientPort, &connId, &consumed) == 3 && consumed == len) {
+            stale = ShmRPCChannel::isProcessGone(_portPid(serverPort)) && ShmRPCChannel::isProcessGone(_portPid(clientPort));
+        }
+        if (stale) {
+            K2LOG_I(log::tx, "Removing stale shared memory segment {}", entry->d_name);
+            ShmSegment::unlink(fmt::format("/{}", entry->d_name));
+        }
+    }
+    ::closedir(dir);
+}
+
+String ShmRPCProtocol::_listenerName(uint32_t port) {
+    return fmt::format("/k2rpc.{}", port);
+}
+
+String ShmRPCProtocol::_connectionName(uint32_t serverPort, uint32_t clientPort, uint64_t connId) {
+    return fmt::format("/k2rpc.{}.{}.{}", serverPort, clientPort, connId);
+}
+
+String ShmRPCProtocol::_hostId() {
+    String id = _hostIdOverride();
+    if (id.empty()) {
+        // the boot id is a uuid, which we format as an ipv6 address
+        std::ifstream bootId("/proc/sys/kernel/random/boot_id");
+        String uuid;
+        bootId >> uuid;
+        for (auto c: uuid) {
+            if (c == '-') continue;
+            if (id.size() % 5 == 4) {
+                id.push_back(':');
+            }
+            id.push_back(c);
+        }
+    }
+    union ibv_gid gid;
+    if (seastar::rdma::EndPoint::StringToGID(id, gid) != 0) {
+        throw std::runtime_error("invalid shared memory host id: " + id);
+    }
+    return seastar::rdma::EndPoint::GIDToString(gid);
+}
+
+} // namespace k2
@@ -0,0 +1,195 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+// third-party
+#include <seastar/core/future.hh>
+#include <seastar/core/shared_ptr.hh>
+
+// k2
+#include <k2/config/Config.h>
+#include "IRPCProtocol.h"
+#include "RPCHeader.h"
+#include "RPCProtocolFactory.h"
+#include "SharedMemory.h"
+#include "ShmRPCChannel.h"
+#include "VirtualNetworkStack.h"
+
+namespace k2 {
+
+// ShmRPCProtocol carries RPC messages over shared memory between processes on the same host, which avoids the
+// cost of going through the loopback TCP stack. Each core listens on a shared memory segment, which peers use
+// to request new connections. Each connection is a separate segment with a pair of SPSC rings, so every
+// connected pair of cores has its own rings.
+// Endpoints look like shm+k2rpc://[<host id>]:<port>. The host id is the boot id of the host, formatted as an
+// ipv6 address. Discovery uses it to tell if a peer is on our host. The port identifies the process and core.
+// The protocol is enabled with --enable_shm_rpc. When it is disabled, it doesn't listen or vend endpoints.
+// NB, the class is meant to be used as a distributed<> container
+class ShmRPCProtocol: public IRPCProtocol {
+public: // types
+    // Convenience builder which creates a shared memory listener on all cores
+    static RPCProtocolFactory::BuilderFunc_t builder(VirtualNetworkStack::Dist_t& vnet);
+
+    // The official protocol name supported for communications over shared memory channels
+    static inline const String proto{"shm+k2rpc"};
+
+public: // lifecycle
+    // Construct the protocol with the given vnet, used to allocate payloads
+    ShmRPCProtocol(VirtualNetworkStack::Dist_t& vnet);
+
+    // Destructor
+    virtual ~ShmRPCProtocol();
+
+public: // API
+    // This method creates an endpoint for a given URL. The endpoint is needed in order to
+    // 1. obtain protocol-specific payloads
+    // 2. send messages.
+    // returns blank pointer if we failed to parse the url or if the protocol is not supported
+    std::unique_ptr<TXEndpoint> getTXEndpoint(String url) override;
+
+    // Invokes the remote rpc for the given verb with the given payload. This is an asyncronous API. No guarantees
+    // are made on the delivery of the payload after the call returns.
+    // This is a lower-level API which is useful for sending messages that do not expect replies.
+    // The RPC message is configured with the given metadata
+    void send(Verb verb, std::unique_ptr<Payload> payload, TXEndpoint& endpoint, MessageMetadata metadata) override;
+
+    // Returns the endpoint where this protocol accepts incoming connections.
+    seastar::lw_shared_ptr<TXEndpoint> getServerEndpoint() override;
+
+public: // distributed<> interface
+    // iface: called by seastar's distributed mechanism when stop() is invoked on the distributed container.
+    // The method's returned future completes once all channels had a chance to complete a graceful shutdown
+    seastar::future<> stop() override;
+
+    // Should be called by user when all distributed objects have been created
+    void start() override;
+
+private: // types
+    // the low bits of a port are the core id, and the rest is the process id
+    static constexpr uint32_t SHARD_BITS = 10;
+
+    // A slot in the listener segment, used by peers to ask for a new connection
+    struct AcceptSlot {
+        static constexpr uint32_t FREE = 0;
+        static constexpr uint32_t CLAIMED = 1;
+        static constexpr uint32_t READY = 2;
+        std::atomic<uint32_t> state{FREE};
+        // the port of the connecting peer
+        uint32_t port{0};
+        // tells apart connections from the same peer
+        uint64_t connId{0};
+    };
+
+    // The listener segment of a core
+    struct ListenerHeader {
+        static constexpr uint32_t MAGIC = 0x4C53324B; // "K2SL"
+        static constexpr size_t NUM_SLOTS = 64;
+        uint32_t magic{MAGIC};
+        int32_t pid{0};
+        AcceptSlot slots[NUM_SLOTS];
+    };
+
+private: // methods
+    // utility method which we use to obtain a connection(either existing or new) for the given endpoint
+    seastar::lw_shared_ptr<ShmRPCChannel> _getOrMakeChannel(TXEndpoint& endpoint);
+
+    // process a new channel creation. The client passes the name of the connection segment
+    seastar::lw_shared_ptr<ShmRPCChannel> _handleNewChannel(ShmSegment segment, ShmRPCChannel::Side side, TXEndpoint endpoint,
+                                                            String segmentName=String());
+
+    // accept any pending connection requests. Returns true if there were any
+    bool _acceptConnections();
+
+    // poll the listener and all channels once. Returns true if there was any work to do
+    bool _pollOnce();
+
+    // remove the segments left behind by processes which are gone, e.g. because they crashed
+    static void _removeStaleSegments();
+
+    // the process which owns the given port
+    static int32_t _portPid(uint64_t port) { return int32_t(port >> SHARD_BITS); }
+
+    // the name of the listener segment for the given port
+    static String _listenerName(uint32_t port);
+
+    // the name of a connection segment
+    static String _connectionName(uint32_t serverPort, uint32_t clientPort, uint64_t connId);
+
+    // returns the id of this host, in canonical ipv6 form
+    String _hostId();
+
+private: // config
+    ConfigVar<bool> _enabled{"enable_shm_rpc", false};
+    // the capacity of each ring. Rounded up to a power of 2
+    ConfigVar<uint64_t> _ringSize{"shm_ring_size", 4 * 1024 * 1024};
+    // overrides the host id, e.g. for containers on the same host which don't share a /dev/shm
+    ConfigVar<String> _hostIdOverride{"shm_host_id", ""};
+    // after any activity, we poll on every reactor cycle for this long
+    ConfigDuration _spinDuration{"shm_poll_spin", 1ms};
+    // then we poll at this interval until there is activity again
+    ConfigDuration _idlePollInterval{"shm_idle_poll_interval", 50us};
+    // a channel fails if more than this many bytes are waiting for room in its outgoing ring
+    ConfigVar<uint64_t> _maxPendingBytes{"shm_max_pending_bytes", 64 * 1024 * 1024};
+    // how long we keep flushing pending writes when we stop
+    ConfigDuration _closeTimeout{"shm_close_timeout", 1s};
+
+private: // fields
+    // we use this flag to signal exit
+    bool _stopped{true};
+
+    // the endpoint version of the address we're listening on
+    seastar::lw_shared_ptr<TXEndpoint> _svrEndpoint;
+
+    // our listener segment
+    ShmSegment _listenerSegment;
+    ListenerHeader* _listener{nullptr};
+
+    // used to tell apart the connections we make
+    uint64_t _nextConnId{0};
+
+    // the underlying channels we're dealing with
+    std::unordered_map<TXEndpoint, seastar::lw_shared_ptr<ShmRPCChannel>> _channels;
+
+    // the channels we poll. We rebuild it from the map whenever channels come and go so that channels can be
+    // removed from the map while we poll them
+    std::vector<seastar::lw_shared_ptr<ShmRPCChannel>> _pollList;
+    bool _channelsChanged{false};
+
+    TimePoint _lastActivity;
+    seastar::future<> _pollLoopDone = seastar::make_ready_future();
+
+private: // not needed
+    ShmRPCProtocol() = delete;
+    ShmRPCProtocol(const ShmRPCProtocol& o) = delete;
+    ShmRPCProtocol(ShmRPCProtocol&& o) = delete;
+    ShmRPCProtocol &operator=(const ShmRPCProtocol& o) = delete;
+    ShmRPCProtocol &operator=(ShmRPCProtocol&& o) = delete;
+
+}; // class ShmRPCProtocol
+
+} // namespace k2
@@ -33,15 +33,17 @@ Copyright(c) 2020 Futurewei Cloud
 namespace k2 {
 
 TCPRPCChannel::TCPRPCChannel(seastar::future<seastar::connected_socket> futureSocket, TXEndpoint endpoint,
-                  RequestObserver_t requestObserver, FailureObserver_t failureObserver):
+                  RequestObserver_t requestObserver, FailureObserver_t failureObserver, TCPWriteBatching& batching):
     _rpcParser([]{return seastar::need_preempt();}, Config()["enable_tx_checksum"].as<bool>()),
     _endpoint(std::move(endpoint)),
     _fdIsSet(false),
     _closingInProgress(false),
     _running(false),
     _futureSocket(std::move(futureSocket)),
-    _sendFuture(seastar::make_ready_future<>()){
+    _sendFuture(seastar::make_ready_future<>()),
+    _batching(batching) {
     K2LOG_D(log::tx, "new future channel");
+    _batchTimer.set_callback([this] { _flushBatch(); });
     registerMessageObserver(requestObserver);
     registerFailureObserver(failureObserver);
 }
@@ -75,17 +77,60 @@ void TCPRPCChannel::send(Verb verb, std::unique_ptr<Payload> payload, MessageMet
         K2LOG_W(log::tx, "channel is going down. ignoring send");
         return;
     }
+    if (_stats) {
+        ++_stats->sentMessages;
+        if (metadata.isRequestIDSet()) {
+            if (_pendingResponses.size() >= MAX_PENDING_RESPONSES) {
+                _pendingResponses.clear();
+            }
+            _pendingResponses[metadata.requestID] = Clock::now();
+        }
+    }
+    // each binary goes out as a separate fragment of the packet, so spliced payload data is never copied here
+    auto buffers = _rpcParser.prepareForSend(verb, std::move(payload), std::move(metadata));
     seastar::net::packet packet;
-    for (auto& buf : _rpcParser.prepareForSend(verb, std::move(payload), std::move(metadata))) {
+    packet.reserve(buffers.size());
+    for (auto& buf : buffers) {
         packet = seastar::net::packet(std::move(packet), std::move(buf));
     }
+    if (_stats) {
+        _stats->sentBytes += packet.len();
+    }
     if (!_fdIsSet) {
         // we don't have a connected socket yet. Queue up the request
         K2LOG_D(log::tx, "send: not connected yet. Buffering the write, have buffered already {}", _pendingWrites.size());
         _pendingWrites.push_back(std::move(packet));
         return;
     }
-    _sendPacket(std::move(packet));
+    _batchPacket(std::move(packet));
+}
+
+void TCPRPCChannel::_batchPacket(seastar::net::packet&& packet) {
+    ++_batchMessages;
+    _batch.append(std::move(packet));
+    if (_batch.len() >= _batching.maxBytes()) {
+        if (_batching.maxBytes() > 0) {
+            ++_batching.fullFlushes;
+        }
+        _flushBatch();
+    }
+    else if (!_batchTimer.armed()) {
+        _batchTimer.arm(_batching.maxDelay());
+    }
+}
+
+void TCPRPCChannel::_flushBatch() {
+    _batchTimer.cancel();
+    if (_batchMessages == 0) {
+        return;
+    }
+    K2LOG_D(log::tx, "flushing batch: messages={}, bytes={}", _batchMessages, _batch.len());
+    _batching.messagesPerFlush.add(_batchMessages);
+    _batching.bytesPerFlush.add(_batch.len());
+    _batching.messages += _batchMessages;
+    ++_batching.flushes;
+    _batchMessages = 0;
+    _sendPacket(std::exchange(_batch, seastar::net::packet()));
 }
 
 void TCPRPCChannel::_sendPacket(seastar::net::packet&& packet) {
@@ -105,6 +150,16 @@ seastar::future<> TCPRPCChannel::_setConnectedSocket(seastar::connected_socket s
     _rpcParser.registerMessageObserver(
         [this](Verb verb, MessageMetadata metadata, std::unique_ptr<Payload> payload) {
             K2LOG_D(log::tx, "Received message with verb: {}", int(verb));
+            if (_stats) {
+                ++_stats->receivedMessages;
+                if (metadata.isResponseIDSet()) {
+                    auto it = _pendingResponses.find(metadata.responseID);
+                    if (it != _pendingResponses.end()) {
+                        _stats->responseLatency.add(Clock::now() - it->second);
+                        _pendingResponses.erase(it);
+                    }
+                }
+            }
             this->_messageObserver(Request(verb, _endpoint, std::move(metadata), std::move(payload)));
         }
     );
@@ -130,6 +185,9 @@ seastar::future<> TCPRPCChannel::_setConnectedSocket(seastar::connected_socket s
                         K2LOG_D(log::tx, "remote end closed connection");
                         return; // just say we're done so the loop can evaluate the end condition
                     }
+                    if (_stats) {
+                        _stats->receivedBytes += packet.size();
+                    }
                     _rpcParser.feed(std::move(packet));
                     // process some messages from the packet
                     _rpcParser.dispatchSome();
@@ -180,9 +238,11 @@ void TCPRPCChannel::registerFailureObserver(FailureObserver_t observer) {
 void TCPRPCChannel::_processQueuedWrites() {
     K2LOG_D(log::tx, "pending writes: {}", _pendingWrites.size());
     for(auto& packet: _pendingWrites) {
-        _sendPacket(std::move(packet));
+        _batchPacket(std::move(packet));
     }
     _pendingWrites.resize(0); // reclaim any memory used by the vector
+    // these have waited for the connection already, so don't hold them for the batch delay too
+    _flushBatch();
 }
 
 seastar::future<> TCPRPCChannel::gracefulClose(Duration timeout) {
@@ -197,6 +257,8 @@ seastar::future<> TCPRPCChannel::gracefulClose(Duration timeout) {
 void TCPRPCChannel::_closeSocket() {
     K2LOG_D(log::tx, "Closing socket: ipr={}, fdIsSet={}", _closingInProgress, _fdIsSet);
     if (!_closingInProgress) {
+        // write out whatever we have batched so that it is flushed before the output is closed
+        _flushBatch();
         _closingInProgress = true;
 
         // shutdown protocol
@@ -242,4 +304,9 @@ void TCPRPCChannel::_closeSocket() {
 
 TXEndpoint& TCPRPCChannel::getTXEndpoint() { return _endpoint;}
 
+void TCPRPCChannel::setStats(TCPChannelStats* stats) {
+    _stats = stats;
+    _pendingResponses.clear();
+}
+
 } // k2
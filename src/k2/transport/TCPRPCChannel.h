@@ -24,13 +24,19 @@ Copyright(c) 2020 Futurewei Cloud
 
 #pragma once
 
+// stl
+#include <unordered_map>
+
 // third-party
+#include <seastar/core/timer.hh>
 #include <seastar/net/api.hh> // seastar's network stuff
 #include <seastar/net/packet.hh>
 
 // k2
 #include <k2/common/Common.h>
+#include <k2/config/Config.h>
 #include "BaseTypes.h"
+#include "Prometheus.h"
 #include "RPCHeader.h"
 #include "RPCParser.h"
 #include "Request.h"
@@ -38,6 +44,34 @@ Copyright(c) 2020 Futurewei Cloud
 
 namespace k2 {
 
+// Settings and counters for the write batching in TCP channels. One instance is shared by all channels of a protocol.
+// Messages sent over a channel are accumulated in a batch, which is written out with a single write and flush.
+// The batch is flushed once it reaches maxBytes, or once maxDelay expires. A maxDelay of 0 flushes the batch
+// at the next reactor poll, i.e. once the current task quota is over.
+struct TCPWriteBatching {
+    // the batch is flushed once it reaches this many bytes. 0 disables batching
+    ConfigVar<uint64_t> maxBytes{"tcp_batch_max_bytes", 64 * 1024};
+    // the longest time a message may wait in a batch
+    ConfigDuration maxDelay{"tcp_batch_max_delay", 0us};
+
+    k2::ExponentialHistogram messagesPerFlush{1, 10'000, 1.5};
+    k2::ExponentialHistogram bytesPerFlush{64, 64 * 1024 * 1024, 1.5};
+    uint64_t flushes{0};
+    uint64_t messages{0};
+    // number of flushes triggered by reaching maxBytes
+    uint64_t fullFlushes{0};
+};
+
+// Traffic stats for a single channel. Kept for the pooled outgoing connections of a protocol
+struct TCPChannelStats {
+    uint64_t sentBytes{0};
+    uint64_t receivedBytes{0};
+    uint64_t sentMessages{0};
+    uint64_t receivedMessages{0};
+    // time from sending a request over the channel to receiving the response over the same channel
+    k2::ExponentialHistogram responseLatency;
+};
+
 // A TCP channel wraps a seastar connected_socket with an RPCParser to enable sending and receiving
 // RPC messages over a TCP connection
 // The class provides Observer interface to allow for user to observe RPC messages coming over this channel
@@ -45,8 +79,9 @@ class TCPRPCChannel {
 
 public: // lifecycle
     // Construct a new channel, wrapping a future connected socket to a client at the given address
+    // Outgoing messages are batched according to the given batching settings, which must outlive the channel
     TCPRPCChannel(seastar::future<seastar::connected_socket> futureSocket, TXEndpoint endpoint,
-                  RequestObserver_t requestObserver, FailureObserver_t failureObserver);
+                  RequestObserver_t requestObserver, FailureObserver_t failureObserver, TCPWriteBatching& batching);
 
     // destructor
     ~TCPRPCChannel();
@@ -74,9 +109,13 @@ public: // API
     // This method needs to be called so that the channel can begin processing messages
     void run();
 
+    // Start collecting traffic stats for this channel into the given stats, which must outlive the channel
+    void setStats(TCPChannelStats* stats);
+
 private: // methods
     // we call this method when we successfully connect to a remote end.
-    // While we're connecting, any writes are queued in the channel and now we have to flush them
+    // While we're connecting, any writes are queued in the channel and now we have to flush them. They are
+    // written out right away, in as few batches as tcp_batch_max_bytes allows
     void _processQueuedWrites();
 
     // helper method to setup an incoming connected socket
@@ -85,6 +124,12 @@ private: // methods
     // helper method used to send a packet
     void _sendPacket(seastar::net::packet&& packet);
 
+    // add the packet to the current write batch, flushing the batch if it is full
+    void _batchPacket(seastar::net::packet&& packet);
+
+    // send out the current write batch, if any
+    void _flushBatch();
+
 private: // fields
     // this is the RPC message parser
     RPCParser _rpcParser;
@@ -134,6 +179,24 @@ private: // fields
     // used to properly chain sends
     std::optional<seastar::future<>> _sendFuture;
 
+    // the batching settings and counters
+    TCPWriteBatching& _batching;
+
+    // messages which are waiting to be written out together
+    seastar::net::packet _batch;
+    size_t _batchMessages{0};
+
+    // flushes the batch once the max delay expires
+    seastar::timer<> _batchTimer;
+
+    // traffic stats, if enabled via setStats()
+    TCPChannelStats* _stats{nullptr};
+
+    // send time of the requests we sent while collecting stats, used to compute response latency.
+    // Requests which never get a response are forgotten once we have too many
+    std::unordered_map<uint32_t, TimePoint> _pendingResponses;
+    static constexpr size_t MAX_PENDING_RESPONSES = 10000;
+
 private: // Not needed
     TCPRPCChannel(const TCPRPCChannel& o) = delete;
     TCPRPCChannel(TCPRPCChannel&& o) = delete;
@@ -25,6 +25,7 @@ Copyright(c) 2020 Futurewei Cloud
 
 // third-party
 #include <seastar/core/future-util.hh>
+#include <seastar/core/metrics.hh>
 #include <seastar/net/api.hh>
 #include <arpa/inet.h> // for inet_ntop
 #include <seastar/net/inet_address.hh> // for inet_address
@@ -55,6 +56,7 @@ TCPRPCProtocol::~TCPRPCProtocol() {
 void TCPRPCProtocol::start() {
     K2LOG_D(log::tx, "start");
     _stopped = false;
+    _registerMetrics();
     if (_svrEndpoint) {
         K2LOG_I(log::tx, "Starting listening TCP Proto on: {}", _svrEndpoint->url);
 
@@ -128,16 +130,25 @@ seastar::future<> TCPRPCProtocol::stop() {
     K2LOG_D(log::tx, "stop");
     // immediately prevent accepting further read/write work
     _stopped = true;
+    _metricGroups.clear();
     if (_listen_socket) {
         _listen_socket.release();
     }
 
-    // place all channels in a list so that we can clear the map
+    // place all channels in a list so that we can clear the maps
     std::vector<seastar::lw_shared_ptr<TCPRPCChannel>> channels;
     for (auto&& iter: _channels) {
         channels.push_back(iter.second);
     }
     _channels.clear();
+    for (auto&& iter: _pools) {
+        for (auto& pooled: iter.second.channels) {
+            if (pooled->chan) {
+                channels.push_back(std::move(pooled->chan));
+            }
+        }
+    }
+    _pools.clear();
 
     // now schedule futures for graceful close of all channels
     std::vector<seastar::future<>> futs;
@@ -173,13 +184,22 @@ seastar::lw_shared_ptr<TXEndpoint> TCPRPCProtocol::getServerEndpoint() {
     return _svrEndpoint;
 }
 
+std::optional<size_t> TCPRPCProtocol::getPooledConnections(const TXEndpoint& endpoint) const {
+    auto iter = _pools.find(endpoint);
+    if (iter == _pools.end()) {
+        return std::nullopt;
+    }
+    return size_t(std::count_if(iter->second.channels.begin(), iter->second.channels.end(),
+                                [](auto& p) { return bool(p->chan); }));
+}
+
 void TCPRPCProtocol::send(Verb verb, std::unique_ptr<Payload> payload, TXEndpoint& endpoint, MessageMetadata metadata) {
     if (_stopped) {
         K2LOG_W(log::tx, "Dropping message since we're stopped: verb={}, url={}", int(verb), endpoint.url);
         return;
     }
 
-    auto&& chan = _getOrMakeChannel(endpoint);
+    auto&& chan = _getOrMakeChannel(endpoint, verb, payload ? payload->getSize() : 0);
     if (!chan) {
         K2LOG_W(log::tx, "Dropping message: Unable to create connection for endpoint {}", endpoint.url);
         return;
@@ -187,12 +207,75 @@ void TCPRPCProtocol::send(Verb verb, std::unique_ptr<Payload> payload, TXEndpoin
     chan->send(verb, std::move(payload), std::move(metadata));
 }
 
-seastar::lw_shared_ptr<TCPRPCChannel> TCPRPCProtocol::_getOrMakeChannel(TXEndpoint& endpoint) {
-    // look for an existing channel
+void TCPRPCProtocol::sendOrdered(Verb verb, std::unique_ptr<Payload> payload, TXEndpoint& endpoint, MessageMetadata metadata,
+                                 uint64_t orderingKey) {
+    if (_stopped) {
+        K2LOG_W(log::tx, "Dropping message since we're stopped: verb={}, url={}", int(verb), endpoint.url);
+        return;
+    }
+
+    auto&& chan = _getOrMakeChannel(endpoint, verb, payload ? payload->getSize() : 0, orderingKey);
+    if (!chan) {
+        K2LOG_W(log::tx, "Dropping message: Unable to create connection for endpoint {}", endpoint.url);
+        return;
+    }
+    chan->send(verb, std::move(payload), std::move(metadata));
+}
+
+void TCPRPCProtocol::connect(TXEndpoint& endpoint) {
+    if (_stopped) {
+        K2LOG_W(log::tx, "Unable to connect since we're stopped for url {}", endpoint.url);
+        return;
+    }
+    auto& pool = _getPool(endpoint);
+    for (size_t i = 0; i < pool.channels.size(); ++i) {
+        if (!pool.channels[i]->chan) {
+            _connectPooled(endpoint, *pool.channels[i], i);
+        }
+    }
+}
+
+seastar::lw_shared_ptr<TCPRPCChannel> TCPRPCProtocol::_getOrMakeChannel(TXEndpoint& endpoint, Verb verb, size_t messageBytes,
+                                                                        std::optional<uint64_t> orderingKey) {
+    // look for an incoming channel
     auto iter = _channels.find(endpoint);
     if (iter != _channels.end()) {
         return iter->second;
     }
+
+    auto& pool = _getPool(endpoint);
+    size_t index = 0;
+    if (orderingKey) {
+        index = std::hash<uint64_t>{}(*orderingKey) % pool.channels.size();
+    }
+    else if (pool.channels.size() > 1) {
+        size_t numLarge = pool.channels.size() / 2;
+        size_t numSmall = pool.channels.size() - numLarge;
+        bool large = messageBytes >= _largeMessageBytes() ||
+            std::find(_bulkVerbs().begin(), _bulkVerbs().end(), verb) != _bulkVerbs().end();
+        index = large ? numSmall + pool.nextLarge++ % numLarge : pool.nextSmall++ % numSmall;
+    }
+    auto& pooled = *pool.channels[index];
+    if (!pooled.chan) {
+        _connectPooled(endpoint, pooled, index);
+    }
+    return pooled.chan;
+}
+
+TCPRPCProtocol::ChannelPool& TCPRPCProtocol::_getPool(const TXEndpoint& endpoint) {
+    auto [iter, created] = _pools.try_emplace(endpoint);
+    if (created) {
+        size_t size = std::max(uint32_t(1), _connectionsPerEndpoint());
+        K2LOG_D(log::tx, "creating pool of {} channels for {}", size, endpoint.url);
+        for (size_t i = 0; i < size; ++i) {
+            iter->second.channels.push_back(std::make_unique<PooledChannel>());
+            _registerPooledMetrics(*iter->second.channels.back(), endpoint, i);
+        }
+    }
+    return iter->second;
+}
+
+void TCPRPCProtocol::_connectPooled(const TXEndpoint& endpoint, PooledChannel& pooled, size_t index) {
     K2LOG_D(log::tx, "creating new channel for {}", endpoint.url);
 
     // TODO support for IPv6?
@@ -202,10 +285,45 @@ seastar::lw_shared_ptr<TCPRPCChannel> TCPRPCProtocol::_getOrMakeChannel(TXEndpoi
     auto futureConn = _vnet.local().connectTCP(address);
     if (futureConn.failed()) {
         // the conn failed immediately
-        return nullptr;
+        return;
     }
     // wrap the connection into a TCPChannel
-    return _handleNewChannel(std::move(futureConn), endpoint);
+    pooled.chan = seastar::make_lw_shared<TCPRPCChannel>(std::move(futureConn), endpoint,
+        [this] (Request&& request) {
+            if (!_stopped) {
+                _messageObserver(std::move(request));
+            }
+        },
+        [this, index] (TXEndpoint& endpoint, auto exc) {
+            if (!_stopped) {
+                if (exc) {
+                    K2LOG_W_EXC(log::tx, exc, "Channel {} failed", endpoint.url);
+                }
+                auto poolIter = _pools.find(endpoint);
+                if (poolIter == _pools.end()) {
+                    return seastar::make_ready_future();
+                }
+                auto& channels = poolIter->second.channels;
+                // the channel reports its own endpoint, so we can tell if it is still the one in the pool, or if
+                // it has already been replaced by a new connection
+                auto& pooled = *channels[index];
+                if (pooled.chan && &pooled.chan->getTXEndpoint() == &endpoint) {
+                    auto chan = std::move(pooled.chan);
+                    // the stats stay with the pooled channel, and go away with the pool below. The closing channel
+                    // may still be reading, so it must not count into them any more
+                    chan->setStats(nullptr);
+                    if (std::none_of(channels.begin(), channels.end(), [](auto& p) { return bool(p->chan); })) {
+                        // don't hold on to pools for endpoints we no longer talk to, e.g. clients which went away
+                        _pools.erase(poolIter);
+                    }
+                    return chan->gracefulClose().then([chan] {});
+                }
+            }
+            return seastar::make_ready_future();
+        },
+        _batching);
+    pooled.chan->setStats(&pooled.stats);
+    pooled.chan->run();
 }
 
 seastar::lw_shared_ptr<TCPRPCChannel>
@@ -231,12 +349,48 @@ TCPRPCProtocol::_handleNewChannel(seastar::future<seastar::connected_socket> fut
                 }
             }
             return seastar::make_ready_future();
-        });
+        },
+        _batching);
     _channels.emplace(chan->getTXEndpoint(), chan);
     chan->run();
     return chan;
 }
 
+void TCPRPCProtocol::_registerMetrics() {
+    namespace sm = seastar::metrics;
+    _metricGroups.clear();
+    std::vector<sm::label_instance> labels;
+    labels.push_back(sm::label_instance("total_cores", seastar::smp::count));
+
+    _metricGroups.add_group("tcp_rpc", {
+        sm::make_counter("flushes", _batching.flushes, sm::description("Number of write batches flushed to TCP sockets"), labels),
+        sm::make_counter("full_flushes", _batching.fullFlushes, sm::description("Number of write batches flushed because they reached tcp_batch_max_bytes"), labels),
+        sm::make_counter("sent_messages", _batching.messages, sm::description("Number of messages sent over TCP"), labels),
+        sm::make_histogram("messages_per_flush", [this]{ return _batching.messagesPerFlush.getHistogram();},
+                sm::description("Number of messages written out in one flush"), labels),
+        sm::make_histogram("bytes_per_flush", [this]{ return _batching.bytesPerFlush.getHistogram();},
+                sm::description("Number of bytes written out in one flush"), labels),
+    });
+}
+
+void TCPRPCProtocol::_registerPooledMetrics(PooledChannel& pooled, const TXEndpoint& endpoint, size_t index) {
+    namespace sm = seastar::metrics;
+    std::vector<sm::label_instance> labels;
+    labels.push_back(sm::label_instance("total_cores", seastar::smp::count));
+    labels.push_back(sm::label_instance("endpoint", endpoint.url));
+    labels.push_back(sm::label_instance("connection", index));
+
+    auto& stats = pooled.stats;
+    pooled.metricGroups.add_group("tcp_rpc_connection", {
+        sm::make_counter("sent_bytes", stats.sentBytes, sm::description("Number of bytes sent over the connection"), labels),
+        sm::make_counter("received_bytes", stats.receivedBytes, sm::description("Number of bytes received over the connection"), labels),
+        sm::make_counter("sent_messages", stats.sentMessages, sm::description("Number of messages sent over the connection"), labels),
+        sm::make_counter("received_messages", stats.receivedMessages, sm::description("Number of messages received over the connection"), labels),
+        sm::make_histogram("response_latency", [&stats]{ return stats.responseLatency.getHistogram();},
+                sm::description("Time from sending a request over the connection to receiving its response, in usecs"), labels),
+    });
+}
+
 TXEndpoint TCPRPCProtocol::_endpointFromAddress(SocketAddress addr) {
     const size_t bufsize = 64;
     char buffer[bufsize];
@@ -22,7 +22,10 @@ Copyright(c) 2020 Futurewei Cloud
 */
 
 #pragma once
+#include <optional>
+
 #include <seastar/core/future.hh>
+#include <seastar/core/metrics_registration.hh>
 #include <seastar/core/shared_ptr.hh>
 // k2
 #include "IRPCProtocol.h"
@@ -37,6 +40,12 @@ namespace k2 {
 // - listen for incoming TCP connections
 // - create outgoing TCP connections when asked to send messages
 // - receive incoming messages and pass them on to the message observer for the protocol
+// Outgoing messages to an endpoint go over a pool of tcp_connections_per_endpoint connections. With more than one
+// connection, the pool is split in two traffic classes so that large messages, and requests for verbs which get
+// large responses (tcp_bulk_verbs), don't hold up small ones: the first half (rounded up) of the connections carry
+// small messages, and the rest carry large ones. Messages within a class are striped round-robin over its connections,
+// so messages to the same endpoint may be delivered out of order. Messages sent with an ordering key (sendOrdered)
+// always go over the connection picked by the key, regardless of their class, so they stay in order.
 // NB, the class is meant to be used as a distributed<> container
 class TCPRPCProtocol: public IRPCProtocol {
 public: // types
@@ -75,9 +84,19 @@ public: // API
     // The RPC message is configured with the given metadata
     void send(Verb verb, std::unique_ptr<Payload> payload, TXEndpoint& endpoint, MessageMetadata metadata) override;
 
+    // Sends over the pooled connection picked by the ordering key
+    void sendOrdered(Verb verb, std::unique_ptr<Payload> payload, TXEndpoint& endpoint, MessageMetadata metadata,
+                     uint64_t orderingKey) override;
+
+    // Opens all connections in the pool for the given endpoint
+    void connect(TXEndpoint& endpoint) override;
+
     // Returns the endpoint where this protocol accepts incoming connections.
     seastar::lw_shared_ptr<TXEndpoint> getServerEndpoint() override;
 
+    // Returns the number of open connections in the pool for the given endpoint, or nullopt if there is no pool
+    std::optional<size_t> getPooledConnections(const TXEndpoint& endpoint) const;
+
 public: // distributed<> interface
     // iface: called by seastar's distributed mechanism when stop() is invoked on the distributed container.
     // The method's returned future completes once all channels had a chance to complete a graceful shutdown
@@ -86,9 +105,34 @@ public: // distributed<> interface
     // Should be called by user when all distributed objects have been created
     void start() override;
 
+private: // types
+    // A connection in the pool of an endpoint. The stats are kept across reconnects, until the pool is dropped
+    // once all of its connections are gone
+    struct PooledChannel {
+        seastar::lw_shared_ptr<TCPRPCChannel> chan;
+        TCPChannelStats stats;
+        seastar::metrics::metric_groups metricGroups;
+    };
+
+    // The outgoing connections to an endpoint
+    struct ChannelPool {
+        std::vector<std::unique_ptr<PooledChannel>> channels;
+        size_t nextSmall{0};
+        size_t nextLarge{0};
+    };
+
 private: // methods
-    // utility method which ew use to obtain a connection(either existing or new) for the given endpoint
-    seastar::lw_shared_ptr<TCPRPCChannel> _getOrMakeChannel(TXEndpoint& endpoint);
+    // utility method which we use to obtain a connection(either existing or new) for the given endpoint.
+    // Incoming connections are used if the endpoint is the remote end of one. Otherwise we pick a connection from
+    // the pool of the endpoint based on the traffic class of the message, or based on the ordering key if given
+    seastar::lw_shared_ptr<TCPRPCChannel> _getOrMakeChannel(TXEndpoint& endpoint, Verb verb, size_t messageBytes,
+                                                            std::optional<uint64_t> orderingKey=std::nullopt);
+
+    // returns the pool for the given endpoint, creating it if needed
+    ChannelPool& _getPool(const TXEndpoint& endpoint);
+
+    // opens a new outgoing connection for the pooled channel at the given index
+    void _connectPooled(const TXEndpoint& endpoint, PooledChannel& pooled, size_t index);
 
     // process a new channel creation
     seastar::lw_shared_ptr<TCPRPCChannel>
@@ -97,6 +141,10 @@ private: // methods
     // Helper method to create an TXEndpoint from a socket address
     TXEndpoint _endpointFromAddress(SocketAddress addr);
 
+    void _registerMetrics();
+
+    void _registerPooledMetrics(PooledChannel& pooled, const TXEndpoint& endpoint, size_t index);
+
 private: // fields
     // the address we're listening on
     SocketAddress _addr;
@@ -110,9 +158,22 @@ private: // fields
     seastar::lw_shared_ptr<seastar::server_socket> _listen_socket;
     seastar::future<> _listenerClosed = seastar::make_ready_future();
 
-    // the underlying TCP channels we're dealing with
+    // the incoming TCP channels we're dealing with
     std::unordered_map<TXEndpoint, seastar::lw_shared_ptr<TCPRPCChannel>> _channels;
 
+    // the outgoing TCP channels
+    std::unordered_map<TXEndpoint, ChannelPool> _pools;
+
+    // connection pool settings
+    ConfigVar<uint32_t> _connectionsPerEndpoint{"tcp_connections_per_endpoint", 1};
+    ConfigVar<uint64_t> _largeMessageBytes{"tcp_large_message_bytes", 16 * 1024};
+    ConfigVar<std::vector<uint32_t>> _bulkVerbs{"tcp_bulk_verbs"};
+
+    // the write batching settings and counters for all of our channels
+    TCPWriteBatching _batching;
+
+    seastar::metrics::metric_groups _metricGroups;
+
 private: // not needed
     TCPRPCProtocol() = delete;
     TCPRPCProtocol(const TCPRPCProtocol& o) = delete;
@@ -0,0 +1,235 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <k2/appbase/Appbase.h>
+#include <k2/appbase/AppEssentials.h>
+#include <k2/dto/Collection.h>
+#include <k2/dto/ControlPlaneOracle.h>
+#include <k2/dto/MessageVerbs.h>
+
+#include <seastar/core/sleep.hh>
+
+#include <algorithm>
+#include <tuple>
+
+// Checks that the CPO recovers collections and schemas from its data directory after a restart.
+// test/integration/test_cpo_restart.sh runs the "create" phase, restarts the CPO and then runs the "verify" phase.
+
+const char* collname = "cpo_restart_test_collection";
+
+namespace k2::log {
+inline thread_local k2::logging::Logger cpo_restart_test("k2::cpo_restart_test");
+}
+
+namespace k2 {
+class CPORestartTest {
+public:
+    CPORestartTest() {
+        K2LOG_I(log::cpo_restart_test, "ctor");
+    }
+    ~CPORestartTest() {
+        K2LOG_I(log::cpo_restart_test, "dtor");
+    }
+    seastar::future<> gracefulStop() {
+        K2LOG_I(log::cpo_restart_test, "stop");
+        return std::move(_testFuture);
+    }
+
+    seastar::future<> start() {
+        K2LOG_I(log::cpo_restart_test, "start");
+        _cpoEndpoint = RPC().getTXEndpoint(_cpoConfigEp());
+
+        _testTimer.set_callback([this] {
+            _testFuture = seastar::make_ready_future()
+            .then([this] {
+                if (_phase() == "create") {
+                    return runCreate();
+                }
+                if (_phase() == "verify") {
+                    return runVerify();
+                }
+                return seastar::make_exception_future(std::runtime_error("unknown test phase: " + _phase()));
+            })
+            .then([this] {
+                K2LOG_I(log::cpo_restart_test, "======= All tests passed ========");
+                exitcode = 0;
+            })
+            .handle_exception([this](auto exc) {
+                try {
+                    std::rethrow_exception(exc);
+                } catch (RPCDispatcher::RequestTimeoutException& exc) {
+                    K2LOG_E(log::cpo_restart_test, "======= Test failed due to timeout ========");
+                    exitcode = -1;
+                } catch (std::exception& e) {
+                    K2LOG_E(log::cpo_restart_test, "======= Test failed with exception [{}] ========", e.what());
+                    exitcode = -1;
+                }
+            })
+            .finally([this] {
+                K2LOG_I(log::cpo_restart_test, "======= Test ended ========");
+                AppBase().stop(exitcode);
+            });
+        });
+        _testTimer.arm(0ms);
+        return seastar::make_ready_future<>();
+    }
+
+    seastar::future<> runCreate() {
+        K2LOG_I(log::cpo_restart_test, ">>> Create: a collection with three schemas");
+        auto request = dto::CollectionCreateRequest{
+            .metadata{
+                .name=collname,
+                .hashScheme=dto::HashScheme::HashCRC32C,
+                .storageDriver=dto::StorageDriver::K23SI,
+                .capacity{
+                    .dataCapacityMegaBytes=1,
+                    .readIOPs=100,
+                    .writeIOPs=200,
+                    .minNodes=1
+                },
+                .retentionPeriod = 1h*90*24
+            },
+            .rangeEnds{}
+        };
+        return RPC()
+        .callRPC<dto::CollectionCreateRequest, dto::CollectionCreateResponse>(dto::Verbs::CPO_COLLECTION_CREATE, request, *_cpoEndpoint, 1s)
+        .then([](auto&& response) {
+            auto& [status, resp] = response;
+            K2EXPECT(log::cpo_restart_test, status, Statuses::S201_Created);
+            // wait for the collection to get assigned
+            return seastar::sleep(100ms);
+        })
+        .then([this] {
+            return _createSchema(_makeSchema("schema1", 1));
+        })
+        .then([this] {
+            return _createSchema(_makeSchema("schema1", 2));
+        })
+        .then([this] {
+            return _createSchema(_makeSchema("schema2", 1));
+        })
+        .then([this] {
+            return _checkSchemas();
+        });
+    }
+
+    seastar::future<> runVerify() {
+        K2LOG_I(log::cpo_restart_test, ">>> Verify: the collection and its schemas are loaded from disk");
+        auto request = dto::CollectionGetRequest{.name=collname};
+        return RPC()
+        .callRPC<dto::CollectionGetRequest, dto::CollectionGetResponse>(dto::Verbs::CPO_COLLECTION_GET, request, *_cpoEndpoint, 1s)
+        .then([](auto&& response) {
+            auto& [status, resp] = response;
+            K2EXPECT(log::cpo_restart_test, status, Statuses::S200_OK);
+            auto& md = resp.collection.metadata;
+            K2EXPECT(log::cpo_restart_test, md.name, collname);
+            K2EXPECT(log::cpo_restart_test, md.hashScheme, dto::HashScheme::HashCRC32C);
+            K2EXPECT(log::cpo_restart_test, md.storageDriver, dto::StorageDriver::K23SI);
+            K2EXPECT(log::cpo_restart_test, md.retentionPeriod, 1h*90*24);
+            K2EXPECT(log::cpo_restart_test, md.capacity.dataCapacityMegaBytes, 1);
+            K2EXPECT(log::cpo_restart_test, md.capacity.readIOPs, 100);
+            K2EXPECT(log::cpo_restart_test, md.capacity.writeIOPs, 200);
+            K2EXPECT(log::cpo_restart_test, resp.collection.partitionMap.partitions.size() > 0, true);
+            for (auto& p : resp.collection.partitionMap.partitions) {
+                K2EXPECT(log::cpo_restart_test, p.astate, dto::AssignmentState::Assigned);
+            }
+        })
+        .then([this] {
+            return _checkSchemas();
+        })
+        .then([this] {
+            // the loaded schemas are used to validate new ones
+            K2LOG_I(log::cpo_restart_test, ">>> Verify: an existing schema can't be created again");
+            auto request = dto::CreateSchemaRequest{collname, _makeSchema("schema1", 2)};
+            return RPC()
+            .callRPC<dto::CreateSchemaRequest, dto::CreateSchemaResponse>(dto::Verbs::CPO_SCHEMA_CREATE, request, *_cpoEndpoint, 1s)
+            .then([](auto&& response) {
+                auto& [status, resp] = response;
+                K2EXPECT(log::cpo_restart_test, status, Statuses::S403_Forbidden);
+            });
+        });
+    }
+
+private:
+    dto::Schema _makeSchema(String name, int64_t version) {
+        dto::Schema schema;
+        schema.name = std::move(name);
+        schema.version = version;
+        schema.fields = std::vector<dto::SchemaField> {
+                {dto::FieldType::STRING, "partition", false, false},
+                {dto::FieldType::STRING, "range", false, false},
+                {dto::FieldType::STRING, "data", false, false},
+        };
+        schema.setPartitionKeyFieldsByName(std::vector<String>{"partition"});
+        schema.setRangeKeyFieldsByName(std::vector<String>{"range"});
+        return schema;
+    }
+
+    seastar::future<> _createSchema(dto::Schema schema) {
+        auto request = dto::CreateSchemaRequest{collname, std::move(schema)};
+        return RPC()
+        .callRPC<dto::CreateSchemaRequest, dto::CreateSchemaResponse>(dto::Verbs::CPO_SCHEMA_CREATE, request, *_cpoEndpoint, 1s)
+        .then([](auto&& response) {
+            auto& [status, resp] = response;
+            K2EXPECT(log::cpo_restart_test, status, Statuses::S200_OK);
+        });
+    }
+
+    seastar::future<> _checkSchemas() {
+        auto request = dto::GetSchemasRequest{collname};
+        return RPC()
+        .callRPC<dto::GetSchemasRequest, dto::GetSchemasResponse>(dto::Verbs::CPO_SCHEMAS_GET, request, *_cpoEndpoint, 1s)
+        .then([](auto&& response) {
+            auto& [status, resp] = response;
+            K2EXPECT(log::cpo_restart_test, status, Statuses::S200_OK);
+            K2EXPECT(log::cpo_restart_test, resp.schemas.size(), 3);
+            auto& schemas = resp.schemas;
+            std::sort(schemas.begin(), schemas.end(), [](const dto::Schema& a, const dto::Schema& b) {
+                return std::tie(a.name, a.version) < std::tie(b.name, b.version);
+            });
+            K2EXPECT(log::cpo_restart_test, schemas[0].name, "schema1");
+            K2EXPECT(log::cpo_restart_test, schemas[0].version, 1);
+            K2EXPECT(log::cpo_restart_test, schemas[1].name, "schema1");
+            K2EXPECT(log::cpo_restart_test, schemas[1].version, 2);
+            K2EXPECT(log::cpo_restart_test, schemas[2].name, "schema2");
+            K2EXPECT(log::cpo_restart_test, schemas[2].version, 1);
+            K2EXPECT(log::cpo_restart_test, schemas[2].fields.size(), 3);
+        });
+    }
+
+    int exitcode = -1;
+    ConfigVar<String> _cpoConfigEp{"cpo"};
+    ConfigVar<String> _phase{"cpo_restart_test_phase"};
+    std::unique_ptr<TXEndpoint> _cpoEndpoint;
+    seastar::future<> _testFuture = seastar::make_ready_future();
+    seastar::timer<> _testTimer;
+};
+} // namespace k2
+
+int main(int argc, char** argv) {
+    k2::App app("CPORestartTest");
+    app.addOptions()("cpo", bpo::value<k2::String>(), "The endpoint of the CPO");
+    app.addOptions()("cpo_restart_test_phase", bpo::value<k2::String>(), "The phase of the test to run: create or verify");
+    app.addApplet<k2::CPORestartTest>();
+    return app.start(argc, argv);
+}
@@ -0,0 +1,227 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#define CATCH_CONFIG_MAIN
+
+#include <map>
+#include <random>
+#include <string>
+
+#include <k2/indexer/BTreeIndex.h>
+#include "catch2/catch.hpp"
+
+namespace {
+// a two-part key, similar to the partition/range keys used by the K23SI indexer
+struct TestKey {
+    std::string pkey;
+    std::string rkey;
+    int compare(const TestKey& o) const {
+        auto c = pkey.compare(o.pkey);
+        return c == 0 ? rkey.compare(o.rkey) : c;
+    }
+    bool operator<(const TestKey& o) const { return compare(o) < 0; }
+};
+
+struct TestKeyTraits {
+    static constexpr size_t segments = 2;
+    static std::string_view segment(const TestKey& key, size_t idx) {
+        return idx == 0 ? std::string_view(key.pkey) : std::string_view(key.rkey);
+    }
+    static int compare(const TestKey& a, const TestKey& b) { return a.compare(b); }
+};
+
+// use small nodes so that we get deep trees with few keys
+typedef k2::indexer::BTreeIndex<TestKey, int, TestKeyTraits, 4> SmallTree;
+typedef k2::indexer::BTreeIndex<TestKey, int, TestKeyTraits> DefaultTree;
+
+// keys with long common prefixes, binary data and keys which are prefixes of each other
+TestKey makeKey(std::mt19937& rng) {
+    static const std::string prefixes[] = {"", "a", "schema\0\1part", "schema\0\1partition_key_0000"};
+    std::string pkey = prefixes[rng() % 4];
+    auto len = rng() % 12;
+    for (size_t i = 0; i < len; ++i) {
+        pkey.push_back(static_cast<char>(rng() % 4 == 0 ? 0xFF - rng() % 3 : rng() % 3));
+    }
+    return TestKey{pkey, std::to_string(rng() % 5)};
+}
+
+template <typename TreeT>
+void checkSame(TreeT& tree, std::map<TestKey, int>& ref) {
+    REQUIRE(tree.size() == ref.size());
+    REQUIRE(tree.empty() == ref.empty());
+    auto it = tree.begin();
+    for (auto& [k, v] : ref) {
+        REQUIRE(it != tree.end());
+        REQUIRE(it->first.compare(k) == 0);
+        REQUIRE(it->second == v);
+        ++it;
+    }
+    REQUIRE(it == tree.end());
+
+    // and backwards
+    auto rit = ref.rbegin();
+    for (auto bit = tree.end(); bit != tree.begin();) {
+        --bit;
+        REQUIRE(bit->first.compare(rit->first) == 0);
+        ++rit;
+    }
+    REQUIRE(rit == ref.rend());
+}
+
+template <typename TreeT>
+void randomOps(uint32_t seed, size_t ops) {
+    std::mt19937 rng(seed);
+    TreeT tree;
+    std::map<TestKey, int> ref;
+    for (size_t i = 0; i < ops; ++i) {
+        auto key = makeKey(rng);
+        auto op = rng() % 10;
+        if (op < 6) {
+            auto [it, inserted] = tree.try_emplace(key, (int)i);
+            auto [rit, rinserted] = ref.try_emplace(key, (int)i);
+            REQUIRE(inserted == rinserted);
+            REQUIRE(it->second == rit->second);
+        } else if (op < 9) {
+            auto it = tree.lower_bound(key);
+            auto rit = ref.lower_bound(key);
+            if (rit == ref.end()) {
+                REQUIRE(it == tree.end());
+                continue;
+            }
+            REQUIRE(it->first.compare(rit->first) == 0);
+            auto next = tree.erase(it);
+            auto rnext = ref.erase(rit);
+            if (rnext == ref.end()) {
+                REQUIRE(next == tree.end());
+            } else {
+                REQUIRE(next->first.compare(rnext->first) == 0);
+            }
+        } else {
+            auto it = tree.upper_bound(key);
+            auto rit = ref.upper_bound(key);
+            REQUIRE((it == tree.end()) == (rit == ref.end()));
+            if (rit != ref.end()) {
+                REQUIRE(it->first.compare(rit->first) == 0);
+            }
+            auto fit = tree.find(key);
+            auto frit = ref.find(key);
+            REQUIRE((fit == tree.end()) == (frit == ref.end()));
+        }
+        if (i % 97 == 0) {
+            checkSame(tree, ref);
+        }
+    }
+    checkSame(tree, ref);
+
+    // drain everything
+    while (!ref.empty()) {
+        auto rit = ref.begin();
+        std::advance(rit, rng() % ref.size());
+        REQUIRE(tree.erase(rit->first) == 1);
+        ref.erase(rit);
+    }
+    checkSame(tree, ref);
+    REQUIRE(tree.begin() == tree.end());
+}
+} // namespace
+
+SCENARIO("test01 empty tree") {
+    DefaultTree tree;
+    REQUIRE(tree.size() == 0);
+    REQUIRE(tree.empty());
+    REQUIRE(tree.begin() == tree.end());
+    REQUIRE(tree.lower_bound(TestKey{"a", ""}) == tree.end());
+    REQUIRE(tree.upper_bound(TestKey{"a", ""}) == tree.end());
+    REQUIRE(tree.find(TestKey{"a", ""}) == tree.end());
+    REQUIRE(tree.erase(TestKey{"a", ""}) == 0);
+}
+
+SCENARIO("test02 sequential inserts and bounds") {
+    SmallTree tree;
+    for (int i = 0; i < 1000; ++i) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "key%06d", i * 2);
+        auto [it, inserted] = tree.try_emplace(TestKey{buf, ""}, i);
+        REQUIRE(inserted);
+        REQUIRE(it->second == i);
+    }
+    REQUIRE(tree.size() == 1000);
+    for (int i = 0; i < 1000; ++i) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "key%06d", i * 2);
+        auto it = tree.find(TestKey{buf, ""});
+        REQUIRE(it != tree.end());
+        REQUIRE(it->second == i);
+
+        // the key right after is not present
+        snprintf(buf, sizeof(buf), "key%06d", i * 2 + 1);
+        REQUIRE(tree.find(TestKey{buf, ""}) == tree.end());
+        auto [lower, upper] = tree.equal_range(TestKey{buf, ""});
+        REQUIRE(lower == upper);
+        if (i == 999) {
+            REQUIRE(lower == tree.end());
+        } else {
+            REQUIRE(lower->second == i + 1);
+        }
+    }
+    // duplicate inserts don't replace the value
+    auto [it, inserted] = tree.try_emplace(TestKey{"key000000", ""}, 42);
+    REQUIRE(!inserted);
+    REQUIRE(it->second == 0);
+}
+
+SCENARIO("test03 references are stable across inserts and erases") {
+    SmallTree tree;
+    auto& val = tree.try_emplace(TestKey{"m", "m"}, 7).first->second;
+    for (int i = 0; i < 500; ++i) {
+        tree.try_emplace(TestKey{std::to_string(i), ""}, i);
+    }
+    for (int i = 0; i < 500; i += 2) {
+        tree.erase(TestKey{std::to_string(i), ""});
+    }
+    REQUIRE(&tree.find(TestKey{"m", "m"})->second == &val);
+    REQUIRE(val == 7);
+}
+
+SCENARIO("test04 randomized operations against std::map") {
+    for (uint32_t seed = 1; seed <= 5; ++seed) {
+        randomOps<SmallTree>(seed, 5000);
+        randomOps<DefaultTree>(seed, 5000);
+    }
+}
+
+SCENARIO("test05 move construction and assignment") {
+    DefaultTree tree;
+    for (int i = 0; i < 100; ++i) {
+        tree.try_emplace(TestKey{std::to_string(i), "r"}, i);
+    }
+    DefaultTree moved(std::move(tree));
+    REQUIRE(tree.empty());
+    REQUIRE(moved.size() == 100);
+    DefaultTree assigned;
+    assigned.try_emplace(TestKey{"x", ""}, 1);
+    assigned = std::move(moved);
+    REQUIRE(assigned.size() == 100);
+    REQUIRE(assigned.find(TestKey{"x", ""}) == assigned.end());
+    REQUIRE(assigned.find(TestKey{"42", "r"})->second == 42);
+}
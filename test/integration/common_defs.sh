@@ -1,6 +1,8 @@
 set -e
 CPODIR=/tmp/___cpo_integ_test
 rm -rf ${CPODIR}
+PERSISTENCEDIR=/tmp/___persistence_integ_test
+rm -rf ${PERSISTENCEDIR}
 EPS=("tcp+k2rpc://0.0.0.0:10000" "tcp+k2rpc://0.0.0.0:10001" "tcp+k2rpc://0.0.0.0:10002" "tcp+k2rpc://0.0.0.0:10003" "tcp+k2rpc://0.0.0.0:10004")
 NUMCORES=`nproc`
 # core on which to run the TSO poller thread. Pick 4 if we have that many, or the highest-available otherwise
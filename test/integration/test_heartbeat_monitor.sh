@@ -9,7 +9,7 @@ cd ${topname}/../..
 nodepool_child_pid=$!
 
 # start persistence
-./build/src/k2/cmd/persistence/persistence ${COMMON_ARGS} -c1 --tcp_endpoints ${PERSISTENCE} --prometheus_port 63002 &
+./build/src/k2/cmd/persistence/persistence ${COMMON_ARGS} -c1 --tcp_endpoints ${PERSISTENCE} --persistence_wal_dir ${PERSISTENCEDIR} --prometheus_port 63002 &
 persistence_child_pid=$!
 
 # start tso
@@ -25,6 +25,7 @@ function finish {
   rv=$?
   # cleanup code
   rm -rf ${CPODIR}
+  rm -rf ${PERSISTENCEDIR}
 
   kill ${cpo_child_pid}
   echo "Waiting for cpo child pid: ${cpo_child_pid}"
@@ -13,7 +13,7 @@ cpo_child_pid=$!
 nodepool_child_pid=$!
 
 # start persistence
-./build/src/k2/cmd/persistence/persistence ${COMMON_ARGS} -c1 --tcp_endpoints ${PERSISTENCE} --prometheus_port 63002 &
+./build/src/k2/cmd/persistence/persistence ${COMMON_ARGS} -c1 --tcp_endpoints ${PERSISTENCE} --persistence_wal_dir ${PERSISTENCEDIR} --prometheus_port 63002 &
 persistence_child_pid=$!
 
 # start tso
@@ -29,6 +29,7 @@ function finish {
   rv=$?
   # cleanup code
   rm -rf ${CPODIR}
+  rm -rf ${PERSISTENCEDIR}
 
   kill ${nodepool_child_pid}
   echo "Waiting for nodepool child pid: ${nodepool_child_pid}"
@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+
+'''
+MIT License
+
+Copyright (c) 2022 Futurewei Cloud
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+'''
+
+# Pushes between two partitions hosted on different cores of the same nodepool. The push is either handled
+# by the TRH core directly (--expect local), or refused there and sent as an RPC instead (--expect remote)
+
+import argparse, unittest, sys
+import requests
+from skvclient import (CollectionMetadata, CollectionCapacity, SKVClient,
+    HashScheme, StorageDriver, Schema, SchemaField, FieldType, TimeDelta)
+
+parser = argparse.ArgumentParser()
+parser.add_argument("--http", help="HTTP API URL")
+parser.add_argument("--prometheus_port", help="Nodepool prometheus_port")
+parser.add_argument("--expect", choices=["local", "remote"], help="How the push is expected to reach the TRH")
+args = parser.parse_args()
+url = "http://127.0.0.1:" + args.prometheus_port + "/metrics"
+
+def get_counter(name):
+    "Sum of the given nodepool counter over all cores"
+    r = requests.get(url)
+    count = 0
+    for line in r.text.splitlines():
+        if line.startswith("NodePoolService_Nodepool_" + name + "{"):
+            count += int(float(line.split()[-1]))
+    return count
+
+class TestLocalPush(unittest.TestCase):
+    def test_push(self):
+        cl = SKVClient(args.http)
+        cname = b'local_push'
+        metadata = CollectionMetadata(name = cname,
+            hashScheme = HashScheme.Range,
+            storageDriver = StorageDriver.K23SI,
+            capacity = CollectionCapacity(minNodes = 2),
+            retentionPeriod = TimeDelta(hours=5)
+        )
+        # partition1 "a" is in the first partition and "z" in the second
+        endspec = b"^01default^00^01^01d^00^01"
+        status = cl.create_collection(metadata, rangeEnds = [endspec, b""])
+        self.assertTrue(status.is2xxOK(), msg=status.message)
+
+        schema = Schema(name=b'push_test', version=1,
+            fields=[
+                SchemaField(FieldType.STRING, b'partition'),
+                SchemaField(FieldType.STRING, b'partition1'),
+                SchemaField(FieldType.STRING, b'range'),
+                SchemaField(FieldType.STRING, b'data')],
+            partitionKeyFields=[0, 1], rangeKeyFields=[2])
+        status = cl.create_schema(cname, schema)
+        self.assertTrue(status.is2xxOK(), msg=status.message)
+
+        local = get_counter("local_pushes")
+        remote = get_counter("remote_pushes")
+
+        # the incumbent has its TRH in the first partition and a WI in the second
+        status, incumbent = cl.begin_txn()
+        self.assertTrue(status.is2xxOK())
+        status = incumbent.write(cname, schema.make_record(partition=b"default", partition1=b"a", range=b"r", data=b"incumbent"))
+        self.assertTrue(status.is2xxOK(), msg=status.message)
+        status = incumbent.write(cname, schema.make_record(partition=b"default", partition1=b"z", range=b"r", data=b"incumbent"))
+        self.assertTrue(status.is2xxOK(), msg=status.message)
+
+        # the challenger runs into the WI in the second partition, which pushes the TRH. The incumbent is older
+        # and still in progress, so it wins
+        status, challenger = cl.begin_txn()
+        self.assertTrue(status.is2xxOK())
+        status = challenger.write(cname, schema.make_record(partition=b"default", partition1=b"z", range=b"r", data=b"challenger"))
+        self.assertEqual(status.code, 409, msg=status.message)
+        status = challenger.end(False)
+        self.assertTrue(status.is2xxOK(), msg=status.message)
+
+        status = incumbent.end()
+        self.assertTrue(status.is2xxOK(), msg=status.message)
+
+        if args.expect == "local":
+            self.assertEqual(get_counter("local_pushes"), local + 1)
+            self.assertEqual(get_counter("remote_pushes"), remote)
+        else:
+            self.assertEqual(get_counter("local_pushes"), local)
+            self.assertEqual(get_counter("remote_pushes"), remote + 1)
+
+        # the incumbent's value is committed
+        status, txn = cl.begin_txn()
+        self.assertTrue(status.is2xxOK())
+        status, record = txn.read(cname, schema.make_record(partition=b"default", partition1=b"z", range=b"r"))
+        self.assertTrue(status.is2xxOK(), msg=status.message)
+        self.assertEqual(record.fields.data, b"incumbent")
+        status = txn.end()
+        self.assertTrue(status.is2xxOK(), msg=status.message)
+
+del sys.argv[1:]
+unittest.main()
@@ -0,0 +1,57 @@
+#!/bin/bash
+set -e
+topname=$(dirname "$0")
+source ${topname}/common_defs.sh
+cd ${topname}/../..
+
+./build/src/k2/cmd/controlPlaneOracle/cpo_main ${COMMON_ARGS} -c1 --tcp_endpoints ${CPO} 9001 --data_dir ${CPODIR} --prometheus_port 63000 --assignment_timeout=3s --txn_heartbeat_deadline=1s --nodepool_endpoints ${EPS[@]:0:2} --tso_endpoints ${TSO} --tso_error_bound=100us --persistence_endpoints ${PERSISTENCE}&
+cpo_child_pid=$!
+
+# both partitions of the test collection are on this node, one per core. The TRH core refuses the pushes
+# handed to it directly, so they are sent as RPCs
+./build/src/k2/cmd/nodepool/nodepool ${COMMON_ARGS} -c2 --tcp_endpoints ${EPS[@]:0:2} --k23si_persistence_endpoint ${PERSISTENCE} --prometheus_port 63001 --memory=1G --partition_request_timeout=6s --k23si_local_push_refuse true &
+nodepool_child_pid=$!
+
+./build/src/k2/cmd/persistence/persistence ${COMMON_ARGS} -c1 --tcp_endpoints ${PERSISTENCE} --persistence_wal_dir ${PERSISTENCEDIR} --prometheus_port 63002 &
+persistence_child_pid=$!
+
+./build/src/k2/cmd/tso/tso ${COMMON_ARGS} -c1 --tcp_endpoints ${TSO} --prometheus_port 63003 --tso.clock_poller_cpu=${TSO_POLLER_CORE} &
+tso_child_pid=$!
+
+sleep 1
+
+./build/src/k2/cmd/httpproxy/http_proxy ${COMMON_ARGS} -c1 --tcp_endpoints ${HTTP} --memory=1G --cpo ${CPO} --cpo_request_timeout=6s&
+http_child_pid=$!
+
+function finish {
+  rv=$?
+  # cleanup code
+  rm -rf ${CPODIR}
+  rm -rf ${PERSISTENCEDIR}
+
+  kill ${nodepool_child_pid}
+  echo "Waiting for nodepool child pid: ${nodepool_child_pid}"
+  wait ${nodepool_child_pid}
+
+  kill ${cpo_child_pid}
+  echo "Waiting for cpo child pid: ${cpo_child_pid}"
+  wait ${cpo_child_pid}
+
+  kill ${persistence_child_pid}
+  echo "Waiting for persistence child pid: ${persistence_child_pid}"
+  wait ${persistence_child_pid}
+
+  kill ${tso_child_pid}
+  echo "Waiting for tso child pid: ${tso_child_pid}"
+  wait ${tso_child_pid}
+
+  kill ${http_child_pid}
+  echo "Waiting for http child pid: ${http_child_pid}"
+  wait ${http_child_pid}
+
+  echo ">>>> Test ${0} finished with code ${rv}"
+}
+trap finish EXIT
+sleep 1
+
+PYTHONPATH=${PYTHONPATH}:./test/integration ./test/integration/test_local_push.py --http http://127.0.0.1:30000 --prometheus_port 63001 --expect remote
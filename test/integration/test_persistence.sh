@@ -0,0 +1,17 @@
+#!/bin/bash
+set -e
+topname=$(dirname "$0")
+source ${topname}/common_defs.sh
+cd ${topname}/../..
+
+function finish {
+  rv=$?
+  # cleanup code
+  rm -rf ${PERSISTENCEDIR}
+  echo ">>>> Test ${0} finished with code ${rv}"
+}
+trap finish EXIT
+
+./build/test/persistence/wal_test ${COMMON_ARGS} -c1 --persistence_wal_dir ${PERSISTENCEDIR} --persistence_segment_size 65536 --prometheus_port 63100
+rm -rf ${PERSISTENCEDIR}
+./build/test/persistence/snapshot_test ${COMMON_ARGS} -c1 --tcp_endpoints 12345 --k23si_persistence_endpoints tcp+k2rpc://0.0.0.0:12345 --persistence_wal_dir ${PERSISTENCEDIR} --prometheus_port 63101
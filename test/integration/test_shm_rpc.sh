@@ -0,0 +1,41 @@
+#!/bin/bash
+set -e
+topname=$(dirname "$0")
+source ${topname}/common_defs.sh
+cd ${topname}/../..
+
+SHM_ARGS="--enable_shm_rpc true --shm_ring_size 65536"
+SERVER=tcp+k2rpc://0.0.0.0:14000
+
+# start the echo server
+./build/test/transport/shm_rpc_test ${COMMON_ARGS} ${SHM_ARGS} -c1 --tcp_endpoints ${SERVER} --shm_test_role server --prometheus_port 63001 &
+server_child_pid=$!
+
+function finish {
+  rv=$?
+  # cleanup code
+  if kill -0 ${server_child_pid} 2>/dev/null; then
+    kill ${server_child_pid}
+    echo "Waiting for server child pid: ${server_child_pid}"
+    wait ${server_child_pid} || true
+  fi
+  echo ">>>> Test ${0} finished with code ${rv}"
+}
+trap finish EXIT
+
+sleep 1
+
+# send/reply, backpressure and peer death. The client crashes the server in the last scenario
+./build/test/transport/shm_rpc_test ${COMMON_ARGS} ${SHM_ARGS} -c1 --tcp_endpoints 14001 --shm_test_role client --shm_test_server ${SERVER} --shm_max_pending_bytes 262144 --prometheus_port 63002
+wait ${server_child_pid} || true
+
+# a listener left behind by a crashed process is removed when the next process starts
+./build/test/transport/shm_rpc_test ${COMMON_ARGS} ${SHM_ARGS} -c1 --tcp_endpoints ${SERVER} --shm_test_role server --prometheus_port 63001 &
+server_child_pid=$!
+sleep 1
+kill -9 ${server_child_pid}
+wait ${server_child_pid} || true
+listener=/dev/shm/k2rpc.$(( server_child_pid << 10 ))
+test -e ${listener}
+./build/test/transport/shm_rpc_test ${COMMON_ARGS} ${SHM_ARGS} -c1 --tcp_endpoints 14001 --shm_test_role idle --prometheus_port 63002
+test ! -e ${listener}
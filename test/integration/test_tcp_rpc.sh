@@ -0,0 +1,23 @@
+#!/bin/bash
+set -e
+topname=$(dirname "$0")
+source ${topname}/common_defs.sh
+cd ${topname}/../..
+
+function finish {
+  rv=$?
+  echo ">>>> Test ${0} finished with code ${rv}"
+}
+trap finish EXIT
+
+# the pooling scenarios need a pool with 2 connections per traffic class, and a bulk verb
+POOL_ARGS="--tcp_connections_per_endpoint 4 --tcp_bulk_verbs 101"
+
+# pooling, and write batching with a size limit and a flush at the next poll, with a flush delay, and without batching
+./build/test/transport/tcp_rpc_test ${COMMON_ARGS} ${POOL_ARGS} -c1 --tcp_endpoints 14000 --prometheus_port 63001 --tcp_batch_max_bytes 4096
+./build/test/transport/tcp_rpc_test ${COMMON_ARGS} ${POOL_ARGS} -c1 --tcp_endpoints 14000 --prometheus_port 63001 --tcp_batch_max_bytes 4096 --tcp_batch_max_delay 200ms
+./build/test/transport/tcp_rpc_test ${COMMON_ARGS} ${POOL_ARGS} -c1 --tcp_endpoints 14000 --prometheus_port 63001 --tcp_batch_max_bytes 0
+
+# the same on the io_uring reactor backend. Where seastar or the kernel doesn't support it, this checks that we fall
+# back to the default backend
+./build/test/transport/tcp_rpc_test ${COMMON_ARGS/--reactor-backend=epoll/} --io_uring true ${POOL_ARGS} -c1 --tcp_endpoints 14000 --prometheus_port 63001 --tcp_batch_max_bytes 4096
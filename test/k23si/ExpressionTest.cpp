@@ -127,9 +127,33 @@ k2d::SKVRecord makeRec() {
     return doc;
 }
 
+// The compiled form of the expression must have the same outcome as Expression::evaluate()
+void checkCompiled(TestCase& tcase) {
+    if (!tcase.rec.schema) {
+        return;
+    }
+    k2e::CompiledExpression compiled(tcase.expr, tcase.rec.schema);
+    auto result = compiled.evaluate(tcase.rec);
+    if (tcase.expectedResult.has_value()) {
+        REQUIRE(result == (tcase.expectedResult.value() ? k2e::EvalResult::PASS : k2e::EvalResult::FAIL));
+        return;
+    }
+    REQUIRE(tcase.expectedException);
+    try{ std::rethrow_exception(tcase.expectedException); }
+    catch(k2d::NoFieldFoundException&) { REQUIRE(result == k2e::EvalResult::MISMATCH); }
+    catch(k2d::TypeMismatchException&) { REQUIRE(result == k2e::EvalResult::MISMATCH); }
+    catch(k2d::DeserializationError&) { REQUIRE(result == k2e::EvalResult::DESERIALIZATION_ERROR); }
+    catch(k2d::InvalidExpressionException&) {
+        REQUIRE(result == k2e::EvalResult::INVALID);
+        REQUIRE(!compiled.error().empty());
+    }
+    catch(...){ REQUIRE(false); }
+}
+
 void runner(std::vector<TestCase>& tcases) {
     for (auto& tcase: tcases) {
         K2LOG_I(log::k23si, "tcase name: {}", tcase.name);
+        checkCompiled(tcase);
         try {
             bool result = tcase.run();
             if (tcase.expectedResult.has_value()) {
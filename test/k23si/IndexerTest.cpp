@@ -23,6 +23,9 @@ Copyright(c) 2020 Futurewei Cloud
 
 #define CATCH_CONFIG_MAIN
 
+#include <algorithm>
+#include <map>
+
 #include <k2/module/k23si/Indexer.h>
 #include "Log.h"
 #include "catch2/catch.hpp"
@@ -544,6 +547,290 @@ SCENARIO("test 06 multi-key iterate and observation") {
     }
 }
 
+SCENARIO("test 07 garbage collection of versions outside the retention window") {
+    auto indexer = Indexer();
+    std::vector<dto::Timestamp> ts;
+    for (uint32_t i = 1000; i < 1020; ++i) {
+        ts.push_back(dto::Timestamp{.endCount=i, .tsoId=1, .startDelta=1000});
+    }
+    indexer.start(ts[0]).get0();
+    dto::Schema sch;
+    sch.name = "schema1";
+    indexer.createSchema(sch);
+
+    dto::Key k1{.schemaName = sch.name, .partitionKey = "KeyAAA", .rangeKey = "rKey1"};
+    dto::Key k2{.schemaName = sch.name, .partitionKey = "KeyABA", .rangeKey = "rKey1"};
+    dto::Key k3{.schemaName = sch.name, .partitionKey = "KeyACA", .rangeKey = "rKey1"};
+    auto addVersion = [&indexer](const dto::Key& key, dto::Timestamp ts, bool tombstone, bool commit) {
+        auto iter = indexer.find(key);
+        dto::DataRecord rec;
+        rec.isTombstone = tombstone;
+        rec.timestamp = ts;
+        iter.addWI(key, std::move(rec), 10);
+        if (commit) {
+            iter.commitWI();
+        }
+    };
+    // k1: versions at t1, t3, t5, t7
+    addVersion(k1, ts[1], false, true);
+    addVersion(k1, ts[3], false, true);
+    addVersion(k1, ts[5], false, true);
+    addVersion(k1, ts[7], false, true);
+    // k2: value at t1, deleted at t2
+    addVersion(k2, ts[1], false, true);
+    addVersion(k2, ts[2], true, true);
+    // k3: value at t1, pending WI at t4
+    addVersion(k3, ts[1], false, true);
+    addVersion(k3, ts[4], false, false);
+    REQUIRE(indexer.size() == 3);
+
+    {
+        // nothing is reclaimable at the start of the retention window
+        auto stats = indexer.collectGarbage(ts[0], 1s);
+        REQUIRE(stats.passDone);
+        REQUIRE(stats.visitedKeys == 3);
+        REQUIRE(stats.reclaimedVersions == 0);
+        REQUIRE(stats.erasedKeys == 0);
+        REQUIRE(indexer.size() == 3);
+    }
+    {
+        auto iter = indexer.find(k2);
+        iter.observeAt(ts[6]);
+    }
+    {
+        // retention window at t4:
+        // k1 keeps t7, t5, t3; k2 is erased; k3 keeps its only version and its WI
+        auto stats = indexer.collectGarbage(ts[4], 1s);
+        REQUIRE(stats.passDone);
+        REQUIRE(stats.visitedKeys == 3);
+        REQUIRE(stats.reclaimedVersions == 3);
+        REQUIRE(stats.erasedKeys == 1);
+        REQUIRE(indexer.size() == 2);
+
+        auto iter = indexer.find(k1);
+        REQUIRE(iter.getAllDataRecords().size() == 3);
+        REQUIRE(iter.getLastCommittedTime() == ts[7]);
+        if (auto [rec, conflict] = iter.getDataRecordAt(ts[4]); true) {
+            REQUIRE(rec->timestamp == ts[3]);
+            REQUIRE(!conflict);
+        }
+
+        auto iter2 = indexer.find(k2);
+        REQUIRE(!iter2.hasData());
+        // the observation on the erased key must be carried over to its neighbors
+        REQUIRE(iter2.getLastReadTime() == ts[6]);
+
+        auto iter3 = indexer.find(k3);
+        REQUIRE(iter3.getAllDataRecords().size() == 2);
+        REQUIRE(iter3.getWI()->data.timestamp == ts[4]);
+    }
+    {
+        // retention window past all versions: only the latest version of each key remains
+        auto stats = indexer.collectGarbage(ts[10], 1s);
+        REQUIRE(stats.passDone);
+        REQUIRE(stats.reclaimedVersions == 2);
+        REQUIRE(indexer.size() == 2);
+        auto iter = indexer.find(k1);
+        REQUIRE(iter.getAllDataRecords().size() == 1);
+        REQUIRE(iter.getLastCommittedTime() == ts[7]);
+    }
+}
+
+SCENARIO("test 08 replay of persisted versions") {
+    auto indexer = Indexer();
+    std::vector<dto::Timestamp> ts;
+    for (uint32_t i = 1000; i < 1010; ++i) {
+        ts.push_back(dto::Timestamp{.endCount=i, .tsoId=1, .startDelta=1000});
+    }
+    indexer.start(ts[0]).get0();
+
+    // replay creates the schema index on demand
+    dto::Key k1{.schemaName = "schema1", .partitionKey = "KeyAAA", .rangeKey = "rKey1"};
+    auto makeRec = [](dto::Timestamp ts) {
+        dto::DataRecord rec;
+        rec.timestamp = ts;
+        return rec;
+    };
+    // versions may come out of order and more than once
+    indexer.replayCommitted(k1, makeRec(ts[3]));
+    indexer.replayCommitted(k1, makeRec(ts[1]));
+    indexer.replayCommitted(k1, makeRec(ts[5]));
+    indexer.replayCommitted(k1, makeRec(ts[3]));
+    dto::WriteIntent wi;
+    wi.data = makeRec(ts[7]);
+    indexer.replayWI(k1, std::move(wi));
+    REQUIRE(indexer.size() == 1);
+
+    auto iter = indexer.find(k1);
+    REQUIRE(iter.getLastCommittedTime() == ts[5]);
+    REQUIRE(iter.getWI()->data.timestamp == ts[7]);
+    REQUIRE(iter.getLastReadTime() == ts[0]);
+    auto recs = iter.getAllDataRecords();
+    REQUIRE(recs.size() == 4);
+    if (auto [rec, conflict] = iter.getDataRecordAt(ts[4]); true) {
+        REQUIRE(rec->timestamp == ts[3]);
+        REQUIRE(!conflict);
+    }
+    if (auto [rec, conflict] = iter.getDataRecordAt(ts[2]); true) {
+        REQUIRE(rec->timestamp == ts[1]);
+        REQUIRE(!conflict);
+    }
+}
+
+SCENARIO("test 09 snapshot visits all keys in slices") {
+    auto indexer = Indexer();
+    dto::Timestamp ts{.endCount=1000, .tsoId=1, .startDelta=1000};
+    indexer.start(ts).get0();
+    std::vector<dto::Key> keys;
+    for (auto schemaName: {"schema1", "schema2"}) {
+        for (int i = 0; i < 50; ++i) {
+            keys.push_back(dto::Key{.schemaName=schemaName, .partitionKey=fmt::format("Key{:03}", i), .rangeKey=""});
+            dto::DataRecord rec;
+            rec.timestamp = ts;
+            indexer.replayCommitted(keys.back(), std::move(rec));
+        }
+    }
+
+    // pause after every 7 keys. Each pass must visit each key once, in order within each schema
+    for (int pass = 0; pass < 2; ++pass) {
+        std::map<String, std::vector<String>> visited;
+        size_t calls = 0;
+        bool done = false;
+        while (!done) {
+            size_t sliceKeys = 0;
+            done = indexer.visitForSnapshot(1s, [&](const String& schemaName, const IndexerKey& key, const VersionSet& vset) {
+                REQUIRE(vset.committed.size() == 1);
+                visited[schemaName].push_back(key.partitionKey);
+                return ++sliceKeys < 7;
+            });
+            ++calls;
+            REQUIRE(calls < 100);
+        }
+        REQUIRE(calls == 15);
+        REQUIRE(visited.size() == 2);
+        for (auto& [schemaName, pkeys]: visited) {
+            REQUIRE(pkeys.size() == 50);
+            REQUIRE(std::is_sorted(pkeys.begin(), pkeys.end()));
+        }
+    }
+
+    // bulk-load versions for a new key and merge them into an existing key
+    dto::Key k1{.schemaName="schema3", .partitionKey="KeyAAA", .rangeKey=""};
+    VersionsT versions;
+    for (uint32_t i = 5; i > 0; --i) {
+        dto::DataRecord rec;
+        rec.timestamp = dto::Timestamp{.endCount=1000 + i * 10, .tsoId=1, .startDelta=1000};
+        versions.push_back(std::move(rec));
+    }
+    indexer.loadCommitted(k1, std::move(versions));
+    VersionsT more;
+    dto::DataRecord rec;
+    rec.timestamp = dto::Timestamp{.endCount=1015, .tsoId=1, .startDelta=1000};
+    more.push_back(std::move(rec));
+    indexer.loadCommitted(k1, std::move(more));
+    auto iter = indexer.find(k1);
+    REQUIRE(iter.getAllDataRecords().size() == 6);
+    REQUIRE(iter.getLastCommittedTime().endCount == 1050);
+    if (auto [found, conflict] = iter.getDataRecordAt(dto::Timestamp{.endCount=1018, .tsoId=1, .startDelta=1000}); true) {
+        REQUIRE(found->timestamp.endCount == 1015);
+    }
+}
+
+SCENARIO("test 10 waiters are woken when the WI is finalized") {
+    auto indexer = Indexer();
+    dto::Timestamp start{.endCount=1000, .tsoId=1, .startDelta=1000};
+    indexer.start(start).get0();
+    dto::Schema sch;
+    sch.name = "schema1";
+    indexer.createSchema(sch);
+    dto::Key k1{.schemaName=sch.name, .partitionKey="KeyAAA", .rangeKey=""};
+    dto::Key k2{.schemaName=sch.name, .partitionKey="KeyABA", .rangeKey=""};
+    for (auto& key: {k1, k2}) {
+        auto iter = indexer.find(key);
+        dto::DataRecord rec;
+        rec.timestamp = dto::Timestamp{.endCount=1010, .tsoId=1, .startDelta=1000};
+        iter.addWI(key, std::move(rec), 10);
+    }
+
+    auto [id1, w1] = indexer.waitForWI(k1);
+    auto [id2, w2] = indexer.waitForWI(k1);
+    auto [id3, w3] = indexer.waitForWI(k2);
+    REQUIRE(indexer.waitersCount() == 3);
+    REQUIRE(id1 != id2);
+    REQUIRE(!w1.available());
+
+    // committing the WI wakes only the waiters for that key
+    indexer.find(k1).commitWI();
+    REQUIRE(w1.available());
+    REQUIRE(w2.available());
+    REQUIRE(!w3.available());
+    REQUIRE(indexer.waitersCount() == 1);
+
+    // aborting the WI wakes its waiters too, even when the key itself is removed
+    indexer.find(k2).abortWI();
+    REQUIRE(w3.available());
+    REQUIRE(indexer.waitersCount() == 0);
+    REQUIRE(indexer.size() == 1);
+    w1.get();
+    w2.get();
+    w3.get();
+
+    // waiters left over at shutdown fail
+    {
+        auto iter = indexer.find(k1);
+        dto::DataRecord rec;
+        rec.timestamp = dto::Timestamp{.endCount=1020, .tsoId=1, .startDelta=1000};
+        iter.addWI(k1, std::move(rec), 11);
+    }
+    auto [id4, w4] = indexer.waitForWI(k1);
+    indexer.stop().get0();
+    REQUIRE(w4.failed());
+    w4.ignore_ready_future();
+}
+
+SCENARIO("test 11 waiters which give up are removed") {
+    auto indexer = Indexer();
+    dto::Timestamp start{.endCount=1000, .tsoId=1, .startDelta=1000};
+    indexer.start(start).get0();
+    dto::Schema sch;
+    sch.name = "schema1";
+    indexer.createSchema(sch);
+    dto::Key k1{.schemaName=sch.name, .partitionKey="KeyAAA", .rangeKey=""};
+    {
+        auto iter = indexer.find(k1);
+        dto::DataRecord rec;
+        rec.timestamp = dto::Timestamp{.endCount=1010, .tsoId=1, .startDelta=1000};
+        iter.addWI(k1, std::move(rec), 10);
+    }
+
+    auto [id1, w1] = indexer.waitForWI(k1);
+    auto [id2, w2] = indexer.waitForWI(k1);
+    REQUIRE(indexer.waitersCount() == 2);
+
+    // only the given waiter is removed, and its future fails
+    indexer.removeWaiter(k1, id1);
+    REQUIRE(indexer.waitersCount() == 1);
+    REQUIRE(w1.failed());
+    w1.ignore_ready_future();
+    REQUIRE(!w2.available());
+
+    // removing an unknown waiter, or one for another key, does nothing
+    indexer.removeWaiter(k1, id1);
+    indexer.removeWaiter(dto::Key{.schemaName=sch.name, .partitionKey="KeyABA", .rangeKey=""}, id2);
+    indexer.removeWaiter(dto::Key{.schemaName="schema2", .partitionKey="KeyAAA", .rangeKey=""}, id2);
+    REQUIRE(indexer.waitersCount() == 1);
+
+    indexer.find(k1).commitWI();
+    REQUIRE(w2.available());
+    w2.get();
+    REQUIRE(indexer.waitersCount() == 0);
+
+    // removing a waiter which was already woken does nothing
+    indexer.removeWaiter(k1, id2);
+    REQUIRE(indexer.waitersCount() == 0);
+    indexer.stop().get0();
+}
+
     }  // namespace k2
     /*
     // 404 read between two values updates the ends to the max(existing, ts)
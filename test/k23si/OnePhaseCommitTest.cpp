@@ -0,0 +1,403 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <k2/appbase/AppEssentials.h>
+#include <k2/appbase/Appbase.h>
+#include <k2/cpo/client/Client.h>
+#include <k2/dto/AssignmentManager.h>
+#include <k2/dto/ControlPlaneOracle.h>
+#include <k2/dto/K23SIInspect.h>
+#include <k2/module/k23si/client/k23si_client.h>
+#include <seastar/core/sleep.hh>
+#include <seastar/net/api.hh>
+
+#include <sstream>
+
+using namespace k2;
+#include "Log.h"
+const char* collname = "one_phase_commit_collection";
+
+// Tests for txns which only write to their TRH partition. These are finalized in place at the TRH, without
+// K23SI_TXN_FINALIZE requests, and their end record is all that is persisted for the outcome. The collection
+// has a single partition, on a single-core nodepool whose metrics are served at --nodepool_prometheus_port.
+// To check recovery, the test restarts the partition itself: it offloads it and assigns it again with the same
+// pvid, so that it replays its WAL.
+class OnePhaseCommitTest {
+
+public:  // application lifespan
+    OnePhaseCommitTest() : _client(K23SIClientConfig()) { K2LOG_I(log::k23si, "ctor");}
+    ~OnePhaseCommitTest(){ K2LOG_I(log::k23si, "dtor");}
+
+    // required for seastar::distributed interface
+    seastar::future<> gracefulStop() {
+        K2LOG_I(log::k23si, "stop");
+        return std::move(_testFuture);
+    }
+
+    seastar::future<> start(){
+        K2LOG_I(log::k23si, "start");
+        _cpoTXEndpoint = RPC().getTXEndpoint(_cpoEndpoint());
+
+        _testTimer.set_callback([this] {
+            _testFuture = seastar::make_ready_future()
+            .then([this] () {
+                return _client.start();
+            })
+            .then([this] {
+                K2LOG_I(log::k23si, "Creating test collection");
+                dto::CollectionMetadata md{
+                    .name = collname,
+                    .hashScheme = dto::HashScheme::HashCRC32C,
+                    .storageDriver = dto::StorageDriver::K23SI,
+                    .capacity = {
+                        .dataCapacityMegaBytes = 0,
+                        .readIOPs = 0,
+                        .writeIOPs = 0,
+                        .minNodes = 1
+                    },
+                    .retentionPeriod = 2h
+                };
+                return _client.makeCollection(std::move(md));
+            })
+            .then([this](auto&& status) {
+                K2ASSERT(log::k23si, status.is2xxOK(), "bad status: {}", status);
+                dto::Schema schema;
+                schema.name = "schema";
+                schema.version = 1;
+                schema.fields = std::vector<dto::SchemaField> {
+                        {dto::FieldType::STRING, "partition", false, false},
+                        {dto::FieldType::STRING, "range", false, false},
+                        {dto::FieldType::STRING, "data", false, false},
+                };
+
+                schema.setPartitionKeyFieldsByName(std::vector<String>{"partition"});
+                schema.setRangeKeyFieldsByName(std::vector<String> {"range"});
+
+                return _client.createSchema(collname, std::move(schema));
+            })
+            .then([this] (auto&& result) {
+                K2EXPECT(log::k23si, result.status.is2xxOK(), true);
+                return _client.getSchema(collname, "schema", 1);
+            })
+            .then([this] (auto&& response) {
+                auto& [status, schemaPtr] = response;
+                K2EXPECT(log::k23si, status.is2xxOK(), true);
+                _schema = schemaPtr;
+            })
+            .then([this] { return runScenario01(); })
+            .then([this] { return runScenario02(); })
+            .then([this] {
+                K2LOG_I(log::k23si, "======= All tests passed ========");
+                exitcode = 0;
+            })
+            .handle_exception([this](auto exc) {
+                try {
+                    std::rethrow_exception(exc);
+                } catch (std::exception& e) {
+                    K2LOG_E(log::k23si, "======= Test failed with exception [{}] ========", e.what());
+                    exitcode = -1;
+                } catch (...) {
+                    K2LOG_E(log::k23si, "Test failed with unknown exception");
+                    exitcode = -1;
+                }
+            })
+            .finally([this] {
+                K2LOG_I(log::k23si, "======= Test ended ========");
+                AppBase().stop(exitcode);
+            });
+        });
+
+        _testTimer.arm(0ms);
+        return seastar::make_ready_future();
+    }
+
+private:
+    int exitcode = -1;
+
+    seastar::timer<> _testTimer;
+    seastar::future<> _testFuture = seastar::make_ready_future();
+
+    ConfigVar<String> _cpoEndpoint{"cpo"};
+    std::unique_ptr<TXEndpoint> _cpoTXEndpoint;
+    ConfigVar<uint16_t> _nodepoolPrometheusPort{"nodepool_prometheus_port"};
+
+    std::shared_ptr<dto::Schema> _schema;
+    K23SIClient _client;
+    // the timestamp of the txn we commit in scenario 01
+    dto::Timestamp _committedTs;
+
+    dto::SKVRecord _makeRecord(const String& key, std::optional<String> data=std::nullopt) {
+        dto::SKVRecord record(collname, _schema);
+        record.serializeNext<String>(key);
+        record.serializeNext<String>("range");
+        if (data) {
+            record.serializeNext<String>(*data);
+        }
+        return record;
+    }
+
+    seastar::future<WriteResult> _write(K2TxnHandle& txn, const String& key, const String& data) {
+        return seastar::do_with(_makeRecord(key, data), [&txn] (auto& record) {
+            return txn.write(record);
+        });
+    }
+
+    seastar::future<ReadResult<dto::SKVRecord>> _read(K2TxnHandle& txn, const String& key) {
+        return txn.read(_makeRecord(key));
+    }
+
+    // the sum over all cores of the given nodepool counter, read from the prometheus endpoint of the nodepool
+    seastar::future<uint64_t> _nodepoolCounter(String name) {
+        struct MetricsConnection {
+            seastar::connected_socket sock;
+            seastar::output_stream<char> out;
+            seastar::input_stream<char> in;
+            String response;
+        };
+        return seastar::connect(seastar::ipv4_addr("127.0.0.1", _nodepoolPrometheusPort()))
+        .then([name=std::move(name)] (seastar::connected_socket&& sock) {
+            return seastar::do_with(MetricsConnection{.sock=std::move(sock)}, [name] (auto& conn) {
+                conn.out = conn.sock.output();
+                conn.in = conn.sock.input();
+                return conn.out.write("GET /metrics HTTP/1.0\r\n\r\n")
+                .then([&conn] {
+                    return conn.out.flush();
+                })
+                .then([&conn] {
+                    // the server closes the connection once the response is written
+                    return seastar::repeat([&conn] {
+                        return conn.in.read().then([&conn] (seastar::temporary_buffer<char>&& buf) {
+                            if (buf.empty()) {
+                                return seastar::stop_iteration::yes;
+                            }
+                            conn.response.append(buf.get(), buf.size());
+                            return seastar::stop_iteration::no;
+                        });
+                    });
+                })
+                .then([&conn] {
+                    return conn.out.close();
+                })
+                .then([&conn, name] {
+                    uint64_t count = 0;
+                    const String prefix = "NodePoolService_Nodepool_" + name + "{";
+                    std::istringstream lines(std::string(conn.response.data(), conn.response.size()));
+                    for (std::string line; std::getline(lines, line);) {
+                        if (line.rfind(prefix.c_str(), 0) == 0) {
+                            count += uint64_t(std::stod(line.substr(line.rfind(' ') + 1)));
+                        }
+                    }
+                    return count;
+                });
+            });
+        });
+    }
+
+    // The test collection has a single partition. Returns the collection as the CPO has it
+    seastar::future<dto::Collection> _getCollection() {
+        auto request = dto::CollectionGetRequest{.name=collname};
+        return RPC()
+        .callRPC<dto::CollectionGetRequest, dto::CollectionGetResponse>(dto::Verbs::CPO_COLLECTION_GET, request, *_cpoTXEndpoint, 1s)
+        .then([](auto&& response) {
+            auto& [status, resp] = response;
+            K2EXPECT(log::k23si, status, Statuses::S200_OK);
+            K2EXPECT(log::k23si, resp.collection.partitionMap.partitions.size(), 1);
+            return std::move(resp.collection);
+        });
+    }
+
+    // checks that the partition at the given endpoint has no txn records and no WIs left
+    seastar::future<> _expectNoPendingTxns(const String& ep) {
+        return seastar::do_with(RPC().getTXEndpoint(ep), dto::K23SIInspectAllTxnsRequest{}, dto::K23SIInspectWIsRequest{},
+            [] (auto& txep, auto& txnsRequest, auto& wisRequest) {
+            return RPC()
+            .callRPC<dto::K23SIInspectAllTxnsRequest, dto::K23SIInspectAllTxnsResponse>(dto::Verbs::K23SI_INSPECT_ALL_TXNS, txnsRequest, *txep, 1s)
+            .then([&txep, &wisRequest] (auto&& response) {
+                auto& [status, resp] = response;
+                K2EXPECT(log::k23si, status.is2xxOK(), true);
+                K2EXPECT(log::k23si, resp.txns.size(), 0);
+                return RPC()
+                .callRPC<dto::K23SIInspectWIsRequest, dto::K23SIInspectWIsResponse>(dto::Verbs::K23SI_INSPECT_WIS, wisRequest, *txep, 1s);
+            })
+            .then([] (auto&& response) {
+                auto& [status, resp] = response;
+                K2EXPECT(log::k23si, status.is2xxOK(), true);
+                K2EXPECT(log::k23si, resp.WIs.size(), 0);
+            });
+        });
+    }
+
+    // reads the given key in a new txn and checks that it has the given data
+    seastar::future<> _expectData(const String& key, const String& data) {
+        return _client.beginTxn(K2TxnOptions{})
+        .then([this, key, data] (K2TxnHandle&& txn) {
+            return seastar::do_with(std::move(txn), [this, key, data] (auto& txn) {
+                return _read(txn, key)
+                .then([&txn, data] (auto&& result) {
+                    K2EXPECT(log::k23si, result.status, dto::K23SIStatus::OK);
+                    K2EXPECT(log::k23si, *result.value.template deserializeField<String>("data"), data);
+                    return txn.end(true);
+                })
+                .then([] (auto&& result) {
+                    K2EXPECT(log::k23si, result.status, dto::K23SIStatus::OK);
+                });
+            });
+        });
+    }
+
+public: // tests
+
+// A txn which only writes to its TRH partition is finalized without finalize requests
+seastar::future<> runScenario01() {
+    K2LOG_I(log::k23si, "Scenario 01");
+    return _nodepoolCounter("one_phase_txns")
+    .then([this] (uint64_t before) {
+        K2TxnOptions options{};
+        options.syncFinalize = true;
+        return _client.beginTxn(options)
+        .then([this] (K2TxnHandle&& txn) {
+            return seastar::do_with(std::move(txn), [this] (auto& txn) {
+                _committedTs = txn.mtr().timestamp;
+                return _write(txn, "key1", "committed")
+                .then([&txn] (auto&& result) {
+                    K2EXPECT(log::k23si, result.status, dto::K23SIStatus::Created);
+                    return txn.end(true);
+                })
+                .then([] (auto&& result) {
+                    K2EXPECT(log::k23si, result.status, dto::K23SIStatus::OK);
+                });
+            });
+        })
+        .then([this] {
+            return _nodepoolCounter("one_phase_txns");
+        })
+        .then([before] (uint64_t after) {
+            // the txn went through the local finalizer, and not through K23SI_TXN_FINALIZE
+            K2EXPECT(log::k23si, after, before + 1);
+        });
+    })
+    .then([this] {
+        return _expectData("key1", "committed");
+    })
+    .then([] {
+        // the txn record is erased in the background once the txn is finalized
+        return seastar::sleep(100ms);
+    })
+    .then([this] {
+        return _getCollection();
+    })
+    .then([this] (dto::Collection&& collection) {
+        return _expectNoPendingTxns(*collection.partitionMap.partitions[0].endpoints.begin());
+    });
+}
+
+// After a restart, the partition recovers the committed data from the end record of the txn alone. Neither the twim
+// nor the finalized txn record were persisted
+seastar::future<> runScenario02() {
+    K2LOG_I(log::k23si, "Scenario 02");
+    return _getCollection()
+    .then([this] (dto::Collection&& collection) {
+        auto ep = *collection.partitionMap.partitions[0].endpoints.begin();
+        auto txep = RPC().getTXEndpoint(ep);
+        return seastar::do_with(std::move(collection), std::move(txep), dto::AssignmentOffloadRequest{.collectionName=collname},
+            [this, ep] (auto& collection, auto& txep, auto& offloadRequest) {
+            auto& partition = collection.partitionMap.partitions[0];
+            K2LOG_I(log::k23si, "Offloading partition {}", partition);
+            return RPC()
+            .callRPC<dto::AssignmentOffloadRequest, dto::AssignmentOffloadResponse>(dto::Verbs::K2_ASSIGNMENT_OFFLOAD, offloadRequest, *txep, 5s)
+            .then([this, &collection, &partition, &txep] (auto&& response) {
+                auto& [status, resp] = response;
+                K2EXPECT(log::k23si, status, Statuses::S200_OK);
+                // assign the same pvid again, so that the new partition module recovers from the WAL of the old one
+                K2LOG_I(log::k23si, "Assigning partition {} again", partition);
+                return seastar::do_with(dto::AssignmentCreateRequest{
+                        .collectionMeta=collection.metadata,
+                        .partition=partition,
+                        .cpoEndpoints={_cpoEndpoint()}
+                    },
+                    [&txep] (auto& request) {
+                        return RPC()
+                        .callRPC<dto::AssignmentCreateRequest, dto::AssignmentCreateResponse>(dto::Verbs::K2_ASSIGNMENT_CREATE, request, *txep, 5s);
+                    });
+            })
+            .then([&partition] (auto&& response) {
+                auto& [status, resp] = response;
+                K2EXPECT(log::k23si, status, Statuses::S201_Created);
+                K2EXPECT(log::k23si, resp.assignedPartition.keyRangeV.pvid, partition.keyRangeV.pvid);
+                // the finalization of recovered txns resumes in the background
+                return seastar::sleep(100ms);
+            })
+            .then([this] {
+                return _nodepoolCounter("one_phase_txns");
+            })
+            .then([] (uint64_t count) {
+                // recovery resumed the finalization of the txn, in place again. The counters start over with
+                // the new partition module
+                K2EXPECT(log::k23si, count, 1);
+                return seastar::make_ready_future();
+            })
+            .then([this] {
+                return _inspectKey1();
+            })
+            .then([this] (auto&& response) {
+                auto& [status, resp] = response;
+                K2EXPECT(log::k23si, status, dto::K23SIStatus::OK);
+                K2EXPECT(log::k23si, resp.records.size(), 1);
+                K2EXPECT(log::k23si, resp.records[0].timestamp, _committedTs);
+                return _expectData("key1", "committed");
+            })
+            .then([] {
+                return seastar::sleep(100ms);
+            })
+            .then([this, ep] {
+                return _expectNoPendingTxns(ep);
+            });
+        });
+    });
+}
+
+private:
+    // the committed records of key1 on its partition
+    seastar::future<std::tuple<Status, dto::K23SIInspectRecordsResponse>> _inspectKey1() {
+        return seastar::do_with(dto::K23SIInspectRecordsRequest{
+                .pvid = dto::PVID{}, // Will be filled in by PartitionRequest
+                .collectionName = collname,
+                .key = _makeRecord("key1").getKey()
+            },
+            [this] (auto& request) {
+                return _client.cpo_client.partitionRequest
+                    <dto::K23SIInspectRecordsRequest, dto::K23SIInspectRecordsResponse, dto::Verbs::K23SI_INSPECT_RECORDS>
+                    (Deadline<>(1s), request);
+            });
+    }
+};
+
+int main(int argc, char** argv) {
+    App app("OnePhaseCommitTest");
+    app.addOptions()
+        ("cpo", bpo::value<String>(), "URL of Control Plane Oracle (CPO), e.g. 'tcp+k2rpc://192.168.1.2:12345'")
+        ("nodepool_prometheus_port", bpo::value<uint16_t>(), "The prometheus port of the nodepool which runs the test partition");
+    app.addApplet<tso::TSOClient>();
+    app.addApplet<OnePhaseCommitTest>();
+    return app.start(argc, argv);
+}
@@ -113,6 +113,8 @@ public:  // application lifespan
         .then([this] { return runScenario08(); })
         .then([this] { return writeAdditionalData(); })
         .then([this] { return runScenario09(); })
+        .then([this] { return runScenario10(); })
+        .then([this] { return runScenario11(); })
         .then([this] {
             K2LOG_I(log::k23si, "======= All tests passed ========");
             exitcode = 0;
@@ -155,7 +157,7 @@ doQuery(const k2::String& start, const k2::String& end, int32_t limit, bool reve
                           k2::Status expectedStatus=k2::dto::K23SIStatus::OK,
                           k2e::Expression filterExpression=k2e::Expression{},
                           std::vector<k2::String> projection=std::vector<k2::String>(),
-                          bool doPrefixScan = false) {
+                          bool doPrefixScan = false, bool streaming = false) {
     K2LOG_D(log::k23si, "doQuery from {} to {}", start, end);
     return _client.beginTxn(k2::K2TxnOptions{})
     .then([this] (k2::K2TxnHandle&& t) {
@@ -165,7 +167,7 @@ doQuery(const k2::String& start, const k2::String& end, int32_t limit, bool reve
     .then([this, start, end, limit, reverse, expectedRecords, expectedPaginations, expectedStatus,
                 filterExpression=std::move(filterExpression),
                 projection=std::move(projection),
-                doPrefixScan] (auto&& response) mutable {
+                doPrefixScan, streaming] (auto&& response) mutable {
         K2EXPECT(log::k23si, response.status.is2xxOK(), true);
         query = std::move(response.query);
 
@@ -190,9 +192,10 @@ doQuery(const k2::String& start, const k2::String& end, int32_t limit, bool reve
         query.setReverseDirection(reverse);
         query.addProjection(projection);
         query.setFilterExpression(std::move(filterExpression));
+        query.setStreaming(streaming);
 
         return seastar::do_with(std::vector<std::vector<k2::dto::SKVRecord>>(), (uint32_t)0, false,
-        [this, expectedRecords, expectedPaginations, expectedStatus, projection] (
+        [this, expectedRecords, expectedPaginations, expectedStatus, projection, streaming] (
                 std::vector<std::vector<k2::dto::SKVRecord>>& result_set, uint32_t& count, bool& done) {
             return seastar::do_until(
                 [this, &done] () { return done; },
@@ -205,7 +208,7 @@ doQuery(const k2::String& start, const k2::String& end, int32_t limit, bool reve
                         result_set.push_back(std::move(response.records));
                     });
             })
-            .then([&result_set, &count, expectedPaginations, expectedRecords, expectedStatus] () {
+            .then([&result_set, &count, expectedPaginations, expectedRecords, expectedStatus, streaming] () {
                 if (!expectedStatus.is2xxOK()) {
                     return seastar::make_ready_future<std::vector<std::vector<k2::dto::SKVRecord>>>(std::move(result_set));
                 }
@@ -215,7 +218,10 @@ doQuery(const k2::String& start, const k2::String& end, int32_t limit, bool reve
                     record_count += set.size();
                 }
                 K2EXPECT(log::k23si, record_count, expectedRecords);
-                K2EXPECT(log::k23si, count, expectedPaginations);
+                if (!streaming) {
+                    // streamed results are returned in chunks as they arrive, so the number of pages varies
+                    K2EXPECT(log::k23si, count, expectedPaginations);
+                }
                 return seastar::make_ready_future<std::vector<std::vector<k2::dto::SKVRecord>>>(std::move(result_set));
             });
         });
@@ -878,6 +884,54 @@ seastar::future<> runScenario09() {
     });
 }
 
+// streaming queries over the data from runSetup and writeAdditionalData
+seastar::future<> runScenario10() {
+    K2LOG_I(log::k23si, "runScenario10");
+
+    K2LOG_I(log::k23si, "Streaming single partition range");
+    return doQuery("10", "20", -1, false, 10, 0, k2::dto::K23SIStatus::OK, k2e::Expression{}, {}, false, true).discard_result()
+    .then([this] () {
+        K2LOG_I(log::k23si, "Streaming with limit");
+        return doQuery("10", "20", 3, false, 3, 0, k2::dto::K23SIStatus::OK, k2e::Expression{}, {}, false, true).discard_result();
+    })
+    .then([this] () {
+        K2LOG_I(log::k23si, "Streaming multi partition full scan");
+        return doQuery("", "", -1, false, 18, 0, k2::dto::K23SIStatus::OK, k2e::Expression{}, {}, false, true).discard_result();
+    })
+    .then([this] () {
+        K2LOG_I(log::k23si, "Streaming multi partition full reverse scan");
+        return doQuery("", "", -1, true, 18, 0, k2::dto::K23SIStatus::OK, k2e::Expression{}, {}, false, true).discard_result();
+    })
+    .then([this] () {
+        auto filter = getEqualFilter<int32_t>("data1", 14);
+        K2LOG_I(log::k23si, "Streaming multi partition full scan with filter");
+        return doQuery("", "", -1, false, 1, 0, k2::dto::K23SIStatus::OK, std::move(filter), {}, false, true).discard_result();
+    });
+}
+
+// a streaming query which is abandoned after the first chunk. Ending the transaction closes the stream
+seastar::future<> runScenario11() {
+    K2LOG_I(log::k23si, "runScenario11");
+    return _client.beginTxn(k2::K2TxnOptions{})
+    .then([this] (k2::K2TxnHandle&& t) {
+        txn = std::move(t);
+        return _client.createQuery(collname, "schema");
+    })
+    .then([this] (auto&& response) {
+        K2EXPECT(log::k23si, response.status.is2xxOK(), true);
+        query = std::move(response.query);
+        query.setStreaming(true);
+        return txn.query(query);
+    })
+    .then([this] (auto&& response) {
+        K2EXPECT(log::k23si, response.status.is2xxOK(), true);
+        K2EXPECT(log::k23si, query.isDone(), false);
+        return txn.end(true);
+    })
+    .then([] (auto&& response) {
+        K2EXPECT(log::k23si, response.status.is2xxOK(), true);
+    });
+}
 
 // TODO: add test Scenario to deal with query request while change the partition map
 
@@ -886,7 +940,8 @@ seastar::future<> runScenario09() {
 int main(int argc, char** argv) {
     k2::App app("QueryTest");
     app.addOptions()
-        ("cpo", bpo::value<k2::String>(), "URL of Control Plane Oracle (CPO), e.g. 'tcp+k2rpc://192.168.1.2:12345'");
+        ("cpo", bpo::value<k2::String>(), "URL of Control Plane Oracle (CPO), e.g. 'tcp+k2rpc://192.168.1.2:12345'")
+        ("query_stream_window", bpo::value<uint32_t>(), "The number of chunks a streaming query lets the partition send ahead");
     app.addApplet<k2::tso::TSOClient>();
     app.addApplet<QueryTest>();
     return app.start(argc, argv);
@@ -0,0 +1,228 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#define CATCH_CONFIG_MAIN
+
+#include <chrono>
+#include <iostream>
+#include <k2/dto/K23SI.h>
+
+#include "catch2/catch.hpp"
+
+using namespace k2;
+
+namespace {
+// Serializes the fields of K2_PAYLOAD_FIELDS structs one by one, recursing into nested structs. This is the
+// field-by-field serialization which the fast path replaces, so it gives us a reference for both bytes and speed
+template <typename T>
+void writeByField(Payload& payload, const T& value) {
+    if constexpr (HasPayloadFieldsTrait<T>::value) {
+        std::apply([&payload](const auto&... fields) { (writeByField(payload, fields), ...); }, value.__k2Fields());
+    }
+    else {
+        payload.write(value);
+    }
+}
+
+template <typename T>
+bool readByField(Payload& payload, T& value) {
+    if constexpr (HasPayloadFieldsTrait<T>::value) {
+        return std::apply([&payload](auto&... fields) { return (readByField(payload, fields) && ...); },
+                          value.__k2Fields());
+    }
+    else {
+        return payload.read(value);
+    }
+}
+
+dto::Key makeKey(size_t i) {
+    return dto::Key{.schemaName = "bench_schema", .partitionKey = "partition_key_" + std::to_string(i), .rangeKey = "range_key"};
+}
+
+dto::K23SI_MTR makeMTR() {
+    return dto::K23SI_MTR{.timestamp = dto::Timestamp(20200828, 1, 1000), .priority = dto::TxnPriority::Medium};
+}
+
+dto::K23SIReadRequest makeRead() {
+    return dto::K23SIReadRequest{
+        .pvid = dto::PVID{.id = 1, .rangeVersion = 2, .assignmentVersion = 3},
+        .collectionName = "bench_collection",
+        .mtr = makeMTR(),
+        .key = makeKey(1)};
+}
+
+dto::K23SIReadBatchRequest makeReadBatch() {
+    dto::K23SIReadBatchRequest request{
+        .pvid = dto::PVID{.id = 1, .rangeVersion = 2, .assignmentVersion = 3},
+        .collectionName = "bench_collection",
+        .mtr = makeMTR(),
+        .key = makeKey(0),
+        .keys = {}};
+    for (size_t i = 0; i < 16; ++i) {
+        request.keys.push_back(makeKey(i));
+    }
+    return request;
+}
+
+dto::K23SIWriteRequest makeWrite() {
+    dto::K23SIWriteRequest request{
+        .pvid = dto::PVID{.id = 1, .rangeVersion = 2, .assignmentVersion = 3},
+        .collectionName = "bench_collection",
+        .mtr = makeMTR(),
+        .trh = makeKey(0),
+        .trhCollection = "bench_collection",
+        .isDelete = false,
+        .designateTRH = true,
+        .precondition = dto::ExistencePrecondition::None,
+        .request_id = 42,
+        .key = makeKey(1),
+        .value = {},
+        .fieldsForPartialUpdate = {1, 3}};
+    request.value.excludedFields = {false, true, false, false};
+    request.value.schemaVersion = 7;
+    request.value.fieldData = Payload(Payload::DefaultAllocator(256));
+    request.value.fieldData.write(String(100, 'v'));
+    request.value.fieldData.write(uint64_t(12345));
+    return request;
+}
+
+// the routing fields and the MTR are moved out of the write, as the client does it
+dto::K23SIWriteAndCommitRequest makeWriteAndCommit() {
+    auto write = makeWrite();
+    dto::K23SIWriteAndCommitRequest request{
+        .pvid = write.pvid,
+        .collectionName = std::move(write.collectionName),
+        .mtr = std::move(write.mtr),
+        .key = std::move(write.key),
+        .write = std::move(write),
+        .writeRanges = {},
+        .syncFinalize = true};
+    // a single range, so that the bytes don't depend on the iteration order of the set
+    request.writeRanges["bench_collection"].insert(
+        dto::KeyRangeVersion{.startKey = "", .endKey = "", .pvid = dto::PVID{.id = 1, .rangeVersion = 2, .assignmentVersion = 3}});
+    return request;
+}
+
+// the bytes of the given payload
+String bytes(Payload& payload) {
+    auto shared = payload.shareAll();
+    String result(shared.getSize(), '\0');
+    REQUIRE(shared.read(result.data(), result.size()));
+    return result;
+}
+
+template <typename RequestT>
+void checkWireCompatible(const RequestT& request) {
+    for (size_t allocSize : {16, 100, 8192}) {
+        Payload fast(Payload::DefaultAllocator(allocSize));
+        fast.write(request);
+        Payload byField(Payload::DefaultAllocator(allocSize));
+        writeByField(byField, request);
+        REQUIRE(bytes(fast) == bytes(byField));
+        fast.seek(0);
+        REQUIRE(fast.computeCrc32c() == byField.shareAll().computeCrc32c());
+
+        // each side can read what the other wrote
+        fast.seek(0);
+        RequestT parsedByField;
+        REQUIRE(readByField(fast, parsedByField));
+        REQUIRE(fast.getDataRemaining() == 0);
+        byField.seek(0);
+        RequestT parsed;
+        REQUIRE(byField.read(parsed));
+        REQUIRE(byField.getDataRemaining() == 0);
+        Payload reserialized(Payload::DefaultAllocator(allocSize));
+        reserialized.write(parsed);
+        REQUIRE(bytes(reserialized) == bytes(fast));
+        Payload reserializedByField(Payload::DefaultAllocator(allocSize));
+        reserializedByField.write(parsedByField);
+        REQUIRE(bytes(reserializedByField) == bytes(fast));
+    }
+}
+
+template <typename RequestT>
+void bench(const char* name, const RequestT& request) {
+    const size_t numOps = 100000;
+    auto nsPerOp = [numOps](auto start) {
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / numOps;
+    };
+    size_t size = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < numOps; ++i) {
+        Payload payload(Payload::DefaultAllocator());
+        writeByField(payload, request);
+        size += payload.getSize();
+    }
+    auto writeByFieldNs = nsPerOp(start);
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < numOps; ++i) {
+        Payload payload(Payload::DefaultAllocator());
+        payload.write(request);
+        size -= payload.getSize();
+    }
+    auto writeNs = nsPerOp(start);
+    REQUIRE(size == 0);
+
+    Payload wire(Payload::DefaultAllocator());
+    wire.write(request);
+    bool success = true;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < numOps; ++i) {
+        wire.seek(0);
+        RequestT parsed;
+        success = readByField(wire, parsed) && success;
+    }
+    auto readByFieldNs = nsPerOp(start);
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < numOps; ++i) {
+        wire.seek(0);
+        RequestT parsed;
+        success = wire.read(parsed) && success;
+    }
+    auto readNs = nsPerOp(start);
+    REQUIRE(success);
+
+    std::cout << name << " (" << wire.getSize() << " bytes): write " << writeByFieldNs << " -> " << writeNs
+              << " ns/op, read " << readByFieldNs << " -> " << readNs << " ns/op" << std::endl;
+}
+} // namespace
+
+SCENARIO("Test01: fast path serialization of K23SI requests is wire compatible") {
+    checkWireCompatible(makeKey(1));
+    checkWireCompatible(makeMTR());
+    checkWireCompatible(makeRead());
+    checkWireCompatible(makeReadBatch());
+    checkWireCompatible(makeWrite());
+    checkWireCompatible(makeWriteAndCommit());
+}
+
+SCENARIO("Test02: serialization speed of K23SI requests, field by field -> fast path") {
+    bench("Key", makeKey(1));
+    bench("K23SIReadRequest", makeRead());
+    bench("K23SIReadBatchRequest", makeReadBatch());
+    bench("K23SIWriteRequest", makeWrite());
+}
@@ -26,11 +26,17 @@ Copyright(c) 2020 Futurewei Cloud
 #include <k2/cpo/client/Client.h>
 #include <k2/module/k23si/client/k23si_client.h>
 #include <seastar/core/sleep.hh>
+#include <boost/range/irange.hpp>
+
+#include <limits>
+#include <unordered_set>
+
 using namespace k2;
 #include "Log.h"
 const char* collname1 = "k23si_test_collection1";
 const char* collname2 = "k23si_test_collection2";
 const char* collname3 = "k23si_test_collection3";
+const char* collname4 = "k23si_test_collection4";
 
 class SKVClientTest {
 
@@ -91,18 +97,33 @@ public:  // application lifespan
                     },
                     .retentionPeriod = 2h
                 };
+                // spread over two partitions so that write batches span partitions
+                dto::CollectionMetadata md4{
+                    .name = collname4,
+                    .hashScheme = dto::HashScheme::HashCRC32C,
+                    .storageDriver = dto::StorageDriver::K23SI,
+                    .capacity = {
+                        .dataCapacityMegaBytes = 0,
+                        .readIOPs = 0,
+                        .writeIOPs = 0,
+                        .minNodes = 2
+                    },
+                    .retentionPeriod = 2h
+                };
                 return seastar::when_all_succeed(
                     _client.makeCollection(std::move(md1)),
                     _client.makeCollection(std::move(md2)),
                     _client.makeCollection(std::move(md3)),
+                    _client.makeCollection(std::move(md4)),
                     seastar::sleep(1s)
                 );
             })
             .then([](auto&& statuses) {
-                auto& [status1, status2, status3] = statuses;
+                auto& [status1, status2, status3, status4] = statuses;
                 K2ASSERT(log::k23si, status1.is2xxOK(), "bad status: {}", status1);
                 K2ASSERT(log::k23si, status2.is2xxOK(), "bad status: {}", status2);
                 K2ASSERT(log::k23si, status3.is2xxOK(), "bad status: {}", status3);
+                K2ASSERT(log::k23si, status4.is2xxOK(), "bad status: {}", status4);
             })
             .then([this] () {
                 dto::Schema schema;
@@ -162,6 +183,25 @@ public:  // application lifespan
             .then([] (auto&& result) {
                 K2EXPECT(log::k23si, result.status.is2xxOK(), true);
             })
+            .then([this] () {
+                dto::Schema schema;
+                schema.name = "4_schema";
+                schema.version = 1;
+                schema.fields = std::vector<dto::SchemaField> {
+                        {dto::FieldType::STRING, "4_partition", false, false},
+                        {dto::FieldType::STRING, "4_range", false, false},
+                        {dto::FieldType::STRING, "4_f1", false, false},
+                        {dto::FieldType::STRING, "4_f2", false, false},
+                };
+
+                schema.setPartitionKeyFieldsByName(std::vector<String>{"4_partition"});
+                schema.setRangeKeyFieldsByName(std::vector<String> {"4_range"});
+
+                return _client.createSchema(collname4, std::move(schema));
+            })
+            .then([] (auto&& result) {
+                K2EXPECT(log::k23si, result.status.is2xxOK(), true);
+            })
             .then([this] { return runScenario01(); })
             .then([this] { return runScenario02(); })
             .then([this] { return runScenario03(); })
@@ -173,6 +213,14 @@ public:  // application lifespan
             .then([this] { return runScenario09(); })
             .then([this] { return runScenario10(); })
             .then([this] { return runScenario11(); })
+            .then([this] { return runScenario12(); })
+            .then([this] { return runScenario13(); })
+            .then([this] { return runScenario14(); })
+            .then([this] { return runScenario15(); })
+            .then([this] { return runScenario16(); })
+            .then([this] { return runScenario17(); })
+            .then([this] { return runScenario18(); })
+            .then([this] { return runScenario19(); })
             .then([this] {
                 K2LOG_I(log::k23si, "======= All tests passed ========");
                 exitcode = 0;
@@ -1585,6 +1633,476 @@ seastar::future<> runScenario11() {
     });
 }
 
+// Batched reads of keys which exist, don't exist, and a key written by the reading txn
+seastar::future<> runScenario12() {
+    K2LOG_I(log::k23si, "Scenario 12");
+    return _client.beginTxn(K2TxnOptions())
+    .then([this] (K2TxnHandle&& txn) {
+        _txn1 = std::move(txn);
+        return _client.getSchema(collname1, "1_schema", 1);
+    })
+    .then([this] (auto&& response) {
+        auto& [status, schemaPtr] = response;
+        K2EXPECT(log::k23si, status.is2xxOK(), true);
+        _schema = schemaPtr;
+
+        // write sequentially so that the first write creates the TRH
+        return seastar::do_for_each(boost::irange(0, 10), [this] (int i) {
+            dto::SKVRecord record(collname1, _schema);
+            record.serializeNext<String>("partkey_s12_" + std::to_string(i));
+            record.serializeNext<String>("rangekey_s12");
+            record.serializeNext<String>("data_" + std::to_string(i));
+            record.serializeNext<String>("data2");
+            return _txn1.write(record)
+            .then([] (auto&& response) {
+                K2EXPECT(log::k23si, response.status, dto::K23SIStatus::Created);
+            });
+        });
+    })
+    .then([this] () {
+        return _txn1.end(true);
+    })
+    .then([this](auto&& response) {
+        K2EXPECT(log::k23si, response.status, dto::K23SIStatus::OK);
+        return _client.beginTxn(K2TxnOptions());
+    })
+    .then([this] (K2TxnHandle&& txn) {
+        _txn1 = std::move(txn);
+        dto::SKVRecord record(collname1, _schema);
+        record.serializeNext<String>("partkey_s12_new");
+        record.serializeNext<String>("rangekey_s12");
+        record.serializeNext<String>("data_new");
+        record.serializeNext<String>("data2");
+        return _txn1.write(record);
+    })
+    .then([this] (auto&& response) {
+        K2EXPECT(log::k23si, response.status, dto::K23SIStatus::Created);
+
+        // read in reverse order, with a missing key in the middle and our own write at the end
+        std::vector<dto::Key> keys;
+        for (int i = 9; i >= 0; --i) {
+            dto::SKVRecord record(collname1, _schema);
+            record.serializeNext<String>(i == 5 ? std::string("partkey_s12_missing") : "partkey_s12_" + std::to_string(i));
+            record.serializeNext<String>("rangekey_s12");
+            keys.push_back(record.getKey());
+        }
+        dto::SKVRecord record(collname1, _schema);
+        record.serializeNext<String>("partkey_s12_new");
+        record.serializeNext<String>("rangekey_s12");
+        keys.push_back(record.getKey());
+        return _txn1.readBatch(std::move(keys), collname1);
+    })
+    .then([this] (std::vector<ReadResult<dto::SKVRecord>>&& results) {
+        K2EXPECT(log::k23si, results.size(), 11);
+        for (int i = 9; i >= 0; --i) {
+            auto& result = results[9 - i];
+            if (i == 5) {
+                K2EXPECT(log::k23si, result.status, dto::K23SIStatus::KeyNotFound);
+                continue;
+            }
+            K2EXPECT(log::k23si, result.status, dto::K23SIStatus::OK);
+            K2EXPECT(log::k23si, *result.value.deserializeNext<String>(), "partkey_s12_" + std::to_string(i));
+            K2EXPECT(log::k23si, *result.value.deserializeNext<String>(), "rangekey_s12");
+            K2EXPECT(log::k23si, *result.value.deserializeNext<String>(), "data_" + std::to_string(i));
+        }
+        K2EXPECT(log::k23si, results[10].status, dto::K23SIStatus::OK);
+        K2EXPECT(log::k23si, *results[10].value.deserializeNext<String>(), "partkey_s12_new");
+        return _txn1.end(true);
+    })
+    .then([this](auto&& response) {
+        K2EXPECT(log::k23si, response.status, dto::K23SIStatus::OK);
+        return seastar::make_ready_future<>();
+    });
+}
+
+// Makes the record in collection 4 with key prefix<i>
+dto::SKVRecord makeRecord4(const String& prefix, int i) {
+    dto::SKVRecord record(collname4, _schema);
+    record.serializeNext<String>(prefix + std::to_string(i));
+    record.serializeNext<String>("rangekey");
+    record.serializeNext<String>("data_" + std::to_string(i));
+    record.serializeNext<String>("data2");
+    return record;
+}
+
+// Makes count records in collection 4 with keys prefix0...prefix<count-1>
+std::vector<dto::SKVRecord> makeRecords4(const String& prefix, int count) {
+    std::vector<dto::SKVRecord> records;
+    for (int i = 0; i < count; ++i) {
+        records.push_back(makeRecord4(prefix, i));
+    }
+    return records;
+}
+
+// The smallest i > 0 for which the record with key prefix<i> in collection 4 is (or is not) owned by the same
+// partition as the record with key prefix0
+int findRecord4(const String& prefix, bool samePartition) {
+    auto& pgetter = _client.cpo_client.collections[collname4];
+    K2EXPECT(log::k23si, pgetter->getAllPartitions().size(), 2);
+    dto::PVID pvid0 = pgetter->getPartitionForKey(makeRecord4(prefix, 0).getKey()).partition->keyRangeV.pvid;
+    for (int i = 1; i < 1000; ++i) {
+        auto& pvid = pgetter->getPartitionForKey(makeRecord4(prefix, i).getKey()).partition->keyRangeV.pvid;
+        if ((pvid == pvid0) == samePartition) {
+            return i;
+        }
+    }
+    throw std::runtime_error("no record found on the requested partition");
+}
+
+// Reads back the records with keys prefix0...prefix<count-1> from collection 4 in a new txn and checks they
+// were all found (or all not found)
+seastar::future<> verifyRecords4(const String& prefix, int count, bool exist) {
+    std::vector<int> indices;
+    for (int i = 0; i < count; ++i) {
+        indices.push_back(i);
+    }
+    return verifyRecords4(prefix, std::move(indices), exist);
+}
+
+// As above, for the records with keys prefix<i> for each of the given indices
+seastar::future<> verifyRecords4(const String& prefix, std::vector<int> indices, bool exist) {
+    return _client.beginTxn(K2TxnOptions())
+    .then([this, prefix, indices] (K2TxnHandle&& txn) {
+        _txn2 = std::move(txn);
+        std::vector<dto::Key> keys;
+        for (auto i : indices) {
+            keys.push_back(makeRecord4(prefix, i).getKey());
+        }
+        return _txn2.readBatch(std::move(keys), collname4);
+    })
+    .then([this, prefix, indices, exist] (std::vector<ReadResult<dto::SKVRecord>>&& results) {
+        K2EXPECT(log::k23si, results.size(), indices.size());
+        for (size_t r = 0; r < results.size(); ++r) {
+            auto& result = results[r];
+            if (!exist) {
+                K2EXPECT(log::k23si, result.status, dto::K23SIStatus::KeyNotFound);
+                continue;
+            }
+            K2EXPECT(log::k23si, result.status, dto::K23SIStatus::OK);
+            K2EXPECT(log::k23si, *result.value.deserializeNext<String>(), prefix + std::to_string(indices[r]));
+            K2EXPECT(log::k23si, *result.value.deserializeNext<String>(), "rangekey");
+            K2EXPECT(log::k23si, *result.value.deserializeNext<String>(), "data_" + std::to_string(indices[r]));
+        }
+        return _txn2.end(true);
+    })
+    .then([](auto&& response) {
+        K2EXPECT(log::k23si, response.status, dto::K23SIStatus::OK);
+    });
+}
+
+// Batched writes which span both partitions of collection 4. The first record designates the TRH
+// and all writes become visible after commit
+seastar::future<> runScenario13() {
+    K2LOG_I(log::k23si, "Scenario 13");
+    return _client.beginTxn(K2TxnOptions())
+    .then([this] (K2TxnHandle&& txn) {
+        _txn1 = std::move(txn);
+        return _client.getSchema(collname4, "4_schema", 1);
+    })
+    .then([this] (auto&& response) {
+        auto& [status, schemaPtr] = response;
+        K2EXPECT(log::k23si, status.is2xxOK(), true);
+        _schema = schemaPtr;
+        return seastar::do_with(makeRecords4("partkey_s13_", 10), [this] (auto& records) {
+            return _txn1.writeBatch(records);
+        });
+    })
+    .then([this] (std::vector<WriteResult>&& results) {
+        K2EXPECT(log::k23si, results.size(), 10);
+        for (auto& result : results) {
+            K2EXPECT(log::k23si, result.status, dto::K23SIStatus::Created);
+        }
+
+        // the batch must have been split between the partitions for this test to be meaningful
+        auto& pgetter = _client.cpo_client.collections[collname4];
+        K2EXPECT(log::k23si, pgetter->getAllPartitions().size(), 2);
+        std::unordered_set<uint64_t> partitions;
+        for (auto& record : makeRecords4("partkey_s13_", 10)) {
+            partitions.insert(pgetter->getPartitionForKey(record.getKey()).partition->keyRangeV.pvid.id);
+        }
+        K2EXPECT(log::k23si, partitions.size(), 2);
+        return _txn1.end(true);
+    })
+    .then([this](auto&& response) {
+        K2EXPECT(log::k23si, response.status, dto::K23SIStatus::OK);
+        return verifyRecords4("partkey_s13_", 10, true);
+    });
+}
+
+// Per-key failures in a batch, a batch with duplicate keys, and abort after writeBatch
+seastar::future<> runScenario14() {
+    K2LOG_I(log::k23si, "Scenario 14");
+    return _client.beginTxn(K2TxnOptions())
+    .then([this] (K2TxnHandle&& txn) {
+        _txn1 = std::move(txn);
+
+        // new keys interleaved with the keys committed in scenario 13. The first one designates the TRH
+        std::vector<dto::SKVRecord> records;
+        auto newRecords = makeRecords4("partkey_s14_", 4);
+        auto oldRecords = makeRecords4("partkey_s13_", 4);
+        for (size_t i = 0; i < newRecords.size(); ++i) {
+            records.push_back(std::move(newRecords[i]));
+            records.push_back(std::move(oldRecords[i]));
+        }
+        return seastar::do_with(std::move(records), [this] (auto& records) {
+            return _txn1.writeBatch(records, false, dto::ExistencePrecondition::NotExists);
+        });
+    })
+    .then([this] (std::vector<WriteResult>&& results) {
+        K2EXPECT(log::k23si, results.size(), 8);
+        for (size_t i = 0; i < results.size(); ++i) {
+            K2EXPECT(log::k23si, results[i].status, i % 2 == 0 ? dto::K23SIStatus::Created : dto::K23SIStatus::ConditionFailed);
+        }
+
+        // the same key twice in one batch is rejected as a whole
+        std::vector<dto::SKVRecord> records = makeRecords4("partkey_s14_dup", 1);
+        records.push_back(makeRecords4("partkey_s14_dup", 1)[0]);
+        return seastar::do_with(std::move(records), [this] (auto& records) {
+            return _txn1.writeBatch(records);
+        });
+    })
+    .then([this] (std::vector<WriteResult>&& results) {
+        K2EXPECT(log::k23si, results.size(), 2);
+        K2EXPECT(log::k23si, results[0].status, dto::K23SIStatus::BadParameter);
+        K2EXPECT(log::k23si, results[1].status, dto::K23SIStatus::BadParameter);
+
+        // neither failure fails the txn, which can still be aborted
+        return _txn1.end(false);
+    })
+    .then([this](auto&& response) {
+        K2EXPECT(log::k23si, response.status, dto::K23SIStatus::OK);
+        return verifyRecords4("partkey_s14_", 4, false);
+    })
+    .then([this] {
+        return verifyRecords4("partkey_s14_dup", 1, false);
+    })
+    .then([this] {
+        return verifyRecords4("partkey_s13_", 10, true);
+    });
+}
+
+// A write batch grouped with a stale partition map. The partition which receives the batch rejects the keys
+// it does not own with RefreshCollection and the client retries them individually after refreshing the map
+seastar::future<> runScenario15() {
+    K2LOG_I(log::k23si, "Scenario 15");
+    return _client.beginTxn(K2TxnOptions())
+    .then([this] (K2TxnHandle&& txn) {
+        _txn1 = std::move(txn);
+        return _client.cpo_client.getPartitionGetterWithRetry(Deadline<>(1s), String(collname4));
+    })
+    .then([this] (auto&& result) {
+        auto& [status, pgetter] = result;
+        K2EXPECT(log::k23si, status.is2xxOK(), true);
+
+        // pretend the partition which owns the first record owns the whole collection
+        auto records = makeRecords4("partkey_s15_", 10);
+        dto::Partition owner = *pgetter->getPartitionForKey(records[0].getKey()).partition;
+        size_t foreign = 0;
+        for (auto& record : records) {
+            if (!(pgetter->getPartitionForKey(record.getKey()).partition->keyRangeV.pvid == owner.keyRangeV.pvid)) {
+                ++foreign;
+            }
+        }
+        K2EXPECT(log::k23si, foreign > 0, true);
+
+        dto::Collection stale = pgetter->collection;
+        owner.keyRangeV.endKey = std::to_string(std::numeric_limits<uint64_t>::max());
+        stale.partitionMap.partitions = std::vector<dto::Partition>{std::move(owner)};
+        _client.cpo_client.collections[collname4] = seastar::make_lw_shared<dto::PartitionGetter>(std::move(stale));
+
+        return seastar::do_with(std::move(records), [this] (auto& records) {
+            return _txn1.writeBatch(records);
+        });
+    })
+    .then([this] (std::vector<WriteResult>&& results) {
+        K2EXPECT(log::k23si, results.size(), 10);
+        for (auto& result : results) {
+            K2EXPECT(log::k23si, result.status, dto::K23SIStatus::Created);
+        }
+        // the retries refreshed the partition map
+        K2EXPECT(log::k23si, _client.cpo_client.collections[collname4]->getAllPartitions().size(), 2);
+        return _txn1.end(true);
+    })
+    .then([this](auto&& response) {
+        K2EXPECT(log::k23si, response.status, dto::K23SIStatus::OK);
+        return verifyRecords4("partkey_s15_", 10, true);
+    });
+}
+
+// writeAndCommit of a record owned by the TRH partition commits the txn with the write, in one round trip.
+// The record written before it by the txn is committed as well
+seastar::future<> runScenario16() {
+    K2LOG_I(log::k23si, "Scenario 16");
+    return _client.getSchema(collname4, "4_schema", 1)
+    .then([this] (auto&& response) {
+        auto& [status, schemaPtr] = response;
+        K2EXPECT(log::k23si, status.is2xxOK(), true);
+        _schema = schemaPtr;
+        return _client.beginTxn(K2TxnOptions());
+    })
+    .then([this] (K2TxnHandle&& txn) {
+        _txn1 = std::move(txn);
+        // designates the TRH
+        auto record = makeRecord4("partkey_s16_", 0);
+        return _txn1.write(record);
+    })
+    .then([this] (WriteResult&& result) {
+        K2EXPECT(log::k23si, result.status, dto::K23SIStatus::Created);
+        auto writeCommits = _client.write_commits;
+        auto last = findRecord4("partkey_s16_", true);
+        auto record = makeRecord4("partkey_s16_", last);
+        return _txn1.writeAndCommit(record)
+        .then([this, writeCommits, last] (EndResult&& result) {
+            K2EXPECT(log::k23si, result.status, dto::K23SIStatus::OK);
+            // the TRH ended the txn, and reported it with txnEnded in the write response
+            K2EXPECT(log::k23si, _client.write_commits, writeCommits + 1);
+            return verifyRecords4("partkey_s16_", std::vector<int>{0, last}, true);
+        });
+    });
+}
+
+// writeAndCommit of a record owned by another partition than the TRH is written as usual and the txn is ended
+// with a separate end request
+seastar::future<> runScenario17() {
+    K2LOG_I(log::k23si, "Scenario 17");
+    return _client.beginTxn(K2TxnOptions())
+    .then([this] (K2TxnHandle&& txn) {
+        _txn1 = std::move(txn);
+        auto record = makeRecord4("partkey_s17_", 0);
+        return _txn1.write(record);
+    })
+    .then([this] (WriteResult&& result) {
+        K2EXPECT(log::k23si, result.status, dto::K23SIStatus::Created);
+        auto writeCommits = _client.write_commits;
+        auto last = findRecord4("partkey_s17_", false);
+        auto record = makeRecord4("partkey_s17_", last);
+        return _txn1.writeAndCommit(record)
+        .then([this, writeCommits, last] (EndResult&& result) {
+            K2EXPECT(log::k23si, result.status, dto::K23SIStatus::OK);
+            K2EXPECT(log::k23si, _client.write_commits, writeCommits);
+            return verifyRecords4("partkey_s17_", std::vector<int>{0, last}, true);
+        });
+    });
+}
+
+// A writeAndCommit which fails, or conflicts with a newer committed write, aborts the txn. The status of the
+// write is returned and none of the writes of the txn become visible
+seastar::future<> runScenario18() {
+    K2LOG_I(log::k23si, "Scenario 18");
+    // commit the record which the txn below tries to insert again, on the TRH partition
+    auto existing = findRecord4("partkey_s18_", true);
+    return _client.beginTxn(K2TxnOptions())
+    .then([this, existing] (K2TxnHandle&& txn) {
+        _txn1 = std::move(txn);
+        auto record = makeRecord4("partkey_s18_", existing);
+        return _txn1.writeAndCommit(record);
+    })
+    .then([this] (EndResult&& result) {
+        K2EXPECT(log::k23si, result.status, dto::K23SIStatus::OK);
+        return _client.beginTxn(K2TxnOptions());
+    })
+    .then([this] (K2TxnHandle&& txn) {
+        _txn1 = std::move(txn);
+        auto record = makeRecord4("partkey_s18_", 0);
+        return _txn1.write(record);
+    })
+    .then([this, existing] (WriteResult&& result) {
+        K2EXPECT(log::k23si, result.status, dto::K23SIStatus::Created);
+        auto writeCommits = _client.write_commits;
+        auto record = makeRecord4("partkey_s18_", existing);
+        return _txn1.writeAndCommit(record, false, dto::ExistencePrecondition::NotExists)
+        .then([this, writeCommits] (EndResult&& result) {
+            K2EXPECT(log::k23si, result.status, dto::K23SIStatus::ConditionFailed);
+            K2EXPECT(log::k23si, _client.write_commits, writeCommits);
+            return verifyRecords4("partkey_s18_", std::vector<int>{0}, false);
+        });
+    })
+    .then([this] {
+        // an older txn writes the TRH, then a newer txn commits a record on the TRH partition
+        return _client.beginTxn(K2TxnOptions());
+    })
+    .then([this] (K2TxnHandle&& txn) {
+        _txn1 = std::move(txn);
+        auto record = makeRecord4("partkey_s18_old_", 0);
+        return _txn1.write(record);
+    })
+    .then([this] (WriteResult&& result) {
+        K2EXPECT(log::k23si, result.status, dto::K23SIStatus::Created);
+        return _client.beginTxn(K2TxnOptions());
+    })
+    .then([this] (K2TxnHandle&& txn) {
+        _txn2 = std::move(txn);
+        auto record = makeRecord4("partkey_s18_old_", findRecord4("partkey_s18_old_", true));
+        return _txn2.writeAndCommit(record);
+    })
+    .then([this] (EndResult&& result) {
+        K2EXPECT(log::k23si, result.status, dto::K23SIStatus::OK);
+        // the older txn can't write over the newer committed record
+        auto writeCommits = _client.write_commits;
+        auto record = makeRecord4("partkey_s18_old_", findRecord4("partkey_s18_old_", true));
+        return _txn1.writeAndCommit(record)
+        .then([this, writeCommits] (EndResult&& result) {
+            K2EXPECT(log::k23si, result.status, dto::K23SIStatus::AbortRequestTooOld);
+            K2EXPECT(log::k23si, _client.write_commits, writeCommits);
+            return verifyRecords4("partkey_s18_old_", std::vector<int>{0}, false);
+        });
+    });
+}
+
+// The txn handle can't be used once writeAndCommit was called, whether the commit is done with the write or not,
+// and also while the writeAndCommit is in flight
+seastar::future<> runScenario19() {
+    K2LOG_I(log::k23si, "Scenario 19");
+    return useAfterWriteAndCommit("partkey_s19_trh_", true)
+    .then([this] {
+        return useAfterWriteAndCommit("partkey_s19_other_", false);
+    });
+}
+
+// Ends a txn with writeAndCommit of a record on the TRH partition (or on another partition), and checks that the
+// txn handle can't be used during and after it
+seastar::future<> useAfterWriteAndCommit(const String& prefix, bool samePartition) {
+    return _client.beginTxn(K2TxnOptions())
+    .then([this, prefix] (K2TxnHandle&& txn) {
+        _txn1 = std::move(txn);
+        auto record = makeRecord4(prefix, 0);
+        return _txn1.write(record);
+    })
+    .then([this, prefix, samePartition] (WriteResult&& result) {
+        K2EXPECT(log::k23si, result.status, dto::K23SIStatus::Created);
+        auto record = makeRecord4(prefix, findRecord4(prefix, samePartition));
+        auto commitFuture = _txn1.writeAndCommit(record);
+
+        // while the writeAndCommit is in flight
+        auto another = makeRecord4(prefix, 0);
+        return expectRejected(_txn1.write(another))
+        .then([commitFuture=std::move(commitFuture)] () mutable {
+            return std::move(commitFuture);
+        });
+    })
+    .then([this, prefix] (EndResult&& result) {
+        K2EXPECT(log::k23si, result.status, dto::K23SIStatus::OK);
+        // and after it completed
+        return expectRejected(_txn1.read(makeRecord4(prefix, 0).getKey(), collname4));
+    })
+    .then([this, prefix] {
+        auto record = makeRecord4(prefix, 0);
+        return expectRejected(_txn1.writeAndCommit(record));
+    })
+    .then([this] {
+        return expectRejected(_txn1.end(true));
+    });
+}
+
+// checks that the given txn operation failed with an exception
+template <typename T>
+seastar::future<> expectRejected(seastar::future<T>&& fut) {
+    return fut.then_wrapped([] (auto&& fut) {
+        K2EXPECT(log::k23si, fut.failed(), true);
+        fut.ignore_ready_future();
+    });
+}
+
 };  // class SKVClientTest
 
 int main(int argc, char** argv) {
@@ -23,6 +23,7 @@ Copyright(c) 2020 Futurewei Cloud
 
 #define CATCH_CONFIG_MAIN
 
+#include <chrono>
 #include <cstdarg>
 #include <k2/dto/SKVRecord.h>
 
@@ -516,3 +517,131 @@ TEST_CASE("Test13: serialiaze float, double and decimal fields") {
     
     std::cout << "Test13: Serialize float and double fields." << std::endl;
 }
+
+namespace {
+// A 50-field row, similar in shape to the wide TPC-C tables: a few key fields followed by a mix of value types
+const uint32_t wideFields = 50;
+
+std::shared_ptr<k2::dto::Schema> makeWideSchema() {
+    auto schema = std::make_shared<k2::dto::Schema>();
+    schema->name = "wide_schema";
+    schema->version = 1;
+    for (uint32_t i = 0; i < wideFields; ++i) {
+        k2::dto::FieldType type = i % 3 == 0 ? k2::dto::FieldType::STRING :
+                                  i % 3 == 1 ? k2::dto::FieldType::INT64T : k2::dto::FieldType::DOUBLE;
+        schema->fields.push_back({type, k2::String("F") + std::to_string(i), false, false});
+    }
+    schema->setPartitionKeyFieldsByName(std::vector<k2::String>{"F0", "F1"});
+    schema->setRangeKeyFieldsByName(std::vector<k2::String>{"F2"});
+    return schema;
+}
+
+// every 7th value field is NULL
+bool isWideNull(uint32_t i) {
+    return i > 2 && i % 7 == 0;
+}
+
+k2::dto::SKVRecord makeWideRecord(std::shared_ptr<k2::dto::Schema> schema) {
+    k2::dto::SKVRecord rec("collection", schema);
+    for (uint32_t i = 0; i < wideFields; ++i) {
+        if (isWideNull(i)) {
+            rec.serializeNull();
+        } else if (i % 3 == 0) {
+            rec.serializeNext<k2::String>(k2::String("value_of_field_") + std::to_string(i));
+        } else if (i % 3 == 1) {
+            rec.serializeNext<int64_t>((int64_t)i * 1000);
+        } else {
+            rec.serializeNext<double>(i * 0.5);
+        }
+    }
+    return rec;
+}
+
+void checkWideField(k2::dto::SKVRecord& rec, uint32_t i) {
+    if (i % 3 == 0) {
+        auto val = rec.deserializeField<k2::String>(i);
+        if (isWideNull(i)) {
+            REQUIRE(!val.has_value());
+        } else {
+            REQUIRE(*val == k2::String("value_of_field_") + std::to_string(i));
+        }
+    } else if (i % 3 == 1) {
+        auto val = rec.deserializeField<int64_t>(i);
+        if (isWideNull(i)) {
+            REQUIRE(!val.has_value());
+        } else {
+            REQUIRE(*val == (int64_t)i * 1000);
+        }
+    } else {
+        auto val = rec.deserializeField<double>(i);
+        if (isWideNull(i)) {
+            REQUIRE(!val.has_value());
+        } else {
+            REQUIRE(*val == i * 0.5);
+        }
+    }
+}
+} // namespace
+
+TEST_CASE("Test14: random field access on a wide record") {
+    auto schema = makeWideSchema();
+    auto doc = makeWideRecord(schema);
+
+    // the offset index is filled in by the writer
+    REQUIRE(doc.getStorage().fieldOffsets.size() == wideFields);
+
+    // the index is not serialized, so a record we receive has to build it on demand
+    k2::Payload wire(k2::Payload::DefaultAllocator());
+    wire.write(doc.getStorage());
+    wire.seek(0);
+    k2::dto::SKVRecord::Storage received;
+    REQUIRE(wire.read(received));
+    REQUIRE(received.fieldOffsets.empty());
+    k2::dto::SKVRecord rec("collection", schema, std::move(received), true);
+
+    // backwards
+    for (uint32_t i = wideFields; i > 0; --i) {
+        checkWideField(rec, i - 1);
+    }
+    // the index now covers the end of the last field as well
+    auto& offsets = rec.getStorage().fieldOffsets;
+    REQUIRE(offsets.size() == wideFields + 1);
+    REQUIRE(std::vector<uint32_t>(offsets.begin(), offsets.begin() + wideFields) == doc.getStorage().fieldOffsets);
+    REQUIRE(offsets.back() == doc.getStorage().fieldData.getSize());
+
+    // and in a scattered order
+    for (uint32_t i = 0; i < wideFields; ++i) {
+        checkWideField(rec, (i * 17) % wideFields);
+        checkWideField(doc, (i * 31) % wideFields);
+    }
+
+    // keys still work after random access
+    REQUIRE(rec.getKey() == doc.getKey());
+    auto keyRec = rec.getSKVKeyRecord();
+    REQUIRE(*keyRec.deserializeField<int64_t>(1) == 1000);
+    REQUIRE(!keyRec.deserializeField<k2::String>(wideFields - 2).has_value());
+    REQUIRE(*keyRec.deserializeField<k2::String>(0) == "value_of_field_0");
+
+    // time a projection-like access pattern: a handful of fields, out of order, from freshly received records
+    const size_t numRecords = 20000;
+    const uint32_t projected[] = {45, 3, 30, 12, 48, 1};
+    auto start = std::chrono::steady_clock::now();
+    size_t found = 0;
+    for (size_t n = 0; n < numRecords; ++n) {
+        wire.seek(0);
+        k2::dto::SKVRecord::Storage storage;
+        REQUIRE(wire.read(storage));
+        k2::dto::SKVRecord fresh("collection", schema, std::move(storage), true);
+        for (auto idx : projected) {
+            if (idx % 3 == 0) {
+                found += fresh.deserializeField<k2::String>(idx).has_value();
+            } else {
+                found += fresh.deserializeField<int64_t>(idx).has_value();
+            }
+        }
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    REQUIRE(found == numRecords * 6);
+    std::cout << "Test14: " << numRecords << " projections of " << sizeof(projected) / sizeof(projected[0])
+              << " fields from a " << wideFields << "-field record in " << elapsed << "s" << std::endl;
+}
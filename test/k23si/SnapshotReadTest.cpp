@@ -0,0 +1,410 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <k2/appbase/AppEssentials.h>
+#include <k2/appbase/Appbase.h>
+#include <k2/cpo/client/Client.h>
+#include <k2/dto/K23SIInspect.h>
+#include <k2/module/k23si/client/k23si_client.h>
+#include <seastar/core/sleep.hh>
+
+using namespace k2;
+#include "Log.h"
+const char* collname = "snapshot_read_collection";
+
+// Tests for snapshot read txns. The same binary runs against a nodepool which closes timestamps
+// (k23si_closed_timestamp_lag > 0, run with --snapshot_test_closed true), and against one with the default lag of 0,
+// where timestamps are only closed up to the retention timestamp and snapshot reads are served as regular reads.
+// The client's --snapshot_read_lag must exceed the nodepool's lag plus its update interval, and the CPO should
+// use a TSO error bound of tens of milliseconds, so that skipping the wait for it at the end of a txn shows
+class SnapshotReadTest {
+
+public:  // application lifespan
+    SnapshotReadTest() : _client(K23SIClientConfig()) { K2LOG_I(log::k23si, "ctor");}
+    ~SnapshotReadTest(){ K2LOG_I(log::k23si, "dtor");}
+
+    // required for seastar::distributed interface
+    seastar::future<> gracefulStop() {
+        K2LOG_I(log::k23si, "stop");
+        return std::move(_testFuture);
+    }
+
+    seastar::future<> start(){
+        K2LOG_I(log::k23si, "start, closed={}", _closed());
+
+        _testTimer.set_callback([this] {
+            _testFuture = seastar::make_ready_future()
+            .then([this] () {
+                return _client.start();
+            })
+            .then([this] {
+                K2LOG_I(log::k23si, "Creating test collection");
+                dto::CollectionMetadata md{
+                    .name = collname,
+                    .hashScheme = dto::HashScheme::HashCRC32C,
+                    .storageDriver = dto::StorageDriver::K23SI,
+                    .capacity = {
+                        .dataCapacityMegaBytes = 0,
+                        .readIOPs = 0,
+                        .writeIOPs = 0,
+                        .minNodes = 1
+                    },
+                    .retentionPeriod = 2h
+                };
+                return _client.makeCollection(std::move(md));
+            })
+            .then([this](auto&& status) {
+                K2ASSERT(log::k23si, status.is2xxOK(), "bad status: {}", status);
+                dto::Schema schema;
+                schema.name = "schema";
+                schema.version = 1;
+                schema.fields = std::vector<dto::SchemaField> {
+                        {dto::FieldType::STRING, "partition", false, false},
+                        {dto::FieldType::STRING, "range", false, false},
+                        {dto::FieldType::STRING, "data", false, false},
+                };
+
+                schema.setPartitionKeyFieldsByName(std::vector<String>{"partition"});
+                schema.setRangeKeyFieldsByName(std::vector<String> {"range"});
+
+                return _client.createSchema(collname, std::move(schema));
+            })
+            .then([this] (auto&& result) {
+                K2EXPECT(log::k23si, result.status.is2xxOK(), true);
+                return _client.getSchema(collname, "schema", 1);
+            })
+            .then([this] (auto&& response) {
+                auto& [status, schemaPtr] = response;
+                K2EXPECT(log::k23si, status.is2xxOK(), true);
+                _schema = schemaPtr;
+            })
+            .then([this] { return runSetup(); })
+            .then([this] { return runScenario01(); })
+            .then([this] { return runScenario02(); })
+            .then([this] { return runScenario03(); })
+            .then([this] { return runScenario04(); })
+            .then([this] {
+                K2LOG_I(log::k23si, "======= All tests passed ========");
+                exitcode = 0;
+            })
+            .handle_exception([this](auto exc) {
+                try {
+                    std::rethrow_exception(exc);
+                } catch (std::exception& e) {
+                    K2LOG_E(log::k23si, "======= Test failed with exception [{}] ========", e.what());
+                    exitcode = -1;
+                } catch (...) {
+                    K2LOG_E(log::k23si, "Test failed with unknown exception");
+                    exitcode = -1;
+                }
+            })
+            .finally([this] {
+                K2LOG_I(log::k23si, "======= Test ended ========");
+                AppBase().stop(exitcode);
+            });
+        });
+
+        _testTimer.arm(0ms);
+        return seastar::make_ready_future();
+    }
+
+private:
+    int exitcode = -1;
+
+    seastar::timer<> _testTimer;
+    seastar::future<> _testFuture = seastar::make_ready_future();
+
+    // true if the nodepool closes timestamps, i.e. runs with a closed timestamp lag
+    ConfigVar<bool> _closed{"snapshot_test_closed", false};
+    ConfigDuration _snapshotReadLag{"snapshot_read_lag", 10s};
+
+    std::shared_ptr<dto::Schema> _schema;
+    K23SIClient _client;
+
+    dto::SKVRecord _makeRecord(const String& key, std::optional<String> data=std::nullopt) {
+        dto::SKVRecord record(collname, _schema);
+        record.serializeNext<String>(key);
+        record.serializeNext<String>("range");
+        if (data) {
+            record.serializeNext<String>(*data);
+        }
+        return record;
+    }
+
+    seastar::future<WriteResult> _write(K2TxnHandle& txn, const String& key, const String& data) {
+        return seastar::do_with(_makeRecord(key, data), [&txn] (auto& record) {
+            return txn.write(record);
+        });
+    }
+
+    seastar::future<ReadResult<dto::SKVRecord>> _read(K2TxnHandle& txn, const String& key) {
+        return txn.read(_makeRecord(key));
+    }
+
+    // the records and read cache state for the given key on its partition
+    seastar::future<std::tuple<Status, dto::K23SIInspectRecordsResponse>> _inspect(const String& key) {
+        return seastar::do_with(dto::K23SIInspectRecordsRequest{
+                .pvid = dto::PVID{}, // Will be filled in by PartitionRequest
+                .collectionName = collname,
+                .key = _makeRecord(key).getKey()
+            },
+            [this] (auto& request) {
+                return _client.cpo_client.partitionRequest
+                    <dto::K23SIInspectRecordsRequest, dto::K23SIInspectRecordsResponse, dto::Verbs::K23SI_INSPECT_RECORDS>
+                    (Deadline<>(1s), request);
+            });
+    }
+
+    // fails unless the given future failed with K23SIClientException
+    template <typename FutureT>
+    static seastar::future<> _expectClientException(FutureT&& fut) {
+        return fut.then_wrapped([] (auto&& fut) {
+            if (!fut.failed()) {
+                fut.ignore_ready_future();
+                throw std::runtime_error("expected the client to refuse the operation");
+            }
+            try {
+                std::rethrow_exception(fut.get_exception());
+            } catch (K23SIClientException& e) {
+                K2LOG_I(log::k23si, "got expected client exception: {}", e.what());
+            }
+        });
+    }
+
+    seastar::future<K2TxnHandle> _beginSnapshotTxn(dto::TxnPriority priority=dto::TxnPriority::Medium) {
+        K2TxnOptions options{};
+        options.snapshotRead = true;
+        options.priority = priority;
+        return _client.beginTxn(options);
+    }
+
+public: // tests
+
+// Commit the record which the snapshot reads expect, and wait until it is older than the snapshot read lag
+seastar::future<> runSetup() {
+    K2LOG_I(log::k23si, "Setup");
+    K2TxnOptions options{};
+    options.syncFinalize = true;
+    return _client.beginTxn(options)
+    .then([this] (K2TxnHandle&& txn) {
+        return seastar::do_with(std::move(txn), [this] (auto& txn) {
+            return _write(txn, "key1", "committed")
+            .then([&txn] (auto&& result) {
+                K2EXPECT(log::k23si, result.status, dto::K23SIStatus::Created);
+                return txn.end(true);
+            })
+            .then([] (auto&& result) {
+                K2EXPECT(log::k23si, result.status, dto::K23SIStatus::OK);
+            });
+        });
+    })
+    .then([this] {
+        return seastar::sleep(_snapshotReadLag() + 200ms);
+    });
+}
+
+// The client refuses writes in snapshot read txns, and their end does not wait for the TSO error bound
+seastar::future<> runScenario01() {
+    K2LOG_I(log::k23si, "Scenario 01");
+    K2EXPECT(log::k23si, _client.getTSOErrorbound() >= 20ms, true);
+    return _beginSnapshotTxn()
+    .then([this] (K2TxnHandle&& txn) {
+        return seastar::do_with(std::move(txn), _makeRecord("key1", "snapshot"), std::vector<dto::SKVRecord>{},
+        [this] (auto& txn, auto& record, auto& records) {
+            return _expectClientException(txn.write(record))
+            .then([&txn, &record] {
+                return _expectClientException(txn.partialUpdate(record, std::vector<String>{"data"}));
+            })
+            .then([&txn, &record, &records] {
+                records.push_back(record.deepCopy());
+                return _expectClientException(txn.writeBatch(records));
+            })
+            .then([&txn, &record] {
+                return _expectClientException(txn.writeAndCommit(record));
+            })
+            .then([this, &txn] {
+                auto start = Clock::now();
+                return txn.end(true)
+                .then([this, start] (auto&& result) {
+                    K2EXPECT(log::k23si, result.status, dto::K23SIStatus::OK);
+                    K2EXPECT(log::k23si, Clock::now() - start < _client.getTSOErrorbound(), true);
+                });
+            });
+        });
+    })
+    .then([this] {
+        // a regular read-only txn waits out the error bound
+        return _client.beginTxn(K2TxnOptions{});
+    })
+    .then([this] (K2TxnHandle&& txn) {
+        return seastar::do_with(std::move(txn), Clock::now(), [this] (auto& txn, auto& start) {
+            return txn.end(true)
+            .then([this, &start] (auto&& result) {
+                K2EXPECT(log::k23si, result.status, dto::K23SIStatus::OK);
+                K2EXPECT(log::k23si, Clock::now() - start >= _client.getTSOErrorbound() / 2, true);
+            });
+        });
+    });
+}
+
+// Writes at or below the closed timestamp are rejected. With a lag of 0, the closed timestamp doesn't follow the TSO
+// time, so a write from a txn which started long ago is still accepted
+seastar::future<> runScenario02() {
+    K2LOG_I(log::k23si, "Scenario 02");
+    return _client.beginTxn(K2TxnOptions{})
+    .then([this] (K2TxnHandle&& txn) {
+        return seastar::do_with(std::move(txn), [this] (auto& txn) {
+            // long enough for the closed timestamp to pass the txn timestamp, if the nodepool closes timestamps
+            return seastar::sleep(1s)
+            .then([this, &txn] {
+                return _write(txn, "key2", "old");
+            })
+            .then([this, &txn] (auto&& result) {
+                if (_closed()) {
+                    K2EXPECT(log::k23si, result.status, dto::K23SIStatus::AbortRequestTooOld);
+                }
+                else {
+                    K2EXPECT(log::k23si, result.status, dto::K23SIStatus::Created);
+                }
+                return txn.end(!_closed());
+            })
+            .then([] (auto&& result) {
+                K2EXPECT(log::k23si, result.status, dto::K23SIStatus::OK);
+            });
+        });
+    })
+    .then([this] {
+        // a new txn is above the closed timestamp
+        return _client.beginTxn(K2TxnOptions{});
+    })
+    .then([this] (K2TxnHandle&& txn) {
+        return seastar::do_with(std::move(txn), [this] (auto& txn) {
+            return _write(txn, "key2", "new")
+            .then([&txn] (auto&& result) {
+                K2EXPECT(log::k23si, result.status.is2xxOK(), true);
+                return txn.end(true);
+            })
+            .then([] (auto&& result) {
+                K2EXPECT(log::k23si, result.status, dto::K23SIStatus::OK);
+            });
+        });
+    });
+}
+
+// A snapshot read at a closed timestamp leaves the read cache alone. Otherwise, it is served as a regular read,
+// which observes the key at the txn timestamp
+seastar::future<> runScenario03() {
+    K2LOG_I(log::k23si, "Scenario 03");
+    return _inspect("key1")
+    .then([this] (auto&& result) {
+        auto& [status, before] = result;
+        K2EXPECT(log::k23si, status.is2xxOK(), true);
+        return _beginSnapshotTxn()
+        .then([this, before=std::move(before)] (K2TxnHandle&& txn) mutable {
+            return seastar::do_with(std::move(txn), std::move(before), [this] (auto& txn, auto& before) {
+                K2EXPECT(log::k23si, before.lastReadTime.compareCertain(txn.mtr().timestamp) == dto::Timestamp::LT, true);
+                return _read(txn, "key1")
+                .then([this] (auto&& result) {
+                    K2EXPECT(log::k23si, result.status, dto::K23SIStatus::OK);
+                    K2EXPECT(log::k23si, *result.value.template deserializeField<String>("data"), "committed");
+                    return _inspect("key1");
+                })
+                .then([this, &txn, &before] (auto&& result) {
+                    auto& [status, after] = result;
+                    K2EXPECT(log::k23si, status.is2xxOK(), true);
+                    if (_closed()) {
+                        K2EXPECT(log::k23si, after.lastReadTime, before.lastReadTime);
+                    }
+                    else {
+                        K2EXPECT(log::k23si, after.lastReadTime, txn.mtr().timestamp);
+                    }
+                    return txn.end(true);
+                })
+                .then([] (auto&& result) {
+                    K2EXPECT(log::k23si, result.status, dto::K23SIStatus::OK);
+                });
+            });
+        });
+    });
+}
+
+// A snapshot read at a closed timestamp doesn't push WIs placed after it, even from a higher priority. The
+// WI's txn commits
+seastar::future<> runScenario04() {
+    K2LOG_I(log::k23si, "Scenario 04");
+    if (!_closed()) {
+        return seastar::make_ready_future();
+    }
+    K2TxnOptions options{};
+    options.priority = dto::TxnPriority::Lowest;
+    options.syncFinalize = true;
+    return _client.beginTxn(options)
+    .then([this] (K2TxnHandle&& txn) {
+        return seastar::do_with(std::move(txn), [this] (auto& incumbent) {
+            return _write(incumbent, "key1", "incumbent")
+            .then([this] (auto&& result) {
+                K2EXPECT(log::k23si, result.status.is2xxOK(), true);
+                return _beginSnapshotTxn(dto::TxnPriority::Highest);
+            })
+            .then([this] (K2TxnHandle&& txn) {
+                return seastar::do_with(std::move(txn), [this] (auto& txn) {
+                    return _read(txn, "key1")
+                    .then([&txn] (auto&& result) {
+                        K2EXPECT(log::k23si, result.status, dto::K23SIStatus::OK);
+                        K2EXPECT(log::k23si, *result.value.template deserializeField<String>("data"), "committed");
+                        return txn.end(true);
+                    })
+                    .then([] (auto&& result) {
+                        K2EXPECT(log::k23si, result.status, dto::K23SIStatus::OK);
+                    });
+                });
+            })
+            .then([this] {
+                return _inspect("key1");
+            })
+            .then([&incumbent] (auto&& result) {
+                // the WI is still there
+                auto& [status, response] = result;
+                K2EXPECT(log::k23si, status.is2xxOK(), true);
+                K2EXPECT(log::k23si, response.records.size(), 2);
+                return incumbent.end(true);
+            })
+            .then([] (auto&& result) {
+                K2EXPECT(log::k23si, result.status, dto::K23SIStatus::OK);
+            });
+        });
+    });
+}
+
+};  // class SnapshotReadTest
+
+int main(int argc, char** argv) {
+    App app("SnapshotReadTest");
+    app.addOptions()
+        ("cpo", bpo::value<String>(), "URL of Control Plane Oracle (CPO), e.g. 'tcp+k2rpc://192.168.1.2:12345'")
+        ("snapshot_read_lag", bpo::value<ParseableDuration>(), "How far in the past snapshot read txns read")
+        ("snapshot_test_closed", bpo::value<bool>(), "Whether the nodepool runs with a closed timestamp lag");
+    app.addApplet<tso::TSOClient>();
+    app.addApplet<SnapshotReadTest>();
+    return app.start(argc, argv);
+}
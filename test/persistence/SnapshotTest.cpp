@@ -0,0 +1,343 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+#include <filesystem>
+
+#include <boost/range/irange.hpp>
+#include <seastar/core/reactor.hh>
+
+#include <k2/appbase/Appbase.h>
+#include <k2/appbase/AppEssentials.h>
+#include <k2/module/k23si/Persistence.h>
+#include <k2/persistence/service/PersistenceService.h>
+#include <k2/persistence/service/SnapshotStore.h>
+
+using namespace k2;
+
+namespace k2::log {
+inline thread_local k2::logging::Logger snaptest("k2::snapshot_test");
+}
+
+// Tests for partition snapshots. The snapshot store is tested directly in a directory under --persistence_wal_dir.
+// Recovery from a snapshot plus the log suffix goes through the PersistenceService which runs in this process, at the
+// endpoint given with --k23si_persistence_endpoints
+class SnapshotTest {
+public:  // application lifespan
+    SnapshotTest() { K2LOG_I(log::snaptest, "ctor"); }
+    ~SnapshotTest() { K2LOG_I(log::snaptest, "dtor"); }
+
+    // required for seastar::distributed interface
+    seastar::future<> gracefulStop() {
+        K2LOG_I(log::snaptest, "stop");
+        return std::move(_testFuture);
+    }
+
+    seastar::future<> start() {
+        K2LOG_I(log::snaptest, "start");
+        _testTimer.set_callback([this] {
+            _testFuture = seastar::make_ready_future()
+            .then([this] { return runScenario01(); })
+            .then([this] { return runScenario02(); })
+            .then([this] { return runScenario03(); })
+            .then([this] {
+                K2LOG_I(log::snaptest, "======= All tests passed ========");
+                exitcode = 0;
+            })
+            .handle_exception([this](auto exc) {
+                K2LOG_W_EXC(log::snaptest, exc, "======= Test failed ========");
+                exitcode = -1;
+            })
+            .finally([this] {
+                K2LOG_I(log::snaptest, "======= Test ended ========");
+                AppBase().stop(exitcode);
+            });
+        });
+        _testTimer.arm(0ms);
+        return seastar::make_ready_future();
+    }
+
+private:
+    int exitcode = -1;
+    ConfigVar<String> _walDir{"persistence_wal_dir", "/tmp/k2_persistence_wal"};
+    seastar::future<> _testFuture = seastar::make_ready_future();
+    seastar::timer<> _testTimer;
+    const String _collection = "snapshot collection/1";
+
+    String _storeDir() {
+        return fmt::format("{}/store_test_{}", _walDir(), seastar::this_shard_id());
+    }
+
+    static Payload _makeChunk(const String& value) {
+        Payload chunk(Payload::DefaultAllocator());
+        chunk.write(value);
+        return chunk;
+    }
+
+    static String _chunkValue(Payload& chunk) {
+        String value;
+        chunk.seek(0);
+        if (!chunk.read(value)) {
+            throw std::runtime_error("unable to read chunk value");
+        }
+        return value;
+    }
+
+    seastar::future<Status> _writeChunk(SnapshotStore& store, uint64_t startSequence, uint64_t chunkId, bool last, const String& value) {
+        return store.write(dto::K23SI_PersistenceSnapshotRequest{
+            .collectionName=_collection,
+            .partitionId=1,
+            .startSequence=startSequence,
+            .chunkId=chunkId,
+            .last=last,
+            .data=_makeChunk(value)
+        });
+    }
+
+    // read all chunks of the latest snapshot in small pages
+    seastar::future<std::vector<String>> _readAll(SnapshotStore& store, uint64_t expectedStartSequence) {
+        return seastar::do_with(std::vector<String>(), uint64_t(0), false,
+            [this, &store, expectedStartSequence](auto& values, auto& offset, auto& done) {
+            return seastar::do_until(
+                [&done] { return done; },
+                [this, &store, expectedStartSequence, &values, &offset, &done] {
+                    return store.read(dto::K23SI_PersistenceSnapshotReadRequest{
+                            .collectionName=_collection,
+                            .partitionId=1,
+                            .continuationOffset=offset,
+                            .maxBytes=4096
+                        })
+                        .then([expectedStartSequence, &values, &offset, &done](auto&& result) {
+                            auto& [status, response] = result;
+                            K2EXPECT(log::snaptest, status.is2xxOK(), true);
+                            K2EXPECT(log::snaptest, response.found, true);
+                            K2EXPECT(log::snaptest, response.startSequence, expectedStartSequence);
+                            for (auto& chunk: response.chunks) {
+                                values.push_back(_chunkValue(chunk));
+                            }
+                            offset = response.continuationOffset;
+                            done = response.done;
+                        });
+                })
+                .then([&values] {
+                    return std::move(values);
+                });
+        });
+    }
+
+public:
+    seastar::future<> runScenario01() {
+        K2LOG_I(log::snaptest, "Scenario 01: a written snapshot is listed and loaded after a restart");
+        std::filesystem::remove_all(_storeDir());
+        std::filesystem::create_directories(_storeDir());
+        // chunks bigger than a read page
+        String bigChunk(10000, 'b');
+        return seastar::do_with(SnapshotStore(), std::move(bigChunk), [this](auto& store, auto& bigChunk) {
+            return store.start(_storeDir())
+                .then([this, &store] {
+                    K2EXPECT(log::snaptest, store.startSequence(_collection, 1).has_value(), false);
+                    return _writeChunk(store, 5, 0, false, "chunk_0");
+                })
+                .then([this, &store, &bigChunk](Status&& status) {
+                    K2EXPECT(log::snaptest, status.is2xxOK(), true);
+                    // the snapshot isn't visible until its last chunk is written
+                    K2EXPECT(log::snaptest, store.startSequence(_collection, 1).has_value(), false);
+                    return _writeChunk(store, 5, 1, false, bigChunk);
+                })
+                .then([this, &store](Status&& status) {
+                    K2EXPECT(log::snaptest, status.is2xxOK(), true);
+                    return _writeChunk(store, 5, 2, true, "chunk_2");
+                })
+                .then([this, &store](Status&& status) {
+                    K2EXPECT(log::snaptest, status.is2xxOK(), true);
+                    K2EXPECT(log::snaptest, store.startSequence(_collection, 1).value_or(0), 5);
+                    return _readAll(store, 5);
+                })
+                .then([&bigChunk](std::vector<String>&& values) {
+                    K2EXPECT(log::snaptest, values.size(), 3);
+                    K2EXPECT(log::snaptest, values[0], "chunk_0");
+                    K2EXPECT(log::snaptest, values[1], bigChunk);
+                    K2EXPECT(log::snaptest, values[2], "chunk_2");
+                    return seastar::make_ready_future();
+                })
+                .then([&store] {
+                    return store.stop();
+                });
+        })
+        .then([this] {
+            String bigChunk(10000, 'b');
+            return seastar::do_with(SnapshotStore(), std::move(bigChunk), [this](auto& store, auto& bigChunk) {
+                return store.start(_storeDir())
+                    .then([this, &store] {
+                        K2EXPECT(log::snaptest, store.startSequence(_collection, 1).value_or(0), 5);
+                        return _readAll(store, 5);
+                    })
+                    .then([&bigChunk](std::vector<String>&& values) {
+                        K2EXPECT(log::snaptest, values.size(), 3);
+                        K2EXPECT(log::snaptest, values[1], bigChunk);
+                    })
+                    .then([&store] {
+                        return store.stop();
+                    });
+            });
+        });
+    }
+
+    seastar::future<> runScenario02() {
+        K2LOG_I(log::snaptest, "Scenario 02: partial snapshots are ignored");
+        return seastar::do_with(SnapshotStore(), SnapshotStore(), [this](auto& crashed, auto& restarted) {
+            return crashed.start(_storeDir())
+                .then([this, &crashed] {
+                    // chunks have to come in order
+                    return _writeChunk(crashed, 9, 1, false, "chunk_1");
+                })
+                .then([this, &crashed](Status&& status) {
+                    K2EXPECT(log::snaptest, status == Statuses::S409_Conflict, true);
+                    return _writeChunk(crashed, 9, 0, false, "chunk_0");
+                })
+                .then([this, &crashed](Status&& status) {
+                    K2EXPECT(log::snaptest, status.is2xxOK(), true);
+                    return _writeChunk(crashed, 9, 1, false, "chunk_1");
+                })
+                .then([this, &crashed](Status&& status) {
+                    K2EXPECT(log::snaptest, status.is2xxOK(), true);
+                    // the complete snapshot is still the one we serve
+                    K2EXPECT(log::snaptest, crashed.startSequence(_collection, 1).value_or(0), 5);
+                    return _readAll(crashed, 5);
+                })
+                .then([this, &restarted](std::vector<String>&& values) {
+                    K2EXPECT(log::snaptest, values.size(), 3);
+                    // start another store in the same directory as if we crashed in the middle of the snapshot
+                    return restarted.start(_storeDir());
+                })
+                .then([this, &restarted] {
+                    K2EXPECT(log::snaptest, restarted.startSequence(_collection, 1).value_or(0), 5);
+                    for (auto& entry: std::filesystem::directory_iterator(_storeDir())) {
+                        K2EXPECT(log::snaptest, entry.path().extension() == ".snap", true);
+                    }
+                    return _readAll(restarted, 5);
+                })
+                .then([](std::vector<String>&& values) {
+                    K2EXPECT(log::snaptest, values.size(), 3);
+                    K2EXPECT(log::snaptest, values[0], "chunk_0");
+                })
+                .finally([&crashed, &restarted] {
+                    return crashed.stop()
+                        .then([&restarted] {
+                            return restarted.stop();
+                        });
+                });
+        });
+    }
+
+    seastar::future<> runScenario03() {
+        K2LOG_I(log::snaptest, "Scenario 03: recovery loads the snapshot and replays the log suffix");
+        dto::PVID pvid{.id=1, .rangeVersion=1, .assignmentVersion=1};
+        return seastar::do_with(std::make_unique<Persistence>(_collection, pvid), uint64_t(0),
+            [this, pvid](auto& persistence, auto& snapshotStart) {
+            auto appendBatch = [&persistence](int i) {
+                persistence->append(PersistenceRecordType::TxnRecord, fmt::format("batch_{}", i));
+                return persistence->flush()
+                    .then([](Status&& status) {
+                        K2EXPECT(log::snaptest, status.is2xxOK(), true);
+                    });
+            };
+            return persistence->start()
+                .then([appendBatch] {
+                    return seastar::do_for_each(boost::irange(0, 6), appendBatch);
+                })
+                .then([&persistence, &snapshotStart] {
+                    snapshotStart = persistence->nextSequence();
+                    K2EXPECT(log::snaptest, snapshotStart, 6);
+                    return persistence->writeSnapshotChunk(snapshotStart, 0, false, _makeChunk("chunk_0"));
+                })
+                .then([&persistence, &snapshotStart](Status&& status) {
+                    K2EXPECT(log::snaptest, status.is2xxOK(), true);
+                    return persistence->writeSnapshotChunk(snapshotStart, 1, true, _makeChunk("chunk_1"));
+                })
+                .then([appendBatch](Status&& status) {
+                    K2EXPECT(log::snaptest, status.is2xxOK(), true);
+                    // the log suffix after the snapshot
+                    return seastar::do_for_each(boost::irange(6, 9), appendBatch);
+                })
+                .then([&persistence] {
+                    return persistence->stop();
+                })
+                .then([this, pvid, &persistence, &snapshotStart] {
+                    // a restarted partition with the same pvid
+                    persistence = std::make_unique<Persistence>(_collection, pvid);
+                    return seastar::do_with(std::vector<String>(), std::vector<uint64_t>(),
+                        [&persistence, &snapshotStart](auto& chunks, auto& sequences) {
+                        return persistence->loadSnapshot([&chunks](Payload&& chunk) {
+                                chunks.push_back(_chunkValue(chunk));
+                            })
+                            .then([&persistence, &snapshotStart, &chunks, &sequences](uint64_t startSequence) {
+                                K2EXPECT(log::snaptest, startSequence, snapshotStart);
+                                K2EXPECT(log::snaptest, chunks.size(), 2);
+                                K2EXPECT(log::snaptest, chunks[1], "chunk_1");
+                                return persistence->recover(startSequence, [&sequences](dto::K23SI_PersistenceRequest<Payload>&& batch) {
+                                    PersistenceRecordType type;
+                                    String value;
+                                    if (!batch.value.val.read(type) || !batch.value.val.read(value)) {
+                                        throw std::runtime_error("unable to read recovered batch");
+                                    }
+                                    K2EXPECT(log::snaptest, value, fmt::format("batch_{}", batch.sequence));
+                                    sequences.push_back(batch.sequence);
+                                });
+                            })
+                            .then([&persistence, &sequences] {
+                                K2EXPECT(log::snaptest, sequences.size(), 3);
+                                K2EXPECT(log::snaptest, sequences.front(), 6);
+                                K2EXPECT(log::snaptest, sequences.back(), 8);
+                                // new batches continue the sequence
+                                K2EXPECT(log::snaptest, persistence->nextSequence(), 9);
+                                return persistence->stop();
+                            });
+                    });
+                })
+                .then([this, pvid, &persistence] {
+                    // a later assignment of the same partition id doesn't see the batches of the earlier one
+                    auto reassigned = pvid;
+                    ++reassigned.assignmentVersion;
+                    persistence = std::make_unique<Persistence>(_collection, reassigned);
+                    return seastar::do_with(uint64_t(0), [&persistence](auto& replayed) {
+                        return persistence->recover(0, [&replayed](dto::K23SI_PersistenceRequest<Payload>&&) {
+                                ++replayed;
+                            })
+                            .then([&persistence, &replayed] {
+                                K2EXPECT(log::snaptest, replayed, 0);
+                                return persistence->stop();
+                            });
+                    });
+                });
+        });
+    }
+};
+
+int main(int argc, char** argv) {
+    k2::App app("SnapshotTest");
+    app.addOptions()
+        ("persistence_wal_dir", bpo::value<k2::String>(), "The directory where the test keeps the write-ahead log and the snapshots")
+        ("k23si_persistence_endpoints", bpo::value<std::vector<k2::String>>()->multitoken(), "The endpoint of the persistence service which runs in the test");
+    app.addApplet<k2::PersistenceService>();
+    app.addApplet<SnapshotTest>();
+    return app.start(argc, argv);
+}
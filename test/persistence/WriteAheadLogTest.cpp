@@ -0,0 +1,340 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+
+#include <filesystem>
+#include <fstream>
+
+#include <boost/range/irange.hpp>
+#include <seastar/core/reactor.hh>
+
+#include <k2/appbase/Appbase.h>
+#include <k2/appbase/AppEssentials.h>
+#include <k2/persistence/service/WriteAheadLog.h>
+
+using namespace k2;
+
+namespace k2::log {
+inline thread_local k2::logging::Logger waltest("k2::wal_test");
+}
+
+// Tests for the write-ahead log of the persistence service. The log writes to --persistence_wal_dir, which
+// is wiped before each scenario. Run with a small --persistence_segment_size so that the segments rotate
+class WriteAheadLogTest {
+public:  // application lifespan
+    WriteAheadLogTest() { K2LOG_I(log::waltest, "ctor"); }
+    ~WriteAheadLogTest() { K2LOG_I(log::waltest, "dtor"); }
+
+    // required for seastar::distributed interface
+    seastar::future<> gracefulStop() {
+        K2LOG_I(log::waltest, "stop");
+        return std::move(_testFuture);
+    }
+
+    seastar::future<> start() {
+        K2LOG_I(log::waltest, "start");
+        _testTimer.set_callback([this] {
+            _testFuture = seastar::make_ready_future()
+            .then([this] { return runScenario01(); })
+            .then([this] { return runScenario02(); })
+            .then([this] { return runScenario03(); })
+            .then([this] { return runScenario04(); })
+            .then([this] { return runScenario05(); })
+            .then([this] {
+                K2LOG_I(log::waltest, "======= All tests passed ========");
+                exitcode = 0;
+            })
+            .handle_exception([this](auto exc) {
+                K2LOG_W_EXC(log::waltest, exc, "======= Test failed ========");
+                exitcode = -1;
+            })
+            .finally([this] {
+                K2LOG_I(log::waltest, "======= Test ended ========");
+                _wal.reset();
+                AppBase().stop(exitcode);
+            });
+        });
+        _testTimer.arm(0ms);
+        return seastar::make_ready_future();
+    }
+
+private:
+    int exitcode = -1;
+    ConfigVar<String> _walDir{"persistence_wal_dir", "/tmp/k2_persistence_wal"};
+    ConfigVar<uint64_t> _segmentSize{"persistence_segment_size", 64 * 1024 * 1024};
+    seastar::future<> _testFuture = seastar::make_ready_future();
+    seastar::timer<> _testTimer;
+    std::unique_ptr<WriteAheadLog> _wal;
+
+    String _shardDir() {
+        return fmt::format("{}/shard_{}", _walDir(), seastar::this_shard_id());
+    }
+
+    // start a new log instance on top of whatever is in the directory
+    seastar::future<> _restart() {
+        auto fut = _wal ? _wal->stop() : seastar::make_ready_future();
+        return fut.then([this] {
+            // the old instance has to go first so that its metrics are unregistered
+            _wal.reset();
+            _wal = std::make_unique<WriteAheadLog>();
+            return _wal->start();
+        });
+    }
+
+    // start a new log instance in an empty directory
+    seastar::future<> _startClean() {
+        auto fut = _wal ? _wal->stop() : seastar::make_ready_future();
+        return fut.then([this] {
+            _wal.reset();
+            std::filesystem::remove_all(_shardDir());
+            return _restart();
+        });
+    }
+
+    static Payload _makeRecord(const String& value) {
+        Payload record(Payload::DefaultAllocator());
+        record.write(value);
+        return record;
+    }
+
+    static String _recordValue(WALRecord& record) {
+        String value;
+        record.data.seek(0);
+        if (!record.data.read(value)) {
+            throw std::runtime_error("unable to read record value");
+        }
+        return value;
+    }
+
+    seastar::future<WALPosition> _append(const String& value) {
+        return _wal->append(_makeRecord(value))
+            .then([](auto&& result) {
+                auto& [status, pos] = result;
+                K2EXPECT(log::waltest, status.is2xxOK(), true);
+                return pos;
+            });
+    }
+
+    // read all records from the given position to the end of the log, in small pages
+    seastar::future<std::vector<WALRecord>> _readAll(WALPosition from=WALPosition{}) {
+        return seastar::do_with(std::vector<WALRecord>(), from, false, [this](auto& records, auto& from, auto& done) {
+            return seastar::do_until(
+                [&done] { return done; },
+                [this, &records, &from, &done] {
+                    return _wal->read(from, 4096)
+                        .then([&records, &from, &done](WALReadResult&& result) {
+                            for (auto& record: result.records) {
+                                records.push_back(std::move(record));
+                            }
+                            from = result.next;
+                            done = result.done;
+                        });
+                })
+                .then([&records] {
+                    return std::move(records);
+                });
+        });
+    }
+
+    // overwrite the given number of bytes at the given position of a segment, while the log is stopped
+    void _overwrite(WALPosition pos, size_t len, char value) {
+        auto path = fmt::format("{}/segment_{:020}.wal", _shardDir(), pos.segmentId);
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        K2EXPECT(log::waltest, file.is_open(), true);
+        file.seekp(pos.offset);
+        String data(len, value);
+        file.write(data.data(), len);
+    }
+
+public:
+    seastar::future<> runScenario01() {
+        K2LOG_I(log::waltest, "Scenario 01: appended records are read back in order");
+        return _startClean()
+            .then([this] {
+                return seastar::do_for_each(boost::irange(0, 10), [this](int i) {
+                    return _append(fmt::format("record_{}", i)).discard_result();
+                });
+            })
+            .then([this] {
+                K2EXPECT(log::waltest, _wal->nextSeq(), 10);
+                return _readAll();
+            })
+            .then([](std::vector<WALRecord>&& records) {
+                K2EXPECT(log::waltest, records.size(), 10);
+                for (size_t i = 0; i < records.size(); ++i) {
+                    K2EXPECT(log::waltest, _recordValue(records[i]), fmt::format("record_{}", i));
+                    K2EXPECT(log::waltest, records[i].seq, i);
+                    if (i > 0) {
+                        K2EXPECT(log::waltest, records[i - 1].pos.offset < records[i].pos.offset, true);
+                    }
+                }
+            });
+    }
+
+    seastar::future<> runScenario02() {
+        K2LOG_I(log::waltest, "Scenario 02: segments rotate, and trimmed segments are skipped");
+        // records of a quarter segment each
+        String value(_segmentSize() / 4, 'x');
+        return seastar::do_with(std::move(value), [this](auto& value) {
+            return _startClean()
+                .then([this, &value] {
+                    return seastar::do_for_each(boost::irange(0, 10), [this, &value](int) {
+                        return _append(value).discard_result();
+                    });
+                })
+                .then([this] {
+                    return _readAll();
+                })
+                .then([this, &value](std::vector<WALRecord>&& records) {
+                    K2EXPECT(log::waltest, records.size(), 10);
+                    for (size_t i = 0; i < records.size(); ++i) {
+                        K2EXPECT(log::waltest, _recordValue(records[i]), value);
+                        K2EXPECT(log::waltest, records[i].seq, i);
+                    }
+                    // at most three records fit in a segment with their headers
+                    K2EXPECT(log::waltest, records.front().pos.segmentId + 3 <= records.back().pos.segmentId, true);
+                    K2EXPECT(log::waltest, records.back().pos.segmentId, _wal->currentSegmentId());
+                    return _wal->trim(_wal->currentSegmentId());
+                })
+                .then([this] {
+                    return _readAll();
+                })
+                .then([this](std::vector<WALRecord>&& records) {
+                    K2EXPECT(log::waltest, records.empty(), false);
+                    K2EXPECT(log::waltest, records.front().pos.segmentId, _wal->currentSegmentId());
+                    K2EXPECT(log::waltest, records.back().seq, 9);
+                    K2EXPECT(log::waltest, std::filesystem::exists(fmt::format("{}/segment_{:020}.wal", _shardDir(), 1)), false);
+                });
+        });
+    }
+
+    seastar::future<> runScenario03() {
+        K2LOG_I(log::waltest, "Scenario 03: concurrent appends are written in group commits");
+        return _startClean()
+            .then([this] {
+                std::vector<seastar::future<WALPosition>> futs;
+                for (int i = 0; i < 100; ++i) {
+                    futs.push_back(_append(fmt::format("record_{}", i)));
+                }
+                return seastar::when_all_succeed(futs.begin(), futs.end());
+            })
+            .then([this](std::vector<WALPosition>&& positions) {
+                K2EXPECT(log::waltest, positions.size(), 100);
+                // all but the first record arrived while a write was in progress
+                K2EXPECT(log::waltest, _wal->groupCommits() < 100, true);
+                K2EXPECT(log::waltest, _wal->groupCommits() > 0, true);
+                return _readAll();
+            })
+            .then([](std::vector<WALRecord>&& records) {
+                K2EXPECT(log::waltest, records.size(), 100);
+                for (size_t i = 0; i < records.size(); ++i) {
+                    K2EXPECT(log::waltest, _recordValue(records[i]), fmt::format("record_{}", i));
+                }
+            });
+    }
+
+    seastar::future<> runScenario04() {
+        K2LOG_I(log::waltest, "Scenario 04: sequence numbers continue after a restart");
+        return _startClean()
+            .then([this] {
+                return seastar::do_for_each(boost::irange(0, 5), [this](int i) {
+                    return _append(fmt::format("record_{}", i)).discard_result();
+                });
+            })
+            .then([this] {
+                // restart twice so that the newest segment is empty
+                return _restart();
+            })
+            .then([this] {
+                return _restart();
+            })
+            .then([this] {
+                K2EXPECT(log::waltest, _wal->nextSeq(), 5);
+                return _append("record_5");
+            })
+            .then([this](WALPosition) {
+                return _readAll();
+            })
+            .then([](std::vector<WALRecord>&& records) {
+                K2EXPECT(log::waltest, records.size(), 6);
+                for (size_t i = 0; i < records.size(); ++i) {
+                    K2EXPECT(log::waltest, _recordValue(records[i]), fmt::format("record_{}", i));
+                    K2EXPECT(log::waltest, records[i].seq, i);
+                }
+            });
+    }
+
+    seastar::future<> runScenario05() {
+        K2LOG_I(log::waltest, "Scenario 05: a torn or zeroed tail ends the log");
+        return seastar::do_with(std::vector<WALPosition>(), [this](auto& positions) {
+            return _startClean()
+                .then([this, &positions] {
+                    return seastar::do_for_each(boost::irange(0, 6), [this, &positions](int i) {
+                        return _append(fmt::format("record_{}", i))
+                            .then([&positions](WALPosition pos) {
+                                positions.push_back(pos);
+                            });
+                    });
+                })
+                .then([this] {
+                    return _wal->stop();
+                })
+                .then([this, &positions] {
+                    // a torn write of the last record: its data doesn't match the checksum
+                    _overwrite(WALPosition{.segmentId=positions[5].segmentId, .offset=positions[5].offset + sizeof(WALRecordHeader) + 2}, 4, 'z');
+                    return _restart();
+                })
+                .then([this] {
+                    K2EXPECT(log::waltest, _wal->nextSeq(), 5);
+                    return _readAll();
+                })
+                .then([this](std::vector<WALRecord>&& records) {
+                    K2EXPECT(log::waltest, records.size(), 5);
+                    K2EXPECT(log::waltest, _recordValue(records.back()), "record_4");
+                    return _wal->stop();
+                })
+                .then([this, &positions] {
+                    // a write which never made it to the device: the tail is zeroed
+                    _overwrite(positions[3], positions[5].offset - positions[3].offset, 0);
+                    return _restart();
+                })
+                .then([this] {
+                    K2EXPECT(log::waltest, _wal->nextSeq(), 3);
+                    return _readAll();
+                })
+                .then([this](std::vector<WALRecord>&& records) {
+                    K2EXPECT(log::waltest, records.size(), 3);
+                    K2EXPECT(log::waltest, _recordValue(records.back()), "record_2");
+                });
+        });
+    }
+};
+
+int main(int argc, char** argv) {
+    k2::App app("WriteAheadLogTest");
+    app.addOptions()
+        ("persistence_wal_dir", bpo::value<k2::String>(), "The directory where the test keeps the write-ahead log")
+        ("persistence_segment_size", bpo::value<uint64_t>(), "The size in bytes at which WAL segments are rotated")
+        ("persistence_sync_policy", bpo::value<k2::String>(), "'fdatasync' or 'none'")
+        ("persistence_max_group_bytes", bpo::value<uint64_t>(), "The max number of bytes written to the WAL in a single group commit");
+    app.addApplet<WriteAheadLogTest>();
+    return app.start(argc, argv);
+}
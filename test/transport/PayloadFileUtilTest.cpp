@@ -0,0 +1,99 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#define CATCH_CONFIG_MAIN
+
+#include <k2/transport/PayloadFileUtil.h>
+
+#include <cstdlib>
+
+#include "catch2/catch.hpp"
+
+using namespace k2;
+
+namespace {
+Payload makePayload(size_t size, char fill) {
+    Payload payload(Payload::DefaultAllocator(4096));
+    String data(size, fill);
+    payload.write(data.data(), data.size());
+    return payload;
+}
+
+String readAll(Payload& payload) {
+    String data(payload.getSize(), '\0');
+    payload.seek(0);
+    REQUIRE(payload.read(data.data(), data.size()));
+    return data;
+}
+
+String makeTestDir() {
+    char dir[] = "/tmp/payload_file_util_test.XXXXXX";
+    REQUIRE(::mkdtemp(dir) != nullptr);
+    return String(dir);
+}
+} // namespace
+
+SCENARIO("test writeFile creates a file which readFile returns in full") {
+    auto dir = makeTestDir();
+    auto path = dir + "/data";
+
+    REQUIRE(fileutil::writeFile(makePayload(10000, 'a'), path));
+    REQUIRE(fileutil::fileExists(path));
+
+    struct stat st;
+    REQUIRE(::stat(path.c_str(), &st) == 0);
+    // the file is created readable and writable by its owner
+    REQUIRE((st.st_mode & (S_IRUSR | S_IWUSR)) == (S_IRUSR | S_IWUSR));
+
+    Payload read;
+    REQUIRE(fileutil::readFile(read, path));
+    REQUIRE(read.getSize() == 10000);
+    REQUIRE(readAll(read) == String(10000, 'a'));
+
+    ::unlink(path.c_str());
+    ::rmdir(dir.c_str());
+}
+
+SCENARIO("test writeFile replaces the contents of an existing longer file") {
+    auto dir = makeTestDir();
+    auto path = dir + "/data";
+
+    REQUIRE(fileutil::writeFile(makePayload(10000, 'a'), path));
+    REQUIRE(fileutil::writeFile(makePayload(100, 'b'), path));
+
+    Payload read;
+    REQUIRE(fileutil::readFile(read, path));
+    // no stale bytes are left over from the first write
+    REQUIRE(read.getSize() == 100);
+    REQUIRE(readAll(read) == String(100, 'b'));
+
+    ::unlink(path.c_str());
+    ::rmdir(dir.c_str());
+}
+
+SCENARIO("test readFile of a file which doesn't exist") {
+    auto dir = makeTestDir();
+    Payload read;
+    REQUIRE_FALSE(fileutil::readFile(read, dir + "/missing"));
+    ::rmdir(dir.c_str());
+}
@@ -114,12 +114,12 @@ SCENARIO("test empty payload serialization") {
 
     Payload dst(Payload::DefaultAllocator(999));
     dst.write(src);
-    REQUIRE(dst.getCurrentPosition().bufferIndex == 1);
-    REQUIRE(dst.getCurrentPosition().bufferOffset == 0);
+    REQUIRE(dst.getCurrentPosition().bufferIndex == 0);
+    REQUIRE(dst.getCurrentPosition().bufferOffset == 8);
     REQUIRE(dst.getCurrentPosition().offset == 8);
     REQUIRE(dst.getSize() == 8);
     REQUIRE(dst.getDataRemaining() == 0);
-    REQUIRE(dst.getCapacity() == 8);  // assumes the capacity of src
+    REQUIRE(dst.getCapacity() == 999);  // small payloads are copied so we keep our buffer
     REQUIRE(dst.computeCrc32c() == 0);
     dst.seek(0);
     REQUIRE(dst.computeCrc32c() == 2351477386);
@@ -189,7 +189,42 @@ SCENARIO("test multi-buffer serialization") {
     REQUIRE(p1.getSize() == 4);
     REQUIRE(p1.getCapacity() == 4096);
     REQUIRE(p2.getSize() == 12);
-    REQUIRE(p2.getCapacity() == 12);
+    REQUIRE(p2.getCapacity() == 20);
+}
+
+SCENARIO("test large payloads are spliced by reference") {
+    Payload src(Payload::DefaultAllocator(1000));
+    String s(3000, 'x');
+    src.write(s);
+    REQUIRE(src.getSize() >= Payload::SPLICE_THRESHOLD);
+
+    Payload dst(Payload::DefaultAllocator(100));
+    int32_t a = 10;
+    dst.write(a);
+    dst.write(src);
+    REQUIRE(dst.getSize() == 4 + 8 + src.getSize());
+    // the unused space of the buffer we were writing into is kept after the spliced data
+    REQUIRE(dst.getCapacity() == 100 + src.getSize());
+    dst.write(a);
+    REQUIRE(dst.getCapacity() == 100 + src.getSize());
+
+    dst.seek(0);
+    int32_t ra = 0, rb = 0;
+    Payload parsed;
+    REQUIRE(dst.read(ra));
+    REQUIRE(dst.read(parsed));
+    REQUIRE(dst.read(rb));
+    REQUIRE(ra == a);
+    REQUIRE(rb == a);
+    REQUIRE(parsed == src);
+
+    // the data was shared, not copied: a change in the source is visible in the destination
+    auto srcBuffers = src.shareAll().release();
+    srcBuffers[0].get_write()[4] = 'y';
+    String rs;
+    parsed.seek(0);
+    REQUIRE(parsed.read(rs));
+    REQUIRE(rs[0] == 'y');
 }
 
 void checkSize(Payload& p) {
@@ -458,6 +493,165 @@ SCENARIO("test getSerializedSizeOf method") {
     REQUIRE(src.getDataRemaining() == 0);
 }
 
+SCENARIO("test running checksum") {
+    // shared views don't carry the running checksum, so they give us a full pass over the data for reference
+    auto fullPass = [](Payload& p, size_t offset) {
+        auto shared = p.shareAll();
+        shared.seek(offset);
+        return shared.computeCrc32c();
+    };
+    const size_t headerSize = 128;
+    String s(100000, 'x');
+    for (auto& d: {makeData(1, 2, 'a', 44, 'f', 123, "hya", 124121123, 's', nullptr, "", 11, Duration(10ms)),
+                   makeData(111,2222,'c', 4444, 'h', 12312345, "hya", 1241245, 's', s.c_str(), "", 107, Duration(13ns)),
+                   makeData(1111, 22222, 'd', 44444, 'i', 123123456, s, 124123456, 's', s.c_str(), s, 109, Duration(21s))}) {
+        // as used for messages: a reserved header followed by the serialized data, which includes spliced
+        // payloads and sizes which are filled in after the data that follows them
+        Payload dst(Payload::DefaultAllocator(1000));
+        dst.reserve(headerSize);
+        dst.write(d);
+        Payload spliced(Payload::DefaultAllocator(1000));
+        spliced.write(s.data(), 5000);
+        dst.write(spliced);
+        for (size_t offset : {headerSize, 0ul, headerSize + 1}) {
+            dst.seek(offset);
+            REQUIRE(dst.computeCrc32c() == fullPass(dst, offset));
+        }
+
+        // copies keep the checksum. Continue with the copy, which doesn't share any data with other payloads
+        auto copied = dst.copy();
+        REQUIRE(copied.computeCrc32c() == fullPass(dst, 0));
+        REQUIRE(copied == dst);
+
+        // overwrite data which is already part of the checksum
+        copied.seek(copied.getSize() / 2);
+        copied.write(uint64_t(0xdeadbeef));
+        copied.seek(0);
+        REQUIRE(copied.computeCrc32c() == fullPass(copied, 0));
+        copied.seek(copied.getSize() / 3);
+        copied.write(s.data(), std::min(copied.getSize() - copied.getSize() / 3, s.size()));
+        copied.seek(0);
+        REQUIRE(copied.computeCrc32c() == fullPass(copied, 0));
+
+        // truncate and append
+        copied.seek(copied.getSize() / 2);
+        copied.truncateToCurrent();
+        copied.write(d);
+        copied.write(spliced);
+        copied.seek(0);
+        REQUIRE(copied.computeCrc32c() == fullPass(copied, 0));
+
+        // a known checksum is used as is
+        Payload shared = dst.shareAll();
+        shared.setCrc32c(123);
+        REQUIRE(shared.computeCrc32c() == 123);
+        shared.clear();
+        REQUIRE(shared.computeCrc32c() == 0);
+    }
+}
+
+struct flatNested {
+    String s;
+    std::vector<uint32_t> nums;
+    std::vector<String> names;
+    K2_PAYLOAD_FIELDS(s, nums, names);
+    bool operator==(const flatNested& o) const {
+        return s == o.s && nums == o.nums && names == o.names;
+    }
+};
+
+struct flatMixed {
+    uint64_t a = 0;
+    embeddedSimple b;
+    String c;
+    std::vector<bool> d;
+    flatNested e;
+    Duration f{0};
+    Payload g;
+    blanks h;
+    std::vector<flatNested> i;
+    K2_PAYLOAD_FIELDS(a, b, c, d, e, f, g, h, i);
+    bool operator==(const flatMixed& o) const {
+        return a == o.a && b == o.b && c == o.c && d == o.d && e == o.e && f == o.f && g == o.g && i == o.i;
+    }
+};
+
+SCENARIO("test fast path serialization of flat fields") {
+    // the bytes of a payload, read through a shared view so that the cursor doesn't move
+    auto bytes = [](Payload& p) {
+        auto shared = p.shareAll();
+        String result(shared.getSize(), '\0');
+        REQUIRE(shared.read(result.data(), result.size()));
+        return result;
+    };
+    flatMixed src;
+    src.a = 0x1122334455667788;
+    src.b = embeddedSimple{.a = 1, .b = 'b', .c = 3};
+    src.c = String(100, 'c');
+    src.d = {true, false, true};
+    src.e = flatNested{.s = "nested", .nums = {1, 2, 3, 4}, .names = {"a", "", String(50, 'n')}};
+    src.f = 12345ns;
+    src.g = Payload(Payload::DefaultAllocator(64));
+    src.g.write(String("payload"));
+    for (uint32_t n = 0; n < 5; ++n) {
+        src.i.push_back(flatNested{.s = String(n * 10, 's'), .nums = {n}, .names = {String(n, 'x')}});
+    }
+
+    for (size_t allocSize : {7, 13, 64, 8196}) {
+        // the same fields, written one by one
+        Payload expected(Payload::DefaultAllocator(allocSize));
+        expected.writeMany(src.a, src.b, src.c, src.d, src.e.s, src.e.nums, src.e.names, src.f, src.g, src.h);
+        expected.write(uint32_t(src.i.size()));
+        for (auto& n : src.i) {
+            expected.writeMany(n.s, n.nums, n.names);
+        }
+
+        Payload fast(Payload::DefaultAllocator(allocSize));
+        fast.write(src);
+        REQUIRE(fast.getSize() == expected.getSize());
+        REQUIRE(bytes(fast) == bytes(expected));
+        REQUIRE(fast == expected);
+        fast.seek(0);
+        auto shared = fast.shareAll();
+        REQUIRE(fast.computeCrc32c() == shared.computeCrc32c());
+
+        // overwrites of existing data go field by field, and keep the checksum up to date
+        Payload over(Payload::DefaultAllocator(allocSize));
+        over.write(src.e);
+        auto size = over.getSize();
+        flatNested changed = src.e;
+        changed.s = "NESTED";
+        changed.nums[3] = 5;
+        over.seek(0);
+        over.write(changed);
+        REQUIRE(over.getSize() == size);
+        over.seek(0);
+        REQUIRE(over.computeCrc32c() == over.shareAll().computeCrc32c());
+        flatNested parsedChanged;
+        REQUIRE(over.read(parsedChanged));
+        REQUIRE(parsedChanged == changed);
+
+        // both payloads parse back the same, on the fast path and field by field
+        expected.seek(0);
+        flatMixed parsed;
+        REQUIRE(expected.read(parsed));
+        REQUIRE(parsed == src);
+        REQUIRE(expected.getDataRemaining() == 0);
+
+        expected.seek(0);
+        flatMixed parsedMany;
+        REQUIRE(expected.readMany(parsedMany.a, parsedMany.b, parsedMany.c, parsedMany.d, parsedMany.e,
+                                  parsedMany.f, parsedMany.g, parsedMany.h, parsedMany.i));
+        REQUIRE(parsedMany == src);
+
+        // a truncated message fails to parse
+        for (size_t size : {size_t(4), expected.getSize() / 2, expected.getSize() - 1}) {
+            auto truncated = expected.shareRegion(0, size);
+            flatMixed partial;
+            REQUIRE(!truncated.read(partial));
+        }
+    }
+}
 
 /*
 SCENARIO("rpc parsing") {
@@ -0,0 +1,232 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#define CATCH_CONFIG_MAIN
+
+#include <vector>
+
+#include <k2/transport/RPCParser.h>
+#include <k2/transport/RPCHeader.h>
+#include "catch2/catch.hpp"
+
+using namespace k2;
+
+namespace {
+struct Received {
+    Verb verb;
+    MessageMetadata meta;
+    std::unique_ptr<Payload> payload;
+};
+
+char patternByte(size_t msg, size_t idx) {
+    return char((msg * 31 + idx) % 251);
+}
+
+// serializes the given number of messages with the given payload size into one contiguous binary
+Binary makeStream(size_t numMessages, size_t payloadSize, bool useChecksum) {
+    RPCParser sender([] { return false; }, useChecksum);
+    std::vector<Binary> buffers;
+    size_t total = 0;
+    for (size_t m = 0; m < numMessages; ++m) {
+        auto payload = std::make_unique<Payload>(Payload::DefaultAllocator(1000));
+        payload->reserve(txconstants::MAX_HEADER_SIZE);
+        for (size_t i = 0; i < payloadSize; ++i) {
+            payload->write(patternByte(m, i));
+        }
+        MessageMetadata meta;
+        meta.setRequestID(uint32_t(m + 1));
+        for (auto& buf : sender.prepareForSend(Verb(m % 100), std::move(payload), std::move(meta))) {
+            total += buf.size();
+            buffers.push_back(std::move(buf));
+        }
+    }
+    Binary stream(total);
+    size_t offset = 0;
+    for (auto& buf : buffers) {
+        std::memcpy(stream.get_write() + offset, buf.get(), buf.size());
+        offset += buf.size();
+    }
+    return stream;
+}
+
+// feeds the stream to a parser in segments of the given size (0 for the whole stream at once)
+std::vector<Received> parse(Binary& stream, size_t segmentSize, bool useChecksum) {
+    std::vector<Received> result;
+    RPCParser parser([] { return false; }, useChecksum);
+    parser.registerMessageObserver([&result](Verb verb, MessageMetadata meta, std::unique_ptr<Payload> payload) {
+        result.push_back(Received{verb, std::move(meta), std::move(payload)});
+    });
+    parser.registerParserFailureObserver([](std::exception_ptr) { REQUIRE(false); });
+
+    if (segmentSize == 0) {
+        segmentSize = stream.size();
+    }
+    for (size_t offset = 0; offset < stream.size(); offset += segmentSize) {
+        parser.feed(stream.share(offset, std::min(segmentSize, stream.size() - offset)));
+        while (parser.canDispatch()) {
+            parser.dispatchSome();
+        }
+    }
+    return result;
+}
+
+void checkMessages(std::vector<Received>& received, size_t numMessages, size_t payloadSize) {
+    REQUIRE(received.size() == numMessages);
+    for (size_t m = 0; m < numMessages; ++m) {
+        auto& msg = received[m];
+        REQUIRE(msg.verb == Verb(m % 100));
+        REQUIRE(msg.meta.isRequestIDSet());
+        REQUIRE(msg.meta.requestID == m + 1);
+        if (payloadSize == 0) {
+            // the payload size isn't sent for empty payloads, so there is no payload to deliver
+            REQUIRE(!msg.payload);
+            continue;
+        }
+        REQUIRE(msg.payload);
+        REQUIRE(msg.payload->getSize() == payloadSize);
+        for (size_t i = 0; i < payloadSize; ++i) {
+            char c;
+            REQUIRE(msg.payload->read(c));
+            REQUIRE(c == patternByte(m, i));
+        }
+    }
+}
+} // namespace
+
+SCENARIO("test01 messages are parsed the same regardless of segmentation") {
+    for (bool useChecksum : {false, true}) {
+        for (size_t payloadSize : {0, 1, 64, 1024, 65536}) {
+            const size_t numMessages = payloadSize > 1024 ? 5 : 50;
+            auto stream = makeStream(numMessages, payloadSize, useChecksum);
+            for (size_t segmentSize : {0, 1, 3, 7, 17, 1448}) {
+                auto received = parse(stream, segmentSize, useChecksum);
+                checkMessages(received, numMessages, payloadSize);
+            }
+        }
+    }
+}
+
+SCENARIO("test02 payloads share the incoming binary") {
+    auto stream = makeStream(2, 1024, false);
+    auto received = parse(stream, 0, false);
+    REQUIRE(received.size() == 2);
+    // the payload of a message which arrived in one binary points into that binary
+    auto buffers = received[1].payload->release();
+    REQUIRE(buffers.size() == 1);
+    REQUIRE(buffers[0].get() > stream.get());
+    REQUIRE(buffers[0].get() + buffers[0].size() == stream.get() + stream.size());
+}
+
+SCENARIO("test03 magic mismatch fails the stream") {
+    auto stream = makeStream(1, 64, false);
+    stream.get_write()[0] = 'X';
+    RPCParser parser([] { return false; }, false);
+    bool failed = false;
+    size_t dispatched = 0;
+    parser.registerMessageObserver([&dispatched](Verb, MessageMetadata, std::unique_ptr<Payload>) { ++dispatched; });
+    parser.registerParserFailureObserver([&failed](std::exception_ptr) { failed = true; });
+    parser.feed(std::move(stream));
+    while (parser.canDispatch()) {
+        parser.dispatchSome();
+    }
+    REQUIRE(failed);
+    REQUIRE(dispatched == 0);
+}
+
+SCENARIO("test04 checksums are validated as fragments arrive") {
+    auto stream = makeStream(3, 4096, true);
+    for (size_t segmentSize : {0, 7, 1448}) {
+        // the received payloads carry the validated checksum
+        auto received = parse(stream, segmentSize, true);
+        REQUIRE(received.size() == 3);
+        for (auto& msg : received) {
+            REQUIRE(msg.meta.isChecksumSet());
+            REQUIRE(msg.payload->computeCrc32c() == msg.meta.checksum);
+            REQUIRE(msg.payload->shareAll().computeCrc32c() == msg.meta.checksum);
+        }
+
+        // corrupt a byte in the payload of the second message
+        Binary corrupted(stream.size());
+        std::memcpy(corrupted.get_write(), stream.get(), stream.size());
+        corrupted.get_write()[stream.size() / 2] ^= 0x1;
+        RPCParser parser([] { return false; }, true);
+        bool failed = false;
+        size_t dispatched = 0;
+        parser.registerMessageObserver([&dispatched](Verb, MessageMetadata, std::unique_ptr<Payload>) { ++dispatched; });
+        parser.registerParserFailureObserver([&failed](std::exception_ptr) { failed = true; });
+        auto size = segmentSize == 0 ? corrupted.size() : segmentSize;
+        for (size_t offset = 0; offset < corrupted.size() && !failed; offset += size) {
+            parser.feed(corrupted.share(offset, std::min(size, corrupted.size() - offset)));
+            while (parser.canDispatch()) {
+                parser.dispatchSome();
+            }
+        }
+        REQUIRE(failed);
+        REQUIRE(dispatched == 1);
+    }
+}
+
+SCENARIO("test05 deadline and priority are carried in the header") {
+    for (bool useChecksum : {false, true}) {
+        RPCParser sender([] { return false; }, useChecksum);
+        std::vector<Binary> buffers;
+        size_t total = 0;
+        // the deadline is clamped to 0 for negative budgets, and to the max 32-bit usecs for huge ones
+        std::vector<std::pair<Duration, uint32_t>> deadlines{{1500us, 1500}, {-5ms, 0}, {100h, UINT32_MAX}};
+        for (size_t m = 0; m < deadlines.size(); ++m) {
+            auto payload = std::make_unique<Payload>(Payload::DefaultAllocator(1000));
+            payload->reserve(txconstants::MAX_HEADER_SIZE);
+            payload->write(patternByte(m, 0));
+            MessageMetadata meta;
+            meta.setRequestID(uint32_t(m + 1));
+            meta.setDeadline(deadlines[m].first);
+            meta.setPriority(uint8_t(m * 100));
+            for (auto& buf : sender.prepareForSend(Verb(m), std::move(payload), std::move(meta))) {
+                total += buf.size();
+                buffers.push_back(std::move(buf));
+            }
+        }
+        Binary stream(total);
+        size_t offset = 0;
+        for (auto& buf : buffers) {
+            std::memcpy(stream.get_write() + offset, buf.get(), buf.size());
+            offset += buf.size();
+        }
+        for (size_t segmentSize : {0, 1, 5}) {
+            auto received = parse(stream, segmentSize, useChecksum);
+            REQUIRE(received.size() == deadlines.size());
+            for (size_t m = 0; m < deadlines.size(); ++m) {
+                auto& msg = received[m];
+                REQUIRE(msg.meta.requestID == m + 1);
+                REQUIRE(msg.meta.isDeadlineSet());
+                REQUIRE(msg.meta.deadlineUsecs == deadlines[m].second);
+                REQUIRE(msg.meta.isPrioritySet());
+                REQUIRE(msg.meta.priority == m * 100);
+                char c;
+                REQUIRE(msg.payload->read(c));
+                REQUIRE(c == patternByte(m, 0));
+            }
+        }
+    }
+}
@@ -0,0 +1,126 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#define CATCH_CONFIG_MAIN
+
+#include <k2/transport/RPCWindow.h>
+#include "catch2/catch.hpp"
+
+using namespace k2;
+
+SCENARIO("test01 fixed window bounds the requests in flight") {
+    RPCWindow window(4, 1024, 0ms);
+    for (int i = 0; i < 4; ++i) {
+        REQUIRE(window.tryAcquire());
+    }
+    REQUIRE(!window.tryAcquire());
+    REQUIRE(window.inFlight() == 4);
+
+    // latency and timeouts don't change a fixed window
+    auto now = Clock::now();
+    window.release(10s, now);
+    window.releaseTimedOut(now);
+    REQUIRE(window.size() == 4);
+    REQUIRE(window.inFlight() == 2);
+    REQUIRE(window.tryAcquire());
+    REQUIRE(window.tryAcquire());
+    REQUIRE(!window.tryAcquire());
+    REQUIRE(window.decreases() == 0);
+}
+
+SCENARIO("test02 adaptive window grows additively and backs off multiplicatively") {
+    RPCWindow window(4, 16, 1ms);
+    auto now = Clock::now();
+
+    // fast responses grow the window by about one per window's worth of responses
+    for (int i = 0; i < 4; ++i) {
+        REQUIRE(window.tryAcquire());
+        window.release(100us, now);
+    }
+    REQUIRE(window.size() == 4);
+    for (int i = 0; i < 2; ++i) {
+        REQUIRE(window.tryAcquire());
+        window.release(100us, now);
+    }
+    REQUIRE(window.size() == 5);
+
+    // but never past the max
+    for (int i = 0; i < 1000; ++i) {
+        REQUIRE(window.tryAcquire());
+        window.release(100us, now);
+    }
+    REQUIRE(window.size() == 16);
+
+    // a round of slow responses halves the window once
+    for (int i = 0; i < 16; ++i) {
+        REQUIRE(window.tryAcquire());
+    }
+    for (int i = 0; i < 16; ++i) {
+        window.release(5ms, now);
+    }
+    REQUIRE(window.size() == 8);
+    REQUIRE(window.decreases() == 1);
+    REQUIRE(window.inFlight() == 0);
+
+    // timeouts in a later round halve it again, down to a single request
+    for (int round = 1; round <= 5; ++round) {
+        REQUIRE(window.tryAcquire());
+        window.releaseTimedOut(now + round * 2ms);
+    }
+    REQUIRE(window.size() == 1);
+    REQUIRE(window.tryAcquire());
+    REQUIRE(!window.tryAcquire());
+}
+
+SCENARIO("test03 requests which time out while queued don't take up room in the queue") {
+    RPCWindow window(1, 1, 0ms);
+    REQUIRE(window.tryAcquire());
+
+    // the queue fills up behind the request in flight
+    REQUIRE(window.tryQueue(2));
+    REQUIRE(window.tryQueue(2));
+    REQUIRE(!window.tryQueue(2));
+    REQUIRE(window.queued() == 2);
+
+    // both queued requests time out while the one in flight is still going, so new requests can be queued
+    window.unqueue();
+    window.unqueue();
+    REQUIRE(window.queued() == 0);
+    REQUIRE(window.tryQueue(2));
+    REQUIRE(window.tryQueue(2));
+    REQUIRE(!window.tryQueue(2));
+
+    // a queued request which gets a slot stops waiting too
+    window.release(1ms, Clock::now());
+    REQUIRE(window.tryAcquire());
+    window.unqueue();
+    REQUIRE(window.queued() == 1);
+    REQUIRE(window.tryQueue(2));
+
+    // extra unqueues don't go below 0
+    for (int i = 0; i < 5; ++i) {
+        window.unqueue();
+    }
+    REQUIRE(window.queued() == 0);
+}
@@ -0,0 +1,273 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <signal.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <filesystem>
+#include <thread>
+
+#include <boost/range/irange.hpp>
+#include <seastar/core/sleep.hh>
+
+#include <k2/appbase/Appbase.h>
+#include <k2/appbase/AppEssentials.h>
+#include <k2/transport/DiscoveryDTO.h>
+#include <k2/transport/ShmRPCProtocol.h>
+
+using namespace k2;
+
+namespace k2::log {
+inline thread_local k2::logging::Logger shmtest("k2::shm_rpc_test");
+}
+
+struct ShmTestMessage {
+    String data;
+    K2_PAYLOAD_FIELDS(data);
+    K2_DEF_FMT(ShmTestMessage, data);
+};
+
+enum ShmTestVerbs : Verb {
+    ECHO = 100,
+    // blocks the server's reactor for a while, so that it stops draining the ring
+    STALL = 101,
+    // kills the server without any cleanup
+    CRASH = 102
+};
+
+// Loopback tests for the shared memory RPC protocol between two processes. The same binary runs as
+// --shm_test_role server, client or idle:
+// - the server echoes messages, and stalls or crashes on request
+// - the client finds the shared memory endpoint of the server at --shm_test_server and runs the scenarios
+// - idle starts and stops right away, which cleans up segments left by crashed processes
+class ShmRPCTest {
+public:  // application lifespan
+    ShmRPCTest() { K2LOG_I(log::shmtest, "ctor"); }
+    ~ShmRPCTest() { K2LOG_I(log::shmtest, "dtor"); }
+
+    // required for seastar::distributed interface
+    seastar::future<> gracefulStop() {
+        K2LOG_I(log::shmtest, "stop");
+        return std::move(_testFuture);
+    }
+
+    seastar::future<> start() {
+        K2LOG_I(log::shmtest, "start as {}", _role());
+        if (_role() == "server") {
+            _registerServerObservers();
+            return seastar::make_ready_future();
+        }
+
+        _testTimer.set_callback([this] {
+            if (_role() == "idle") {
+                AppBase().stop(0);
+                return;
+            }
+            _testFuture = seastar::make_ready_future()
+            .then([this] { return _discoverServer(); })
+            .then([this] { return runScenario01(); })
+            .then([this] { return runScenario02(); })
+            .then([this] { return runScenario03(); })
+            .then([this] {
+                K2LOG_I(log::shmtest, "======= All tests passed ========");
+                exitcode = 0;
+            })
+            .handle_exception([this](auto exc) {
+                K2LOG_W_EXC(log::shmtest, exc, "======= Test failed ========");
+                exitcode = -1;
+            })
+            .finally([this] {
+                K2LOG_I(log::shmtest, "======= Test ended ========");
+                AppBase().stop(exitcode);
+            });
+        });
+        _testTimer.arm(0ms);
+        return seastar::make_ready_future();
+    }
+
+private:
+    int exitcode = -1;
+    seastar::timer<> _testTimer;
+    seastar::future<> _testFuture = seastar::make_ready_future();
+
+    ConfigVar<String> _role{"shm_test_role", "client"};
+    ConfigVar<String> _serverURL{"shm_test_server", ""};
+
+    // the shared memory endpoint of the server
+    std::unique_ptr<TXEndpoint> _shmEp;
+
+    void _registerServerObservers() {
+        RPC().registerRPCObserver<ShmTestMessage, ShmTestMessage>(ShmTestVerbs::ECHO, [] (ShmTestMessage&& request) {
+            return RPCResponse(Statuses::S200_OK("echo"), std::move(request));
+        });
+        RPC().registerRPCObserver<ShmTestMessage, ShmTestMessage>(ShmTestVerbs::STALL, [] (ShmTestMessage&& request) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            return RPCResponse(Statuses::S200_OK("stalled"), std::move(request));
+        });
+        RPC().registerRPCObserver<ShmTestMessage, ShmTestMessage>(ShmTestVerbs::CRASH, [] (ShmTestMessage&&) {
+            K2LOG_I(log::shmtest, "crashing on request");
+            ::kill(::getpid(), SIGKILL);
+            return RPCResponse(Statuses::S500_Internal_Server_Error("still alive"), ShmTestMessage{});
+        });
+    }
+
+    seastar::future<std::tuple<Status, ShmTestMessage>> _call(Verb verb, String data, Duration timeout) {
+        return seastar::do_with(ShmTestMessage{.data = std::move(data)}, [this, verb, timeout] (auto& request) {
+            return RPC().callRPC<ShmTestMessage, ShmTestMessage>(verb, request, *_shmEp, timeout);
+        });
+    }
+
+    // true if there is a shared memory segment with the given name
+    static bool _segmentExists(const String& name) {
+        return std::filesystem::exists("/dev/shm/" + name);
+    }
+
+    // the connection segments from us to the server
+    size_t _connectionSegments() {
+        auto prefix = fmt::format("k2rpc.{}.{}.", _shmEp->port, RPC().getServerEndpoint(ShmRPCProtocol::proto)->port);
+        size_t count = 0;
+        for (auto& entry : std::filesystem::directory_iterator("/dev/shm")) {
+            if (entry.path().filename().string().rfind(prefix, 0) == 0) {
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    seastar::future<> _discoverServer() {
+        auto tcpEp = RPC().getTXEndpoint(_serverURL());
+        K2EXPECT(log::shmtest, (bool)tcpEp, true);
+        return seastar::do_with(ListEndpointsRequest{}, std::move(tcpEp), [this] (auto& request, auto& tcpEp) {
+            return RPC().callRPC<ListEndpointsRequest, ListEndpointsResponse>(InternalVerbs::LIST_ENDPOINTS, request, *tcpEp, 1s)
+            .then([this] (auto&& result) {
+                auto& [status, response] = result;
+                K2EXPECT(log::shmtest, status.is2xxOK(), true);
+                for (auto& url : response.endpoints) {
+                    if (url.rfind(ShmRPCProtocol::proto, 0) == 0) {
+                        _shmEp = RPC().getTXEndpoint(url);
+                    }
+                }
+                K2EXPECT(log::shmtest, (bool)_shmEp, true);
+                K2LOG_I(log::shmtest, "server shared memory endpoint: {}", _shmEp->url);
+            });
+        });
+    }
+
+public: // tests
+
+// Send and reply. Many small messages in parallel and a message much larger than the ring, which takes
+// many partial writes in both directions. The connection segment names are gone once the server attached
+seastar::future<> runScenario01() {
+    K2LOG_I(log::shmtest, "Scenario 01");
+    std::vector<seastar::future<>> futs;
+    for (auto i : boost::irange(0, 100)) {
+        futs.push_back(_call(ShmTestVerbs::ECHO, "message_" + std::to_string(i), 1s)
+            .then([i] (auto&& result) {
+                auto& [status, response] = result;
+                K2EXPECT(log::shmtest, status.is2xxOK(), true);
+                K2EXPECT(log::shmtest, response.data, "message_" + std::to_string(i));
+            }));
+    }
+    return seastar::when_all_succeed(futs.begin(), futs.end()).discard_result()
+    .then([this] {
+        return _call(ShmTestVerbs::ECHO, String(1024 * 1024, 'x'), 5s);
+    })
+    .then([this] (auto&& result) {
+        auto& [status, response] = result;
+        K2EXPECT(log::shmtest, status.is2xxOK(), true);
+        K2EXPECT(log::shmtest, response.data.size(), 1024 * 1024);
+        K2EXPECT(log::shmtest, response.data == String(1024 * 1024, 'x'), true);
+
+        K2EXPECT(log::shmtest, _segmentExists(fmt::format("k2rpc.{}", _shmEp->port)), true);
+        K2EXPECT(log::shmtest, _connectionSegments(), 0);
+    });
+}
+
+// The server stops draining the ring. Writes pile up beyond --shm_max_pending_bytes, so the channel fails
+// instead of buffering them. Once the server is back, a new connection works
+seastar::future<> runScenario02() {
+    K2LOG_I(log::shmtest, "Scenario 02");
+    auto stallFut = _call(ShmTestVerbs::STALL, "stall", 3s);
+    std::vector<seastar::future<Status>> futs;
+    for (auto i : boost::irange(0, 8)) {
+        (void)i;
+        futs.push_back(_call(ShmTestVerbs::ECHO, String(64 * 1024, 'y'), 3s)
+            .then([] (auto&& result) {
+                return std::move(std::get<0>(result));
+            }));
+    }
+    return seastar::when_all_succeed(futs.begin(), futs.end())
+    .then([stallFut = std::move(stallFut)] (std::vector<Status>&& statuses) mutable {
+        size_t failed = 0;
+        for (auto& status : statuses) {
+            failed += !status.is2xxOK();
+        }
+        K2EXPECT(log::shmtest, failed > 0, true);
+        return std::move(stallFut);
+    })
+    .then([this] (auto&& result) {
+        // the reply went to the failed channel
+        auto& [status, response] = result;
+        K2EXPECT(log::shmtest, status.is2xxOK(), false);
+        return _call(ShmTestVerbs::ECHO, "after stall", 1s);
+    })
+    .then([] (auto&& result) {
+        auto& [status, response] = result;
+        K2EXPECT(log::shmtest, status.is2xxOK(), true);
+        K2EXPECT(log::shmtest, response.data, "after stall");
+    });
+}
+
+// Peer death. The server dies without cleaning up. Our channel to it fails, and the next connection attempt
+// finds the listener stale and removes it
+seastar::future<> runScenario03() {
+    K2LOG_I(log::shmtest, "Scenario 03");
+    return _call(ShmTestVerbs::CRASH, "crash", 200ms)
+    .then([] (auto&& result) {
+        auto& [status, response] = result;
+        K2EXPECT(log::shmtest, status.is2xxOK(), false);
+        return seastar::sleep(500ms);
+    })
+    .then([this] {
+        K2EXPECT(log::shmtest, _segmentExists(fmt::format("k2rpc.{}", _shmEp->port)), true);
+        return _call(ShmTestVerbs::ECHO, "to the dead", 200ms);
+    })
+    .then([this] (auto&& result) {
+        auto& [status, response] = result;
+        K2EXPECT(log::shmtest, status.is2xxOK(), false);
+        K2EXPECT(log::shmtest, _segmentExists(fmt::format("k2rpc.{}", _shmEp->port)), false);
+        K2EXPECT(log::shmtest, _connectionSegments(), 0);
+    });
+}
+
+};  // class ShmRPCTest
+
+int main(int argc, char** argv) {
+    k2::App app("ShmRPCTest");
+    app.addOptions()
+        ("shm_test_role", bpo::value<k2::String>(), "server, client or idle")
+        ("shm_test_server", bpo::value<k2::String>(), "The TCP endpoint of the server, used by the client to discover its shared memory endpoint");
+    app.addApplet<ShmRPCTest>();
+    return app.start(argc, argv);
+}
@@ -0,0 +1,131 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#define CATCH_CONFIG_MAIN
+
+#include <unistd.h>
+
+#include <thread>
+#include <vector>
+
+#include <k2/transport/SharedMemory.h>
+#include "catch2/catch.hpp"
+
+using namespace k2;
+
+namespace {
+String segmentName(const char* test) {
+    return fmt::format("/k2rpc.test.{}.{}", ::getpid(), test);
+}
+}
+
+SCENARIO("test01 ring writes and reads wrap around") {
+    std::vector<char> mem(ShmRing::sizeFor(64));
+    auto ring = ShmRing::init(mem.data(), 64);
+    REQUIRE(ring->readable() == 0);
+    REQUIRE(ring->writable() == 64);
+
+    char in[100];
+    for (size_t i = 0; i < sizeof(in); ++i) {
+        in[i] = char(i);
+    }
+    char out[100];
+    // move the positions so that the next write wraps around the end of the ring
+    REQUIRE(ring->write(in, 40) == 40);
+    REQUIRE(ring->read(out, 40) == 40);
+
+    // a write which doesn't fit is partial
+    REQUIRE(ring->write(in, 100) == 64);
+    REQUIRE(ring->writable() == 0);
+    REQUIRE(ring->write(in, 1) == 0);
+    REQUIRE(ring->readable() == 64);
+
+    REQUIRE(ring->read(out, 30) == 30);
+    REQUIRE(ring->read(out + 30, 100) == 34);
+    REQUIRE(std::memcmp(in, out, 64) == 0);
+    REQUIRE(ring->readable() == 0);
+    REQUIRE(ring->read(out, 1) == 0);
+}
+
+SCENARIO("test02 segments are shared by name") {
+    auto name = segmentName("test02");
+    auto created = ShmSegment::create(name, 4096);
+    REQUIRE(created.size() == 4096);
+    REQUIRE(created.data()[100] == 0);
+
+    auto opened = ShmSegment::open(name);
+    REQUIRE(opened);
+    REQUIRE(opened.size() == 4096);
+    created.data()[100] = 'x';
+    REQUIRE(opened.data()[100] == 'x');
+
+    // the mappings outlive the name
+    ShmSegment::unlink(name);
+    REQUIRE(!ShmSegment::open(name));
+    opened.data()[200] = 'y';
+    REQUIRE(created.data()[200] == 'y');
+}
+
+SCENARIO("test03 a stream through a shared ring between two threads") {
+    auto name = segmentName("test03");
+    const uint64_t capacity = 4096;
+    auto producerSegment = ShmSegment::create(name, ShmRing::sizeFor(capacity));
+    ShmRing::init(producerSegment.data(), capacity);
+    auto consumerSegment = ShmSegment::open(name);
+    ShmSegment::unlink(name);
+
+    const size_t total = 10 * 1024 * 1024;
+    std::thread producer([&] {
+        auto ring = ShmRing::attach(producerSegment.data());
+        char buf[1000];
+        size_t sent = 0;
+        while (sent < total) {
+            auto len = std::min(sizeof(buf), total - sent);
+            for (size_t i = 0; i < len; ++i) {
+                buf[i] = char((sent + i) % 251);
+            }
+            size_t written = 0;
+            while (written < len) {
+                written += ring->write(buf + written, len - written);
+            }
+            sent += len;
+        }
+    });
+
+    auto ring = ShmRing::attach(consumerSegment.data());
+    char buf[777];
+    size_t received = 0;
+    bool same = true;
+    while (received < total) {
+        auto len = ring->read(buf, sizeof(buf));
+        for (size_t i = 0; i < len; ++i) {
+            same &= buf[i] == char((received + i) % 251);
+        }
+        received += len;
+    }
+    producer.join();
+    REQUIRE(same);
+    REQUIRE(received == total);
+    REQUIRE(ring->readable() == 0);
+}
@@ -0,0 +1,510 @@
+/*
+MIT License
+
+Copyright(c) 2022 Futurewei Cloud
+
+    Permission is hereby granted,
+    free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and / or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+
+    The above copyright notice and this permission notice shall be included in all copies
+    or
+    substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS",
+    WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+    DAMAGES OR OTHER
+    LIABILITY,
+    WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <optional>
+#include <vector>
+
+#include <seastar/core/sleep.hh>
+#include <seastar/net/api.hh>
+
+#include <k2/appbase/Appbase.h>
+#include <k2/appbase/AppEssentials.h>
+#include <k2/transport/RPCHeader.h>
+#include <k2/transport/RPCParser.h>
+#include <k2/transport/TCPRPCChannel.h>
+#include <k2/transport/TCPRPCProtocol.h>
+
+using namespace k2;
+
+namespace k2::log {
+inline thread_local k2::logging::Logger tcptest("k2::tcp_rpc_test");
+}
+
+// Tests for the TCP transport against a plain TCP receiver in the same process, which parses and records all
+// messages it gets on each accepted connection.
+// The batching scenarios send over channels which use the batching settings of the test, so that the flush
+// counters only count our own traffic. They expect --tcp_batch_max_bytes to be 0 (no batching) or 4096, and
+// work with any --tcp_batch_max_delay. test/integration/test_tcp_rpc.sh runs them with several settings.
+// The pooling scenarios send through the TCP protocol of the process, and expect --tcp_connections_per_endpoint 4
+// (2 connections for small messages and 2 for large ones), --tcp_bulk_verbs 101 and the default
+// --tcp_large_message_bytes of 16KB
+class TCPRPCTest {
+public:  // application lifespan
+    TCPRPCTest() { K2LOG_I(log::tcptest, "ctor"); }
+    ~TCPRPCTest() { K2LOG_I(log::tcptest, "dtor"); }
+
+    // required for seastar::distributed interface
+    seastar::future<> gracefulStop() {
+        K2LOG_I(log::tcptest, "stop");
+        return std::move(_testFuture)
+            .then([this] { return _stopReceiver(); });
+    }
+
+    seastar::future<> start() {
+        K2LOG_I(log::tcptest, "start");
+        _testTimer.set_callback([this] {
+            _testFuture = seastar::make_ready_future()
+            .then([this] { return _startReceiver(); })
+            .then([this] { return runScenario01(); })
+            .then([this] { return runScenario02(); })
+            .then([this] { return runScenario03(); })
+            .then([this] { return runScenario04(); })
+            .then([this] { return runScenario05(); })
+            .then([this] { return runScenario06(); })
+            .then([this] { return runScenario07(); })
+            .then([this] {
+                K2LOG_I(log::tcptest, "======= All tests passed ========");
+                exitcode = 0;
+            })
+            .handle_exception([this](auto exc) {
+                K2LOG_W_EXC(log::tcptest, exc, "======= Test failed ========");
+                exitcode = -1;
+            })
+            .finally([this] {
+                K2LOG_I(log::tcptest, "======= Test ended ========");
+                AppBase().stop(exitcode);
+            });
+        });
+        _testTimer.arm(0ms);
+        return seastar::make_ready_future();
+    }
+
+private:
+    // a message as seen by the receiver
+    struct Received {
+        Verb verb;
+        uint32_t id;
+        size_t size;
+    };
+
+    // a connection accepted by the receiver
+    struct Connection {
+        Connection(seastar::connected_socket&& socket):
+            sock(std::move(socket)),
+            in(sock.input()),
+            out(sock.output()),
+            parser([] { return seastar::need_preempt(); }, Config()["enable_tx_checksum"].as<bool>()) {
+        }
+        seastar::connected_socket sock;
+        seastar::input_stream<char> in;
+        seastar::output_stream<char> out;
+        RPCParser parser;
+        std::vector<Received> messages;
+        bool eof{false};
+        seastar::future<> loopDone = seastar::make_ready_future();
+    };
+
+    int exitcode = -1;
+    seastar::timer<> _testTimer;
+    seastar::future<> _testFuture = seastar::make_ready_future();
+
+    // the batching settings and counters for the channels we make
+    TCPWriteBatching _batching;
+
+    std::optional<seastar::server_socket> _listener;
+    seastar::future<> _acceptDone = seastar::make_ready_future();
+    std::vector<std::unique_ptr<Connection>> _connections;
+    std::unique_ptr<TXEndpoint> _receiverEp;
+    uint32_t _nextID{1};
+
+    seastar::future<> _startReceiver() {
+        seastar::listen_options lo;
+        lo.reuse_address = true;
+        _listener = seastar::listen(seastar::make_ipv4_address({"127.0.0.1", 0}), lo);
+        auto port = _listener->local_address().port();
+        _receiverEp = RPC().getTXEndpoint(fmt::format("{}://127.0.0.1:{}", TCPRPCProtocol::proto, port));
+        K2EXPECT(log::tcptest, (bool)_receiverEp, true);
+        K2LOG_I(log::tcptest, "receiver listening on {}", _receiverEp->url);
+
+        _acceptDone = seastar::keep_doing([this] {
+            return _listener->accept().then([this] (seastar::accept_result&& result) {
+                _connections.push_back(std::make_unique<Connection>(std::move(result.connection)));
+                _connections.back()->loopDone = _readLoop(*_connections.back());
+            });
+        }).handle_exception([] (auto) {
+            K2LOG_D(log::tcptest, "receiver stopped accepting");
+        });
+        return seastar::make_ready_future();
+    }
+
+    seastar::future<> _stopReceiver() {
+        if (!_listener) {
+            return seastar::make_ready_future();
+        }
+        _listener->abort_accept();
+        std::vector<seastar::future<>> futs;
+        futs.push_back(std::move(_acceptDone));
+        for (auto& conn : _connections) {
+            try { conn->sock.shutdown_input(); } catch (...) {}
+            futs.push_back(std::move(conn->loopDone));
+        }
+        return seastar::when_all_succeed(futs.begin(), futs.end()).discard_result()
+            .then([this] {
+                _connections.clear();
+                _listener.reset();
+            });
+    }
+
+    seastar::future<> _readLoop(Connection& conn) {
+        conn.parser.registerMessageObserver([&conn] (Verb verb, MessageMetadata meta, std::unique_ptr<Payload> payload) {
+            conn.messages.push_back(Received{verb, meta.requestID, payload ? payload->getSize() : 0});
+        });
+        conn.parser.registerParserFailureObserver([] (std::exception_ptr exc) {
+            K2LOG_W_EXC(log::tcptest, exc, "receiver failed to parse");
+        });
+        return seastar::repeat([&conn] {
+            return conn.in.read().then([&conn] (Binary&& packet) {
+                if (packet.empty()) {
+                    conn.eof = true;
+                    return seastar::stop_iteration::yes;
+                }
+                conn.parser.feed(std::move(packet));
+                while (conn.parser.canDispatch()) {
+                    conn.parser.dispatchSome();
+                }
+                return seastar::stop_iteration::no;
+            });
+        }).handle_exception([&conn] (auto) {
+            conn.eof = true;
+        });
+    }
+
+    // waits until the condition holds or the timeout expires
+    seastar::future<> _waitFor(std::function<bool()> cond, Duration timeout=1s) {
+        auto deadline = Clock::now() + timeout;
+        return seastar::do_until([cond, deadline] { return cond() || Clock::now() > deadline; },
+                                 [] { return seastar::sleep(1ms); });
+    }
+
+    std::unique_ptr<Payload> _makePayload(size_t size) {
+        auto payload = _receiverEp->newPayload();
+        payload->write(String(size, 'x').data(), size);
+        return payload;
+    }
+
+    // makes a channel to the receiver which batches according to our settings. The channel isn't running yet
+    seastar::lw_shared_ptr<TCPRPCChannel> _makeChannel() {
+        return seastar::make_lw_shared<TCPRPCChannel>(seastar::connect(_listener->local_address()), *_receiverEp,
+                                                      nullptr, nullptr, _batching);
+    }
+
+    void _send(TCPRPCChannel& chan, size_t count, size_t payloadSize) {
+        for (size_t i = 0; i < count; ++i) {
+            MessageMetadata meta;
+            meta.setRequestID(_nextID++);
+            chan.send(100, _makePayload(payloadSize), std::move(meta));
+        }
+    }
+
+    // makes a running channel and waits until its connection is up. Returns the receiving end too
+    seastar::future<std::tuple<seastar::lw_shared_ptr<TCPRPCChannel>, Connection*>> _connect() {
+        auto chan = _makeChannel();
+        chan->run();
+        auto accepted = _connections.size();
+        // the first message goes out once the connection is up, so it tells us when that is
+        _send(*chan, 1, 10);
+        return _waitFor([this, accepted] { return _connections.size() > accepted && _connections.back()->messages.size() == 1; })
+            .then([this, chan, accepted] {
+                K2EXPECT(log::tcptest, _connections.size(), accepted + 1);
+                K2EXPECT(log::tcptest, _connections.back()->messages.size(), 1);
+                return std::make_tuple(chan, _connections.back().get());
+            });
+    }
+
+    seastar::future<> _close(seastar::lw_shared_ptr<TCPRPCChannel> chan) {
+        return chan->gracefulClose().then([chan] {});
+    }
+
+    bool _batchingOn() const { return _batching.maxBytes() > 0; }
+
+    seastar::shared_ptr<TCPRPCProtocol> _tcpProto() {
+        auto proto = seastar::dynamic_pointer_cast<TCPRPCProtocol>(RPC().getProtocol(TCPRPCProtocol::proto));
+        K2EXPECT(log::tcptest, (bool)proto, true);
+        return proto;
+    }
+
+    void _sendPooled(Verb verb, size_t payloadSize, std::optional<uint64_t> orderingKey=std::nullopt) {
+        MessageMetadata meta;
+        meta.setRequestID(_nextID++);
+        if (orderingKey) {
+            _tcpProto()->sendOrdered(verb, _makePayload(payloadSize), *_receiverEp, std::move(meta), *orderingKey);
+        }
+        else {
+            _tcpProto()->send(verb, _makePayload(payloadSize), *_receiverEp, std::move(meta));
+        }
+    }
+
+    // number of messages received over the connections accepted since the given number of connections
+    size_t _receivedSince(size_t accepted) {
+        size_t count = 0;
+        for (size_t i = accepted; i < _connections.size(); ++i) {
+            count += _connections[i]->messages.size();
+        }
+        return count;
+    }
+
+    // the pool connections accepted by the receiver
+    size_t _poolStart{0};
+
+public: // tests
+
+// A batch is flushed once it reaches tcp_batch_max_bytes. Without batching, each message goes out with its own write
+seastar::future<> runScenario01() {
+    K2LOG_I(log::tcptest, "Scenario 01");
+    K2EXPECT(log::tcptest, _batching.maxBytes() == 0 || _batching.maxBytes() == 4096, true);
+    return _connect().then([this] (auto&& result) {
+        auto chan = std::get<0>(result);
+        auto conn = std::get<1>(result);
+        auto flushes = _batching.flushes;
+        auto fullFlushes = _batching.fullFlushes;
+        // every 3 of these messages fill up a batch, and the last one waits for the timer
+        _send(*chan, 10, 1500);
+        if (_batchingOn()) {
+            K2EXPECT(log::tcptest, _batching.flushes - flushes, 3);
+            K2EXPECT(log::tcptest, _batching.fullFlushes - fullFlushes, 3);
+        }
+        else {
+            K2EXPECT(log::tcptest, _batching.flushes - flushes, 10);
+            K2EXPECT(log::tcptest, _batching.fullFlushes - fullFlushes, 0);
+        }
+        return _waitFor([conn] { return conn->messages.size() == 11; }, _batching.maxDelay() + 1s)
+            .then([this, chan, conn, flushes] {
+                K2EXPECT(log::tcptest, conn->messages.size(), 11);
+                for (size_t i = 1; i < conn->messages.size(); ++i) {
+                    K2EXPECT(log::tcptest, conn->messages[i].size, 1500);
+                    K2EXPECT(log::tcptest, conn->messages[i].id, conn->messages[i - 1].id + 1);
+                }
+                K2EXPECT(log::tcptest, _batching.flushes - flushes, _batchingOn() ? 4u : 10u);
+                return _close(chan);
+            });
+    });
+}
+
+// A batch which doesn't fill up is flushed by the timer: at the next poll with a delay of 0, or once the delay
+// is over otherwise. Without batching, messages are written out right away
+seastar::future<> runScenario02() {
+    K2LOG_I(log::tcptest, "Scenario 02");
+    return _connect().then([this] (auto&& result) {
+        auto chan = std::get<0>(result);
+        auto conn = std::get<1>(result);
+        auto flushes = _batching.flushes;
+        auto start = Clock::now();
+        _send(*chan, 3, 100);
+        K2EXPECT(log::tcptest, _batching.flushes - flushes, _batchingOn() ? 0u : 3u);
+        if (!_batchingOn() || _batching.maxDelay() == 0us) {
+            return seastar::sleep(10ms)
+                .then([this, conn] {
+                    return _waitFor([conn] { return conn->messages.size() == 4; });
+                })
+                .then([this, chan, conn, flushes] {
+                    K2EXPECT(log::tcptest, _batching.flushes - flushes, _batchingOn() ? 1u : 3u);
+                    K2EXPECT(log::tcptest, conn->messages.size(), 4);
+                    return _close(chan);
+                });
+        }
+        return seastar::sleep(_batching.maxDelay() / 4)
+            .then([this, conn, flushes] {
+                // still waiting in the batch
+                K2EXPECT(log::tcptest, _batching.flushes - flushes, 0);
+                K2EXPECT(log::tcptest, conn->messages.size(), 1);
+                return _waitFor([conn] { return conn->messages.size() == 4; }, _batching.maxDelay() + 1s);
+            })
+            .then([this, chan, conn, flushes, start] {
+                K2EXPECT(log::tcptest, conn->messages.size(), 4);
+                K2EXPECT(log::tcptest, _batching.flushes - flushes, 1);
+                K2EXPECT(log::tcptest, Clock::now() - start >= _batching.maxDelay(), true);
+                return _close(chan);
+            });
+    });
+}
+
+// Messages sent before the connection is up are written out as one batch as soon as it is, without waiting
+// for the batch delay
+seastar::future<> runScenario03() {
+    K2LOG_I(log::tcptest, "Scenario 03");
+    auto chan = _makeChannel();
+    auto flushes = _batching.flushes;
+    auto accepted = _connections.size();
+    _send(*chan, 5, 100);
+    K2EXPECT(log::tcptest, _batching.flushes - flushes, 0);
+    chan->run();
+    // only wait for half the batch delay, so that a timer flush would be too late
+    auto timeout = _batching.maxDelay() > 0us ? _batching.maxDelay() / 2 : 1s;
+    return _waitFor([this, accepted] {
+            return _connections.size() > accepted && _connections.back()->messages.size() == 5;
+        }, timeout)
+        .then([this, chan, flushes, accepted] {
+            K2EXPECT(log::tcptest, _connections.size(), accepted + 1);
+            K2EXPECT(log::tcptest, _connections.back()->messages.size(), 5);
+            K2EXPECT(log::tcptest, _batching.flushes - flushes, _batchingOn() ? 1u : 5u);
+            return _close(chan);
+        });
+}
+
+// Messages still in the batch are written out before the socket is closed
+seastar::future<> runScenario04() {
+    K2LOG_I(log::tcptest, "Scenario 04");
+    return _connect().then([this] (auto&& result) {
+        auto chan = std::get<0>(result);
+        auto conn = std::get<1>(result);
+        auto flushes = _batching.flushes;
+        _send(*chan, 3, 100);
+        return _close(chan)
+            .then([this, conn] {
+                return _waitFor([conn] { return conn->eof; });
+            })
+            .then([this, conn, flushes] {
+                K2EXPECT(log::tcptest, conn->eof, true);
+                K2EXPECT(log::tcptest, conn->messages.size(), 4);
+                K2EXPECT(log::tcptest, _batching.flushes - flushes, _batchingOn() ? 1u : 3u);
+            });
+    });
+}
+
+// Pooled connections are split in traffic classes: small messages are striped over the first half of the pool, and
+// large messages and bulk verbs over the second half
+seastar::future<> runScenario05() {
+    K2LOG_I(log::tcptest, "Scenario 05");
+    K2EXPECT(log::tcptest, _tcpProto()->getPooledConnections(*_receiverEp).has_value(), false);
+    _poolStart = _connections.size();
+    for (int i = 0; i < 4; ++i) {
+        _sendPooled(100, 100);
+    }
+    for (int i = 0; i < 4; ++i) {
+        _sendPooled(101, 100);
+    }
+    for (int i = 0; i < 2; ++i) {
+        _sendPooled(100, 20 * 1024);
+    }
+    return _waitFor([this] { return _receivedSince(_poolStart) == 10; })
+        .then([this] {
+            K2EXPECT(log::tcptest, _receivedSince(_poolStart), 10);
+            K2EXPECT(log::tcptest, _connections.size() - _poolStart, 4);
+            K2EXPECT(log::tcptest, *_tcpProto()->getPooledConnections(*_receiverEp), 4);
+            size_t smallConns = 0;
+            size_t largeConns = 0;
+            for (size_t i = _poolStart; i < _connections.size(); ++i) {
+                auto& messages = _connections[i]->messages;
+                auto large = std::count_if(messages.begin(), messages.end(), [](auto& msg) {
+                    return msg.verb == 101 || msg.size >= 16 * 1024;
+                });
+                if (large == 0) {
+                    // round-robin over the 2 small connections
+                    ++smallConns;
+                    K2EXPECT(log::tcptest, messages.size(), 2);
+                }
+                else {
+                    // a connection for large messages doesn't carry small ones
+                    ++largeConns;
+                    K2EXPECT(log::tcptest, size_t(large), messages.size());
+                    K2EXPECT(log::tcptest, messages.size(), 3);
+                }
+            }
+            K2EXPECT(log::tcptest, smallConns, 2);
+            K2EXPECT(log::tcptest, largeConns, 2);
+        });
+}
+
+// Messages with the same ordering key stick to one connection of the pool, in order, whatever their class
+seastar::future<> runScenario06() {
+    K2LOG_I(log::tcptest, "Scenario 06");
+    std::vector<uint32_t> ids;
+    for (uint64_t key : {7, 8}) {
+        auto firstID = _nextID;
+        for (int i = 0; i < 30; ++i) {
+            auto kind = i % 3;
+            _sendPooled(kind == 1 ? 101 : 100, kind == 2 ? 20 * 1024 : 100, key);
+        }
+        ids.push_back(firstID);
+    }
+    auto before = _receivedSince(_poolStart);
+    return _waitFor([this, before] { return _receivedSince(_poolStart) == before + 60; })
+        .then([this, ids, before] {
+            K2EXPECT(log::tcptest, _receivedSince(_poolStart), before + 60);
+            // no new connections, and the pool is still whole
+            K2EXPECT(log::tcptest, _connections.size() - _poolStart, 4);
+            for (auto firstID : ids) {
+                size_t carriers = 0;
+                for (size_t i = _poolStart; i < _connections.size(); ++i) {
+                    std::vector<uint32_t> keyed;
+                    for (auto& msg : _connections[i]->messages) {
+                        if (msg.id >= firstID && msg.id < firstID + 30) {
+                            keyed.push_back(msg.id);
+                        }
+                    }
+                    if (keyed.empty()) {
+                        continue;
+                    }
+                    ++carriers;
+                    K2EXPECT(log::tcptest, keyed.size(), 30);
+                    for (size_t j = 0; j < keyed.size(); ++j) {
+                        K2EXPECT(log::tcptest, keyed[j], firstID + j);
+                    }
+                }
+                K2EXPECT(log::tcptest, carriers, 1);
+            }
+        });
+}
+
+// The receiver sends garbage over all pooled connections, so each of them fails in its parser while its read loop
+// is still running. Once all of them are gone, the pool is dropped, and the next message opens a new one
+seastar::future<> runScenario07() {
+    K2LOG_I(log::tcptest, "Scenario 07");
+    std::vector<seastar::future<>> futs;
+    for (size_t i = _poolStart; i < _connections.size(); ++i) {
+        auto& out = _connections[i]->out;
+        futs.push_back(out.write(String(1024, 'g')).then([&out] { return out.flush(); }));
+    }
+    return seastar::when_all_succeed(futs.begin(), futs.end()).discard_result()
+        .then([this] {
+            return _waitFor([this] { return !_tcpProto()->getPooledConnections(*_receiverEp).has_value(); });
+        })
+        .then([this] {
+            K2EXPECT(log::tcptest, _tcpProto()->getPooledConnections(*_receiverEp).has_value(), false);
+            // the closed channels are gone from our end too
+            return _waitFor([this] {
+                for (size_t i = _poolStart; i < _connections.size(); ++i) {
+                    if (!_connections[i]->eof) return false;
+                }
+                return true;
+            });
+        })
+        .then([this] {
+            auto accepted = _connections.size();
+            _sendPooled(100, 100);
+            K2EXPECT(log::tcptest, *_tcpProto()->getPooledConnections(*_receiverEp), 1);
+            return _waitFor([this, accepted] { return _receivedSince(accepted) == 1; })
+                .then([this, accepted] {
+                    K2EXPECT(log::tcptest, _connections.size(), accepted + 1);
+                    K2EXPECT(log::tcptest, _receivedSince(accepted), 1);
+                });
+        });
+}
+
+};  // class TCPRPCTest
+
+int main(int argc, char** argv) {
+    k2::App app("TCPRPCTest");
+    app.addApplet<TCPRPCTest>();
+    return app.start(argc, argv);
+}